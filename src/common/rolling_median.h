@@ -0,0 +1,241 @@
+// Copyright (c) 2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <deque>
+#include <iterator>
+#include <set>
+#include "misc_log_ex.h"
+
+namespace tools
+{
+
+/**
+ * @brief median of a multiset of values, updated in O(log N)
+ *
+ * Values are split across two ordered halves so the median is available
+ * without sorting, and any value may be removed, not just the oldest. The
+ * median of an even number of values is the mean of the two middle values,
+ * matching epee::misc_utils::median.
+ */
+template<typename T>
+class median_set
+{
+public:
+  /**
+   * @brief removes all values
+   */
+  void clear()
+  {
+    m_low.clear();
+    m_high.clear();
+  }
+
+  /**
+   * @brief adds a value
+   *
+   * @param v the value to add
+   */
+  void insert(const T &v)
+  {
+    if (m_low.empty() || !(*m_low.rbegin() < v))
+      m_low.insert(v);
+    else
+      m_high.insert(v);
+    rebalance();
+  }
+
+  /**
+   * @brief removes one instance of a value
+   *
+   * @param v the value to remove
+   *
+   * @return false if the value was not found, true otherwise
+   */
+  bool erase(const T &v)
+  {
+    // any value not greater than the low half's maximum lives in the low half
+    std::multiset<T> &half = !m_low.empty() && !(*m_low.rbegin() < v) ? m_low : m_high;
+    const auto i = half.find(v);
+    if (i == half.end())
+      return false;
+    half.erase(i);
+    rebalance();
+    return true;
+  }
+
+  /**
+   * @brief gets the median of the values
+   *
+   * @return the median, or a value-initialized T if there are no values
+   */
+  T median() const
+  {
+    if (m_low.empty())
+      return T();
+    if (m_low.size() > m_high.size())
+      return *m_low.rbegin();
+    return (*m_low.rbegin() + *m_high.begin()) / 2;
+  }
+
+  /**
+   * @brief gets the smallest value
+   *
+   * @return the smallest value, or a value-initialized T if there are no values
+   */
+  T min() const
+  {
+    return m_low.empty() ? T() : *m_low.begin();
+  }
+
+  /**
+   * @brief gets the largest value
+   *
+   * @return the largest value, or a value-initialized T if there are no values
+   */
+  T max() const
+  {
+    if (!m_high.empty())
+      return *m_high.rbegin();
+    return m_low.empty() ? T() : *m_low.rbegin();
+  }
+
+  size_t size() const { return m_low.size() + m_high.size(); }
+  bool empty() const { return m_low.empty(); }
+
+private:
+  // keeps m_low holding the lower ceil(N/2) values
+  void rebalance()
+  {
+    if (m_low.size() > m_high.size() + 1)
+    {
+      auto i = std::prev(m_low.end());
+      m_high.insert(*i);
+      m_low.erase(i);
+    }
+    else if (m_high.size() > m_low.size())
+    {
+      auto i = m_high.begin();
+      m_low.insert(*i);
+      m_high.erase(i);
+    }
+  }
+
+  std::multiset<T> m_low;
+  std::multiset<T> m_high;
+};
+
+/**
+ * @brief median of a sliding window of values, updated in O(log N)
+ *
+ * Values are kept in insertion order so the oldest one can be dropped when
+ * the window is full, and in a median_set so the median is available
+ * without sorting.
+ */
+template<typename T>
+class rolling_median
+{
+public:
+  explicit rolling_median(size_t capacity): m_capacity(capacity) {}
+
+  /**
+   * @brief empties the window
+   */
+  void clear()
+  {
+    m_values.clear();
+    m_sorted.clear();
+  }
+
+  /**
+   * @brief adds a newest value, dropping the oldest one if the window is full
+   *
+   * @param v the value to add
+   */
+  void push_back(const T &v)
+  {
+    if (m_capacity == 0)
+      return;
+    if (m_values.size() == m_capacity)
+    {
+      m_sorted.erase(m_values.front());
+      m_values.pop_front();
+    }
+    m_values.push_back(v);
+    m_sorted.insert(v);
+  }
+
+  /**
+   * @brief removes the newest value
+   */
+  void pop_back()
+  {
+    CHECK_AND_ASSERT_THROW_MES(!m_values.empty(), "pop_back on empty rolling median");
+    m_sorted.erase(m_values.back());
+    m_values.pop_back();
+  }
+
+  /**
+   * @brief adds a value older than all others in the window
+   *
+   * @param v the value to add
+   *
+   * @return false if the window is already full, true otherwise
+   */
+  bool push_front(const T &v)
+  {
+    if (m_values.size() >= m_capacity)
+      return false;
+    m_values.push_front(v);
+    m_sorted.insert(v);
+    return true;
+  }
+
+  /**
+   * @brief gets the median of the values in the window
+   *
+   * @return the median, or a value-initialized T if the window is empty
+   */
+  T median() const
+  {
+    return m_sorted.median();
+  }
+
+  size_t size() const { return m_values.size(); }
+  size_t capacity() const { return m_capacity; }
+  bool empty() const { return m_values.empty(); }
+  bool full() const { return m_values.size() >= m_capacity; }
+
+private:
+  size_t m_capacity;
+  std::deque<T> m_values;
+  median_set<T> m_sorted;
+};
+
+}
@@ -0,0 +1,970 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crypto-ops.h"
+#include "crypto-ops-51.h"
+
+/* This file is built a second time by crypto-ops-51-bmi2.c, which defines
+   CRYPTO_OPS_51_NAME to suffix the names of its functions; only the first
+   build holds the backend selection. */
+#if !defined(CRYPTO_OPS_51_NAME)
+#define CRYPTO_OPS_51_NAME(name) name
+#define CRYPTO_OPS_51_SELECTION
+#endif
+
+#if defined(CRYPTO_OPS_RADIX51)
+
+typedef unsigned __int128 fe51_wide;
+
+static const uint64_t fe51_mask = (((uint64_t) 1) << 51) - 1;
+
+static uint64_t load_8(const unsigned char *in) {
+  uint64_t result = 0;
+  int i;
+  for (i = 7; i >= 0; --i) {
+    result = (result << 8) | in[i];
+  }
+  return result;
+}
+
+static void store_8(unsigned char *out, uint64_t v) {
+  int i;
+  for (i = 0; i < 8; ++i) {
+    out[i] = (unsigned char) (v >> (8 * i));
+  }
+}
+
+/* Field arithmetic */
+
+static void fe51_0(fe51 h) {
+  h[0] = 0;
+  h[1] = 0;
+  h[2] = 0;
+  h[3] = 0;
+  h[4] = 0;
+}
+
+static void fe51_1(fe51 h) {
+  h[0] = 1;
+  h[1] = 0;
+  h[2] = 0;
+  h[3] = 0;
+  h[4] = 0;
+}
+
+static void fe51_copy(fe51 h, const fe51 f) {
+  h[0] = f[0];
+  h[1] = f[1];
+  h[2] = f[2];
+  h[3] = f[3];
+  h[4] = f[4];
+}
+
+/* Brings limbs back to 51 bits, but for a little slack in h[0] */
+static void fe51_carry(fe51 h) {
+  uint64_t c;
+  c = h[0] >> 51; h[0] &= fe51_mask; h[1] += c;
+  c = h[1] >> 51; h[1] &= fe51_mask; h[2] += c;
+  c = h[2] >> 51; h[2] &= fe51_mask; h[3] += c;
+  c = h[3] >> 51; h[3] &= fe51_mask; h[4] += c;
+  c = h[4] >> 51; h[4] &= fe51_mask; h[0] += 19 * c;
+}
+
+static void fe51_add(fe51 h, const fe51 f, const fe51 g) {
+  h[0] = f[0] + g[0];
+  h[1] = f[1] + g[1];
+  h[2] = f[2] + g[2];
+  h[3] = f[3] + g[3];
+  h[4] = f[4] + g[4];
+  fe51_carry(h);
+}
+
+/* Adds 4 * p first, so limbs of g may be up to 53 bits */
+static void fe51_sub(fe51 h, const fe51 f, const fe51 g) {
+  h[0] = f[0] + 0x1fffffffffffb4ULL - g[0];
+  h[1] = f[1] + 0x1ffffffffffffcULL - g[1];
+  h[2] = f[2] + 0x1ffffffffffffcULL - g[2];
+  h[3] = f[3] + 0x1ffffffffffffcULL - g[3];
+  h[4] = f[4] + 0x1ffffffffffffcULL - g[4];
+  fe51_carry(h);
+}
+
+static void fe51_neg(fe51 h, const fe51 f) {
+  fe51 zero;
+  fe51_0(zero);
+  fe51_sub(h, zero, f);
+}
+
+static void fe51_cmov(fe51 f, const fe51 g, unsigned int b) {
+  uint64_t mask = (uint64_t) 0 - b;
+  f[0] ^= mask & (f[0] ^ g[0]);
+  f[1] ^= mask & (f[1] ^ g[1]);
+  f[2] ^= mask & (f[2] ^ g[2]);
+  f[3] ^= mask & (f[3] ^ g[3]);
+  f[4] ^= mask & (f[4] ^ g[4]);
+}
+
+static void fe51_mul(fe51 h, const fe51 f, const fe51 g) {
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+  uint64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4;
+  fe51_wide t0, t1, t2, t3, t4;
+  uint64_t c;
+
+  t0 = (fe51_wide) f0 * g0 + (fe51_wide) f1 * g4_19 + (fe51_wide) f2 * g3_19 + (fe51_wide) f3 * g2_19 + (fe51_wide) f4 * g1_19;
+  t1 = (fe51_wide) f0 * g1 + (fe51_wide) f1 * g0 + (fe51_wide) f2 * g4_19 + (fe51_wide) f3 * g3_19 + (fe51_wide) f4 * g2_19;
+  t2 = (fe51_wide) f0 * g2 + (fe51_wide) f1 * g1 + (fe51_wide) f2 * g0 + (fe51_wide) f3 * g4_19 + (fe51_wide) f4 * g3_19;
+  t3 = (fe51_wide) f0 * g3 + (fe51_wide) f1 * g2 + (fe51_wide) f2 * g1 + (fe51_wide) f3 * g0 + (fe51_wide) f4 * g4_19;
+  t4 = (fe51_wide) f0 * g4 + (fe51_wide) f1 * g3 + (fe51_wide) f2 * g2 + (fe51_wide) f3 * g1 + (fe51_wide) f4 * g0;
+
+  t1 += (uint64_t) (t0 >> 51); h[0] = (uint64_t) t0 & fe51_mask;
+  t2 += (uint64_t) (t1 >> 51); h[1] = (uint64_t) t1 & fe51_mask;
+  t3 += (uint64_t) (t2 >> 51); h[2] = (uint64_t) t2 & fe51_mask;
+  t4 += (uint64_t) (t3 >> 51); h[3] = (uint64_t) t3 & fe51_mask;
+  c = (uint64_t) (t4 >> 51); h[4] = (uint64_t) t4 & fe51_mask;
+  h[0] += 19 * c;
+  h[1] += h[0] >> 51; h[0] &= fe51_mask;
+}
+
+static void fe51_sq(fe51 h, const fe51 f) {
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  uint64_t f0_2 = 2 * f0, f1_2 = 2 * f1, f2_38 = 38 * f2, f3_19 = 19 * f3, f4_19 = 19 * f4, f4_38 = 38 * f4;
+  fe51_wide t0, t1, t2, t3, t4;
+  uint64_t c;
+
+  t0 = (fe51_wide) f0 * f0 + (fe51_wide) f4_38 * f1 + (fe51_wide) f2_38 * f3;
+  t1 = (fe51_wide) f0_2 * f1 + (fe51_wide) f4_38 * f2 + (fe51_wide) f3_19 * f3;
+  t2 = (fe51_wide) f0_2 * f2 + (fe51_wide) f1 * f1 + (fe51_wide) f4_38 * f3;
+  t3 = (fe51_wide) f0_2 * f3 + (fe51_wide) f1_2 * f2 + (fe51_wide) f4_19 * f4;
+  t4 = (fe51_wide) f0_2 * f4 + (fe51_wide) f1_2 * f3 + (fe51_wide) f2 * f2;
+
+  t1 += (uint64_t) (t0 >> 51); h[0] = (uint64_t) t0 & fe51_mask;
+  t2 += (uint64_t) (t1 >> 51); h[1] = (uint64_t) t1 & fe51_mask;
+  t3 += (uint64_t) (t2 >> 51); h[2] = (uint64_t) t2 & fe51_mask;
+  t4 += (uint64_t) (t3 >> 51); h[3] = (uint64_t) t3 & fe51_mask;
+  c = (uint64_t) (t4 >> 51); h[4] = (uint64_t) t4 & fe51_mask;
+  h[0] += 19 * c;
+  h[1] += h[0] >> 51; h[0] &= fe51_mask;
+}
+
+/* h = 2 * f * f */
+static void fe51_sq2(fe51 h, const fe51 f) {
+  fe51_sq(h, f);
+  h[0] <<= 1;
+  h[1] <<= 1;
+  h[2] <<= 1;
+  h[3] <<= 1;
+  h[4] <<= 1;
+  fe51_carry(h);
+}
+
+/* Ignores the top bit, like fe_frombytes */
+static void fe51_frombytes(fe51 h, const unsigned char *s) {
+  h[0] = load_8(s) & fe51_mask;
+  h[1] = (load_8(s + 6) >> 3) & fe51_mask;
+  h[2] = (load_8(s + 12) >> 6) & fe51_mask;
+  h[3] = (load_8(s + 19) >> 1) & fe51_mask;
+  h[4] = (load_8(s + 24) >> 12) & fe51_mask;
+}
+
+/* Fully reduces f mod p */
+static void fe51_canonical(fe51 h, const fe51 f) {
+  uint64_t c;
+  fe51_copy(h, f);
+  fe51_carry(h);
+  fe51_carry(h);
+  /* now h is below 2^255 + a little, so adding 19 carries out of bit 255
+     exactly when h >= p */
+  c = (h[0] + 19) >> 51;
+  c = (h[1] + c) >> 51;
+  c = (h[2] + c) >> 51;
+  c = (h[3] + c) >> 51;
+  c = (h[4] + c) >> 51;
+  h[0] += 19 * c;
+  c = h[0] >> 51; h[0] &= fe51_mask; h[1] += c;
+  c = h[1] >> 51; h[1] &= fe51_mask; h[2] += c;
+  c = h[2] >> 51; h[2] &= fe51_mask; h[3] += c;
+  c = h[3] >> 51; h[3] &= fe51_mask; h[4] += c;
+  h[4] &= fe51_mask;
+}
+
+static void fe51_tobytes(unsigned char *s, const fe51 f) {
+  fe51 h;
+  fe51_canonical(h, f);
+  store_8(s, h[0] | (h[1] << 51));
+  store_8(s + 8, (h[1] >> 13) | (h[2] << 38));
+  store_8(s + 16, (h[2] >> 26) | (h[3] << 25));
+  store_8(s + 24, (h[3] >> 39) | (h[4] << 12));
+}
+
+static int fe51_isnegative(const fe51 f) {
+  unsigned char s[32];
+  fe51_tobytes(s, f);
+  return s[0] & 1;
+}
+
+static int fe51_isnonzero(const fe51 f) {
+  fe51 h;
+  fe51_canonical(h, f);
+  return (h[0] | h[1] | h[2] | h[3] | h[4]) != 0;
+}
+
+/* Conversions from and to radix 2^25.5, whose limbs sit at bits 0, 26, 51,
+   77, ..., so each pair of them makes a limb in radix 2^51 */
+
+/* f may be unreduced, as left by fe_add and fe_sub, so 16 * p is added to
+   make the limbs positive */
+static void fe51_from_fe(fe51 h, const fe f) {
+  int i;
+  for (i = 0; i < 5; ++i) {
+    int64_t t = (int64_t) f[2 * i] + (int64_t) f[2 * i + 1] * ((int64_t) 1 << 26);
+    h[i] = (uint64_t) (t + (i == 0 ? 0x7ffffffffffed0LL : 0x7ffffffffffff0LL));
+  }
+  fe51_carry(h);
+}
+
+/* The limbs are balanced around 0, as fe_mul leaves them, since the ref10
+   code relies on their bounds */
+static void fe_from_fe51(fe h, const fe51 f) {
+  fe51 t;
+  int32_t carry;
+  int i;
+  fe51_canonical(t, f);
+  for (i = 0; i < 5; ++i) {
+    h[2 * i] = (int32_t) (t[i] & ((1 << 26) - 1));
+    h[2 * i + 1] = (int32_t) (t[i] >> 26);
+  }
+  for (i = 0; i < 10; ++i) {
+    const int bits = (i & 1) ? 25 : 26;
+    carry = (h[i] + (1 << (bits - 1))) >> bits;
+    h[i] -= carry * (1 << bits);
+    if (i < 9) {
+      h[i + 1] += carry;
+    } else {
+      h[0] += carry * 19;
+    }
+  }
+}
+
+/* r = u^(m+1)v^(-(m+1)), as fe_divpowm1 */
+static void fe51_divpowm1(fe51 r, const fe51 u, const fe51 v) {
+  fe51 v3, uv7, t0, t1, t2;
+  int i;
+
+  fe51_sq(v3, v);
+  fe51_mul(v3, v3, v); /* v3 = v^3 */
+  fe51_sq(uv7, v3);
+  fe51_mul(uv7, uv7, v);
+  fe51_mul(uv7, uv7, u); /* uv7 = uv^7 */
+
+  fe51_sq(t0, uv7);
+  fe51_sq(t1, t0);
+  fe51_sq(t1, t1);
+  fe51_mul(t1, uv7, t1);
+  fe51_mul(t0, t0, t1);
+  fe51_sq(t0, t0);
+  fe51_mul(t0, t1, t0);
+  fe51_sq(t1, t0);
+  for (i = 0; i < 4; ++i) {
+    fe51_sq(t1, t1);
+  }
+  fe51_mul(t0, t1, t0);
+  fe51_sq(t1, t0);
+  for (i = 0; i < 9; ++i) {
+    fe51_sq(t1, t1);
+  }
+  fe51_mul(t1, t1, t0);
+  fe51_sq(t2, t1);
+  for (i = 0; i < 19; ++i) {
+    fe51_sq(t2, t2);
+  }
+  fe51_mul(t1, t2, t1);
+  for (i = 0; i < 10; ++i) {
+    fe51_sq(t1, t1);
+  }
+  fe51_mul(t0, t1, t0);
+  fe51_sq(t1, t0);
+  for (i = 0; i < 49; ++i) {
+    fe51_sq(t1, t1);
+  }
+  fe51_mul(t1, t1, t0);
+  fe51_sq(t2, t1);
+  for (i = 0; i < 99; ++i) {
+    fe51_sq(t2, t2);
+  }
+  fe51_mul(t1, t2, t1);
+  for (i = 0; i < 50; ++i) {
+    fe51_sq(t1, t1);
+  }
+  fe51_mul(t0, t1, t0);
+  fe51_sq(t0, t0);
+  fe51_sq(t0, t0);
+  fe51_mul(t0, t0, uv7);
+
+  /* t0 = (uv^7)^((q-5)/8) */
+  fe51_mul(t0, t0, v3);
+  fe51_mul(r, t0, u);
+}
+
+/* Group operations, as their ref10 counterparts in crypto-ops.c */
+
+static void ge51_p2_0(ge51_p2 *h) {
+  fe51_0(h->X);
+  fe51_1(h->Y);
+  fe51_1(h->Z);
+}
+
+static void ge51_p3_0(ge51_p3 *h) {
+  fe51_0(h->X);
+  fe51_1(h->Y);
+  fe51_1(h->Z);
+  fe51_0(h->T);
+}
+
+static void ge51_precomp_0(ge51_precomp *h) {
+  fe51_1(h->yplusx);
+  fe51_1(h->yminusx);
+  fe51_0(h->xy2d);
+}
+
+static void ge51_cached_0(ge51_cached *r) {
+  fe51_1(r->YplusX);
+  fe51_1(r->YminusX);
+  fe51_1(r->Z);
+  fe51_0(r->T2d);
+}
+
+static void ge51_add(ge51_p1p1 *r, const ge51_p3 *p, const ge51_cached *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->YplusX);
+  fe51_mul(r->Y, r->Y, q->YminusX);
+  fe51_mul(r->T, q->T2d, p->T);
+  fe51_mul(r->X, p->Z, q->Z);
+  fe51_add(t0, r->X, r->X);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_add(r->Z, t0, r->T);
+  fe51_sub(r->T, t0, r->T);
+}
+
+static void ge51_sub(ge51_p1p1 *r, const ge51_p3 *p, const ge51_cached *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->YminusX);
+  fe51_mul(r->Y, r->Y, q->YplusX);
+  fe51_mul(r->T, q->T2d, p->T);
+  fe51_mul(r->X, p->Z, q->Z);
+  fe51_add(t0, r->X, r->X);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_sub(r->Z, t0, r->T);
+  fe51_add(r->T, t0, r->T);
+}
+
+static void ge51_madd(ge51_p1p1 *r, const ge51_p3 *p, const ge51_precomp *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->yplusx);
+  fe51_mul(r->Y, r->Y, q->yminusx);
+  fe51_mul(r->T, q->xy2d, p->T);
+  fe51_add(t0, p->Z, p->Z);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_add(r->Z, t0, r->T);
+  fe51_sub(r->T, t0, r->T);
+}
+
+static void ge51_msub(ge51_p1p1 *r, const ge51_p3 *p, const ge51_precomp *q) {
+  fe51 t0;
+  fe51_add(r->X, p->Y, p->X);
+  fe51_sub(r->Y, p->Y, p->X);
+  fe51_mul(r->Z, r->X, q->yminusx);
+  fe51_mul(r->Y, r->Y, q->yplusx);
+  fe51_mul(r->T, q->xy2d, p->T);
+  fe51_add(t0, p->Z, p->Z);
+  fe51_sub(r->X, r->Z, r->Y);
+  fe51_add(r->Y, r->Z, r->Y);
+  fe51_sub(r->Z, t0, r->T);
+  fe51_add(r->T, t0, r->T);
+}
+
+static void ge51_p1p1_to_p2(ge51_p2 *r, const ge51_p1p1 *p) {
+  fe51_mul(r->X, p->X, p->T);
+  fe51_mul(r->Y, p->Y, p->Z);
+  fe51_mul(r->Z, p->Z, p->T);
+}
+
+static void ge51_p1p1_to_p3(ge51_p3 *r, const ge51_p1p1 *p) {
+  fe51_mul(r->X, p->X, p->T);
+  fe51_mul(r->Y, p->Y, p->Z);
+  fe51_mul(r->Z, p->Z, p->T);
+  fe51_mul(r->T, p->X, p->Y);
+}
+
+static void ge51_p2_dbl(ge51_p1p1 *r, const ge51_p2 *p) {
+  fe51 t0;
+  fe51_sq(r->X, p->X);
+  fe51_sq(r->Z, p->Y);
+  fe51_sq2(r->T, p->Z);
+  fe51_add(r->Y, p->X, p->Y);
+  fe51_sq(t0, r->Y);
+  fe51_add(r->Y, r->Z, r->X);
+  fe51_sub(r->Z, r->Z, r->X);
+  fe51_sub(r->X, t0, r->Y);
+  fe51_sub(r->T, r->T, r->Z);
+}
+
+static void ge51_p3_to_p2(ge51_p2 *r, const ge51_p3 *p) {
+  fe51_copy(r->X, p->X);
+  fe51_copy(r->Y, p->Y);
+  fe51_copy(r->Z, p->Z);
+}
+
+static void ge51_p3_dbl(ge51_p1p1 *r, const ge51_p3 *p) {
+  ge51_p2 q;
+  ge51_p3_to_p2(&q, p);
+  ge51_p2_dbl(r, &q);
+}
+
+static void ge51_p3_to_cached(ge51_cached *r, const ge51_p3 *p) {
+  fe51_add(r->YplusX, p->Y, p->X);
+  fe51_sub(r->YminusX, p->Y, p->X);
+  fe51_copy(r->Z, p->Z);
+  fe51_mul(r->T2d, p->T, fe51_d2);
+}
+
+static void ge51_dsm_precomp(ge51_cached r[8], const ge51_p3 *s) {
+  ge51_p1p1 t;
+  ge51_p3 s2, u;
+  int i;
+  ge51_p3_to_cached(&r[0], s);
+  ge51_p3_dbl(&t, s); ge51_p1p1_to_p3(&s2, &t);
+  for (i = 0; i < 7; ++i) {
+    ge51_add(&t, &s2, &r[i]); ge51_p1p1_to_p3(&u, &t); ge51_p3_to_cached(&r[i + 1], &u);
+  }
+}
+
+static void ge51_precomp_cmov(ge51_precomp *t, const ge51_precomp *u, unsigned char b) {
+  fe51_cmov(t->yplusx, u->yplusx, b);
+  fe51_cmov(t->yminusx, u->yminusx, b);
+  fe51_cmov(t->xy2d, u->xy2d, b);
+}
+
+static void ge51_cached_cmov(ge51_cached *t, const ge51_cached *u, unsigned char b) {
+  fe51_cmov(t->YplusX, u->YplusX, b);
+  fe51_cmov(t->YminusX, u->YminusX, b);
+  fe51_cmov(t->Z, u->Z, b);
+  fe51_cmov(t->T2d, u->T2d, b);
+}
+
+static unsigned char equal(signed char b, signed char c) {
+  unsigned char ub = b;
+  unsigned char uc = c;
+  unsigned char x = ub ^ uc; /* 0: yes; 1..255: no */
+  uint32_t y = x; /* 0: yes; 1..255: no */
+  y -= 1; /* 4294967295: yes; 0..254: no */
+  y >>= 31; /* 1: yes; 0: no */
+  return y;
+}
+
+static unsigned char negative(signed char b) {
+  unsigned long long x = b; /* 18446744073709551361..18446744073709551615: yes; 0..255: no */
+  x >>= 63; /* 1: yes; 0: no */
+  return x;
+}
+
+static void ge51_select(ge51_precomp *t, int pos, signed char b) {
+  ge51_precomp minust;
+  unsigned char bnegative = negative(b);
+  unsigned char babs = b - (((-bnegative) & b) << 1);
+  int i;
+
+  ge51_precomp_0(t);
+  for (i = 0; i < 8; ++i) {
+    ge51_precomp_cmov(t, &ge51_base[pos][i], equal(babs, i + 1));
+  }
+  fe51_copy(minust.yplusx, t->yminusx);
+  fe51_copy(minust.yminusx, t->yplusx);
+  fe51_neg(minust.xy2d, t->xy2d);
+  ge51_precomp_cmov(t, &minust, bnegative);
+}
+
+static void slide(signed char *r, const unsigned char *a) {
+  int i;
+  int b;
+  int k;
+
+  for (i = 0; i < 256; ++i) {
+    r[i] = 1 & (a[i >> 3] >> (i & 7));
+  }
+
+  for (i = 0; i < 256; ++i) {
+    if (r[i]) {
+      for (b = 1; b <= 6 && i + b < 256; ++b) {
+        if (r[i + b]) {
+          if (r[i] + (r[i + b] << b) <= 15) {
+            r[i] += r[i + b] << b; r[i + b] = 0;
+          } else if (r[i] - (r[i + b] << b) >= -15) {
+            r[i] -= r[i + b] << b;
+            for (k = i + b; k < 256; ++k) {
+              if (!r[k]) {
+                r[k] = 1;
+                break;
+              }
+              r[k] = 0;
+            }
+          } else
+            break;
+        }
+      }
+    }
+  }
+}
+
+static void ge51_from_p3(ge51_p3 *r, const ge_p3 *p) {
+  fe51_from_fe(r->X, p->X);
+  fe51_from_fe(r->Y, p->Y);
+  fe51_from_fe(r->Z, p->Z);
+  fe51_from_fe(r->T, p->T);
+}
+
+static void ge51_from_dsmp(ge51_cached r[8], const ge_dsmp p) {
+  int i;
+  for (i = 0; i < 8; ++i) {
+    fe51_from_fe(r[i].YplusX, p[i].YplusX);
+    fe51_from_fe(r[i].YminusX, p[i].YminusX);
+    fe51_from_fe(r[i].Z, p[i].Z);
+    fe51_from_fe(r[i].T2d, p[i].T2d);
+  }
+}
+
+static void ge_from_ge51_p2(ge_p2 *r, const ge51_p2 *p) {
+  fe_from_fe51(r->X, p->X);
+  fe_from_fe51(r->Y, p->Y);
+  fe_from_fe51(r->Z, p->Z);
+}
+
+static void ge_from_ge51_p3(ge_p3 *r, const ge51_p3 *p) {
+  fe_from_fe51(r->X, p->X);
+  fe_from_fe51(r->Y, p->Y);
+  fe_from_fe51(r->Z, p->Z);
+  fe_from_fe51(r->T, p->T);
+}
+
+/* Entry points */
+
+/* Assumes that a[31] <= 127 */
+void CRYPTO_OPS_51_NAME(ge51_scalarmult)(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
+  signed char e[64];
+  int carry, carry2, i;
+  ge51_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
+  ge51_p1p1 t;
+  ge51_p3 A51, u;
+  ge51_p2 r51;
+
+  carry = 0; /* 0..1 */
+  for (i = 0; i < 31; i++) {
+    carry += a[i]; /* 0..256 */
+    carry2 = (carry + 8) >> 4; /* 0..16 */
+    e[2 * i] = carry - (carry2 << 4); /* -8..7 */
+    carry = (carry2 + 8) >> 4; /* 0..1 */
+    e[2 * i + 1] = carry2 - (carry << 4); /* -8..7 */
+  }
+  carry += a[31]; /* 0..128 */
+  carry2 = (carry + 8) >> 4; /* 0..8 */
+  e[62] = carry - (carry2 << 4); /* -8..7 */
+  e[63] = carry2; /* 0..8 */
+
+  ge51_from_p3(&A51, A);
+  ge51_p3_to_cached(&Ai[0], &A51);
+  for (i = 0; i < 7; i++) {
+    ge51_add(&t, &A51, &Ai[i]);
+    ge51_p1p1_to_p3(&u, &t);
+    ge51_p3_to_cached(&Ai[i + 1], &u);
+  }
+
+  ge51_p2_0(&r51);
+  for (i = 63; i >= 0; i--) {
+    signed char b = e[i];
+    unsigned char bnegative = negative(b);
+    unsigned char babs = b - (((-bnegative) & b) << 1);
+    ge51_cached cur, minuscur;
+    int j;
+    ge51_p2_dbl(&t, &r51);
+    ge51_p1p1_to_p2(&r51, &t);
+    ge51_p2_dbl(&t, &r51);
+    ge51_p1p1_to_p2(&r51, &t);
+    ge51_p2_dbl(&t, &r51);
+    ge51_p1p1_to_p2(&r51, &t);
+    ge51_p2_dbl(&t, &r51);
+    ge51_p1p1_to_p3(&u, &t);
+    ge51_cached_0(&cur);
+    for (j = 0; j < 8; ++j) {
+      ge51_cached_cmov(&cur, &Ai[j], equal(babs, j + 1));
+    }
+    fe51_copy(minuscur.YplusX, cur.YminusX);
+    fe51_copy(minuscur.YminusX, cur.YplusX);
+    fe51_copy(minuscur.Z, cur.Z);
+    fe51_neg(minuscur.T2d, cur.T2d);
+    ge51_cached_cmov(&cur, &minuscur, bnegative);
+    ge51_add(&t, &u, &cur);
+    ge51_p1p1_to_p2(&r51, &t);
+  }
+
+  ge_from_ge51_p2(r, &r51);
+}
+
+/* Assumes that a[31] <= 127 */
+void CRYPTO_OPS_51_NAME(ge51_scalarmult_base)(ge_p3 *h, const unsigned char *a) {
+  signed char e[64];
+  signed char carry;
+  ge51_p1p1 r;
+  ge51_p2 s;
+  ge51_p3 h51;
+  ge51_precomp t;
+  int i;
+
+  for (i = 0; i < 32; ++i) {
+    e[2 * i + 0] = (a[i] >> 0) & 15;
+    e[2 * i + 1] = (a[i] >> 4) & 15;
+  }
+  /* each e[i] is between 0 and 15 */
+  /* e[63] is between 0 and 7 */
+
+  carry = 0;
+  for (i = 0; i < 63; ++i) {
+    e[i] += carry;
+    carry = e[i] + 8;
+    carry >>= 4;
+    e[i] -= carry << 4;
+  }
+  e[63] += carry;
+  /* each e[i] is between -8 and 8 */
+
+  ge51_p3_0(&h51);
+  for (i = 1; i < 64; i += 2) {
+    ge51_select(&t, i / 2, e[i]);
+    ge51_madd(&r, &h51, &t); ge51_p1p1_to_p3(&h51, &r);
+  }
+
+  ge51_p3_dbl(&r, &h51);  ge51_p1p1_to_p2(&s, &r);
+  ge51_p2_dbl(&r, &s); ge51_p1p1_to_p2(&s, &r);
+  ge51_p2_dbl(&r, &s); ge51_p1p1_to_p2(&s, &r);
+  ge51_p2_dbl(&r, &s); ge51_p1p1_to_p3(&h51, &r);
+
+  for (i = 0; i < 64; i += 2) {
+    ge51_select(&t, i / 2, e[i]);
+    ge51_madd(&r, &h51, &t); ge51_p1p1_to_p3(&h51, &r);
+  }
+
+  ge_from_ge51_p3(h, &h51);
+}
+
+void CRYPTO_OPS_51_NAME(ge51_double_scalarmult_base_vartime)(ge_p2 *r, const unsigned char *a, const ge_p3 *A, const unsigned char *b) {
+  signed char aslide[256];
+  signed char bslide[256];
+  ge51_cached Ai[8]; /* A, 3A, 5A, 7A, 9A, 11A, 13A, 15A */
+  ge51_p1p1 t;
+  ge51_p3 A51, u;
+  ge51_p2 r51;
+  int i;
+
+  slide(aslide, a);
+  slide(bslide, b);
+  ge51_from_p3(&A51, A);
+  ge51_dsm_precomp(Ai, &A51);
+
+  ge51_p2_0(&r51);
+
+  for (i = 255; i >= 0; --i) {
+    if (aslide[i] || bslide[i]) break;
+  }
+
+  for (; i >= 0; --i) {
+    ge51_p2_dbl(&t, &r51);
+
+    if (aslide[i] > 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_add(&t, &u, &Ai[aslide[i]/2]);
+    } else if (aslide[i] < 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_sub(&t, &u, &Ai[(-aslide[i])/2]);
+    }
+
+    if (bslide[i] > 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_madd(&t, &u, &ge51_Bi[bslide[i]/2]);
+    } else if (bslide[i] < 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_msub(&t, &u, &ge51_Bi[(-bslide[i])/2]);
+    }
+
+    ge51_p1p1_to_p2(&r51, &t);
+  }
+
+  ge_from_ge51_p2(r, &r51);
+}
+
+void CRYPTO_OPS_51_NAME(ge51_double_scalarmult_precomp_vartime2)(ge_p2 *r, const unsigned char *a, const ge_dsmp Ai, const unsigned char *b, const ge_dsmp Bi) {
+  signed char aslide[256];
+  signed char bslide[256];
+  ge51_cached Ai51[8], Bi51[8];
+  ge51_p1p1 t;
+  ge51_p3 u;
+  ge51_p2 r51;
+  int i;
+
+  slide(aslide, a);
+  slide(bslide, b);
+  ge51_from_dsmp(Ai51, Ai);
+  ge51_from_dsmp(Bi51, Bi);
+
+  ge51_p2_0(&r51);
+
+  for (i = 255; i >= 0; --i) {
+    if (aslide[i] || bslide[i]) break;
+  }
+
+  for (; i >= 0; --i) {
+    ge51_p2_dbl(&t, &r51);
+
+    if (aslide[i] > 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_add(&t, &u, &Ai51[aslide[i]/2]);
+    } else if (aslide[i] < 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_sub(&t, &u, &Ai51[(-aslide[i])/2]);
+    }
+
+    if (bslide[i] > 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_add(&t, &u, &Bi51[bslide[i]/2]);
+    } else if (bslide[i] < 0) {
+      ge51_p1p1_to_p3(&u, &t);
+      ge51_sub(&t, &u, &Bi51[(-bslide[i])/2]);
+    }
+
+    ge51_p1p1_to_p2(&r51, &t);
+  }
+
+  ge_from_ge51_p2(r, &r51);
+}
+
+int CRYPTO_OPS_51_NAME(ge51_frombytes_vartime)(ge_p3 *h, const unsigned char *s) {
+  ge51_p3 h51;
+  fe51 u;
+  fe51 v;
+  fe51 vxx;
+  fe51 check;
+
+  fe51_frombytes(h51.Y, s);
+
+  /* Validate the number to be canonical */
+  if (h51.Y[4] == fe51_mask && h51.Y[3] == fe51_mask && h51.Y[2] == fe51_mask &&
+    h51.Y[1] == fe51_mask && h51.Y[0] >= fe51_mask - 18) {
+    return -1;
+  }
+
+  fe51_1(h51.Z);
+  fe51_sq(u, h51.Y);
+  fe51_mul(v, u, fe51_d);
+  fe51_sub(u, u, h51.Z);       /* u = y^2-1 */
+  fe51_add(v, v, h51.Z);       /* v = dy^2+1 */
+
+  fe51_divpowm1(h51.X, u, v); /* x = uv^3(uv^7)^((q-5)/8) */
+
+  fe51_sq(vxx, h51.X);
+  fe51_mul(vxx, vxx, v);
+  fe51_sub(check, vxx, u);    /* vx^2-u */
+  if (fe51_isnonzero(check)) {
+    fe51_add(check, vxx, u);  /* vx^2+u */
+    if (fe51_isnonzero(check)) {
+      return -1;
+    }
+    fe51_mul(h51.X, h51.X, fe51_sqrtm1);
+  }
+
+  if (fe51_isnegative(h51.X) != (s[31] >> 7)) {
+    /* If x = 0, the sign must be positive */
+    if (!fe51_isnonzero(h51.X)) {
+      return -1;
+    }
+    fe51_neg(h51.X, h51.X);
+  }
+
+  fe51_mul(h51.T, h51.X, h51.Y);
+  ge_from_ge51_p3(h, &h51);
+  return 0;
+}
+
+#endif
+
+#if defined(CRYPTO_OPS_51_SELECTION)
+
+/* Backend selection */
+
+#if defined(CRYPTO_OPS_BMI2)
+#include <cpuid.h>
+
+static int check_bmi2_hw(void) {
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid_max(0, NULL) < 7)
+    return 0;
+  __cpuid_count(7, 0, eax, ebx, ecx, edx);
+  return (ebx >> 8) & 1;
+}
+#endif
+
+static const char *const backend_names[CRYPTO_OPS_BACKEND_COUNT] = {
+  "ref10",
+  "radix51",
+  "radix51-bmi2",
+};
+
+#if defined(CRYPTO_OPS_RADIX51)
+static const crypto_ops_ge_impl ge51_impl = {
+  ge51_scalarmult,
+  ge51_scalarmult_base,
+  ge51_double_scalarmult_base_vartime,
+  ge51_double_scalarmult_precomp_vartime2,
+  ge51_frombytes_vartime,
+};
+#endif
+
+#if defined(CRYPTO_OPS_BMI2)
+static const crypto_ops_ge_impl ge51_bmi2_impl = {
+  ge51_scalarmult_bmi2,
+  ge51_scalarmult_base_bmi2,
+  ge51_double_scalarmult_base_vartime_bmi2,
+  ge51_double_scalarmult_precomp_vartime2_bmi2,
+  ge51_frombytes_vartime_bmi2,
+};
+#endif
+
+typedef struct {
+  int id;
+  const crypto_ops_ge_impl *impl; /* NULL for ref10 */
+} backend_entry;
+
+static const backend_entry backends[CRYPTO_OPS_BACKEND_COUNT] = {
+  { CRYPTO_OPS_BACKEND_REF10, NULL },
+#if defined(CRYPTO_OPS_RADIX51)
+  { CRYPTO_OPS_BACKEND_RADIX51, &ge51_impl },
+#else
+  { CRYPTO_OPS_BACKEND_RADIX51, NULL },
+#endif
+#if defined(CRYPTO_OPS_BMI2)
+  { CRYPTO_OPS_BACKEND_RADIX51_BMI2, &ge51_bmi2_impl },
+#else
+  { CRYPTO_OPS_BACKEND_RADIX51_BMI2, NULL },
+#endif
+};
+
+/* The id and implementation change together through this one pointer, so
+   threads calling in while it is first picked or changed see either the old
+   backend or the new one, never a mix. NULL until picked. */
+static _Atomic(const backend_entry *) backend = NULL;
+
+int crypto_ops_backend_available(int b) {
+  switch (b) {
+    case CRYPTO_OPS_BACKEND_REF10:
+      return 1;
+#if defined(CRYPTO_OPS_RADIX51)
+    case CRYPTO_OPS_BACKEND_RADIX51:
+      return 1;
+#endif
+#if defined(CRYPTO_OPS_BMI2)
+    case CRYPTO_OPS_BACKEND_RADIX51_BMI2:
+      return check_bmi2_hw();
+#endif
+    default:
+      return 0;
+  }
+}
+
+const char *crypto_ops_backend_name(int b) {
+  if (b < 0 || b >= CRYPTO_OPS_BACKEND_COUNT)
+    return "unknown";
+  return backend_names[b];
+}
+
+int crypto_ops_set_backend(int b) {
+  if (!crypto_ops_backend_available(b))
+    return 0;
+  atomic_store_explicit(&backend, &backends[b], memory_order_release);
+  return 1;
+}
+
+/* The fastest available, unless MONERO_CRYPTO_OPS_BACKEND names another */
+static int pick_backend(void) {
+  const char *env = getenv("MONERO_CRYPTO_OPS_BACKEND");
+  int b;
+
+  if (env) {
+    for (b = 0; b < CRYPTO_OPS_BACKEND_COUNT; ++b) {
+      if (!strcmp(env, backend_names[b]) && crypto_ops_backend_available(b))
+        return b;
+    }
+  }
+  for (b = CRYPTO_OPS_BACKEND_COUNT - 1; b > 0; --b) {
+    if (crypto_ops_backend_available(b))
+      return b;
+  }
+  return CRYPTO_OPS_BACKEND_REF10;
+}
+
+static const backend_entry *get_backend(void) {
+  const backend_entry *current = atomic_load_explicit(&backend, memory_order_acquire);
+  if (current == NULL) {
+    /* concurrent first calls all pick the same, and only the first store
+       counts, so one set by crypto_ops_set_backend meanwhile is kept */
+    const backend_entry *picked = &backends[pick_backend()];
+    if (atomic_compare_exchange_strong_explicit(&backend, &current, picked, memory_order_acq_rel, memory_order_acquire))
+      current = picked;
+  }
+  return current;
+}
+
+int crypto_ops_get_backend(void) {
+  return get_backend()->id;
+}
+
+const crypto_ops_ge_impl *crypto_ops_get_ge_impl(void) {
+  return get_backend()->impl;
+}
+
+#endif
@@ -0,0 +1,111 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "crypto-ops.h"
+
+/* The group operations provided by backends other than ref10 */
+
+typedef struct {
+  void (*scalarmult)(ge_p2 *, const unsigned char *, const ge_p3 *);
+  void (*scalarmult_base)(ge_p3 *, const unsigned char *);
+  void (*double_scalarmult_base_vartime)(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *);
+  void (*double_scalarmult_precomp_vartime2)(ge_p2 *, const unsigned char *, const ge_dsmp, const unsigned char *, const ge_dsmp);
+  int (*frombytes_vartime)(ge_p3 *, const unsigned char *);
+} crypto_ops_ge_impl;
+
+/* The selected backend's operations, or NULL to use the ref10 code */
+const crypto_ops_ge_impl *crypto_ops_get_ge_impl(void);
+
+#if defined(CRYPTO_OPS_RADIX51)
+
+/* Field elements in radix 2^51, as five limbs of 51 bits and some slack */
+
+typedef uint64_t fe51[5];
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+} ge51_p2;
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+  fe51 T;
+} ge51_p3;
+
+typedef struct {
+  fe51 X;
+  fe51 Y;
+  fe51 Z;
+  fe51 T;
+} ge51_p1p1;
+
+typedef struct {
+  fe51 yplusx;
+  fe51 yminusx;
+  fe51 xy2d;
+} ge51_precomp;
+
+typedef struct {
+  fe51 YplusX;
+  fe51 YminusX;
+  fe51 Z;
+  fe51 T2d;
+} ge51_cached;
+
+/* From crypto-ops-data-51.c */
+
+extern const fe51 fe51_d;
+extern const fe51 fe51_sqrtm1;
+extern const fe51 fe51_d2;
+extern const ge51_precomp ge51_base[32][8];
+extern const ge51_precomp ge51_Bi[8];
+
+/* Implementations of the crypto-ops.h functions of the same names, taking
+   and returning points in radix 2^25.5, built once generic and once for
+   processors with BMI2 */
+
+void ge51_scalarmult(ge_p2 *, const unsigned char *, const ge_p3 *);
+void ge51_scalarmult_base(ge_p3 *, const unsigned char *);
+void ge51_double_scalarmult_base_vartime(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *);
+void ge51_double_scalarmult_precomp_vartime2(ge_p2 *, const unsigned char *, const ge_dsmp, const unsigned char *, const ge_dsmp);
+int ge51_frombytes_vartime(ge_p3 *, const unsigned char *);
+
+#if defined(CRYPTO_OPS_BMI2)
+void ge51_scalarmult_bmi2(ge_p2 *, const unsigned char *, const ge_p3 *);
+void ge51_scalarmult_base_bmi2(ge_p3 *, const unsigned char *);
+void ge51_double_scalarmult_base_vartime_bmi2(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *);
+void ge51_double_scalarmult_precomp_vartime2_bmi2(ge_p2 *, const unsigned char *, const ge_dsmp, const unsigned char *, const ge_dsmp);
+int ge51_frombytes_vartime_bmi2(ge_p3 *, const unsigned char *);
+#endif
+
+#endif
@@ -33,6 +33,7 @@
 
 #include "warnings.h"
 #include "crypto-ops.h"
+#include "crypto-ops-51.h"
 
 DISABLE_VS_WARNINGS(4146 4244)
 
@@ -1200,6 +1201,12 @@ void ge_double_scalarmult_base_vartime(ge_p2 *r, const unsigned char *a, const g
   ge_p1p1 t;
   ge_p3 u;
   int i;
+  const crypto_ops_ge_impl *impl = crypto_ops_get_ge_impl();
+
+  if (impl) {
+    impl->double_scalarmult_base_vartime(r, a, A, b);
+    return;
+  }
 
   slide(aslide, a);
   slide(bslide, b);
@@ -1241,6 +1248,11 @@ int ge_frombytes_vartime(ge_p3 *h, const unsigned char *s) {
   fe v;
   fe vxx;
   fe check;
+  const crypto_ops_ge_impl *impl = crypto_ops_get_ge_impl();
+
+  if (impl) {
+    return impl->frombytes_vartime(h, s);
+  }
 
   /* From fe_frombytes.c */
 
@@ -1512,20 +1524,20 @@ static void ge_precomp_cmov(ge_precomp *t, const ge_precomp *u, unsigned char b)
   fe_cmov(t->xy2d, u->xy2d, b);
 }
 
-static void select(ge_precomp *t, int pos, signed char b) {
+static void select(ge_precomp *t, const ge_precomp row[8], signed char b) {
   ge_precomp minust;
   unsigned char bnegative = negative(b);
   unsigned char babs = b - (((-bnegative) & b) << 1);
 
   ge_precomp_0(t);
-  ge_precomp_cmov(t, &ge_base[pos][0], equal(babs, 1));
-  ge_precomp_cmov(t, &ge_base[pos][1], equal(babs, 2));
-  ge_precomp_cmov(t, &ge_base[pos][2], equal(babs, 3));
-  ge_precomp_cmov(t, &ge_base[pos][3], equal(babs, 4));
-  ge_precomp_cmov(t, &ge_base[pos][4], equal(babs, 5));
-  ge_precomp_cmov(t, &ge_base[pos][5], equal(babs, 6));
-  ge_precomp_cmov(t, &ge_base[pos][6], equal(babs, 7));
-  ge_precomp_cmov(t, &ge_base[pos][7], equal(babs, 8));
+  ge_precomp_cmov(t, &row[0], equal(babs, 1));
+  ge_precomp_cmov(t, &row[1], equal(babs, 2));
+  ge_precomp_cmov(t, &row[2], equal(babs, 3));
+  ge_precomp_cmov(t, &row[3], equal(babs, 4));
+  ge_precomp_cmov(t, &row[4], equal(babs, 5));
+  ge_precomp_cmov(t, &row[5], equal(babs, 6));
+  ge_precomp_cmov(t, &row[6], equal(babs, 7));
+  ge_precomp_cmov(t, &row[7], equal(babs, 8));
   fe_copy(minust.yplusx, t->yminusx);
   fe_copy(minust.yminusx, t->yplusx);
   fe_neg(minust.xy2d, t->xy2d);
@@ -1533,15 +1545,15 @@ static void select(ge_precomp *t, int pos, signed char b) {
 }
 
 /*
-h = a * B
+h = a * P
 where a = a[0]+256*a[1]+...+256^31 a[31]
-B is the Ed25519 base point (x,4/5) with x positive.
+and table[i][j] = (j + 1) * 256^i * P
 
 Preconditions:
   a[31] <= 127
 */
 
-void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
+static void scalarmult_table(ge_p3 *h, const unsigned char *a, const ge_precomp table[32][8]) {
   signed char e[64];
   signed char carry;
   ge_p1p1 r;
@@ -1568,7 +1580,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
 
   ge_p3_0(h);
   for (i = 1; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 
@@ -1578,11 +1590,85 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
   ge_p2_dbl(&r, &s); ge_p1p1_to_p3(h, &r);
 
   for (i = 0; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 }
 
+/*
+h = a * B
+where a = a[0]+256*a[1]+...+256^31 a[31]
+B is the Ed25519 base point (x,4/5) with x positive.
+
+Preconditions:
+  a[31] <= 127
+*/
+
+void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
+  const crypto_ops_ge_impl *impl = crypto_ops_get_ge_impl();
+
+  if (impl) {
+    impl->scalarmult_base(h, a);
+    return;
+  }
+
+  scalarmult_table(h, a, ge_base);
+}
+
+static void ge_p3_to_precomp(ge_precomp *r, const ge_p3 *p) {
+  fe recip, x, y;
+
+  fe_invert(recip, p->Z);
+  fe_mul(x, p->X, recip);
+  fe_mul(y, p->Y, recip);
+  fe_add(r->yplusx, y, x);
+  fe_sub(r->yminusx, y, x);
+  fe_mul(r->xy2d, x, y);
+  fe_mul(r->xy2d, r->xy2d, fe_d2);
+}
+
+/*
+table[i][j] = (j + 1) * 256^i * P, the layout of ge_base
+*/
+
+void ge_precomp_table(ge_precomp table[32][8], const ge_p3 *P) {
+  ge_p3 base = *P, q;
+  ge_cached c;
+  ge_p1p1 t;
+  ge_p2 s;
+  int i, j;
+
+  for (i = 0; i < 32; ++i) {
+    ge_p3_to_cached(&c, &base);
+    q = base;
+    ge_p3_to_precomp(&table[i][0], &q);
+    for (j = 1; j < 8; ++j) {
+      ge_add(&t, &q, &c);
+      ge_p1p1_to_p3(&q, &t);
+      ge_p3_to_precomp(&table[i][j], &q);
+    }
+
+    ge_p3_to_p2(&s, &base);
+    for (j = 0; j < 7; ++j) {
+      ge_p2_dbl(&t, &s);
+      ge_p1p1_to_p2(&s, &t);
+    }
+    ge_p2_dbl(&t, &s);
+    ge_p1p1_to_p3(&base, &t);
+  }
+}
+
+/*
+h = a * P, with table made by ge_precomp_table from P. Constant time.
+
+Preconditions:
+  a[31] <= 127
+*/
+
+void ge_scalarmult_precomp(ge_p3 *h, const unsigned char *a, const ge_precomp table[32][8]) {
+  scalarmult_table(h, a, table);
+}
+
 /* From ge_sub.c */
 
 /*
@@ -1618,6 +1704,70 @@ void ge_tobytes(unsigned char *s, const ge_p2 *h) {
   s[31] ^= fe_isnegative(x) << 7;
 }
 
+/* Batched encoding and decoding, for callers holding arrays of points */
+
+/* Points are encoded GE_BATCH_SIZE at a time, sharing a single field
+   inversion through Montgomery's trick: invert the product of all the Z,
+   then peel off each 1/Z with two multiplies */
+#define GE_BATCH_SIZE 64
+
+void ge_tobytes_batch(unsigned char *s, const ge_p2 *h, size_t n) {
+  fe acc[GE_BATCH_SIZE];
+  fe recip;
+  fe zinv;
+  fe x;
+  fe y;
+  size_t i, j, count;
+
+  for (i = 0; i < n; i += count) {
+    count = n - i < GE_BATCH_SIZE ? n - i : GE_BATCH_SIZE;
+    fe_copy(acc[0], h[i].Z);
+    for (j = 1; j < count; ++j) {
+      fe_mul(acc[j], acc[j - 1], h[i + j].Z);
+    }
+    fe_invert(recip, acc[count - 1]);
+    for (j = count; j-- > 0; ) {
+      /* recip is 1 / (Z_0 ... Z_j) here */
+      if (j > 0) {
+        fe_mul(zinv, recip, acc[j - 1]);
+        fe_mul(recip, recip, h[i + j].Z);
+      } else {
+        fe_copy(zinv, recip);
+      }
+      fe_mul(x, h[i + j].X, zinv);
+      fe_mul(y, h[i + j].Y, zinv);
+      fe_tobytes(s + 32 * (i + j), y);
+      s[32 * (i + j) + 31] ^= fe_isnegative(x) << 7;
+    }
+  }
+}
+
+void ge_p3_tobytes_batch(unsigned char *s, const ge_p3 *h, size_t n) {
+  ge_p2 p2[GE_BATCH_SIZE];
+  size_t i, j, count;
+
+  for (i = 0; i < n; i += count) {
+    count = n - i < GE_BATCH_SIZE ? n - i : GE_BATCH_SIZE;
+    for (j = 0; j < count; ++j) {
+      ge_p3_to_p2(&p2[j], &h[i + j]);
+    }
+    ge_tobytes_batch(s + 32 * i, p2, count);
+  }
+}
+
+/* Unlike encoding, decoding shares no work between points, since each one
+   needs its own square root: this is a plain loop */
+int ge_frombytes_vartime_batch(ge_p3 *h, const unsigned char *s, size_t n) {
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    if (ge_frombytes_vartime(&h[i], s + 32 * i) != 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
 /* From sc_reduce.c */
 
 /*
@@ -1946,6 +2096,12 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
   ge_p1p1 t;
   ge_p3 u;
+  const crypto_ops_ge_impl *impl = crypto_ops_get_ge_impl();
+
+  if (impl) {
+    impl->scalarmult(r, a, A);
+    return;
+  }
 
   carry = 0; /* 0..1 */
   for (i = 0; i < 31; i++) {
@@ -2006,6 +2162,12 @@ void ge_double_scalarmult_precomp_vartime2(ge_p2 *r, const unsigned char *a, con
   ge_p1p1 t;
   ge_p3 u;
   int i;
+  const crypto_ops_ge_impl *impl = crypto_ops_get_ge_impl();
+
+  if (impl) {
+    impl->double_scalarmult_precomp_vartime2(r, a, Ai, b, Bi);
+    return;
+  }
 
   slide(aslide, a);
   slide(bslide, b);
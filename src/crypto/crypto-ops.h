@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 /* From fe.h */
 
 typedef int32_t fe[10];
@@ -120,6 +122,14 @@ void ge_scalarmult_base(ge_p3 *, const unsigned char *);
 
 void ge_tobytes(unsigned char *, const ge_p2 *);
 
+/* Batched ge_tobytes, ge_p3_tobytes and ge_frombytes_vartime, on arrays of
+   n points and n * 32 bytes. ge_frombytes_vartime_batch returns -1 if any
+   point is invalid */
+
+void ge_tobytes_batch(unsigned char *, const ge_p2 *, size_t);
+void ge_p3_tobytes_batch(unsigned char *, const ge_p3 *, size_t);
+int ge_frombytes_vartime_batch(ge_p3 *, const unsigned char *, size_t);
+
 /* From sc_reduce.c */
 
 void sc_reduce(unsigned char *);
@@ -130,6 +140,9 @@ void ge_scalarmult(ge_p2 *, const unsigned char *, const ge_p3 *);
 void ge_double_scalarmult_precomp_vartime(ge_p2 *, const unsigned char *, const ge_p3 *, const unsigned char *, const ge_dsmp);
 void ge_double_scalarmult_precomp_vartime2(ge_p2 *, const unsigned char *, const ge_dsmp, const unsigned char *, const ge_dsmp);
 void ge_mul8(ge_p1p1 *, const ge_p2 *);
+/* Fixed base multiplication for points other than B, table being laid out like ge_base */
+void ge_precomp_table(ge_precomp [32][8], const ge_p3 *);
+void ge_scalarmult_precomp(ge_p3 *, const unsigned char *, const ge_precomp [32][8]);
 extern const fe fe_ma2;
 extern const fe fe_ma;
 extern const fe fe_fffb1;
@@ -147,6 +160,29 @@ void sc_muladd(unsigned char *s, const unsigned char *a, const unsigned char *b,
 int sc_check(const unsigned char *);
 int sc_isnonzero(const unsigned char *); /* Doesn't normalize */
 
+/* Backends */
+
+/* The radix 2^51 backend needs 64x64 to 128 bit multiplies */
+#if defined(__SIZEOF_INT128__)
+#define CRYPTO_OPS_RADIX51
+#endif
+
+enum {
+  CRYPTO_OPS_BACKEND_REF10, /* the portable radix 2^25.5 code in this file */
+  CRYPTO_OPS_BACKEND_RADIX51, /* radix 2^51, see crypto-ops-51.c */
+  CRYPTO_OPS_BACKEND_RADIX51_BMI2, /* the same, built for processors with BMI2 */
+  CRYPTO_OPS_BACKEND_COUNT
+};
+
+/* The backend is picked on first use, as the fastest one available, unless
+   the MONERO_CRYPTO_OPS_BACKEND environment variable names another. These
+   may be called from any thread, though changing the backend while others
+   are running operations is only meant for tests and benchmarks */
+int crypto_ops_get_backend(void);
+int crypto_ops_set_backend(int); /* 0 if not available */
+int crypto_ops_backend_available(int);
+const char *crypto_ops_backend_name(int);
+
 // internal
 uint64_t load_3(const unsigned char *in);
 uint64_t load_4(const unsigned char *in);
@@ -34,6 +34,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <vector>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
 #include <boost/shared_ptr.hpp>
@@ -42,6 +43,7 @@
 #include "warnings.h"
 #include "crypto.h"
 #include "hash.h"
+#include "point_cache.h"
 
 namespace crypto {
 
@@ -491,30 +493,29 @@ POP_WARNINGS
     ge_dsm_precomp(image_pre, &image_unp);
     sc_0(&sum);
     buf->h = prefix_hash;
+    // a and b of all the ring members are encoded together at the end, see ge_tobytes_batch
+    std::vector<ge_p2> ab(2 * pubs_count);
     for (i = 0; i < pubs_count; i++) {
-      ge_p2 tmp2;
       ge_p3 tmp3;
       if (i == sec_index) {
         random_scalar(k);
         ge_scalarmult_base(&tmp3, &k);
-        ge_p3_tobytes(&buf->ab[i].a, &tmp3);
+        ge_p3_to_p2(&ab[2 * i], &tmp3);
         hash_to_ec(*pubs[i], tmp3);
-        ge_scalarmult(&tmp2, &k, &tmp3);
-        ge_tobytes(&buf->ab[i].b, &tmp2);
+        ge_scalarmult(&ab[2 * i + 1], &k, &tmp3);
       } else {
         random_scalar(sig[i].c);
         random_scalar(sig[i].r);
         if (ge_frombytes_vartime(&tmp3, &*pubs[i]) != 0) {
           abort();
         }
-        ge_double_scalarmult_base_vartime(&tmp2, &sig[i].c, &tmp3, &sig[i].r);
-        ge_tobytes(&buf->ab[i].a, &tmp2);
+        ge_double_scalarmult_base_vartime(&ab[2 * i], &sig[i].c, &tmp3, &sig[i].r);
         hash_to_ec(*pubs[i], tmp3);
-        ge_double_scalarmult_precomp_vartime(&tmp2, &sig[i].r, &tmp3, &sig[i].c, image_pre);
-        ge_tobytes(&buf->ab[i].b, &tmp2);
+        ge_double_scalarmult_precomp_vartime(&ab[2 * i + 1], &sig[i].r, &tmp3, &sig[i].c, image_pre);
         sc_add(&sum, &sum, &sig[i].c);
       }
     }
+    ge_tobytes_batch(&buf->ab[0].a, ab.data(), ab.size());
     hash_to_scalar(buf.get(), rs_comm_size(pubs_count), h);
     sc_sub(&sig[sec_index].c, &h, &sum);
     sc_mulsub(&sig[sec_index].r, &sig[sec_index].c, &sec, &k);
@@ -541,22 +542,21 @@ POP_WARNINGS
     ge_dsm_precomp(image_pre, &image_unp);
     sc_0(&sum);
     buf->h = prefix_hash;
+    std::vector<ge_p2> ab(2 * pubs_count);
     for (i = 0; i < pubs_count; i++) {
-      ge_p2 tmp2;
       ge_p3 tmp3;
       if (sc_check(&sig[i].c) != 0 || sc_check(&sig[i].r) != 0) {
         return false;
       }
-      if (ge_frombytes_vartime(&tmp3, &*pubs[i]) != 0) {
+      if (!point_cache::instance().get(tmp3, *pubs[i])) {
         return false;
       }
-      ge_double_scalarmult_base_vartime(&tmp2, &sig[i].c, &tmp3, &sig[i].r);
-      ge_tobytes(&buf->ab[i].a, &tmp2);
+      ge_double_scalarmult_base_vartime(&ab[2 * i], &sig[i].c, &tmp3, &sig[i].r);
       hash_to_ec(*pubs[i], tmp3);
-      ge_double_scalarmult_precomp_vartime(&tmp2, &sig[i].r, &tmp3, &sig[i].c, image_pre);
-      ge_tobytes(&buf->ab[i].b, &tmp2);
+      ge_double_scalarmult_precomp_vartime(&ab[2 * i + 1], &sig[i].r, &tmp3, &sig[i].c, image_pre);
       sc_add(&sum, &sum, &sig[i].c);
     }
+    ge_tobytes_batch(&buf->ab[0].a, ab.data(), ab.size());
     hash_to_scalar(buf.get(), rs_comm_size(pubs_count), h);
     sc_sub(&h, &h, &sum);
     return sc_isnonzero(&h) == 0;
@@ -79,8 +79,20 @@ enum {
 };
 
 void cn_fast_hash(const void *data, size_t length, char *hash);
+/* Hashes count messages of length bytes each, stored one after the other, into
+   count hashes. Several messages are hashed at once, so this is faster than as
+   many calls to cn_fast_hash. hashes may point to data if length >= HASH_SIZE */
+void cn_fast_hash_batch(const void *data, size_t length, size_t count, char *hashes);
 void cn_slow_hash(const void *data, size_t length, char *hash);
 
+#define CN_SLOW_HASH_MAX_WAYS 4
+/* Computes count (at most CN_SLOW_HASH_MAX_WAYS) CryptoNight hashes on the calling
+   thread, interleaving their memory accesses. Each extra hash needs another 2MB
+   scratchpad, which stays allocated until slow_hash_free_state is called */
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t count, char (*hashes)[HASH_SIZE]);
+/* Number of CryptoNight scratchpads allocated by all threads so far, and how many of them got huge pages */
+void slow_hash_get_hugepage_stats(size_t *scratchpads, size_t *huge_pages);
+
 void hash_extra_blake(const void *data, size_t length, char *hash);
 void hash_extra_groestl(const void *data, size_t length, char *hash);
 void hash_extra_jh(const void *data, size_t length, char *hash);
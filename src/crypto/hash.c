@@ -48,3 +48,23 @@ void cn_fast_hash(const void *data, size_t length, char *hash) {
   hash_process(&state, data, length);
   memcpy(hash, &state, HASH_SIZE);
 }
+
+void cn_fast_hash_batch(const void *data, size_t length, size_t count, char *hashes) {
+  const uint8_t *in[4];
+  uint8_t *out[4];
+  union hash_state state[4];
+  size_t n;
+  int k;
+
+  for (n = 0; n + 4 <= count; n += 4) {
+    for (k = 0; k < 4; k++) {
+      in[k] = (const uint8_t*)data + (n + k) * length;
+      out[k] = state[k].b;
+    }
+    keccak_x4(in, length, out, sizeof(state[0]));
+    for (k = 0; k < 4; k++)
+      memcpy(hashes + (n + k) * HASH_SIZE, &state[k], HASH_SIZE);
+  }
+  for (; n < count; n++)
+    cn_fast_hash((const uint8_t*)data + n * length, length, hashes + n * HASH_SIZE);
+}
@@ -122,3 +122,123 @@ void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md)
 {
     keccak(in, inlen, md, sizeof(state_t));
 }
+
+// four states side by side, so each step of the permutation works on the
+// same lane of four states at once, which the compiler maps to SIMD registers
+#if defined(__GNUC__)
+
+typedef uint64_t lane_x4_t __attribute__((vector_size(32)));
+
+static void keccakf_x4(lane_x4_t st[25], int rounds)
+{
+    int i, j, round;
+    lane_x4_t t, bc[5];
+
+    for (round = 0; round < rounds; round++) {
+
+        // Theta
+        for (i = 0; i < 5; i++)
+            bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+
+        for (i = 0; i < 5; i++) {
+            t = bc[(i + 4) % 5] ^ ROTL64(bc[(i + 1) % 5], 1);
+            for (j = 0; j < 25; j += 5)
+                st[j + i] ^= t;
+        }
+
+        // Rho Pi
+        t = st[1];
+        for (i = 0; i < 24; i++) {
+            j = keccakf_piln[i];
+            bc[0] = st[j];
+            st[j] = ROTL64(t, keccakf_rotc[i]);
+            t = bc[0];
+        }
+
+        //  Chi
+        for (j = 0; j < 25; j += 5) {
+            for (i = 0; i < 5; i++)
+                bc[i] = st[j + i];
+            for (i = 0; i < 5; i++)
+                st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+        }
+
+        //  Iota
+        st[0] ^= keccakf_rndc[round];
+    }
+}
+
+static inline void xor_x4(lane_x4_t *st, const uint8_t *const in[4], size_t offset)
+{
+    uint64_t w[4];
+    int k;
+
+    for (k = 0; k < 4; k++)
+        memcpy(&w[k], in[k] + offset, 8);
+    *st ^= (lane_x4_t){w[0], w[1], w[2], w[3]};
+}
+
+void keccak_x4(const uint8_t *const in[4], size_t inlen, uint8_t *const md[4], int mdlen)
+{
+    lane_x4_t st[25];
+    uint8_t temp[4][144];
+    const uint8_t *last[4];
+    uint64_t out[25];
+    size_t i, rsiz, rsizw, offset;
+    int k;
+
+    if (mdlen <= 0 || mdlen > 200)
+    {
+      fprintf(stderr, "Bad keccak use");
+      abort();
+    }
+
+    rsiz = 200 == mdlen ? HASH_DATA_AREA : 200 - 2 * mdlen;
+    rsizw = rsiz / 8;
+
+    memset(st, 0, sizeof(st));
+
+    for (offset = 0; inlen >= rsiz; inlen -= rsiz, offset += rsiz) {
+        for (i = 0; i < rsizw; i++)
+            xor_x4(&st[i], in, offset + i * 8);
+        keccakf_x4(st, KECCAK_ROUNDS);
+    }
+
+    // last block and padding
+    if (inlen >= sizeof(temp[0]) || rsiz > sizeof(temp[0]))
+    {
+      fprintf(stderr, "Bad keccak use");
+      abort();
+    }
+
+    for (k = 0; k < 4; k++) {
+        memcpy(temp[k], in[k] + offset, inlen);
+        temp[k][inlen] = 1;
+        memset(temp[k] + inlen + 1, 0, rsiz - inlen - 1);
+        temp[k][rsiz - 1] |= 0x80;
+        last[k] = temp[k];
+    }
+
+    for (i = 0; i < rsizw; i++)
+        xor_x4(&st[i], last, i * 8);
+
+    keccakf_x4(st, KECCAK_ROUNDS);
+
+    for (k = 0; k < 4; k++) {
+        for (i = 0; i < 25; i++)
+            out[i] = st[i][k];
+        memcpy(md[k], out, mdlen);
+    }
+}
+
+#else
+
+void keccak_x4(const uint8_t *const in[4], size_t inlen, uint8_t *const md[4], int mdlen)
+{
+    int k;
+
+    for (k = 0; k < 4; k++)
+        keccak(in[k], inlen, md[k], mdlen);
+}
+
+#endif
@@ -23,4 +23,7 @@ void keccakf(uint64_t st[25], int norounds);
 
 void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md);
 
+// compute four keccak hashes of messages of the same length at once
+void keccak_x4(const uint8_t *const in[4], size_t inlen, uint8_t *const md[4], int mdlen);
+
 #endif
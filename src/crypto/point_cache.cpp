@@ -0,0 +1,150 @@
+// Copyright (c) 2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <cstring>
+#include <vector>
+#include <boost/thread/lock_guard.hpp>
+
+#include "point_cache.h"
+extern "C" {
+#include "crypto-ops.h"
+}
+
+namespace crypto {
+
+  point_cache &point_cache::instance() {
+    static point_cache cache;
+    return cache;
+  }
+
+  point_cache::point_cache(): m_max_size(0) {
+  }
+
+  void point_cache::set_max_size(size_t max_points) {
+    m_max_size = max_points;
+    clear();
+  }
+
+  size_t point_cache::size() const {
+    size_t n = 0;
+    for (const shard &s: m_shards) {
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      n += s.current.size() + s.previous.size();
+    }
+    return n;
+  }
+
+  void point_cache::clear() {
+    for (shard &s: m_shards) {
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      s.current.clear();
+      s.previous.clear();
+    }
+  }
+
+  bool point_cache::shard::find(point &r, const public_key &p, size_t generation_size) {
+    auto it = current.find(p);
+    if (it != current.end()) {
+      r = it->second;
+      return true;
+    }
+    it = previous.find(p);
+    if (it == previous.end())
+      return false;
+    r = it->second;
+    previous.erase(it);
+    insert(p, r, generation_size);
+    return true;
+  }
+
+  void point_cache::shard::insert(const public_key &p, const point &r, size_t generation_size) {
+    if (current.size() >= generation_size) {
+      previous.clear();
+      previous.swap(current);
+    }
+    current.emplace(p, r);
+  }
+
+  bool point_cache::get_point(void *r, const public_key &p) {
+    static_assert(sizeof(ge_p3) == sizeof(point), "point_cache::point does not match ge_p3");
+    const size_t gen = generation_size();
+    ge_p3 &result = *static_cast<ge_p3*>(r);
+    if (m_max_size == 0)
+      return ge_frombytes_vartime(&result, (const unsigned char*)p.data) == 0;
+    shard &s = get_shard(p);
+    point stored;
+    {
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      if (s.find(stored, p, gen)) {
+        memcpy(&result, &stored, sizeof(stored));
+        return true;
+      }
+    }
+    if (ge_frombytes_vartime(&result, (const unsigned char*)p.data) != 0)
+      return false;
+    memcpy(&stored, &result, sizeof(stored));
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    s.insert(p, stored, gen);
+    return true;
+  }
+
+  void point_cache::add(const public_key *points, size_t count) {
+    const size_t gen = generation_size();
+    if (m_max_size == 0 || count == 0)
+      return;
+
+    std::vector<public_key> missing;
+    missing.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      shard &s = get_shard(points[i]);
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      if (s.current.find(points[i]) == s.current.end() && s.previous.find(points[i]) == s.previous.end())
+        missing.push_back(points[i]);
+    }
+    if (missing.empty())
+      return;
+
+    std::vector<ge_p3> decoded(missing.size());
+    std::vector<bool> valid(missing.size(), true);
+    if (ge_frombytes_vartime_batch(decoded.data(), (const unsigned char*)missing[0].data, missing.size()) != 0) {
+      // some outputs on the chain do not have valid keys: decode one by one to leave them out
+      for (size_t i = 0; i < missing.size(); ++i)
+        valid[i] = ge_frombytes_vartime(&decoded[i], (const unsigned char*)missing[i].data) == 0;
+    }
+    for (size_t i = 0; i < missing.size(); ++i) {
+      if (!valid[i])
+        continue;
+      point stored;
+      memcpy(&stored, &decoded[i], sizeof(stored));
+      shard &s = get_shard(missing[i]);
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      s.insert(missing[i], stored, gen);
+    }
+  }
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <boost/thread/mutex.hpp>
+
+#include "crypto.h"
+
+namespace crypto {
+
+  /* Bounded cache of decompressed curve points, keyed by their encoding. Ring
+     members which many transactions reference, and their commitments, are then
+     decompressed once instead of once per ring they appear in. The entries are
+     spread over shards which are locked separately, so that verifier threads
+     seldom wait for each other. A cache of size 0, the default, keeps nothing */
+  class point_cache {
+  public:
+    static point_cache &instance();
+
+    void set_max_size(size_t max_points);
+    size_t get_max_size() const { return m_max_size; }
+    size_t size() const;
+    void clear();
+
+    // decompresses p into r, a ge_p3, using and filling the cache; false if p is not a point
+    template<typename ge_p3_type>
+    bool get(ge_p3_type &r, const public_key &p) {
+      static_assert(sizeof(ge_p3_type) == sizeof(point), "point_cache::get needs a ge_p3");
+      return get_point(&r, p);
+    }
+    // decompresses the points which are not cached yet in one batch, and caches them
+    void add(const public_key *points, size_t count);
+
+  private:
+    point_cache();
+
+    // a ge_p3 as stored. crypto.cpp sees crypto-ops.h inside namespace crypto
+    // and the rest of the tree sees it globally, so this header includes it
+    // neither way, and keeps the points as the four field elements they are
+    struct point {
+      int32_t coords[4][10];
+    };
+
+    bool get_point(void *r, const public_key &p);
+
+    // each shard keeps two generations: when the current one is full it becomes
+    // the previous one, and hits in the previous one are moved back to the current
+    struct shard {
+      mutable boost::mutex lock;
+      std::unordered_map<public_key, point> current, previous;
+
+      bool find(point &r, const public_key &p, size_t generation_size);
+      void insert(const public_key &p, const point &r, size_t generation_size);
+    };
+
+    enum { SHARDS = 16 };
+    shard &get_shard(const public_key &p) { return m_shards[(unsigned char)p.data[0] % SHARDS]; }
+    size_t generation_size() const { return std::max<size_t>(m_max_size / SHARDS / 2, 1); }
+
+    shard m_shards[SHARDS];
+    std::atomic<size_t> m_max_size;
+  };
+}
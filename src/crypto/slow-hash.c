@@ -155,6 +155,19 @@ union cn_slow_hash_state
 
 THREADV uint8_t *hp_state = NULL;
 THREADV int hp_allocated = 0;
+// the scratchpads of the other ways of cn_slow_hash_multi, hp_state being the first
+THREADV uint8_t *hp_state_extra[CN_SLOW_HASH_MAX_WAYS - 1] = { NULL };
+THREADV int hp_allocated_extra[CN_SLOW_HASH_MAX_WAYS - 1] = { 0 };
+
+// process wide count of the scratchpads allocated so far, and of those on huge pages
+static volatile long hp_scratchpads = 0;
+static volatile long hp_huge_pages = 0;
+
+#if defined(_MSC_VER)
+#define hp_count(x, d) InterlockedExchangeAdd(&(x), (d))
+#else
+#define hp_count(x, d) __sync_fetch_and_add(&(x), (d))
+#endif
 
 #if defined(_MSC_VER)
 #define cpuid(info,x)    __cpuidex(info,x,0)
@@ -421,70 +434,116 @@ BOOL SetLockPagesPrivilege(HANDLE hProcess, BOOL bEnable)
 #endif
 
 /**
- * @brief allocate the 2MB scratch buffer using OS support for huge pages, if available
+ * @brief allocate a 2MB scratch buffer using OS support for huge pages, if available
  *
  * This function tries to allocate the 2MB scratch buffer using a single
  * 2MB "huge page" (instead of the usual 4KB page sizes) to reduce TLB misses
  * during the random accesses to the scratch buffer.  This is one of the
  * important speed optimizations needed to make CryptoNight faster.
  *
- * No parameters.  Updates a thread-local pointer, hp_state, to point to
- * the allocated buffer.
+ * @param allocated set to 1 if the buffer was mapped, 0 if it was malloc'ed
+ * @return the allocated buffer
  */
 
-void slow_hash_allocate_state(void)
+STATIC uint8_t *allocate_scratchpad(int *allocated)
 {
-    if(hp_state != NULL)
-        return;
+    uint8_t *l;
+    int huge = 0;
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
     SetLockPagesPrivilege(GetCurrentProcess(), TRUE);
-    hp_state = (uint8_t *) VirtualAlloc(hp_state, MEMORY, MEM_LARGE_PAGES |
-                                        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    l = (uint8_t *) VirtualAlloc(NULL, MEMORY, MEM_LARGE_PAGES |
+                                 MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    huge = l != NULL;
 #else
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
   defined(__DragonFly__)
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANON, 0, 0);
+    l = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANON, 0, 0);
 #else
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
+    l = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
+    huge = l != MAP_FAILED;
 #endif
-    if(hp_state == MAP_FAILED)
-        hp_state = NULL;
+    if(l == MAP_FAILED)
+        l = NULL;
 #endif
-    hp_allocated = 1;
-    if(hp_state == NULL)
+    *allocated = 1;
+    if(l == NULL)
+    {
+        *allocated = 0;
+        l = (uint8_t *) malloc(MEMORY);
+    }
+
+    hp_count(hp_scratchpads, 1);
+    if(huge)
+        hp_count(hp_huge_pages, 1);
+    return l;
+}
+
+STATIC void free_scratchpad(uint8_t *l, int allocated)
+{
+    if(!allocated)
+        free(l);
+    else
     {
-        hp_allocated = 0;
-        hp_state = (uint8_t *) malloc(MEMORY);
+#if defined(_MSC_VER) || defined(__MINGW32__)
+        VirtualFree(l, 0, MEM_RELEASE);
+#else
+        munmap(l, MEMORY);
+#endif
     }
 }
 
 /**
- *@brief frees the state allocated by slow_hash_allocate_state
+ * @brief allocate the 2MB scratch buffer of the calling thread, see allocate_scratchpad
+ *
+ * No parameters.  Updates a thread-local pointer, hp_state, to point to
+ * the allocated buffer.
  */
 
-void slow_hash_free_state(void)
+void slow_hash_allocate_state(void)
 {
-    if(hp_state == NULL)
+    if(hp_state != NULL)
         return;
 
-    if(!hp_allocated)
-        free(hp_state);
-    else
+    hp_state = allocate_scratchpad(&hp_allocated);
+}
+
+/**
+ *@brief frees the state allocated by slow_hash_allocate_state and cn_slow_hash_multi
+ */
+
+void slow_hash_free_state(void)
+{
+    size_t i;
+
+    for(i = 0; i < CN_SLOW_HASH_MAX_WAYS - 1; i++)
     {
-#if defined(_MSC_VER) || defined(__MINGW32__)
-        VirtualFree(hp_state, MEMORY, MEM_RELEASE);
-#else
-        munmap(hp_state, MEMORY);
-#endif
+        if(hp_state_extra[i] != NULL)
+            free_scratchpad(hp_state_extra[i], hp_allocated_extra[i]);
+        hp_state_extra[i] = NULL;
+        hp_allocated_extra[i] = 0;
     }
 
+    if(hp_state == NULL)
+        return;
+
+    free_scratchpad(hp_state, hp_allocated);
     hp_state = NULL;
     hp_allocated = 0;
 }
 
+/**
+ * @brief reports how many scratchpads were allocated process wide, and how many got huge pages
+ */
+
+void slow_hash_get_hugepage_stats(size_t *scratchpads, size_t *huge_pages)
+{
+    *scratchpads = hp_scratchpads;
+    *huge_pages = hp_huge_pages;
+}
+
 /**
  * @brief the hash function implementing CryptoNight, used for the Monero proof-of-work
  *
@@ -645,6 +704,141 @@ void cn_slow_hash(const void *data, size_t length, char *hash)
     extra_hashes[state.hs.b[0] & 3](&state, 200, hash);
 }
 
+/*
+ * One iteration of CryptoNight step 3 for one of the ways of cn_slow_hash_ways,
+ * the same as pre_aes(), _mm_aesenc_si128 and post_aes() on that way's scratchpad.
+ */
+#define multi_round(w) \
+  l = hp[w]; \
+  j = state_index(a[w]); \
+  _c = _mm_load_si128(R128(&l[j])); \
+  _c = _mm_aesenc_si128(_c, _mm_load_si128(R128(a[w]))); \
+  _mm_store_si128(R128(c), _c); \
+  _b[w] = _mm_xor_si128(_b[w], _c); \
+  _mm_store_si128(R128(&l[j]), _b[w]); \
+  j = state_index(c); \
+  p = U64(&l[j]); \
+  b[0] = p[0]; b[1] = p[1]; \
+  __mul(); \
+  a[w][0] += hi; a[w][1] += lo; \
+  p[0] = a[w][0];  p[1] = a[w][1]; \
+  a[w][0] ^= b[0]; a[w][1] ^= b[1]; \
+  _b[w] = _c; \
+
+/*
+ * cn_slow_hash with hardware AES for several inputs at once.  Steps 1, 2, 4
+ * and 5 are done one input after the other, but the iterations of step 3 are
+ * interleaved: each is a chain of dependent, mostly cache missing scratchpad
+ * accesses, so running a few independent ones side by side lets the CPU
+ * overlap their latencies.  Inlined with a constant number of ways, so the
+ * loop over the ways is unrolled.
+ */
+STATIC INLINE void cn_slow_hash_ways(const void *const *data, const size_t *length, char (*hashes)[HASH_SIZE], size_t ways)
+{
+    RDATA_ALIGN16 uint8_t expandedKey[240];
+    uint8_t text[INIT_SIZE_BYTE];
+    RDATA_ALIGN16 uint64_t a[CN_SLOW_HASH_MAX_WAYS][2];
+    RDATA_ALIGN16 uint64_t b[2];
+    RDATA_ALIGN16 uint64_t c[2];
+    union cn_slow_hash_state state[CN_SLOW_HASH_MAX_WAYS];
+    uint8_t *hp[CN_SLOW_HASH_MAX_WAYS];
+    __m128i _b[CN_SLOW_HASH_MAX_WAYS], _c;
+    uint64_t hi, lo;
+    uint8_t *l;
+    size_t i, j, w;
+    uint64_t *p = NULL;
+
+    static void (*const extra_hashes[4])(const void *, size_t, char *) =
+    {
+        hash_extra_blake, hash_extra_groestl, hash_extra_jh, hash_extra_skein
+    };
+
+    if(hp_state == NULL)
+        slow_hash_allocate_state();
+    hp[0] = hp_state;
+    for(w = 1; w < ways; w++)
+    {
+        if(hp_state_extra[w - 1] == NULL)
+            hp_state_extra[w - 1] = allocate_scratchpad(&hp_allocated_extra[w - 1]);
+        hp[w] = hp_state_extra[w - 1];
+    }
+
+    /* Steps 1 and 2, see cn_slow_hash */
+    for(w = 0; w < ways; w++)
+    {
+        hash_process(&state[w].hs, data[w], length[w]);
+        memcpy(text, state[w].init, INIT_SIZE_BYTE);
+        aes_expand_key(state[w].hs.b, expandedKey);
+        for(i = 0; i < MEMORY / INIT_SIZE_BYTE; i++)
+        {
+            aes_pseudo_round(text, text, expandedKey, INIT_SIZE_BLK);
+            memcpy(&hp[w][i * INIT_SIZE_BYTE], text, INIT_SIZE_BYTE);
+        }
+
+        U64(a[w])[0] = U64(&state[w].k[0])[0] ^ U64(&state[w].k[32])[0];
+        U64(a[w])[1] = U64(&state[w].k[0])[1] ^ U64(&state[w].k[32])[1];
+        U64(b)[0] = U64(&state[w].k[16])[0] ^ U64(&state[w].k[48])[0];
+        U64(b)[1] = U64(&state[w].k[16])[1] ^ U64(&state[w].k[48])[1];
+        _b[w] = _mm_load_si128(R128(b));
+    }
+
+    /* Step 3, interleaved */
+    for(i = 0; i < ITER / 2; i++)
+    {
+        for(w = 0; w < ways; w++)
+        {
+            multi_round(w);
+        }
+    }
+
+    /* Steps 4 and 5 */
+    for(w = 0; w < ways; w++)
+    {
+        memcpy(text, state[w].init, INIT_SIZE_BYTE);
+        aes_expand_key(&state[w].hs.b[32], expandedKey);
+        for(i = 0; i < MEMORY / INIT_SIZE_BYTE; i++)
+            aes_pseudo_round_xor(text, text, expandedKey, &hp[w][i * INIT_SIZE_BYTE], INIT_SIZE_BLK);
+
+        memcpy(state[w].init, text, INIT_SIZE_BYTE);
+        hash_permutation(&state[w].hs);
+        extra_hashes[state[w].hs.b[0] & 3](&state[w], 200, hashes[w]);
+    }
+}
+
+/**
+ * @brief computes count CryptoNight hashes on the calling thread, interleaving them
+ *
+ * See cn_slow_hash_ways.  Without hardware AES, the AES rounds dominate and
+ * there is nothing to gain, so the hashes are computed one after the other.
+ *
+ * @param data the data to hash, one pointer per hash
+ * @param length the length in bytes of each data
+ * @param count the number of hashes, at most CN_SLOW_HASH_MAX_WAYS
+ * @param hashes where to store the hashes
+ */
+
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t count, char (*hashes)[HASH_SIZE])
+{
+    size_t i;
+
+    assert(count <= CN_SLOW_HASH_MAX_WAYS);
+    if(force_software_aes() || !check_aes_hw())
+    {
+        for(i = 0; i < count; i++)
+            cn_slow_hash(data[i], length[i], hashes[i]);
+        return;
+    }
+
+    switch(count)
+    {
+    case 0: break;
+    case 1: cn_slow_hash(data[0], length[0], hashes[0]); break;
+    case 2: cn_slow_hash_ways(data, length, hashes, 2); break;
+    case 3: cn_slow_hash_ways(data, length, hashes, 3); break;
+    default: cn_slow_hash_ways(data, length, hashes, 4); break;
+    }
+}
+
 #elif !defined NO_AES && (defined(__arm__) || defined(__aarch64__))
 void slow_hash_allocate_state(void)
 {
@@ -1282,3 +1476,21 @@ void cn_slow_hash(const void *data, size_t length, char *hash) {
 }
 
 #endif
+
+#if defined NO_AES || !(defined(__x86_64__) || (defined(_MSC_VER) && defined(_WIN64)))
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t count, char (*hashes)[HASH_SIZE])
+{
+  size_t i;
+
+  assert(count <= CN_SLOW_HASH_MAX_WAYS);
+  for (i = 0; i < count; i++)
+    cn_slow_hash(data[i], length[i], hashes[i]);
+}
+
+void slow_hash_get_hugepage_stats(size_t *scratchpads, size_t *huge_pages)
+{
+  // these implementations do not use a separately allocated scratchpad
+  *scratchpads = 0;
+  *huge_pages = 0;
+}
+#endif
@@ -35,6 +35,7 @@ using namespace epee;
 #include <iostream>
 #include "cryptonote_format_utils.h"
 #include "cryptonote_config.h"
+#include "common/int-util.h"
 #include "crypto/crypto.h"
 #include "crypto/hash.h"
 #include "ringct/rctSigs.h"
@@ -722,6 +723,19 @@ namespace cryptonote
     return h;
   }
   //---------------------------------------------------------------
+  uint64_t get_transaction_short_id(const crypto::hash& tx_hash, uint64_t salt)
+  {
+    // salted, so which txes share a short id can't be known without the salt
+    char data[sizeof(salt) + sizeof(tx_hash)];
+    salt = SWAP64LE(salt);
+    memcpy(data, &salt, sizeof(salt));
+    memcpy(data + sizeof(salt), &tx_hash, sizeof(tx_hash));
+    const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+    uint64_t short_id;
+    memcpy(&short_id, &h, sizeof(short_id));
+    return SWAP64LE(short_id);
+  }
+  //---------------------------------------------------------------
   bool get_transaction_hash(const transaction& t, crypto::hash& res)
   {
     return get_transaction_hash(t, res, NULL);
@@ -902,6 +916,27 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  bool get_block_longhashes(const block *blocks, size_t count, crypto::hash *res, uint64_t height)
+  {
+    CHECK_AND_ASSERT_MES(count <= CN_SLOW_HASH_MAX_WAYS, false, "Too many blocks to hash at once: " << count);
+    blobdata bd[CN_SLOW_HASH_MAX_WAYS];
+    const void *data[CN_SLOW_HASH_MAX_WAYS];
+    size_t length[CN_SLOW_HASH_MAX_WAYS];
+    for (size_t i = 0; i < count; ++i)
+    {
+      bd[i] = get_block_hashing_blob(blocks[i]);
+      data[i] = bd[i].data();
+      length[i] = bd[i].size();
+    }
+    crypto::cn_slow_hash_multi(data, length, count, res);
+
+    // block 202612 bug workaround, as in get_block_longhash
+    for (size_t i = 0; i < count; ++i)
+      if (height + i == 202612)
+        get_block_longhash(blocks[i], res[i], height + i);
+    return true;
+  }
+  //---------------------------------------------------------------
   std::vector<uint64_t> relative_output_offsets_to_absolute(const std::vector<uint64_t>& off)
   {
     std::vector<uint64_t> res = off;
@@ -162,4 +162,57 @@ namespace cryptonote {
     return (low + time_span - 1) / time_span;
   }
 
+  difficulty_window::difficulty_window(size_t capacity): m_blocks(capacity), m_start_height(0) {
+  }
+
+  void difficulty_window::reset(uint64_t height) {
+    m_blocks.clear();
+    m_start_height = height;
+  }
+
+  void difficulty_window::push_back(uint64_t timestamp, difficulty_type cumulative_difficulty) {
+    if (m_blocks.full()) {
+      ++m_start_height;
+    }
+    m_blocks.push_back({timestamp, cumulative_difficulty});
+  }
+
+  void difficulty_window::pop_back() {
+    if (!m_blocks.empty()) {
+      m_blocks.pop_back();
+    }
+  }
+
+  bool difficulty_window::push_front(uint64_t timestamp, difficulty_type cumulative_difficulty) {
+    if (m_blocks.full() || m_start_height == 0) {
+      return false;
+    }
+    m_blocks.push_front({timestamp, cumulative_difficulty});
+    --m_start_height;
+    return true;
+  }
+
+  bool difficulty_window::get(uint64_t start, uint64_t stop, vector<uint64_t> *timestamps, vector<difficulty_type> *cumulative_difficulties) const {
+    if (!contains(start, stop)) {
+      return false;
+    }
+    const size_t count = stop - start;
+    if (timestamps) {
+      timestamps->reserve(timestamps->size() + count);
+    }
+    if (cumulative_difficulties) {
+      cumulative_difficulties->reserve(cumulative_difficulties->size() + count);
+    }
+    for (size_t i = start - m_start_height; i < stop - m_start_height; ++i) {
+      const block_data &b = m_blocks[i];
+      if (timestamps) {
+        timestamps->push_back(b.timestamp);
+      }
+      if (cumulative_difficulties) {
+        cumulative_difficulties->push_back(b.cumulative_difficulty);
+      }
+    }
+    return true;
+  }
+
 }
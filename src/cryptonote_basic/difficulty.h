@@ -32,6 +32,7 @@
 
 #include <cstdint>
 #include <vector>
+#include <boost/circular_buffer.hpp>
 
 #include "crypto/hash.h"
 
@@ -53,4 +54,93 @@ namespace cryptonote
      */
     bool check_hash(const crypto::hash &hash, difficulty_type difficulty);
     difficulty_type next_difficulty(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
+
+    /**
+     * @brief a fixed capacity window of per-block timestamps and cumulative difficulties
+     *
+     * The window holds the data of a run of consecutive blocks, from
+     * start_height() up to (but excluding) height().  Blocks are added and
+     * removed at the tip as the chain grows or is popped, and older blocks
+     * can be prepended to extend the window backwards, up to its capacity.
+     * When full, adding a block at the tip drops the oldest one.
+     */
+    class difficulty_window
+    {
+    public:
+      /**
+       * @brief constructor
+       *
+       * @param capacity the maximum number of blocks held
+       */
+      difficulty_window(size_t capacity);
+
+      /**
+       * @brief empties the window and moves it to a given height
+       *
+       * @param height the height of the next block to be added
+       */
+      void reset(std::uint64_t height);
+
+      /**
+       * @brief adds the block at height() to the tip of the window
+       *
+       * @param timestamp the block's timestamp
+       * @param cumulative_difficulty the block's cumulative difficulty
+       */
+      void push_back(std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+
+      /**
+       * @brief removes the block at the tip of the window
+       *
+       * Does nothing if the window is empty.
+       */
+      void pop_back();
+
+      /**
+       * @brief adds the block at start_height() - 1 to the front of the window
+       *
+       * @param timestamp the block's timestamp
+       * @param cumulative_difficulty the block's cumulative difficulty
+       *
+       * @return false if the window is full or starts at height 0, otherwise true
+       */
+      bool push_front(std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+
+      /**
+       * @brief copies the data for the blocks in [start, stop) to the given vectors
+       *
+       * The data is appended to the vectors, oldest block first.  Either
+       * vector pointer may be NULL if that data is not wanted.
+       *
+       * @param start the height of the first block to copy
+       * @param stop the height after the last block to copy
+       * @param timestamps return-by-pointer the blocks' timestamps
+       * @param cumulative_difficulties return-by-pointer the blocks' cumulative difficulties
+       *
+       * @return false if the range is not entirely within the window, otherwise true
+       */
+      bool get(std::uint64_t start, std::uint64_t stop, std::vector<std::uint64_t> *timestamps, std::vector<difficulty_type> *cumulative_difficulties) const;
+
+      /**
+       * @brief checks whether the blocks in [start, stop) are all within the window
+       */
+      bool contains(std::uint64_t start, std::uint64_t stop) const { return start >= m_start_height && start <= stop && stop <= height(); }
+
+      std::uint64_t start_height() const { return m_start_height; }
+      std::uint64_t height() const { return m_start_height + m_blocks.size(); }
+      size_t size() const { return m_blocks.size(); }
+      size_t capacity() const { return m_blocks.capacity(); }
+      bool empty() const { return m_blocks.empty(); }
+      bool full() const { return m_blocks.full(); }
+
+    private:
+      struct block_data
+      {
+        std::uint64_t timestamp;
+        difficulty_type cumulative_difficulty;
+      };
+
+      boost::circular_buffer<block_data> m_blocks;
+      std::uint64_t m_start_height;
+    };
 }
@@ -94,6 +94,9 @@
 
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                    86400 //seconds, one day
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     604800 //seconds, one week
+#define DEFAULT_TXPOOL_MAX_SIZE                           648000000ull // 3 days at 300000, in bytes
+#define TXPOOL_EVICTED_FILTER_GENERATION_SIZE             50000 // evicted txes remembered per filter generation
+#define TXPOOL_PARSED_TX_CACHE_SIZE                       (32*1024*1024) // total blob size of the txes kept parsed, in bytes
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
 
@@ -117,7 +120,17 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_TX_ANNOUNCE                    0x02
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_TX_ANNOUNCE)
+
+#define P2P_TX_ANNOUNCE_MAX_REMEMBERED                  16384 // short tx ids announced to a peer which it may still request
+#define P2P_TX_ANNOUNCE_REQUEST_TIMEOUT                 30    // seconds before asking another peer for an announced tx
+#define P2P_TX_ANNOUNCE_MAX_REQUESTED_PER_PEER          1024  // announced txes asked from one peer and not yet received
+#define P2P_TX_ANNOUNCE_MAX_REQUESTED                   16384 // announced txes asked from all peers and not yet received
+#define P2P_TX_ANNOUNCE_MAX_ANNOUNCERS                  8     // other peers remembered for an announced tx, to ask if the first does not send it
+#define P2P_TX_RELAY_AVERAGE_DELAY                      2000  // average milliseconds txes wait in a peer's relay queue
+#define P2P_TX_RELAY_MAX_QUEUED                         256   // txes queued for a peer before they are sent early
+#define P2P_TX_RELAY_STEM_EPOCH                         600   // seconds before picking a new peer to stem txes to
 
 #define ALLOW_DEBUG_COMMANDS
 
@@ -49,6 +49,7 @@
 #include "common/boost_serialization_helper.h"
 #include "warnings.h"
 #include "crypto/hash.h"
+#include "crypto/point_cache.h"
 #include "cryptonote_core.h"
 #include "ringct/rctSigs.h"
 #include "common/perf_timer.h"
@@ -61,6 +62,10 @@
 
 #define FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE (100*1024*1024) // 100 MB
 
+// enough to compute difficulties after popping up to DIFFICULTY_BLOCKS_COUNT
+// blocks, or for alt chains forking up to that deep, without db reads
+#define DIFFICULTY_WINDOW_CACHE_SIZE (2 * (DIFFICULTY_BLOCKS_COUNT))
+
 using namespace crypto;
 
 //#include "serialization/json_archive.h"
@@ -76,6 +81,19 @@ using epee::string_tools::pod_to_hex;
 extern "C" void slow_hash_allocate_state();
 extern "C" void slow_hash_free_state();
 
+// Says once if some PoW scratchpads could not get huge pages, which makes hashing slower
+static void report_pow_hugepages()
+{
+  static bool reported = false;
+  size_t scratchpads, huge_pages;
+  slow_hash_get_hugepage_stats(&scratchpads, &huge_pages);
+  if (reported || huge_pages == scratchpads)
+    return;
+  MGINFO("Only " << huge_pages << " of " << scratchpads << " PoW scratchpads could be allocated on huge pages, "
+      "reserving huge pages (vm.nr_hugepages on Linux) would speed up block verification");
+  reported = true;
+}
+
 DISABLE_VS_WARNINGS(4267)
 
 #define MERROR_VER(x) MCERROR("verify", x)
@@ -133,8 +151,8 @@ static const uint64_t testnet_hard_fork_version_1_till = 624633;
 
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
-  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_sz_limit(0),
-  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_blocks_per_sync(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_cancel(false)
+  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_difficulty_window(DIFFICULTY_WINDOW_CACHE_SIZE), m_block_sizes_median(CRYPTONOTE_REWARD_BLOCKS_WINDOW), m_block_sizes_median_height(0), m_current_block_cumul_sz_limit(0),
+  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_pow_hash_ways(1), m_db_blocks_per_sync(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_block_processing_stats(), m_sync_counter(0), m_cancel(false)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -500,8 +518,6 @@ block Blockchain::pop_block_from_blockchain()
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   block popped_block;
   std::vector<transaction> popped_txs;
 
@@ -522,6 +538,21 @@ block Blockchain::pop_block_from_blockchain()
     throw;
   }
 
+  // keep the difficulty window in step with the chain, if it was tracking it
+  if (m_difficulty_window.height() == m_db->height() + 1)
+  {
+    m_difficulty_window.pop_back();
+    m_difficulty_window_top_hash = popped_block.prev_id;
+  }
+  if (m_block_sizes_median_height == m_db->height() + 1)
+  {
+    m_block_sizes_median.pop_back();
+    m_block_sizes_median_height = m_db->height();
+    m_block_sizes_median_top_hash = popped_block.prev_id;
+    if (m_block_sizes_median_height >= CRYPTONOTE_REWARD_BLOCKS_WINDOW)
+      m_block_sizes_median.push_front(m_db->get_block_size(m_block_sizes_median_height - CRYPTONOTE_REWARD_BLOCKS_WINDOW));
+  }
+
   // return transactions from popped block to the tx_pool
   for (transaction& tx : popped_txs)
   {
@@ -561,7 +592,9 @@ bool Blockchain::reset_and_set_genesis_block(const block& b)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
+  m_difficulty_window.reset(0);
+  m_block_sizes_median.clear();
+  m_block_sizes_median_height = 0;
   m_alternative_chains.clear();
   m_db->reset();
   m_hardfork->init();
@@ -730,6 +763,73 @@ void Blockchain::get_all_known_block_ids(std::list<crypto::hash> &main, std::lis
     invalid.push_back(v.first);
 }
 //------------------------------------------------------------------
+// This function brings the difficulty window in line with the current top
+// of the blockchain, and extends it backwards so that it starts at or before
+// start_height, as far as its capacity allows.  Only the blocks which are not
+// already in the window are read from the db.
+void Blockchain::update_difficulty_window(uint64_t start_height) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint64_t height = m_db->height();
+  if (height == 0)
+  {
+    m_difficulty_window.reset(0);
+    return;
+  }
+
+  // Blocks added through handle_block_to_main_chain and popped through
+  // pop_block_from_blockchain are mirrored in the window, so if it ends at
+  // the top of the db, it is current.  The db can be modified from elsewhere
+  // too (eg, when importing), which leaves the window behind or ahead, so if
+  // behind, make sure the block it ends with is still in the main chain.
+  bool stale = m_difficulty_window.empty() || m_difficulty_window.height() > height || height - m_difficulty_window.height() > m_difficulty_window.capacity();
+  if (!stale && m_difficulty_window.height() < height)
+    stale = m_db->get_block_hash_from_height(m_difficulty_window.height() - 1) != m_difficulty_window_top_hash;
+  if (stale)
+  {
+    m_difficulty_window.reset(height);
+    m_difficulty_window_top_hash = m_db->top_block_hash();
+  }
+  else if (m_difficulty_window.height() < height)
+  {
+    for (uint64_t h = m_difficulty_window.height(); h < height; ++h)
+      m_difficulty_window.push_back(m_db->get_block_timestamp(h), m_db->get_block_cumulative_difficulty(h));
+    m_difficulty_window_top_hash = m_db->top_block_hash();
+  }
+
+  while (m_difficulty_window.start_height() > start_height && !m_difficulty_window.full())
+  {
+    const uint64_t h = m_difficulty_window.start_height() - 1;
+    m_difficulty_window.push_front(m_db->get_block_timestamp(h), m_db->get_block_cumulative_difficulty(h));
+  }
+}
+//------------------------------------------------------------------
+// This function appends the timestamps and cumulative difficulties of the
+// main chain blocks in [start_height, stop_height) to the given vectors,
+// serving them from the difficulty window when it covers that range, and
+// from the db otherwise.
+void Blockchain::get_difficulty_window_data(uint64_t start_height, uint64_t stop_height, std::vector<uint64_t> *timestamps, std::vector<difficulty_type> *cumulative_difficulties) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  if (start_height >= stop_height)
+    return;
+
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  update_difficulty_window(start_height);
+  if (m_difficulty_window.get(start_height, stop_height, timestamps, cumulative_difficulties))
+    return;
+
+  // too deep for the window, this is only expected with long reorgs
+  for (uint64_t h = start_height; h < stop_height; ++h)
+  {
+    if (timestamps)
+      timestamps->push_back(m_db->get_block_timestamp(h));
+    if (cumulative_difficulties)
+      cumulative_difficulties->push_back(m_db->get_block_cumulative_difficulty(h));
+  }
+}
+//------------------------------------------------------------------
 // This function aggregates the cumulative difficulties and timestamps of the
 // last DIFFICULTY_BLOCKS_COUNT blocks and passes them to next_difficulty,
 // returning the result of that call.  Ignores the genesis block, and can use
@@ -740,45 +840,14 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   std::vector<uint64_t> timestamps;
   std::vector<difficulty_type> difficulties;
-  auto height = m_db->height();
-  // ND: Speedup
-  // 1. Keep a list of the last 735 (or less) blocks that is used to compute difficulty,
-  //    then when the next block difficulty is queried, push the latest height data and
-  //    pop the oldest one from the list. This only requires 1x read per height instead
-  //    of doing 735 (DIFFICULTY_BLOCKS_COUNT).
-  if (m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1))
-  {
-    uint64_t index = height - 1;
-    m_timestamps.push_back(m_db->get_block_timestamp(index));
-    m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
-
-    while (m_timestamps.size() > DIFFICULTY_BLOCKS_COUNT)
-      m_timestamps.erase(m_timestamps.begin());
-    while (m_difficulties.size() > DIFFICULTY_BLOCKS_COUNT)
-      m_difficulties.erase(m_difficulties.begin());
-
-    m_timestamps_and_difficulties_height = height;
-    timestamps = m_timestamps;
-    difficulties = m_difficulties;
-  }
-  else
-  {
-    size_t offset = height - std::min < size_t > (height, static_cast<size_t>(DIFFICULTY_BLOCKS_COUNT));
-    if (offset == 0)
-      ++offset;
+  const uint64_t height = m_db->height();
+  uint64_t start_height = height - std::min<uint64_t>(height, DIFFICULTY_BLOCKS_COUNT);
+  if (start_height == 0)
+    ++start_height; // skip genesis block
 
-    timestamps.clear();
-    difficulties.clear();
-    for (; offset < height; offset++)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-      difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
-    }
+  // the difficulty window only reads the blocks added since the last call
+  get_difficulty_window_data(start_height, height, &timestamps, &difficulties);
 
-    m_timestamps_and_difficulties_height = height;
-    m_timestamps = timestamps;
-    m_difficulties = difficulties;
-  }
   size_t target = get_difficulty_target();
   return next_difficulty(timestamps, difficulties, target);
 }
@@ -797,8 +866,6 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
     return true;
   }
 
-  m_timestamps_and_difficulties_height = 0;
-
   // remove blocks from blockchain until we get back to where we should be.
   while (m_db->height() != rollback_height)
   {
@@ -833,8 +900,6 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   // if empty alt chain passed (not sure how that could happen), return false
   CHECK_AND_ASSERT_MES(alt_chain.size(), false, "switch_to_alternative_blockchain: empty chain passed");
 
@@ -945,11 +1010,7 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
       ++main_chain_start_offset; //skip genesis block
 
     // get difficulties and timestamps from relevant main chain blocks
-    for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
-      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
-    }
+    get_difficulty_window_data(main_chain_start_offset, main_chain_stop_offset, &timestamps, &cumulative_difficulties);
 
     // make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
     CHECK_AND_ASSERT_MES((alt_chain.size() + timestamps.size()) <= DIFFICULTY_BLOCKS_COUNT, false, "Internal error, alt_chain.size()[" << alt_chain.size() << "] + vtimestampsec.size()[" << timestamps.size() << "] NOT <= DIFFICULTY_WINDOW[]" << DIFFICULTY_BLOCKS_COUNT);
@@ -1036,9 +1097,7 @@ bool Blockchain::validate_miner_transaction(const block& b, size_t cumulative_bl
     }
   }
 
-  std::vector<size_t> last_blocks_sizes;
-  get_last_n_blocks_sizes(last_blocks_sizes, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-  if (!get_block_reward(epee::misc_utils::median(last_blocks_sizes), cumulative_block_size, already_generated_coins, base_reward, version))
+  if (!get_block_reward(get_block_sizes_median(), cumulative_block_size, already_generated_coins, base_reward, version))
   {
     MERROR_VER("block size " << cumulative_block_size << " is bigger than allowed for this blockchain");
     return false;
@@ -1091,6 +1150,40 @@ void Blockchain::get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count)
   m_db->block_txn_stop();
 }
 //------------------------------------------------------------------
+size_t Blockchain::get_block_sizes_median() const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint64_t height = m_db->height();
+
+  // as with the difficulty window, the db may have been changed behind our
+  // back, so check the last block we saw is still where we saw it
+  bool stale = m_block_sizes_median_height == 0 || m_block_sizes_median_height > height;
+  if (!stale)
+  {
+    const crypto::hash top_hash = m_block_sizes_median_height == height ? m_db->top_block_hash() : m_db->get_block_hash_from_height(m_block_sizes_median_height - 1);
+    stale = top_hash != m_block_sizes_median_top_hash;
+  }
+  if (stale)
+  {
+    m_block_sizes_median.clear();
+    m_block_sizes_median_height = height - std::min<uint64_t>(height, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
+  }
+  if (m_block_sizes_median_height < height)
+  {
+    // no point in adding sizes which would be pushed out straight away
+    if (height - m_block_sizes_median_height > CRYPTONOTE_REWARD_BLOCKS_WINDOW)
+      m_block_sizes_median_height = height - CRYPTONOTE_REWARD_BLOCKS_WINDOW;
+    m_db->block_txn_start(true);
+    for (uint64_t h = m_block_sizes_median_height; h < height; ++h)
+      m_block_sizes_median.push_back(m_db->get_block_size(h));
+    m_db->block_txn_stop();
+    m_block_sizes_median_height = height;
+    m_block_sizes_median_top_hash = m_db->top_block_hash();
+  }
+  return m_block_sizes_median.median();
+}
+//------------------------------------------------------------------
 uint64_t Blockchain::get_current_cumulative_blocksize_limit() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -1274,11 +1367,7 @@ bool Blockchain::complete_timestamps_vector(uint64_t start_top_height, std::vect
   size_t need_elements = BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW - timestamps.size();
   CHECK_AND_ASSERT_MES(start_top_height < m_db->height(), false, "internal error: passed start_height not < " << " m_db->height() -- " << start_top_height << " >= " << m_db->height());
   size_t stop_offset = start_top_height > need_elements ? start_top_height - need_elements : 0;
-  while (start_top_height != stop_offset)
-  {
-    timestamps.push_back(m_db->get_block_timestamp(start_top_height));
-    --start_top_height;
-  }
+  get_difficulty_window_data(stop_offset + 1, start_top_height + 1, &timestamps, NULL);
   return true;
 }
 //------------------------------------------------------------------
@@ -1292,7 +1381,6 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
   uint64_t block_height = get_block_height(b);
   if(0 == block_height)
   {
@@ -2531,7 +2619,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height)
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, ring_signature_batch *ring_sigs)
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2701,7 +2789,19 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
     if (tx.version == 1)
     {
-      if (threads > 1)
+      if (ring_sigs)
+      {
+        // checked along with the rest of the block's, see verify_ring_signatures
+        ring_sigs->entries.push_back(ring_signature_batch::entry());
+        ring_signature_batch::entry &e = ring_sigs->entries.back();
+        e.tx_id = get_transaction_hash(tx);
+        e.tx_prefix_hash = tx_prefix_hash;
+        e.key_image = in_to_key.k_image;
+        e.pubkeys = std::move(pubkeys[sig_index]);
+        e.signatures = tx.signatures[sig_index];
+        e.result = 0;
+      }
+      else if (threads > 1)
       {
         // ND: Speedup
         // 1. Thread ring signature verification if possible.
@@ -2728,12 +2828,12 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
     sig_index++;
   }
-  if (tx.version == 1 && threads > 1)
+  if (tx.version == 1 && threads > 1 && !ring_sigs)
     waiter.wait();
 
   if (tx.version == 1)
   {
-    if (threads > 1)
+    if (threads > 1 && !ring_sigs)
     {
       // save results to table, passed or otherwise
       bool failed = false;
@@ -2910,6 +3010,41 @@ void Blockchain::check_ring_signature(const crypto::hash &tx_prefix_hash, const
   result = crypto::check_ring_signature(tx_prefix_hash, key_image, p_output_keys, sig.data()) ? 1 : 0;
 }
 
+//------------------------------------------------------------------
+bool Blockchain::verify_ring_signatures(ring_signature_batch &ring_sigs, crypto::hash &failed_tx_id)
+{
+  PERF_TIMER(verify_ring_signatures);
+  LOG_PRINT_L3("Blockchain::" << __func__);
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  const int threads = tpool.get_max_concurrency();
+
+  for (auto &e: ring_sigs.entries)
+  {
+    if (threads > 1)
+      tpool.submit(&waiter, boost::bind(&Blockchain::check_ring_signature, this, std::cref(e.tx_prefix_hash), std::cref(e.key_image), std::cref(e.pubkeys), std::cref(e.signatures), std::ref(e.result)));
+    else
+      check_ring_signature(e.tx_prefix_hash, e.key_image, e.pubkeys, e.signatures, e.result);
+  }
+  if (threads > 1)
+    waiter.wait();
+
+  // save results to table, passed or otherwise
+  bool failed = false;
+  for (const auto &e: ring_sigs.entries)
+  {
+    m_check_txin_table[e.tx_prefix_hash][e.key_image] = e.result;
+    if (!failed && !e.result)
+    {
+      MERROR_VER("Failed to check ring signature for tx " << e.tx_id << "  vin key with k_image: " << e.key_image);
+      failed_tx_id = e.tx_id;
+      failed = true;
+    }
+  }
+  return !failed;
+}
+
 //------------------------------------------------------------------
 static uint64_t get_fee_quantization_mask()
 {
@@ -3154,10 +3289,7 @@ bool Blockchain::check_block_timestamp(const block& b) const
 
   // need most recent 60 blocks, get index of first of those
   size_t offset = h - BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW;
-  for(;offset < h; ++offset)
-  {
-    timestamps.push_back(m_db->get_block_timestamp(offset));
-  }
+  get_difficulty_window_data(offset, h, &timestamps, NULL);
 
   return check_block_timestamp(timestamps, b);
 }
@@ -3314,7 +3446,12 @@ leave:
       proof_of_work = it->second;
     }
     else
+    {
+      TIME_MEASURE_NS_START(pow_ns);
       proof_of_work = get_block_longhash(bl, m_db->height());
+      TIME_MEASURE_NS_FINISH(pow_ns);
+      m_block_processing_stats.pow_ns += pow_ns;
+    }
 
     // validate proof_of_work versus difficulty target
     if(!check_hash(proof_of_work, current_diffic))
@@ -3356,6 +3493,7 @@ leave:
 
   std::vector<transaction> txs;
   key_images_container keys;
+  ring_signature_batch ring_sigs;
 
   uint64_t fee_summary = 0;
   uint64_t t_checktx = 0;
@@ -3431,7 +3569,11 @@ leave:
     {
       // validate that transaction inputs and the keys spending them are correct.
       tx_verification_context tvc;
-      if(!check_tx_inputs(tx, tvc))
+      TIME_MEASURE_NS_START(tx_check_ns);
+      const bool inputs_ok = check_tx_inputs(tx, tvc, NULL, &ring_sigs);
+      TIME_MEASURE_NS_FINISH(tx_check_ns);
+      m_block_processing_stats.tx_check_ns += tx_check_ns;
+      if(!inputs_ok)
       {
         MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
 
@@ -3468,6 +3610,26 @@ leave:
 
   m_blocks_txs_check.clear();
 
+  // v1 ring signatures were only queued above, check them all at once so
+  // the threadpool is kept busy even if the block is made of small txes
+  if (!ring_sigs.entries.empty())
+  {
+    crypto::hash failed_tx_id = null_hash;
+    TIME_MEASURE_NS_START(ring_sigs_ns);
+    const bool ring_sigs_ok = verify_ring_signatures(ring_sigs, failed_tx_id);
+    TIME_MEASURE_NS_FINISH(ring_sigs_ns);
+    m_block_processing_stats.tx_check_ns += ring_sigs_ns;
+    if (!ring_sigs_ok)
+    {
+      MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << failed_tx_id << ") with wrong inputs.");
+      add_block_as_invalid(bl, id);
+      MERROR_VER("Block with id " << id << " added as invalid because of wrong inputs in transactions");
+      bvc.m_verifivation_failed = true;
+      return_tx_to_pool(txs);
+      goto leave;
+    }
+  }
+
   TIME_MEASURE_START(vmt);
   uint64_t base_reward = 0;
   uint64_t already_generated_coins = m_db->height() ? m_db->get_block_already_generated_coins(m_db->height() - 1) : 0;
@@ -3500,6 +3662,7 @@ leave:
 
   m_db->block_txn_stop();
   TIME_MEASURE_START(addblock);
+  TIME_MEASURE_NS_START(db_write_ns);
   uint64_t new_height = 0;
   if (!bvc.m_verifivation_failed)
   {
@@ -3527,7 +3690,18 @@ leave:
     LOG_ERROR("Blocks that failed verification should not reach here");
   }
 
+  // keep the difficulty window in step with the chain, if it was tracking it
+  if (!m_difficulty_window.empty() && m_difficulty_window.height() + 1 == new_height && m_difficulty_window_top_hash == bl.prev_id)
+  {
+    m_difficulty_window.push_back(bl.timestamp, cumulative_difficulty);
+    m_difficulty_window_top_hash = id;
+  }
+
   TIME_MEASURE_FINISH(addblock);
+  TIME_MEASURE_NS_FINISH(db_write_ns);
+  m_block_processing_stats.db_write_ns += db_write_ns;
+  ++m_block_processing_stats.blocks;
+  m_block_processing_stats.txes += bl.tx_hashes.size();
 
   // do this after updating the hard fork state since the size limit may change due to fork
   update_next_cumulative_size_limit();
@@ -3551,15 +3725,64 @@ leave:
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::check_block_header_and_pow(const block& bl, const crypto::hash& id)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  if (bl.prev_id != get_tail_id())
+  {
+    MDEBUG("Block " << id << " does not build on the top block");
+    return false;
+  }
+
+  if (!m_hardfork->check(bl))
+  {
+    MERROR_VER("Block with id: " << id << std::endl << "has old version: " << (unsigned)bl.major_version << std::endl << "current: " << (unsigned)m_hardfork->get_current_version());
+    return false;
+  }
+
+  if (!check_block_timestamp(bl))
+  {
+    MERROR_VER("Block with id: " << id << std::endl << "has invalid timestamp: " << bl.timestamp);
+    return false;
+  }
+
+  const uint64_t height = m_db->height();
+  if (!prevalidate_miner_transaction(bl, height))
+  {
+    MERROR_VER("Block with id: " << id << " failed to pass prevalidation");
+    return false;
+  }
+
+  if (m_checkpoints.is_in_checkpoint_zone(height) && !m_checkpoints.check_block(height, id))
+  {
+    LOG_ERROR("CHECKPOINT VALIDATION FAILED");
+    return false;
+  }
+
+  difficulty_type current_diffic = get_difficulty_for_next_block();
+  CHECK_AND_ASSERT_MES(current_diffic, false, "!!!!!!!!! difficulty overhead !!!!!!!!!");
+
+  crypto::hash proof_of_work = get_block_longhash(bl, height);
+  if (!check_hash(proof_of_work, current_diffic))
+  {
+    MERROR_VER("Block with id: " << id << std::endl << "does not have enough proof of work: " << proof_of_work << std::endl << "unexpected difficulty: " << current_diffic);
+    return false;
+  }
+
+  // handle_block_to_main_chain will pick this up instead of hashing again,
+  // it is cleared in cleanup_handle_incoming_blocks
+  m_blocks_longhash_table[id] = proof_of_work;
+  return true;
+}
+//------------------------------------------------------------------
 bool Blockchain::update_next_cumulative_size_limit()
 {
   uint64_t full_reward_zone = get_min_block_size(get_current_hard_fork_version());
 
   LOG_PRINT_L3("Blockchain::" << __func__);
-  std::vector<size_t> sz;
-  get_last_n_blocks_sizes(sz, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-
-  uint64_t median = epee::misc_utils::median(sz);
+  uint64_t median = get_block_sizes_median();
   if(median <= full_reward_zone)
     median = full_reward_zone;
 
@@ -3683,13 +3906,16 @@ void Blockchain::block_longhash_worker(uint64_t height, const std::vector<block>
   TIME_MEASURE_START(t);
   slow_hash_allocate_state();
 
-  for (const auto & block : blocks)
+  const size_t ways = std::max<size_t>(1, std::min<size_t>(m_pow_hash_ways, CN_SLOW_HASH_MAX_WAYS));
+  crypto::hash pow[CN_SLOW_HASH_MAX_WAYS];
+  for (size_t n = 0; n < blocks.size(); n += ways)
   {
     if (m_cancel)
        break;
-    crypto::hash id = get_block_hash(block);
-    crypto::hash pow = get_block_longhash(block, height++);
-    map.emplace(id, pow);
+    const size_t count = std::min(ways, blocks.size() - n);
+    get_block_longhashes(&blocks[n], count, pow, height + n);
+    for (size_t i = 0; i < count; ++i)
+      map.emplace(get_block_hash(blocks[n + i]), pow[i]);
   }
 
   slow_hash_free_state();
@@ -3768,6 +3994,21 @@ void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uin
   try
   {
     m_db->get_output_key(amount, offsets, outputs, true);
+
+    // decompress the ring members here, on the scan threads, so the verifiers find them cached
+    crypto::point_cache &cache = crypto::point_cache::instance();
+    if (cache.get_max_size() > 0)
+    {
+      std::vector<crypto::public_key> points;
+      points.reserve(amount == 0 ? 2 * outputs.size() : outputs.size());
+      for (const output_data_t &od: outputs)
+      {
+        points.push_back(od.pubkey);
+        if (amount == 0)
+          points.push_back(rct::rct2pk(od.commitment));
+      }
+      cache.add(points.data(), points.size());
+    }
   }
   catch (const std::exception& e)
   {
@@ -3997,6 +4238,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
 
     if (!blocks_exist)
     {
+      TIME_MEASURE_NS_START(pow_ns);
       m_blocks_longhash_table.clear();
       uint64_t thread_height = height;
       tools::threadpool::waiter waiter;
@@ -4007,6 +4249,9 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
       }
 
       waiter.wait();
+      TIME_MEASURE_NS_FINISH(pow_ns);
+      m_block_processing_stats.pow_ns += pow_ns;
+      report_pow_hugepages();
 
       if (m_cancel)
          return false;
@@ -4040,6 +4285,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
     MDEBUG("Prepare blocks took: " << prepare << " ms");
 
   TIME_MEASURE_START(scantable);
+  TIME_MEASURE_NS_START(ring_fetch_ns);
 
   // [input] stores all unique amounts found
   std::vector < uint64_t > amounts;
@@ -4210,6 +4456,8 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::list<block_complete_e
   }
 
   TIME_MEASURE_FINISH(scantable);
+  TIME_MEASURE_NS_FINISH(ring_fetch_ns);
+  m_block_processing_stats.ring_fetch_ns += ring_fetch_ns;
   if (total_txs > 0)
   {
     m_fake_scan_time = scantable / total_txs;
@@ -45,6 +45,7 @@
 #include "string_tools.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "common/util.h"
+#include "common/rolling_median.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/difficulty.h"
@@ -231,6 +232,22 @@ namespace cryptonote
      */
     bool cleanup_handle_incoming_blocks(bool force_sync = false);
 
+    /**
+     * @brief checks a new block's header and proof of work, ahead of full verification
+     *
+     * This only passes blocks which build on the current top block, have
+     * a valid version, timestamp and miner transaction prefix, match any
+     * checkpoint, and meet the difficulty target.  The transactions are
+     * not checked.  The proof of work hash is kept so it is not computed
+     * again when the block is then fully verified.
+     *
+     * @param bl the block to check
+     * @param id the hash of the block
+     *
+     * @return true if the block passes these checks, otherwise false
+     */
+    bool check_block_header_and_pow(const block& bl, const crypto::hash& id);
+
     /**
      * @brief search the blockchain for a transaction by hash
      *
@@ -760,6 +777,45 @@ namespace cryptonote
      */
     void set_show_time_stats(bool stats) { m_show_time_stats = stats; }
 
+    /**
+     * @brief set how many block PoW hashes each thread computes at once when preparing blocks
+     *
+     * Each extra hash needs another 2MB scratchpad per thread, so this only
+     * helps if the CPU cache holds them all.
+     *
+     * @param ways between 1 and CN_SLOW_HASH_MAX_WAYS
+     */
+    void set_pow_hash_ways(size_t ways) { m_pow_hash_ways = ways; }
+
+    /**
+     * @brief time spent in the main stages of adding blocks to the main chain
+     *
+     * Times are in nanoseconds, and accumulate until reset.  PoW includes
+     * the hashes precomputed in prepare_handle_incoming_blocks, and ring
+     * fetch is the bulk output key lookup done there.
+     */
+    struct block_processing_stats
+    {
+      uint64_t blocks;
+      uint64_t txes;
+      uint64_t pow_ns;
+      uint64_t ring_fetch_ns;
+      uint64_t tx_check_ns;
+      uint64_t db_write_ns;
+    };
+
+    /**
+     * @brief gets the accumulated block processing times
+     *
+     * @return the stats accumulated since the last reset
+     */
+    const block_processing_stats &get_block_processing_stats() const { return m_block_processing_stats; }
+
+    /**
+     * @brief resets the accumulated block processing times
+     */
+    void reset_block_processing_stats() { m_block_processing_stats = block_processing_stats(); }
+
     /**
      * @brief gets the hardfork voting state object
      *
@@ -921,6 +977,8 @@ namespace cryptonote
     /**
      * @brief computes the "short" and "long" hashes for a set of blocks
      *
+     * The long hashes are computed m_pow_hash_ways at a time.
+     *
      * @param height the height of the first block
      * @param blocks the blocks to be hashed
      * @param map return-by-reference the hashes for each block
@@ -977,6 +1035,26 @@ namespace cryptonote
 
     typedef std::map<uint64_t, std::vector<std::pair<crypto::hash, size_t>>> outputs_container; //crypto::hash - tx hash, size_t - index of out in transaction
 
+    /**
+     * @brief v1 ring signatures queued by check_tx_inputs, to be checked later
+     *
+     * Holds everything check_ring_signature needs for each input, as well
+     * as which transaction it came from, so a failure can be reported.
+     */
+    struct ring_signature_batch
+    {
+      struct entry
+      {
+        crypto::hash tx_id;
+        crypto::hash tx_prefix_hash;
+        crypto::key_image key_image;
+        std::vector<rct::ctkey> pubkeys;
+        std::vector<crypto::signature> signatures;
+        uint64_t result;
+      };
+      std::vector<entry> entries;
+    };
+
 
     BlockchainDB* m_db;
 
@@ -1004,12 +1082,22 @@ namespace cryptonote
     bool m_db_default_sync;
     uint64_t m_db_blocks_per_sync;
     uint64_t m_max_prepare_blocks_threads;
+    size_t m_pow_hash_ways;
     uint64_t m_fake_pow_calc_time;
     uint64_t m_fake_scan_time;
+    block_processing_stats m_block_processing_stats;
     uint64_t m_sync_counter;
-    std::vector<uint64_t> m_timestamps;
-    std::vector<difficulty_type> m_difficulties;
-    uint64_t m_timestamps_and_difficulties_height;
+
+    // timestamps and cumulative difficulties of the most recent blocks, a
+    // cache of db data, so updated from const methods too
+    mutable difficulty_window m_difficulty_window;
+    mutable crypto::hash m_difficulty_window_top_hash;
+
+    // sizes of the last CRYPTONOTE_REWARD_BLOCKS_WINDOW blocks, kept in step
+    // with the chain like the difficulty window
+    mutable tools::rolling_median<size_t> m_block_sizes_median;
+    mutable uint64_t m_block_sizes_median_height;
+    mutable crypto::hash m_block_sizes_median_top_hash;
 
     boost::asio::io_service m_async_service;
     boost::thread_group m_async_pool;
@@ -1087,15 +1175,33 @@ namespace cryptonote
      * of the most recent block which contains an output used in any input set
      *
      * Currently this function calls ring signature validation for each
-     * transaction.
+     * transaction, unless ring_sigs is not NULL, in which case the ring
+     * signatures of v1 transactions are queued there instead, and are only
+     * checked by verify_ring_signatures.
      *
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param ring_sigs if not NULL, where to queue v1 ring signatures instead of checking them
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL);
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, ring_signature_batch *ring_sigs = NULL);
+
+    /**
+     * @brief checks the ring signatures queued by check_tx_inputs
+     *
+     * All the signatures are checked in one go on the threadpool, which
+     * keeps all threads busy even when the transactions they come from
+     * only have one or two inputs each. Results are cached like those
+     * check_tx_inputs gets itself.
+     *
+     * @param ring_sigs the queued ring signatures
+     * @param failed_tx_id return-by-reference the id of a transaction with an invalid ring signature
+     *
+     * @return false if any ring signature is invalid, otherwise true
+     */
+    bool verify_ring_signatures(ring_signature_batch &ring_sigs, crypto::hash &failed_tx_id);
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1227,6 +1333,18 @@ namespace cryptonote
      */
     void get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count) const;
 
+    /**
+     * @brief gets the median size of the last CRYPTONOTE_REWARD_BLOCKS_WINDOW blocks
+     *
+     * The median is maintained incrementally as blocks are added and
+     * popped, so only blocks not seen since the last call are read from
+     * the db.  If the tracked sizes no longer match the main chain, they
+     * are reloaded from the db.
+     *
+     * @return the median block size, or 0 for an empty blockchain
+     */
+    size_t get_block_sizes_median() const;
+
     /**
      * @brief adds the given output to the requested set of random outputs
      *
@@ -1336,6 +1454,32 @@ namespace cryptonote
      */
     bool complete_timestamps_vector(uint64_t start_height, std::vector<uint64_t>& timestamps);
 
+    /**
+     * @brief brings the difficulty window up to date with the blockchain
+     *
+     * Blocks added to or popped from the main chain are mirrored at the tip
+     * of the window as it happens, so this only reads the db for blocks
+     * added to it from elsewhere.  The window is then extended backwards so
+     * it starts at or before start_height if its capacity allows.  If the
+     * window no longer matches the main chain, it is rebuilt from the db.
+     *
+     * @param start_height the height of the oldest block needed
+     */
+    void update_difficulty_window(uint64_t start_height) const;
+
+    /**
+     * @brief gets the timestamps and cumulative difficulties of a range of main chain blocks
+     *
+     * The data is served from the difficulty window, falling back to the
+     * db if the range is deeper than the window can hold.
+     *
+     * @param start_height the height of the first block
+     * @param stop_height the height after the last block
+     * @param timestamps return-by-pointer the timestamps are appended here, if not NULL
+     * @param cumulative_difficulties return-by-pointer the cumulative difficulties are appended here, if not NULL
+     */
+    void get_difficulty_window_data(uint64_t start_height, uint64_t stop_height, std::vector<uint64_t> *timestamps, std::vector<difficulty_type> *cumulative_difficulties) const;
+
     /**
      * @brief calculate the block size limit for the next block to be added
      *
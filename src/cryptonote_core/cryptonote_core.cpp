@@ -41,6 +41,7 @@ using namespace epee;
 #include "common/command_line.h"
 #include "warnings.h"
 #include "crypto/crypto.h"
+#include "crypto/point_cache.h"
 #include "cryptonote_config.h"
 #include "cryptonote_tx_utils.h"
 #include "misc_language.h"
@@ -105,6 +106,16 @@ namespace cryptonote
   , "Max number of threads to use when preparing block hashes in groups."
   , 4
   };
+  static const command_line::arg_descriptor<size_t> arg_prep_blocks_pow_ways = {
+    "prep-blocks-pow-ways"
+  , "Number of block PoW hashes each thread computes at once when preparing blocks (1-4), each needs 2MB of CPU cache."
+  , 1
+  };
+  static const command_line::arg_descriptor<size_t> arg_ring_member_cache_size = {
+    "ring-member-cache-size"
+  , "Number of decompressed ring member keys and commitments kept for transaction verification (0 to disable)."
+  , 65536
+  };
   static const command_line::arg_descriptor<uint64_t> arg_show_time_stats  = {
     "show-time-stats"
   , "Show time-stats when processing blocks/txs and disk synchronization."
@@ -125,6 +136,31 @@ namespace cryptonote
   , "Relay blocks as fluffy blocks where possible (automatic on testnet)"
   , false
   };
+  static const command_line::arg_descriptor<bool> arg_fast_block_relay  = {
+    "fast-block-relay"
+  , "Relay new blocks once their header and proof of work are checked, before full verification"
+  , false
+  };
+  static const command_line::arg_descriptor<uint64_t> arg_tx_relay_average_delay  = {
+    "tx-relay-average-delay"
+  , "Average delay in milliseconds before transactions are relayed to a peer, batched with others (0 to relay at once)"
+  , P2P_TX_RELAY_AVERAGE_DELAY
+  };
+  static const command_line::arg_descriptor<uint32_t> arg_tx_relay_fluff_probability  = {
+    "tx-relay-fluff-probability"
+  , "Percent chance to broadcast a stem transaction rather than pass it on to a single peer (100 to always broadcast)"
+  , 100
+  };
+  static const command_line::arg_descriptor<size_t> arg_max_txpool_size  = {
+    "max-txpool-size"
+  , "Set maximum txpool size in bytes, evicting the lowest fee per byte transactions beyond it."
+  , DEFAULT_TXPOOL_MAX_SIZE
+  };
+  static const command_line::arg_descriptor<bool> arg_maximize_block_fees  = {
+    "maximize-block-fees"
+  , "Let txpool transactions be replaced by double spends paying more, and pick the most paying combination of transactions for block templates"
+  , false
+  };
 
   //-----------------------------------------------------------------------------------------------
   core::core(i_cryptonote_protocol* pprotocol):
@@ -221,11 +257,18 @@ namespace cryptonote
     command_line::add_arg(desc, arg_testnet_on);
     command_line::add_arg(desc, arg_dns_checkpoints);
     command_line::add_arg(desc, arg_prep_blocks_threads);
+    command_line::add_arg(desc, arg_prep_blocks_pow_ways);
+    command_line::add_arg(desc, arg_ring_member_cache_size);
     command_line::add_arg(desc, arg_fast_block_sync);
     command_line::add_arg(desc, arg_show_time_stats);
     command_line::add_arg(desc, arg_block_sync_size);
     command_line::add_arg(desc, arg_check_updates);
     command_line::add_arg(desc, arg_fluffy_blocks);
+    command_line::add_arg(desc, arg_fast_block_relay);
+    command_line::add_arg(desc, arg_tx_relay_average_delay);
+    command_line::add_arg(desc, arg_tx_relay_fluff_probability);
+    command_line::add_arg(desc, arg_max_txpool_size);
+    command_line::add_arg(desc, arg_maximize_block_fees);
     command_line::add_arg(desc, arg_test_dbg_lock_sleep);
 
     // we now also need some of net_node's options (p2p bind arg, for separate data dir)
@@ -264,6 +307,9 @@ namespace cryptonote
     set_enforce_dns_checkpoints(command_line::get_arg(vm, arg_dns_checkpoints));
     test_drop_download_height(command_line::get_arg(vm, arg_test_drop_download_height));
     m_fluffy_blocks_enabled = m_testnet || get_arg(vm, arg_fluffy_blocks);
+    m_fast_block_relay_enabled = get_arg(vm, arg_fast_block_relay);
+    m_tx_relay_average_delay = get_arg(vm, arg_tx_relay_average_delay);
+    m_tx_relay_fluff_probability = std::min<uint32_t>(get_arg(vm, arg_tx_relay_fluff_probability), 100);
 
     if (command_line::get_arg(vm, arg_test_drop_download) == true)
       test_drop_download();
@@ -314,6 +360,12 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_txpool_backlog_buckets(std::vector<tx_backlog_entry>& backlog) const
+  {
+    m_mempool.get_transaction_backlog_buckets(backlog);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_transactions(const std::vector<crypto::hash>& txs_ids, std::list<transaction>& txs, std::list<crypto::hash>& missed_txs) const
   {
     return m_blockchain_storage.get_transactions(txs_ids, txs, missed_txs);
@@ -469,8 +521,9 @@ namespace cryptonote
 
     r = m_blockchain_storage.init(db, m_testnet, test_options);
 
-    r = m_mempool.init();
+    r = m_mempool.init(command_line::get_arg(vm, arg_max_txpool_size), folder.string());
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
+    m_mempool.set_maximize_fees(command_line::get_arg(vm, arg_maximize_block_fees));
 
     // now that we have a valid m_blockchain_storage, we can clean out any
     // transactions in the pool that do not conform to the current fork
@@ -478,6 +531,10 @@ namespace cryptonote
 
     bool show_time_stats = command_line::get_arg(vm, arg_show_time_stats) != 0;
     m_blockchain_storage.set_show_time_stats(show_time_stats);
+    const size_t pow_ways = command_line::get_arg(vm, arg_prep_blocks_pow_ways);
+    CHECK_AND_ASSERT_MES(pow_ways >= 1 && pow_ways <= CN_SLOW_HASH_MAX_WAYS, false, "prep-blocks-pow-ways must be between 1 and " << CN_SLOW_HASH_MAX_WAYS);
+    m_blockchain_storage.set_pow_hash_ways(pow_ways);
+    crypto::point_cache::instance().set_max_size(command_line::get_arg(vm, arg_ring_member_cache_size));
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
     block_sync_size = command_line::get_arg(vm, arg_block_sync_size);
@@ -665,12 +722,17 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
+  bool core::handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay, std::vector<crypto::hash> *tx_hashes)
   {
     TRY_ENTRY();
 
-    struct result { bool res; cryptonote::transaction tx; crypto::hash hash; crypto::hash prefix_hash; bool in_txpool; bool in_blockchain; };
+    struct result { bool res; cryptonote::transaction tx; crypto::hash hash; crypto::hash prefix_hash; bool known; tx_memory_pool::checked_inputs inputs; };
     std::vector<result> results(tx_blobs.size());
+    for (result &r: results)
+    {
+      r.hash = crypto::null_hash;
+      r.known = false;
+    }
 
     tvc.resize(tx_blobs.size());
     tools::threadpool::waiter waiter;
@@ -696,10 +758,12 @@ namespace cryptonote
       if(m_mempool.have_tx(results[i].hash))
       {
         LOG_PRINT_L2("tx " << results[i].hash << "already have transaction in tx_pool");
+        results[i].known = true;
       }
       else if(m_blockchain_storage.have_tx(results[i].hash))
       {
         LOG_PRINT_L2("tx " << results[i].hash << " already have transaction in blockchain");
+        results[i].known = true;
       }
       else
       {
@@ -718,36 +782,85 @@ namespace cryptonote
     }
     waiter.wait();
 
-    bool ok = true;
+    if (tx_hashes)
+    {
+      tx_hashes->resize(results.size());
+      for (size_t i = 0; i < results.size(); ++i)
+        (*tx_hashes)[i] = results[i].hash;
+    }
+
+    // the ring signature checks are done before taking the pool lock, so
+    // the pool and the chain are only locked while the txes are inserted;
+    // the pool checks them again if the chain changed in the meantime
     it = tx_blobs.begin();
-    for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
-      if (!results[i].res)
-      {
-        ok = false;
-        continue;
-      }
+    for (size_t i = 0; i < tx_blobs.size(); i++, ++it)
+    {
+      if (results[i].res && !results[i].known)
+        m_mempool.check_tx_inputs(results[i].tx, it->size(), keeped_by_block, results[i].inputs);
+    }
 
-      ok &= add_new_tx(results[i].tx, results[i].hash, results[i].prefix_hash, it->size(), tvc[i], keeped_by_block, relayed, do_not_relay);
-      if(tvc[i].m_verifivation_failed)
-      {MERROR_VER("Transaction verification failed: " << results[i].hash);}
-      else if(tvc[i].m_verifivation_impossible)
-      {MERROR_VER("Transaction verification impossible: " << results[i].hash);}
+    // add all the txes under a single pool lock and db write txn, rather
+    // than committing each of them separately
+    bool ok = true, committed = true;
+    {
+      CRITICAL_REGION_LOCAL(m_mempool);
+      CRITICAL_REGION_LOCAL1(m_blockchain_storage);
+      const bool batch = m_blockchain_storage.get_db().batch_start();
+      epee::misc_utils::auto_scope_leave_caller batch_stopper = epee::misc_utils::create_scope_leave_handler([this, batch, &committed]() {
+        try { if (batch) m_blockchain_storage.get_db().batch_stop(); }
+        catch (const std::exception &e)
+        {
+          // the db has none of the batch, so the in memory pool must forget it too
+          MERROR("Failed to commit txpool additions, resyncing the pool: " << e.what());
+          committed = false;
+          try { if (!m_mempool.resync()) MERROR("Failed to resync the pool"); }
+          catch (const std::exception &e) { MERROR("Failed to resync the pool: " << e.what()); }
+        }
+      });
+
+      it = tx_blobs.begin();
+      for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
+        if (!results[i].res)
+        {
+          ok = false;
+          continue;
+        }
 
-      if(tvc[i].m_added_to_pool)
-        MDEBUG("tx added: " << results[i].hash);
+        ok &= add_new_tx(results[i].tx, results[i].hash, results[i].prefix_hash, it->size(), tvc[i], keeped_by_block, relayed, do_not_relay, results[i].known ? NULL : &results[i].inputs);
+        if(tvc[i].m_verifivation_failed)
+        {MERROR_VER("Transaction verification failed: " << results[i].hash);}
+        else if(tvc[i].m_verifivation_impossible)
+        {MERROR_VER("Transaction verification impossible: " << results[i].hash);}
+
+        if(tvc[i].m_added_to_pool)
+          MDEBUG("tx added: " << results[i].hash);
+      }
+    }
+
+    if (!committed)
+    {
+      for (tx_verification_context &v: tvc)
+      {
+        v.m_added_to_pool = false;
+        v.m_should_be_relayed = false;
+      }
+      return false;
     }
     return ok;
 
     CATCH_ENTRY_L0("core::handle_incoming_txs()", false);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
+  bool core::handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay, crypto::hash *tx_hash)
   {
     std::list<cryptonote::blobdata> tx_blobs;
     tx_blobs.push_back(tx_blob);
     std::vector<tx_verification_context> tvcv(1);
-    bool r = handle_incoming_txs(tx_blobs, tvcv, keeped_by_block, relayed, do_not_relay);
+    std::vector<crypto::hash> tx_hashes;
+    bool r = handle_incoming_txs(tx_blobs, tvcv, keeped_by_block, relayed, do_not_relay, tx_hash ? &tx_hashes : NULL);
     tvc = tvcv[0];
+    if (tx_hash)
+      *tx_hash = tx_hashes.empty() ? crypto::null_hash : tx_hashes[0];
     return r;
   }
   //-----------------------------------------------------------------------------------------------
@@ -982,7 +1095,7 @@ namespace cryptonote
     return m_blockchain_storage.get_total_transactions();
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::add_new_tx(transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
+  bool core::add_new_tx(transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay, const tx_memory_pool::checked_inputs *inputs)
   {
     if (keeped_by_block)
       get_blockchain_storage().on_new_tx_from_block(tx);
@@ -1000,7 +1113,7 @@ namespace cryptonote
     }
 
     uint8_t version = m_blockchain_storage.get_current_hard_fork_version();
-    return m_mempool.add_tx(tx, tx_hash, blob_size, tvc, keeped_by_block, relayed, do_not_relay, version);
+    return m_mempool.add_tx(tx, tx_hash, blob_size, tvc, keeped_by_block, relayed, do_not_relay, version, inputs);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::relay_txpool_transactions()
@@ -1012,27 +1125,23 @@ namespace cryptonote
       cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
       tx_verification_context tvc = AUTO_VAL_INIT(tvc);
       NOTIFY_NEW_TRANSACTIONS::request r;
+      std::vector<crypto::hash> tx_hashes;
+      tx_hashes.reserve(txs.size());
       for (auto it = txs.begin(); it != txs.end(); ++it)
       {
         r.txs.push_back(it->second);
+        tx_hashes.push_back(it->first);
       }
-      get_protocol()->relay_transactions(r, fake_context);
+      get_protocol()->relay_transactions(r, tx_hashes, fake_context);
       m_mempool.set_relayed(txs);
     }
     return true;
   }
   //-----------------------------------------------------------------------------------------------
-  void core::on_transaction_relayed(const cryptonote::blobdata& tx_blob)
+  void core::on_transaction_relayed(const crypto::hash &tx_hash, const cryptonote::blobdata& tx_blob)
   {
     std::list<std::pair<crypto::hash, cryptonote::blobdata>> txs;
-    cryptonote::transaction tx;
-    crypto::hash tx_hash, tx_prefix_hash;
-    if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash))
-    {
-      LOG_ERROR("Failed to parse relayed transaction");
-      return;
-    }
-    txs.push_back(std::make_pair(tx_hash, std::move(tx_blob)));
+    txs.push_back(std::make_pair(tx_hash, tx_blob));
     m_mempool.set_relayed(txs);
   }
   //-----------------------------------------------------------------------------------------------
@@ -1225,6 +1334,11 @@ namespace cryptonote
     CATCH_ENTRY_L0("core::handle_incoming_block()", false);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::check_block_header_and_pow(const block& b)
+  {
+    return m_blockchain_storage.check_block_header_and_pow(b, get_block_hash(b));
+  }
+  //-----------------------------------------------------------------------------------------------
   // Used by the RPC server to check the size of an incoming
   // block_blob
   bool core::check_incoming_block_size(const blobdata& block_blob) const
@@ -1290,6 +1404,16 @@ namespace cryptonote
     return m_mempool.get_transaction(id, tx);
   }  
   //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_tx_short_id_salt() const
+  {
+    return m_mempool.get_short_id_salt();
+  }
+  //-----------------------------------------------------------------------------------------------
+  void core::get_missing_tx_short_ids(const std::vector<uint64_t> &short_ids, std::vector<uint64_t> &missing) const
+  {
+    m_mempool.get_missing_short_ids(short_ids, missing);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::pool_has_tx(const crypto::hash &id) const
   {
     return m_mempool.have_tx(id);
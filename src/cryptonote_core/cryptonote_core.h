@@ -115,10 +115,11 @@ namespace cryptonote
       * @param keeped_by_block if the transaction has been in a block
       * @param relayed whether or not the transaction was relayed to us
       * @param do_not_relay whether to prevent the transaction from being relayed
+      * @param tx_hash if not NULL, return-by-pointer the transaction's hash, if it parsed
       *
       * @return true if the transaction made it to the transaction pool, otherwise false
       */
-     bool handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay);
+     bool handle_incoming_tx(const blobdata& tx_blob, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay, crypto::hash *tx_hash = NULL);
 
      /**
       * @brief handles a list of incoming transactions
@@ -131,10 +132,11 @@ namespace cryptonote
       * @param keeped_by_block if the transactions have been in a block
       * @param relayed whether or not the transactions were relayed to us
       * @param do_not_relay whether to prevent the transactions from being relayed
+      * @param tx_hashes if not NULL, return-by-pointer the transactions' hashes, null_hash for those which did not parse
       *
       * @return true if the transactions made it to the transaction pool, otherwise false
       */
-     bool handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay);
+     bool handle_incoming_txs(const std::list<blobdata>& tx_blobs, std::vector<tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay, std::vector<crypto::hash> *tx_hashes = NULL);
 
      /**
       * @brief handles an incoming block
@@ -165,6 +167,13 @@ namespace cryptonote
       * @note see Blockchain::cleanup_handle_incoming_blocks
       */
      bool cleanup_handle_incoming_blocks(bool force_sync = false);
+
+     /**
+      * @copydoc Blockchain::check_block_header_and_pow
+      *
+      * @note see Blockchain::check_block_header_and_pow
+      */
+     bool check_block_header_and_pow(const block& b);
      	     	
      /**
       * @brief check the size of a block against the current maximum
@@ -206,8 +215,11 @@ namespace cryptonote
 
      /**
       * @brief called when a transaction is relayed
+      *
+      * @param tx_hash the transaction's hash
+      * @param tx the transaction's blob
       */
-     virtual void on_transaction_relayed(const cryptonote::blobdata& tx);
+     virtual void on_transaction_relayed(const crypto::hash &tx_hash, const cryptonote::blobdata& tx);
 
 
      /**
@@ -437,6 +449,13 @@ namespace cryptonote
       * @note see tx_memory_pool::get_txpool_backlog
       */
      bool get_txpool_backlog(std::vector<tx_backlog_entry>& backlog) const;
+
+     /**
+      * @copydoc tx_memory_pool::get_transaction_backlog_buckets
+      *
+      * @note see tx_memory_pool::get_transaction_backlog_buckets
+      */
+     bool get_txpool_backlog_buckets(std::vector<tx_backlog_entry>& backlog) const;
      
      /**
       * @copydoc tx_memory_pool::get_transactions
@@ -461,6 +480,20 @@ namespace cryptonote
       */
      bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx) const;
 
+     /**
+      * @copydoc tx_memory_pool::get_short_id_salt
+      *
+      * @note see tx_memory_pool::get_short_id_salt
+      */
+     uint64_t get_tx_short_id_salt() const;
+
+     /**
+      * @copydoc tx_memory_pool::get_missing_short_ids
+      *
+      * @note see tx_memory_pool::get_missing_short_ids
+      */
+     void get_missing_tx_short_ids(const std::vector<uint64_t> &short_ids, std::vector<uint64_t> &missing) const;
+
      /**
       * @copydoc tx_memory_pool::get_pool_transactions_and_spent_keys_info
       * @param include_unrelayed_txes include unrelayed txes in result
@@ -599,6 +632,13 @@ namespace cryptonote
       */
      const Blockchain& get_blockchain_storage()const{return m_blockchain_storage;}
 
+     /**
+      * @brief gets the transaction pool
+      *
+      * @return a reference to the transaction pool
+      */
+     tx_memory_pool& get_pool(){return m_mempool;}
+
      /**
       * @copydoc Blockchain::print_blockchain
       *
@@ -759,6 +799,27 @@ namespace cryptonote
       */
      bool fluffy_blocks_enabled() const { return m_fluffy_blocks_enabled; }
 
+     /**
+      * @brief get whether new blocks are relayed before full verification
+      *
+      * @return whether fast block relay is enabled
+      */
+     bool fast_block_relay_enabled() const { return m_fast_block_relay_enabled; }
+
+     /**
+      * @brief get the average time transactions wait before being relayed to a peer
+      *
+      * @return the average delay, in milliseconds
+      */
+     uint64_t get_tx_relay_average_delay() const { return m_tx_relay_average_delay; }
+
+     /**
+      * @brief get the chance a stem transaction is broadcast rather than passed on to a single peer
+      *
+      * @return the chance, in percent, 100 if stem relaying is disabled
+      */
+     uint32_t get_tx_relay_fluff_probability() const { return m_tx_relay_fluff_probability; }
+
      /**
       * @brief check a set of hashes against the precompiled hash set
       *
@@ -783,9 +844,10 @@ namespace cryptonote
       * @param blob_size the size of the transaction
       * @param relayed whether or not the transaction was relayed to us
       * @param do_not_relay whether to prevent the transaction from being relayed
+      * @param inputs the transaction's inputs checked beforehand, or NULL
       *
       */
-     bool add_new_tx(transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay);
+     bool add_new_tx(transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prefix_hash, size_t blob_size, tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay, const tx_memory_pool::checked_inputs *inputs = NULL);
 
      /**
       * @brief add a new transaction to the transaction pool
@@ -1000,6 +1062,9 @@ namespace cryptonote
      boost::mutex m_update_mutex;
 
      bool m_fluffy_blocks_enabled;
+     bool m_fast_block_relay_enabled;
+     uint64_t m_tx_relay_average_delay;
+     uint32_t m_tx_relay_fluff_probability;
    };
 }
 
@@ -40,6 +40,8 @@
 #include "blockchain.h"
 #include "blockchain_db/blockchain_db.h"
 #include "common/boost_serialization_helper.h"
+#include "file_io_utils.h"
+#include "common/util.h"
 #include "common/int-util.h"
 #include "misc_language.h"
 #include "warnings.h"
@@ -65,6 +67,9 @@ namespace cryptonote
     time_t const MIN_RELAY_TIME = (60 * 5); // only start re-relaying transactions after that many seconds
     time_t const MAX_RELAY_TIME = (60 * 60 * 4); // at most that many seconds between resends
     float const ACCEPT_THRESHOLD = 1.0f;
+    float const REPLACE_BY_FEE_THRESHOLD = 1.1f; // how much more per byte a transaction must pay to replace those it double spends
+    size_t const TEMPLATE_KNAPSACK_TAIL = 32; // how many of the last transactions fitting in the penalty free size to search again
+    size_t const TEMPLATE_KNAPSACK_NEXT = 64; // how many of the transactions not fitting to search
 
     // a kind of increasing backoff within min/max bounds
     uint64_t get_relay_delay(time_t now, time_t received)
@@ -85,6 +90,49 @@ namespace cryptonote
       return get_min_block_size(version) - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
     }
 
+    // the saved pool state file is the magic, the format version (4 bytes,
+    // little endian) and the payload's hash, followed by the payload
+    const char POOL_STATE_MAGIC[] = "monero pool state";
+    uint32_t const POOL_STATE_VERSION = 1;
+    size_t const POOL_STATE_HEADER_SIZE = sizeof(POOL_STATE_MAGIC) + sizeof(uint32_t) + sizeof(crypto::hash);
+
+    std::string make_pool_state_file(const std::string &payload)
+    {
+      std::string contents(POOL_STATE_MAGIC, sizeof(POOL_STATE_MAGIC));
+      const uint32_t version = SWAP32LE(POOL_STATE_VERSION);
+      contents.append((const char*)&version, sizeof(version));
+      const crypto::hash checksum = crypto::cn_fast_hash(payload.data(), payload.size());
+      contents.append(checksum.data, sizeof(checksum.data));
+      contents += payload;
+      return contents;
+    }
+
+    bool read_pool_state_file(const std::string &contents, std::string &payload)
+    {
+      if (contents.size() < POOL_STATE_HEADER_SIZE || memcmp(contents.data(), POOL_STATE_MAGIC, sizeof(POOL_STATE_MAGIC)))
+      {
+        MWARNING("Saved pool state has no valid header");
+        return false;
+      }
+      uint32_t version;
+      memcpy(&version, contents.data() + sizeof(POOL_STATE_MAGIC), sizeof(version));
+      version = SWAP32LE(version);
+      if (version != POOL_STATE_VERSION)
+      {
+        MWARNING("Saved pool state has version " << version << ", expected " << POOL_STATE_VERSION);
+        return false;
+      }
+      crypto::hash checksum;
+      memcpy(checksum.data, contents.data() + sizeof(POOL_STATE_MAGIC) + sizeof(version), sizeof(checksum.data));
+      payload = contents.substr(POOL_STATE_HEADER_SIZE);
+      if (crypto::cn_fast_hash(payload.data(), payload.size()) != checksum)
+      {
+        MWARNING("Saved pool state has a bad checksum");
+        return false;
+      }
+      return true;
+    }
+
     // This class is meant to create a batch when none currently exists.
     // If a batch exists, it can't be from another thread, since we can
     // only be called with the txpool lock taken, and it is held during
@@ -102,12 +150,32 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs)
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_txpool_max_size(DEFAULT_TXPOOL_MAX_SIZE), m_maximize_fees(false), m_num_evicted(0), m_bytes_evicted(0), m_num_evicted_rejected(0), m_blockchain(bchs)
   {
+    m_block_template.valid = false;
+    do
+      m_short_id_salt = crypto::rand<uint64_t>();
+    while (m_short_id_salt == 0);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::check_tx_inputs(transaction &tx, size_t blob_size, bool kept_by_block, checked_inputs &inputs) const
+  {
+    inputs.valid = false;
+    inputs.top_block_id = null_hash;
+    inputs.max_used_block_height = 0;
+    inputs.max_used_block_id = null_hash;
+    inputs.tvc = AUTO_VAL_INIT(inputs.tvc);
 
+    uint64_t fee;
+    if (!kept_by_block && (!get_tx_fee(tx, fee) || !m_blockchain.check_fee(blob_size, fee)))
+      return;
+
+    CRITICAL_REGION_LOCAL(m_blockchain);
+    inputs.top_block_id = m_blockchain.get_tail_id();
+    inputs.valid = m_blockchain.check_tx_inputs(tx, inputs.max_used_block_height, inputs.max_used_block_id, inputs.tvc, kept_by_block);
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_hash,*/ const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version)
+  bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_hash,*/ const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version, const checked_inputs *inputs)
   {
     // this should already be called with that lock, but let's make it explicit for clarity
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -131,6 +199,17 @@ namespace cryptonote
       return false;
     }
 
+    // nor those we evicted recently, as they would likely be evicted again;
+    // the sender is not at fault, so this is not a verification failure,
+    // but the fee is too low for the pool as it stands
+    if (!kept_by_block && m_evicted_txs.contains(id))
+    {
+      LOG_PRINT_L1("Transaction with id= "<< id << " was recently evicted from the pool, ignoring it");
+      ++m_num_evicted_rejected;
+      tvc.m_fee_too_low = true;
+      return true;
+    }
+
     if(!check_inputs_types_supported(tx))
     {
       tvc.m_verifivation_failed = true;
@@ -185,9 +264,10 @@ namespace cryptonote
     // if the transaction came from a block popped from the chain,
     // don't check if we have its key images as spent.
     // TODO: Investigate why not?
+    std::vector<crypto::hash> replaced;
     if(!kept_by_block)
     {
-      if(have_tx_keyimges_as_spent(tx))
+      if(have_tx_keyimges_as_spent(tx) && !(m_maximize_fees && get_replaced_txes(tx, fee, blob_size, replaced)))
       {
         mark_double_spend(tx);
         LOG_PRINT_L1("Transaction with id= "<< id << " used already spent key images");
@@ -197,6 +277,16 @@ namespace cryptonote
       }
     }
 
+    // no point in verifying a transaction we would evict right away,
+    // accounting for the room freed by those it replaces
+    if (!kept_by_block && would_be_evicted(fee, blob_size, replaced))
+    {
+      LOG_PRINT_L1("Transaction with id= "<< id << " pays too little per byte for the pool's size limit, ignoring it");
+      ++m_num_evicted_rejected;
+      tvc.m_fee_too_low = true;
+      return true;
+    }
+
     if (!m_blockchain.check_tx_outputs(tx, tvc))
     {
       LOG_PRINT_L1("Transaction with id= "<< id << " has at least one invalid output");
@@ -213,7 +303,19 @@ namespace cryptonote
     crypto::hash max_used_block_id = null_hash;
     uint64_t max_used_block_height = 0;
     cryptonote::txpool_tx_meta_t meta;
-    bool ch_inp_res = m_blockchain.check_tx_inputs(tx, max_used_block_height, max_used_block_id, tvc, kept_by_block);
+    bool ch_inp_res;
+    if (inputs && inputs->top_block_id == m_blockchain.get_tail_id())
+    {
+      ch_inp_res = inputs->valid;
+      max_used_block_height = inputs->max_used_block_height;
+      max_used_block_id = inputs->max_used_block_id;
+      tvc.m_low_mixin |= inputs->tvc.m_low_mixin;
+      tvc.m_double_spend |= inputs->tvc.m_double_spend;
+    }
+    else
+    {
+      ch_inp_res = m_blockchain.check_tx_inputs(tx, max_used_block_height, max_used_block_id, tvc, kept_by_block);
+    }
     if(!ch_inp_res)
     {
       // if the transaction was valid before (kept_by_block), then it
@@ -240,7 +342,9 @@ namespace cryptonote
           m_blockchain.add_txpool_tx(tx, meta);
           if (!insert_key_images(tx, kept_by_block))
             return false;
-          m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
+          add_tx_entry(id, meta);
+          add_template_candidate(id, tx, meta, false);
+          m_parsed_txs.insert(id, std::make_shared<const transaction>(tx), blob_size);
         }
         catch (const std::exception &e)
         {
@@ -269,19 +373,80 @@ namespace cryptonote
       meta.receive_time = receive_time;
       meta.last_relayed_time = time(NULL);
       meta.relayed = relayed;
-      meta.do_not_relay = do_not_relay;
-      meta.double_spend_seen = false;
+      // peers not replacing by fee would see a double spend, and drop us
+      meta.do_not_relay = do_not_relay || !replaced.empty();
+      meta.double_spend_seen = !replaced.empty();
       memset(meta.padding, 0, sizeof(meta.padding));
 
       try
       {
         CRITICAL_REGION_LOCAL1(m_blockchain);
+        // gather what replacing needs before touching anything, so the
+        // replaced transactions go only if this one goes in
+        std::vector<txpool_tx_meta_t> replaced_metas;
+        std::vector<std::shared_ptr<const transaction>> replaced_txs;
+        replaced_metas.reserve(replaced.size());
+        replaced_txs.reserve(replaced.size());
+        for (const crypto::hash &replaced_id: replaced)
+        {
+          const txpool_tx_meta_t *replaced_meta = get_tx_meta(replaced_id);
+          const std::shared_ptr<const transaction> replaced_tx = replaced_meta ? get_parsed_tx(replaced_id) : std::shared_ptr<const transaction>();
+          if (!replaced_tx)
+          {
+            MERROR("Failed to find tx " << replaced_id << " to replace in txpool");
+            return false;
+          }
+          replaced_metas.push_back(*replaced_meta);
+          replaced_txs.push_back(replaced_tx);
+        }
+        if (!replaced.empty())
+        {
+          for (const auto &in: tx.vin)
+          {
+            CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
+            for (const crypto::hash &spender: m_spent_key_images.get(txin.k_image))
+            {
+              if (std::find(replaced.begin(), replaced.end(), spender) == replaced.end())
+              {
+                MERROR("Key image " << txin.k_image << " is spent by tx " << spender << ", which is not being replaced");
+                return false;
+              }
+            }
+          }
+        }
+
         LockedTXN lock(m_blockchain);
         m_blockchain.remove_txpool_tx(get_transaction_hash(tx));
+        remove_tx_entry(id);
         m_blockchain.add_txpool_tx(tx, meta);
+        size_t n_removed = 0;
+        try
+        {
+          for (; n_removed < replaced.size(); ++n_removed)
+            m_blockchain.remove_txpool_tx(replaced[n_removed]);
+        }
+        catch (const std::exception &e)
+        {
+          // put the pool back the way it was
+          for (size_t i = 0; i < n_removed; ++i)
+          {
+            transaction restored = *replaced_txs[i];
+            m_blockchain.add_txpool_tx(restored, replaced_metas[i]);
+          }
+          m_blockchain.remove_txpool_tx(id);
+          throw;
+        }
+        // nothing below can fail now that the db is updated
+        for (size_t i = 0; i < replaced.size(); ++i)
+        {
+          forget_evicted_tx(replaced[i], *replaced_txs[i], replaced_metas[i].blob_size);
+          MINFO("Replaced tx " << replaced[i] << " in txpool by " << id << ", paying more");
+        }
         if (!insert_key_images(tx, kept_by_block))
           return false;
-        m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)blob_size, receive_time), id);
+        add_tx_entry(id, meta);
+        add_template_candidate(id, tx, meta, true);
+        m_parsed_txs.insert(id, std::make_shared<const transaction>(tx), blob_size);
       }
       catch (const std::exception &e)
       {
@@ -290,12 +455,24 @@ namespace cryptonote
       }
       tvc.m_added_to_pool = true;
 
-      if(meta.fee > 0 && !do_not_relay)
+      if(meta.fee > 0 && !meta.do_not_relay)
         tvc.m_should_be_relayed = true;
     }
 
     tvc.m_verifivation_failed = false;
 
+    // make room if needed; would_be_evicted made sure this very transaction
+    // stays, unless it was kept_by_block and the pool is full of those
+    prune(m_txpool_max_size);
+    if (!get_tx_meta(id))
+    {
+      LOG_PRINT_L1("Transaction with id= "<< id << " was evicted from the pool right away");
+      tvc.m_added_to_pool = false;
+      tvc.m_should_be_relayed = false;
+      tvc.m_fee_too_low = true;
+      return true;
+    }
+
     MINFO("Transaction added to pool: txid " << id << " bytes: " << blob_size << " fee/byte: " << (fee / (double)blob_size));
     return true;
   }
@@ -309,18 +486,379 @@ namespace cryptonote
     return add_tx(tx, h, blob_size, tvc, keeped_by_block, relayed, do_not_relay, version);
   }
   //---------------------------------------------------------------------------------
+  bool spent_key_images_index::insert(const crypto::key_image &key_image, const crypto::hash &txid, bool kept_by_block)
+  {
+    shard &s = get_shard(key_image);
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    tx_hashes_container& kei_image_set = s.key_images[key_image];
+    CHECK_AND_ASSERT_MES(kept_by_block || kei_image_set.size() == 0, false, "internal error: kept_by_block=" << kept_by_block
+                                        << ",  kei_image_set.size()=" << kei_image_set.size() << ENDL << "txin.k_image=" << key_image << ENDL
+                                        << "tx_id=" << txid );
+    auto ins_res = kei_image_set.insert(txid);
+    CHECK_AND_ASSERT_MES(ins_res.second, false, "internal error: try to insert duplicate iterator in key_image set");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool spent_key_images_index::remove(const crypto::key_image &key_image, const crypto::hash &txid)
+  {
+    shard &s = get_shard(key_image);
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    auto it = s.key_images.find(key_image);
+    CHECK_AND_ASSERT_MES(it != s.key_images.end(), false, "failed to find transaction input in key images. img=" << key_image << ENDL
+                                  << "transaction id = " << txid);
+    tx_hashes_container& key_image_set =  it->second;
+    CHECK_AND_ASSERT_MES(key_image_set.size(), false, "empty key_image set, img=" << key_image << ENDL
+      << "transaction id = " << txid);
+
+    auto it_in_set = key_image_set.find(txid);
+    CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << key_image << ENDL
+      << "transaction id = " << txid);
+    key_image_set.erase(it_in_set);
+    if(!key_image_set.size())
+    {
+      //it is now empty hash container for this key_image
+      s.key_images.erase(it);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool spent_key_images_index::contains(const crypto::key_image &key_image) const
+  {
+    const shard &s = get_shard(key_image);
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    return s.key_images.find(key_image) != s.key_images.end();
+  }
+  //---------------------------------------------------------------------------------
+  spent_key_images_index::tx_hashes_container spent_key_images_index::get(const crypto::key_image &key_image) const
+  {
+    const shard &s = get_shard(key_image);
+    boost::lock_guard<boost::mutex> lock(s.lock);
+    auto it = s.key_images.find(key_image);
+    return it == s.key_images.end() ? tx_hashes_container() : it->second;
+  }
+  //---------------------------------------------------------------------------------
+  void spent_key_images_index::for_each(const std::function<void(const crypto::key_image&, const tx_hashes_container&)> &f) const
+  {
+    for (const shard &s: m_shards)
+    {
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      for (const auto &e: s.key_images)
+        f(e.first, e.second);
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void spent_key_images_index::clear()
+  {
+    for (shard &s: m_shards)
+    {
+      boost::lock_guard<boost::mutex> lock(s.lock);
+      s.key_images.clear();
+    }
+  }
+  //---------------------------------------------------------------------------------
+  size_t txpool_aggregates::get_fee_bucket(uint64_t fee, uint64_t blob_size)
+  {
+    const uint64_t fee_per_byte = blob_size ? fee / blob_size : fee;
+    if (fee_per_byte == 0)
+      return 0;
+    // the position of the top bit, then the three bits below it
+    size_t top = 63;
+    while (!(fee_per_byte >> top))
+      --top;
+    const uint64_t fraction = top >= 3 ? fee_per_byte >> (top - 3) : fee_per_byte << (3 - top);
+    return 1 + top * 8 + (fraction & 7);
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_aggregates::add(const txpool_tx_meta_t &meta)
+  {
+    ++m_txs;
+    m_bytes += meta.blob_size;
+    m_fee += meta.fee;
+    if (meta.last_failed_height)
+      ++m_num_failing;
+    if (!meta.relayed)
+      ++m_num_not_relayed;
+    if (meta.double_spend_seen)
+      ++m_num_double_spends;
+    m_sizes.insert(meta.blob_size);
+
+    txpool_histo &h = m_by_receive_time[meta.receive_time];
+    ++h.txs;
+    h.bytes += meta.blob_size;
+
+    fee_bucket &b = m_fee_buckets[get_fee_bucket(meta.fee, meta.blob_size)];
+    ++b.txs;
+    b.bytes += meta.blob_size;
+    b.fee += meta.fee;
+    b.receive_time_sum += meta.receive_time;
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_aggregates::remove(const txpool_tx_meta_t &meta)
+  {
+    CHECK_AND_ASSERT_THROW_MES(m_sizes.erase(meta.blob_size), "Transaction not found in pool aggregates");
+    --m_txs;
+    m_bytes -= meta.blob_size;
+    m_fee -= meta.fee;
+    if (meta.last_failed_height)
+      --m_num_failing;
+    if (!meta.relayed)
+      --m_num_not_relayed;
+    if (meta.double_spend_seen)
+      --m_num_double_spends;
+
+    auto h = m_by_receive_time.find(meta.receive_time);
+    CHECK_AND_ASSERT_THROW_MES(h != m_by_receive_time.end(), "Receive time not found in pool aggregates");
+    if (--h->second.txs == 0)
+      m_by_receive_time.erase(h);
+    else
+      h->second.bytes -= meta.blob_size;
+
+    auto b = m_fee_buckets.find(get_fee_bucket(meta.fee, meta.blob_size));
+    CHECK_AND_ASSERT_THROW_MES(b != m_fee_buckets.end(), "Fee bucket not found in pool aggregates");
+    if (--b->second.txs == 0)
+    {
+      m_fee_buckets.erase(b);
+    }
+    else
+    {
+      b->second.bytes -= meta.blob_size;
+      b->second.fee -= meta.fee;
+      b->second.receive_time_sum -= meta.receive_time;
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_aggregates::clear()
+  {
+    m_txs = 0;
+    m_bytes = 0;
+    m_fee = 0;
+    m_num_failing = 0;
+    m_num_not_relayed = 0;
+    m_num_double_spends = 0;
+    m_sizes.clear();
+    m_by_receive_time.clear();
+    m_fee_buckets.clear();
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_aggregates::get_stats(txpool_stats &stats, uint64_t now) const
+  {
+    stats.txs_total = m_txs;
+    stats.bytes_total = m_bytes;
+    stats.bytes_min = m_sizes.min();
+    stats.bytes_max = m_sizes.max();
+    stats.bytes_med = m_sizes.median();
+    stats.fee_total = m_fee;
+    stats.num_failing = m_num_failing;
+    stats.num_not_relayed = m_num_not_relayed;
+    stats.num_double_spends = m_num_double_spends;
+    stats.oldest = m_by_receive_time.empty() ? 0 : m_by_receive_time.begin()->first;
+    stats.num_10m = 0;
+    for (auto i = m_by_receive_time.begin(); i != m_by_receive_time.end() && i->first < now - 600; ++i)
+      stats.num_10m += i->second.txs;
+    stats.histo_98pc = 0;
+    stats.histo.clear();
+
+    if (stats.txs_total > 1)
+    {
+      // newest first, ie by increasing age
+      typedef std::map<uint64_t, txpool_histo>::const_reverse_iterator age_iterator;
+      const auto age = [now](const age_iterator &i) { return i->first < now ? now - i->first : 1; };
+
+      /* looking for 98th percentile */
+      size_t end = stats.txs_total * 0.02;
+      uint64_t delta, factor;
+      age_iterator it, i2;
+      if (end)
+      {
+        /* If enough txs, spread the first 98% of results across
+         * the first 9 bins, drop final 2% in last bin.
+         */
+        it = m_by_receive_time.rend();
+        for (size_t n=0; n <= end && it != m_by_receive_time.rbegin(); n++, it--);
+        stats.histo_98pc = age(it);
+        factor = 9;
+        delta = age(it);
+        stats.histo.resize(10);
+      } else
+      {
+        /* If not enough txs, don't reserve the last slot;
+         * spread evenly across all 10 bins.
+         */
+        it = m_by_receive_time.rend();
+        factor = stats.txs_total > 9 ? 10 : stats.txs_total;
+        delta = now > stats.oldest ? now - stats.oldest : 0;
+        stats.histo.resize(factor);
+      }
+      if (!delta)
+        delta = 1;
+      for (i2 = m_by_receive_time.rbegin(); i2 != it; i2++)
+      {
+        size_t i = std::min<size_t>((age(i2) * factor - 1) / delta, stats.histo.size() - 1);
+        stats.histo[i].txs += i2->second.txs;
+        stats.histo[i].bytes += i2->second.bytes;
+      }
+      for (; i2 != m_by_receive_time.rend(); i2++)
+      {
+        stats.histo[factor].txs += i2->second.txs;
+        stats.histo[factor].bytes += i2->second.bytes;
+      }
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void txpool_aggregates::get_backlog(std::vector<tx_backlog_entry> &backlog, uint64_t now) const
+  {
+    backlog.reserve(backlog.size() + m_fee_buckets.size());
+    for (auto i = m_fee_buckets.rbegin(); i != m_fee_buckets.rend(); ++i)
+    {
+      const fee_bucket &b = i->second;
+      const uint64_t mean_receive_time = b.receive_time_sum / b.txs;
+      backlog.push_back({b.bytes, b.fee, now > mean_receive_time ? now - mean_receive_time : 0});
+    }
+  }
+  //---------------------------------------------------------------------------------
+  evicted_tx_filter::evicted_tx_filter(size_t generation_size):
+    m_generation_size(std::max<size_t>(generation_size, 1)),
+    m_bits(m_generation_size * BITS_PER_TX),
+    m_count(0),
+    m_current((m_bits + 63) / 64, 0),
+    m_previous((m_bits + 63) / 64, 0)
+  {
+    // salted, so which transactions collide can't be known in advance
+    for (uint32_t &salt: m_salt)
+      salt = crypto::rand<uint32_t>();
+  }
+  //---------------------------------------------------------------------------------
+  size_t evicted_tx_filter::get_bit(const crypto::hash &txid, size_t n) const
+  {
+    uint32_t word;
+    memcpy(&word, txid.data + n * sizeof(word), sizeof(word));
+    return (word ^ m_salt[n]) % m_bits;
+  }
+  //---------------------------------------------------------------------------------
+  void evicted_tx_filter::insert(const crypto::hash &txid)
+  {
+    if (m_count >= m_generation_size)
+    {
+      std::swap(m_current, m_previous);
+      std::fill(m_current.begin(), m_current.end(), 0);
+      m_count = 0;
+    }
+    for (size_t n = 0; n < HASHES; ++n)
+    {
+      const size_t bit = get_bit(txid, n);
+      m_current[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+    ++m_count;
+  }
+  //---------------------------------------------------------------------------------
+  bool evicted_tx_filter::contains(const crypto::hash &txid) const
+  {
+    bool in_current = true, in_previous = true;
+    for (size_t n = 0; n < HASHES && (in_current || in_previous); ++n)
+    {
+      const size_t bit = get_bit(txid, n);
+      const uint64_t mask = (uint64_t)1 << (bit % 64);
+      in_current = in_current && (m_current[bit / 64] & mask);
+      in_previous = in_previous && (m_previous[bit / 64] & mask);
+    }
+    return in_current || in_previous;
+  }
+  //---------------------------------------------------------------------------------
+  void evicted_tx_filter::clear()
+  {
+    std::fill(m_current.begin(), m_current.end(), 0);
+    std::fill(m_previous.begin(), m_previous.end(), 0);
+    m_count = 0;
+  }
+  //---------------------------------------------------------------------------------
+  std::shared_ptr<const transaction> parsed_tx_cache::get(const crypto::hash &txid)
+  {
+    const auto it = m_entries.find(txid);
+    if (it == m_entries.end())
+      return std::shared_ptr<const transaction>();
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+    return it->second.tx;
+  }
+  //---------------------------------------------------------------------------------
+  void parsed_tx_cache::insert(const crypto::hash &txid, const std::shared_ptr<const transaction> &tx, size_t blob_size)
+  {
+    erase(txid);
+    if (blob_size > m_max_bytes)
+      return;
+    while (m_bytes + blob_size > m_max_bytes)
+      erase(m_lru.back());
+    m_lru.push_front(txid);
+    m_entries[txid] = {tx, blob_size, m_lru.begin()};
+    m_bytes += blob_size;
+  }
+  //---------------------------------------------------------------------------------
+  void parsed_tx_cache::erase(const crypto::hash &txid)
+  {
+    const auto it = m_entries.find(txid);
+    if (it == m_entries.end())
+      return;
+    m_bytes -= it->second.blob_size;
+    m_lru.erase(it->second.lru);
+    m_entries.erase(it);
+  }
+  //---------------------------------------------------------------------------------
+  void parsed_tx_cache::clear()
+  {
+    m_entries.clear();
+    m_lru.clear();
+    m_bytes = 0;
+  }
+  //---------------------------------------------------------------------------------
+  std::vector<size_t> select_max_fee_txes(const std::vector<size_t> &sizes, const std::vector<uint64_t> &fees, size_t capacity, size_t max_units)
+  {
+    std::vector<size_t> selected;
+    const size_t n = std::min(sizes.size(), fees.size());
+    if (n == 0 || capacity == 0 || max_units == 0)
+      return selected;
+
+    const size_t unit = (capacity + max_units - 1) / max_units;
+    const size_t units = capacity / unit;
+    std::vector<size_t> weights(n);
+    for (size_t i = 0; i < n; ++i)
+      weights[i] = std::max<size_t>((sizes[i] + unit - 1) / unit, 1);
+
+    // best[u] is the largest fee fitting in u units with the transactions seen so far,
+    // and taken[i * (units + 1) + u] whether transaction i was part of it then
+    std::vector<uint64_t> best(units + 1, 0);
+    std::vector<bool> taken(n * (units + 1), false);
+    for (size_t i = 0; i < n; ++i)
+    {
+      for (size_t u = units; u >= weights[i]; --u)
+      {
+        if (best[u - weights[i]] + fees[i] > best[u])
+        {
+          best[u] = best[u - weights[i]] + fees[i];
+          taken[i * (units + 1) + u] = true;
+        }
+      }
+    }
+
+    size_t u = units;
+    for (size_t i = n; i-- > 0; )
+    {
+      if (taken[i * (units + 1) + u])
+      {
+        selected.push_back(i);
+        u -= weights[i];
+      }
+    }
+    std::reverse(selected.begin(), selected.end());
+    return selected;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::insert_key_images(const transaction &tx, bool kept_by_block)
   {
+    const crypto::hash id = get_transaction_hash(tx);
     for(const auto& in: tx.vin)
     {
-      const crypto::hash id = get_transaction_hash(tx);
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
-      std::unordered_set<crypto::hash>& kei_image_set = m_spent_key_images[txin.k_image];
-      CHECK_AND_ASSERT_MES(kept_by_block || kei_image_set.size() == 0, false, "internal error: kept_by_block=" << kept_by_block
-                                          << ",  kei_image_set.size()=" << kei_image_set.size() << ENDL << "txin.k_image=" << txin.k_image << ENDL
-                                          << "tx_id=" << id );
-      auto ins_res = kei_image_set.insert(id);
-      CHECK_AND_ASSERT_MES(ins_res.second, false, "internal error: try to insert duplicate iterator in key_image set");
+      if (!m_spent_key_images.insert(txin.k_image, id, kept_by_block))
+        return false;
     }
     return true;
   }
@@ -338,23 +876,8 @@ namespace cryptonote
     for(const txin_v& vi: tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(vi, const txin_to_key, txin, false);
-      auto it = m_spent_key_images.find(txin.k_image);
-      CHECK_AND_ASSERT_MES(it != m_spent_key_images.end(), false, "failed to find transaction input in key images. img=" << txin.k_image << ENDL
-                                    << "transaction id = " << get_transaction_hash(tx));
-      std::unordered_set<crypto::hash>& key_image_set =  it->second;
-      CHECK_AND_ASSERT_MES(key_image_set.size(), false, "empty key_image set, img=" << txin.k_image << ENDL
-        << "transaction id = " << actual_hash);
-
-      auto it_in_set = key_image_set.find(actual_hash);
-      CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << txin.k_image << ENDL
-        << "transaction id = " << actual_hash);
-      key_image_set.erase(it_in_set);
-      if(!key_image_set.size())
-      {
-        //it is now empty hash container for this key_image
-        m_spent_key_images.erase(it);
-      }
-
+      if (!m_spent_key_images.remove(txin.k_image, actual_hash))
+        return false;
     }
     return true;
   }
@@ -364,20 +887,22 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    auto sorted_it = find_tx_in_sorted_container(id);
-    if (sorted_it == m_txs_by_fee_and_receive_time.end())
+    auto &txs_by_id = m_txs.get<pool_tx_by_id>();
+    const auto it = txs_by_id.find(id);
+    if (it == txs_by_id.end())
       return false;
 
     try
     {
       LockedTXN lock(m_blockchain);
-      txpool_tx_meta_t meta = m_blockchain.get_txpool_tx_meta(id);
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(id);
-      if (!parse_and_validate_tx_from_blob(txblob, tx))
+      const txpool_tx_meta_t &meta = it->meta;
+      const std::shared_ptr<const transaction> ptx = get_parsed_tx(id);
+      if (!ptx)
       {
         MERROR("Failed to parse tx from txpool");
         return false;
       }
+      tx = *ptx;
       blob_size = meta.blob_size;
       fee = meta.fee;
       relayed = meta.relayed;
@@ -394,22 +919,251 @@ namespace cryptonote
       return false;
     }
 
-    m_txs_by_fee_and_receive_time.erase(sorted_it);
+    remove_tx_entry(id);
+    remove_template_candidate(id);
     return true;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_template_candidate(const crypto::hash &id, const transaction &tx, const txpool_tx_meta_t &meta, bool ready)
+  {
+    template_candidate &candidate = m_template_candidates[id];
+    candidate.key_images.clear();
+    candidate.key_images.reserve(tx.vin.size());
+    for (const auto &in: tx.vin)
+    {
+      CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
+      candidate.key_images.push_back(txin.k_image);
+    }
+    candidate.blob_size = meta.blob_size;
+    candidate.fee = meta.fee;
+    candidate.ready = ready;
+    candidate.ready_top_block_id = ready ? m_blockchain.get_tail_id() : null_hash;
+    candidate.ready_version = m_blockchain.get_current_hard_fork_version();
+
+    // the new transaction may well displace others from the template
+    m_block_template.valid = false;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_template_candidate(const crypto::hash &id)
+  {
+    m_template_candidates.erase(id);
+    if (m_block_template.valid && std::find(m_block_template.tx_hashes.begin(), m_block_template.tx_hashes.end(), id) != m_block_template.tx_hashes.end())
+      m_block_template.valid = false;
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::on_idle()
   {
     m_remove_stuck_tx_interval.do_call([this](){return remove_stuck_transactions();});
   }
   //---------------------------------------------------------------------------------
-  sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
+  std::shared_ptr<const transaction> tx_memory_pool::get_parsed_tx(const crypto::hash &id, const cryptonote::blobdata *bd) const
+  {
+    std::shared_ptr<const transaction> cached = m_parsed_txs.get(id);
+    if (cached)
+      return cached;
+
+    cryptonote::blobdata txblob;
+    if (!bd)
+    {
+      txblob = m_blockchain.get_txpool_tx_blob(id);
+      bd = &txblob;
+    }
+    std::shared_ptr<transaction> tx = std::make_shared<transaction>();
+    if (!parse_and_validate_tx_from_blob(*bd, *tx))
+      return std::shared_ptr<const transaction>();
+    // we know these already, so get_transaction_hash and friends need not compute them
+    tx->hash = id;
+    tx->set_hash_valid(true);
+    tx->blob_size = bd->size();
+    tx->set_blob_size_valid(true);
+    m_parsed_txs.insert(id, tx, bd->size());
+    return tx;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::would_be_evicted(uint64_t fee, size_t blob_size, const std::vector<crypto::hash> &replaced) const
+  {
+    uint64_t bytes = m_aggregates.bytes() + blob_size;
+    for (const crypto::hash &txid: replaced)
+    {
+      const txpool_tx_meta_t *meta = get_tx_meta(txid);
+      if (meta)
+        bytes -= meta->blob_size;
+    }
+    if (bytes <= m_txpool_max_size)
+      return false;
+
+    // replay what prune would do: eviction goes from the lowest fee per byte,
+    // newest first, so a new transaction goes before any paying as much
+    const double fee_per_byte = fee / (double)blob_size;
+    const auto &txs_by_fee = m_txs.get<pool_tx_by_fee>();
+    for (auto it = txs_by_fee.rbegin(); it != txs_by_fee.rend() && bytes > m_txpool_max_size; ++it)
+    {
+      if (it->fee_per_byte >= fee_per_byte)
+        return true;
+      if (it->meta.kept_by_block || std::find(replaced.begin(), replaced.end(), it->id) != replaced.end())
+        continue;
+      bytes -= it->meta.blob_size;
+    }
+    return bytes > m_txpool_max_size;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::prune(size_t bytes)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    if (m_aggregates.bytes() <= bytes)
+      return;
+
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    LockedTXN lock(m_blockchain);
+    const auto &txs_by_fee = m_txs.get<pool_tx_by_fee>();
+    // it is one past the next candidate, so erasing the candidate leaves it valid
+    auto it = txs_by_fee.end();
+    while (it != txs_by_fee.begin() && m_aggregates.bytes() > bytes)
+    {
+      const auto candidate = std::prev(it);
+      // don't evict the kept_by_block ones, they're likely added because we're adding a block with those
+      if (candidate->meta.kept_by_block)
+      {
+        it = candidate;
+        continue;
+      }
+      const crypto::hash txid = candidate->id;
+      const uint64_t blob_size = candidate->meta.blob_size;
+      const double fee_per_byte = candidate->fee_per_byte;
+      if (!evict_tx(txid))
+        return;
+      MINFO("Evicted tx " << txid << " from txpool: size: " << blob_size << ", fee/byte: " << fee_per_byte);
+    }
+    if (m_aggregates.bytes() > bytes)
+      MINFO("Pool size after pruning is larger than limit: " << m_aggregates.bytes() << "/" << bytes);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::evict_tx(const crypto::hash &txid)
+  {
+    const txpool_tx_meta_t *meta = get_tx_meta(txid);
+    if (!meta)
+      return false;
+    const uint64_t blob_size = meta->blob_size;
+    try
+    {
+      const std::shared_ptr<const transaction> tx = get_parsed_tx(txid);
+      if (!tx)
+      {
+        MERROR("Failed to parse tx from txpool");
+        return false;
+      }
+      // remove first, in case this throws, so key images aren't removed
+      m_blockchain.remove_txpool_tx(txid);
+      forget_evicted_tx(txid, *tx, blob_size);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Error while evicting tx " << txid << " from txpool: " << e.what());
+      return false;
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::forget_evicted_tx(const crypto::hash &txid, const transaction &tx, uint64_t blob_size)
+  {
+    remove_transaction_keyimages(tx);
+    remove_tx_entry(txid);
+    remove_template_candidate(txid);
+    m_evicted_txs.insert(txid);
+    ++m_num_evicted;
+    m_bytes_evicted += blob_size;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::set_txpool_max_size(size_t bytes)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_txpool_max_size = bytes;
+    prune(m_txpool_max_size);
+  }
+  //---------------------------------------------------------------------------------
+  size_t tx_memory_pool::get_txpool_max_size() const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    return m_txpool_max_size;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::set_maximize_fees(bool maximize_fees)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_maximize_fees = maximize_fees;
+    m_block_template.valid = false;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::get_missing_short_ids(const std::vector<uint64_t> &short_ids, std::vector<uint64_t> &missing) const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    for (uint64_t short_id: short_ids)
+      if (m_short_ids.find(short_id) == m_short_ids.end())
+        missing.push_back(short_id);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_tx_entry(const crypto::hash &id, const txpool_tx_meta_t &meta)
+  {
+    if (!m_txs.emplace(id, meta).second)
+      return false;
+    m_short_ids.insert(get_transaction_short_id(id, m_short_id_salt));
+    m_aggregates.add(meta);
+    if (!meta.do_not_relay)
+      m_relayable_aggregates.add(meta);
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_tx_entry(const crypto::hash &id)
   {
-    return std::find_if( m_txs_by_fee_and_receive_time.begin(), m_txs_by_fee_and_receive_time.end()
-                       , [&](const sorted_tx_container::value_type& a){
-                         return a.second == id;
-                       }
-    );
+    auto &txs_by_id = m_txs.get<pool_tx_by_id>();
+    const auto it = txs_by_id.find(id);
+    if (it == txs_by_id.end())
+      return;
+    m_aggregates.remove(it->meta);
+    if (!it->meta.do_not_relay)
+      m_relayable_aggregates.remove(it->meta);
+    txs_by_id.erase(it);
+    m_parsed_txs.erase(id);
+    const auto short_id = m_short_ids.find(get_transaction_short_id(id, m_short_id_salt));
+    if (short_id != m_short_ids.end())
+      m_short_ids.erase(short_id);
+  }
+  //---------------------------------------------------------------------------------
+  const txpool_tx_meta_t *tx_memory_pool::get_tx_meta(const crypto::hash &id) const
+  {
+    const auto &txs_by_id = m_txs.get<pool_tx_by_id>();
+    const auto it = txs_by_id.find(id);
+    return it == txs_by_id.end() ? NULL : &it->meta;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::update_tx_meta(const crypto::hash &id, const txpool_tx_meta_t &meta)
+  {
+    // db first, so both copies stay the same if it throws
+    m_blockchain.update_txpool_tx(id, meta);
+    auto &txs_by_id = m_txs.get<pool_tx_by_id>();
+    const auto it = txs_by_id.find(id);
+    if (it == txs_by_id.end())
+      return;
+    m_aggregates.remove(it->meta);
+    if (!it->meta.do_not_relay)
+      m_relayable_aggregates.remove(it->meta);
+    txs_by_id.modify(it, [&meta](pool_tx_entry &e) { e.meta = meta; });
+    m_aggregates.add(meta);
+    if (!meta.do_not_relay)
+      m_relayable_aggregates.add(meta);
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::for_all_tx_meta(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&)> f, bool include_unrelayed_txes) const
+  {
+    for (const pool_tx_entry &e: m_txs.get<pool_tx_by_id>())
+    {
+      if (!include_unrelayed_txes && e.meta.do_not_relay)
+        continue;
+      if (!f(e.id, e.meta))
+        return false;
+    }
+    return true;
   }
   //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
@@ -418,28 +1172,23 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     std::unordered_set<crypto::hash> remove;
-    m_blockchain.for_all_txpool_txes([this, &remove](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
-      uint64_t tx_age = time(nullptr) - meta.receive_time;
+    const uint64_t now = time(nullptr);
+    const uint64_t min_livetime = std::min<uint64_t>(CRYPTONOTE_MEMPOOL_TX_LIVETIME, CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME);
+
+    // oldest first, so we can stop at the first transaction too young to expire
+    const auto &txs_by_receive_time = m_txs.get<pool_tx_by_receive_time>();
+    for (auto it = txs_by_receive_time.begin(); it != txs_by_receive_time.end() && it->receive_time + min_livetime < now; ++it)
+    {
+      const txpool_tx_meta_t &meta = it->meta;
+      uint64_t tx_age = now - meta.receive_time;
 
       if((tx_age > CRYPTONOTE_MEMPOOL_TX_LIVETIME && !meta.kept_by_block) ||
          (tx_age > CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME && meta.kept_by_block) )
       {
-        LOG_PRINT_L1("Tx " << txid << " removed from tx pool due to outdated, age: " << tx_age );
-        auto sorted_it = find_tx_in_sorted_container(txid);
-        if (sorted_it == m_txs_by_fee_and_receive_time.end())
-        {
-          LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
-        }
-        else
-        {
-          m_txs_by_fee_and_receive_time.erase(sorted_it);
-        }
-        m_timed_out_transactions.insert(txid);
-        remove.insert(txid);
+        LOG_PRINT_L1("Tx " << it->id << " removed from tx pool due to outdated, age: " << tx_age );
+        remove.insert(it->id);
       }
-      return true;
-    }, false);
-
+    }
     if (!remove.empty())
     {
       LockedTXN lock(m_blockchain);
@@ -447,9 +1196,8 @@ namespace cryptonote
       {
         try
         {
-          cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
-          cryptonote::transaction tx;
-          if (!parse_and_validate_tx_from_blob(bd, tx))
+          const std::shared_ptr<const transaction> tx = get_parsed_tx(txid);
+          if (!tx)
           {
             MERROR("Failed to parse tx from txpool");
             // continue
@@ -458,7 +1206,7 @@ namespace cryptonote
           {
             // remove first, so we only remove key images if the tx removal succeeds
             m_blockchain.remove_txpool_tx(txid);
-            remove_transaction_keyimages(tx);
+            remove_transaction_keyimages(*tx);
           }
         }
         catch (const std::exception &e)
@@ -466,6 +1214,9 @@ namespace cryptonote
           MWARNING("Failed to remove stuck transaction: " << txid);
           // ignore error
         }
+        remove_tx_entry(txid);
+        remove_template_candidate(txid);
+        m_timed_out_transactions.insert(txid);
       }
     }
     return true;
@@ -477,7 +1228,7 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     const uint64_t now = time(NULL);
-    m_blockchain.for_all_txpool_txes([this, now, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *){
+    for_all_tx_meta([this, now, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta){
       // 0 fee transactions are never relayed
       if(meta.fee > 0 && !meta.do_not_relay && now - meta.last_relayed_time > get_relay_delay(now, meta.receive_time))
       {
@@ -500,7 +1251,7 @@ namespace cryptonote
         }
       }
       return true;
-    }, false);
+    });
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -514,10 +1265,13 @@ namespace cryptonote
     {
       try
       {
-        txpool_tx_meta_t meta = m_blockchain.get_txpool_tx_meta(it->first);
+        const txpool_tx_meta_t *current_meta = get_tx_meta(it->first);
+        if (!current_meta)
+          continue;
+        txpool_tx_meta_t meta = *current_meta;
         meta.relayed = true;
         meta.last_relayed_time = now;
-        m_blockchain.update_txpool_tx(it->first, meta);
+        update_tx_meta(it->first, meta);
       }
       catch (const std::exception &e)
       {
@@ -530,35 +1284,43 @@ namespace cryptonote
   size_t tx_memory_pool::get_transactions_count(bool include_unrelayed_txes) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
+    return include_unrelayed_txes ? m_aggregates.count() : m_relayable_aggregates.count();
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::list<transaction>& txs, bool include_unrelayed_txes) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+    for_all_tx_meta([this, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta){
+      try
       {
-        MERROR("Failed to parse tx from txpool");
+        const std::shared_ptr<const transaction> tx = get_parsed_tx(txid);
+        if (!tx)
+        {
+          MERROR("Failed to parse tx from txpool");
+          // continue
+          return true;
+        }
+        txs.push_back(*tx);
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to get tx from txpool: " << e.what());
         // continue
-        return true;
       }
-      txs.push_back(tx);
       return true;
-    }, true, include_unrelayed_txes);
+    }, include_unrelayed_txes);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    txs.reserve(txs.size() + m_txs.size());
+    for_all_tx_meta([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta){
       txs.push_back(txid);
       return true;
-    }, false, include_unrelayed_txes);
+    }, include_unrelayed_txes);
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes) const
@@ -566,87 +1328,28 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     const uint64_t now = time(NULL);
-    m_blockchain.for_all_txpool_txes([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      backlog.push_back({meta.blob_size, meta.fee, meta.receive_time - now});
+    backlog.reserve(backlog.size() + (include_unrelayed_txes ? m_aggregates : m_relayable_aggregates).count());
+    for_all_tx_meta([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta){
+      backlog.push_back({meta.blob_size, meta.fee, now > meta.receive_time ? now - meta.receive_time : 0});
       return true;
-    }, false, include_unrelayed_txes);
+    }, include_unrelayed_txes);
   }
   //------------------------------------------------------------------
-  void tx_memory_pool::get_transaction_stats(struct txpool_stats& stats, bool include_unrelayed_txes) const
+  void tx_memory_pool::get_transaction_backlog_buckets(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     const uint64_t now = time(NULL);
-    std::map<uint64_t, txpool_histo> agebytes;
-    stats.txs_total = m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
-    std::vector<uint32_t> sizes;
-    sizes.reserve(stats.txs_total);
-    m_blockchain.for_all_txpool_txes([&stats, &sizes, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      sizes.push_back(meta.blob_size);
-      stats.bytes_total += meta.blob_size;
-      if (!stats.bytes_min || meta.blob_size < stats.bytes_min)
-        stats.bytes_min = meta.blob_size;
-      if (meta.blob_size > stats.bytes_max)
-        stats.bytes_max = meta.blob_size;
-      if (!meta.relayed)
-        stats.num_not_relayed++;
-      stats.fee_total += meta.fee;
-      if (!stats.oldest || meta.receive_time < stats.oldest)
-        stats.oldest = meta.receive_time;
-      if (meta.receive_time < now - 600)
-        stats.num_10m++;
-      if (meta.last_failed_height)
-        stats.num_failing++;
-      uint64_t age = now - meta.receive_time + (now == meta.receive_time);
-      agebytes[age].txs++;
-      agebytes[age].bytes += meta.blob_size;
-      if (meta.double_spend_seen)
-        ++stats.num_double_spends;
-      return true;
-      }, false, include_unrelayed_txes);
-    stats.bytes_med = epee::misc_utils::median(sizes);
-    if (stats.txs_total > 1)
-    {
-      /* looking for 98th percentile */
-      size_t end = stats.txs_total * 0.02;
-      uint64_t delta, factor;
-      std::map<uint64_t, txpool_histo>::iterator it, i2;
-      if (end)
-      {
-        /* If enough txs, spread the first 98% of results across
-         * the first 9 bins, drop final 2% in last bin.
-         */
-        it=agebytes.end();
-        for (size_t n=0; n <= end; n++, it--);
-        stats.histo_98pc = it->first;
-        factor = 9;
-        delta = it->first;
-        stats.histo.resize(10);
-      } else
-      {
-        /* If not enough txs, don't reserve the last slot;
-         * spread evenly across all 10 bins.
-         */
-        stats.histo_98pc = 0;
-        it = agebytes.end();
-        factor = stats.txs_total > 9 ? 10 : stats.txs_total;
-        delta = now - stats.oldest;
-        stats.histo.resize(factor);
-      }
-      if (!delta)
-        delta = 1;
-      for (i2 = agebytes.begin(); i2 != it; i2++)
-      {
-        size_t i = (i2->first * factor - 1) / delta;
-        stats.histo[i].txs += i2->second.txs;
-        stats.histo[i].bytes += i2->second.bytes;
-      }
-      for (; i2 != agebytes.end(); i2++)
-      {
-        stats.histo[factor].txs += i2->second.txs;
-        stats.histo[factor].bytes += i2->second.bytes;
-      }
-    }
+    (include_unrelayed_txes ? m_aggregates : m_relayable_aggregates).get_backlog(backlog, now);
+  }
+  //------------------------------------------------------------------
+  void tx_memory_pool::get_transaction_stats(struct txpool_stats& stats, bool include_unrelayed_txes) const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    const uint64_t now = time(NULL);
+    (include_unrelayed_txes ? m_aggregates : m_relayable_aggregates).get_stats(stats, now);
+    stats.num_evicted = m_num_evicted;
+    stats.bytes_evicted = m_bytes_evicted;
+    stats.num_evicted_rejected = m_num_evicted_rejected;
   }
   //------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
@@ -654,17 +1357,18 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    m_blockchain.for_all_txpool_txes([this, &tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       tx_info txi;
       txi.id_hash = epee::string_tools::pod_to_hex(txid);
       txi.tx_blob = *bd;
-      transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+      const std::shared_ptr<const transaction> ptx = get_parsed_tx(txid, bd);
+      if (!ptx)
       {
         MERROR("Failed to parse tx from txpool");
         // continue
         return true;
       }
+      transaction tx = *ptx;
       txi.tx_json = obj_to_json_str(tx);
       txi.blob_size = meta.blob_size;
       txi.fee = meta.fee;
@@ -684,53 +1388,49 @@ namespace cryptonote
       return true;
     }, true, include_sensitive_data);
 
-    txpool_tx_meta_t meta;
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
-      const crypto::key_image& k_image = kee.first;
-      const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
+    bool r = true;
+    m_spent_key_images.for_each([this, &r, &key_image_infos, include_sensitive_data](const crypto::key_image& k_image, const spent_key_images_index::tx_hashes_container& kei_image_set) {
       spent_key_image_info ki;
       ki.id_hash = epee::string_tools::pod_to_hex(k_image);
       for (const crypto::hash& tx_id_hash : kei_image_set)
       {
         if (!include_sensitive_data)
         {
-          try
-          {
-            meta = m_blockchain.get_txpool_tx_meta(tx_id_hash);
-            if (!meta.relayed)
-              // Do not include that transaction if in restricted mode and it's not relayed
-              continue;
-          }
-          catch (const std::exception &e)
+          const txpool_tx_meta_t *meta = get_tx_meta(tx_id_hash);
+          if (!meta)
           {
-            MERROR("Failed to get tx meta from txpool: " << e.what());
-            return false;
+            MERROR("Failed to get tx meta from txpool");
+            r = false;
+            return;
           }
+          if (!meta->relayed)
+            // Do not include that transaction if in restricted mode and it's not relayed
+            continue;
         }
         ki.txs_hashes.push_back(epee::string_tools::pod_to_hex(tx_id_hash));
       }
       // Only return key images for which we have at least one tx that we can show for them
       if (!ki.txs_hashes.empty())
         key_image_infos.push_back(ki);
-    }
-    return true;
+    });
+    return r;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_pool_for_rpc(std::vector<cryptonote::rpc::tx_in_pool>& tx_infos, cryptonote::rpc::key_images_with_tx_hashes& key_image_infos) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    m_blockchain.for_all_txpool_txes([this, &tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       cryptonote::rpc::tx_in_pool txi;
       txi.tx_hash = txid;
-      transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+      const std::shared_ptr<const transaction> tx = get_parsed_tx(txid, bd);
+      if (!tx)
       {
         MERROR("Failed to parse tx from txpool");
         // continue
         return true;
       }
-      txi.tx = tx;
+      txi.tx = *tx;
       txi.blob_size = meta.blob_size;
       txi.fee = meta.fee;
       txi.kept_by_block = meta.kept_by_block;
@@ -747,30 +1447,20 @@ namespace cryptonote
       return true;
     }, true, false);
 
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
-      std::vector<crypto::hash> tx_hashes;
-      const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
-      for (const crypto::hash& tx_id_hash : kei_image_set)
-      {
-        tx_hashes.push_back(tx_id_hash);
-      }
-
-      const crypto::key_image& k_image = kee.first;
-      key_image_infos[k_image] = tx_hashes;
-    }
+    m_spent_key_images.for_each([&key_image_infos](const crypto::key_image& k_image, const spent_key_images_index::tx_hashes_container& kei_image_set) {
+      key_image_infos[k_image] = std::vector<crypto::hash>(kei_image_set.begin(), kei_image_set.end());
+    });
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-
+    // no pool lock needed, the key images index has its own locks
     spent.clear();
 
     for (const auto& image : key_images)
     {
-      spent.push_back(m_spent_key_images.find(image) == m_spent_key_images.end() ? false : true);
+      spent.push_back(m_spent_key_images.contains(image));
     }
 
     return true;
@@ -792,25 +1482,30 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_block_template.valid = false;
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_block_template.valid = false;
+    // outputs used by pool transactions may have been popped along with the
+    // block, so eligibility must be fully checked again
+    for (auto &e: m_template_candidates)
+      e.second.ready_top_block_id = null_hash;
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx(const crypto::hash &id) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_db().txpool_has_tx(id);
+    return get_tx_meta(id) != NULL;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction& tx) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     for(const auto& in: tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, tokey_in, true);//should never fail
@@ -822,8 +1517,7 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimg_as_spent(const crypto::key_image& key_im) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    return m_spent_key_images.end() != m_spent_key_images.find(key_im);
+    return m_spent_key_images.contains(key_im);
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::lock() const
@@ -894,6 +1588,16 @@ namespace cryptonote
     return false;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::have_key_images(const std::unordered_set<crypto::key_image>& k_images, const std::vector<crypto::key_image>& key_images)
+  {
+    for (const crypto::key_image &ki: key_images)
+    {
+      if (k_images.count(ki))
+        return true;
+    }
+    return false;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::append_key_images(std::unordered_set<crypto::key_image>& k_images, const transaction& tx)
   {
     for(size_t i = 0; i!= tx.vin.size(); i++)
@@ -913,45 +1617,73 @@ namespace cryptonote
     for(size_t i = 0; i!= tx.vin.size(); i++)
     {
       CHECKED_GET_SPECIFIC_VARIANT(tx.vin[i], const txin_to_key, itk, void());
-      const key_images_container::const_iterator it = m_spent_key_images.find(itk.k_image);
-      if (it != m_spent_key_images.end())
+      for (const crypto::hash &txid: m_spent_key_images.get(itk.k_image))
       {
-        for (const crypto::hash &txid: it->second)
+        const txpool_tx_meta_t *current_meta = get_tx_meta(txid);
+        if (current_meta && !current_meta->double_spend_seen)
         {
-          txpool_tx_meta_t meta = m_blockchain.get_txpool_tx_meta(txid);
-          if (!meta.double_spend_seen)
+          MDEBUG("Marking " << txid << " as double spending " << itk.k_image);
+          txpool_tx_meta_t meta = *current_meta;
+          meta.double_spend_seen = true;
+          try
           {
-            MDEBUG("Marking " << txid << " as double spending " << itk.k_image);
-            meta.double_spend_seen = true;
-            try
-            {
-              m_blockchain.update_txpool_tx(txid, meta);
-            }
-            catch (const std::exception &e)
-            {
-              MERROR("Failed to update tx meta: " << e.what());
-              // continue, not fatal
-            }
+            update_tx_meta(txid, meta);
+          }
+          catch (const std::exception &e)
+          {
+            MERROR("Failed to update tx meta: " << e.what());
+            // continue, not fatal
           }
         }
       }
     }
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_replaced_txes(const transaction &tx, uint64_t fee, size_t blob_size, std::vector<crypto::hash> &replaced) const
+  {
+    std::unordered_set<crypto::hash> double_spent;
+    for (const auto &in: tx.vin)
+    {
+      CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
+      for (const crypto::hash &txid: m_spent_key_images.get(txin.k_image))
+        double_spent.insert(txid);
+    }
+    if (double_spent.empty())
+      return false;
+
+    const double fee_per_byte = fee / (double)blob_size;
+    uint64_t replaced_fee = 0;
+    for (const crypto::hash &txid: double_spent)
+    {
+      const txpool_tx_meta_t *meta = get_tx_meta(txid);
+      if (!meta || meta->kept_by_block)
+        return false;
+      if (fee_per_byte < REPLACE_BY_FEE_THRESHOLD * (meta->fee / (double)meta->blob_size))
+        return false;
+      replaced_fee += meta->fee;
+    }
+    if (fee <= replaced_fee)
+      return false;
+
+    replaced.assign(double_spent.begin(), double_spent.end());
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   std::string tx_memory_pool::print_pool(bool short_format) const
   {
     std::stringstream ss;
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&ss, short_format](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *txblob) {
+    m_blockchain.for_all_txpool_txes([this, &ss, short_format](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *txblob) {
       ss << "id: " << txid << std::endl;
       if (!short_format) {
-        cryptonote::transaction tx;
-        if (!parse_and_validate_tx_from_blob(*txblob, tx))
+        const std::shared_ptr<const transaction> ptx = get_parsed_tx(txid, txblob);
+        if (!ptx)
         {
           MERROR("Failed to parse tx from txpool");
           return true; // continue
         }
+        cryptonote::transaction tx = *ptx;
         ss << obj_to_json_str(tx) << std::endl;
       }
       ss << "blob_size: " << meta.blob_size << std::endl
@@ -968,16 +1700,208 @@ namespace cryptonote
     return ss.str();
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::is_template_candidate_ready(const crypto::hash &id, template_candidate &candidate, const crypto::hash &top_block_id, uint8_t version)
+  {
+    if (candidate.ready_top_block_id == top_block_id && candidate.ready_version == version)
+      return candidate.ready;
+
+    if (candidate.ready && candidate.ready_top_block_id != null_hash && candidate.ready_version == version)
+    {
+      // the chain only grew since the transaction was found eligible, so
+      // its inputs are still valid unless they were spent in the meantime
+      for (const crypto::key_image &ki: candidate.key_images)
+      {
+        if (m_blockchain.have_tx_keyimg_as_spent(ki))
+        {
+          candidate.ready = false;
+          break;
+        }
+      }
+      if (candidate.ready)
+      {
+        candidate.ready_top_block_id = top_block_id;
+        return true;
+      }
+    }
+
+    const txpool_tx_meta_t *current_meta = get_tx_meta(id);
+    if (!current_meta)
+    {
+      MERROR("Transaction " << id << " not found in txpool");
+      return false;
+    }
+    txpool_tx_meta_t meta = *current_meta;
+    const std::shared_ptr<const transaction> ptx = get_parsed_tx(id);
+    if (!ptx)
+    {
+      MERROR("Failed to parse tx from txpool");
+      return false;
+    }
+
+    // input checks expand the transaction in place, so work on a copy
+    transaction tx = *ptx;
+    candidate.ready = is_transaction_ready_to_go(meta, tx);
+    candidate.ready_top_block_id = top_block_id;
+    candidate.ready_version = version;
+    if (memcmp(current_meta, &meta, sizeof(meta)))
+    {
+      try
+      {
+        update_tx_meta(id, meta);
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to update tx meta: " << e.what());
+        // continue, not fatal
+      }
+    }
+    return candidate.ready;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::fill_block_template_maximizing_fees(const crypto::hash &top_block_id, size_t median_size, uint64_t already_generated_coins, size_t max_total_size, uint8_t version, std::vector<crypto::hash> &tx_hashes, size_t &total_size, uint64_t &fee, uint64_t &coinbase)
+  {
+    // eligible transactions, greatest fee per byte first, leaving out those
+    // double spending one paying more per byte
+    std::vector<std::pair<crypto::hash, const template_candidate*>> eligible;
+    std::vector<crypto::hash> double_spending;
+    std::unordered_set<crypto::key_image> k_images;
+    const auto &txs_by_fee = m_txs.get<pool_tx_by_fee>();
+    for (auto sorted_it = txs_by_fee.begin(); sorted_it != txs_by_fee.end(); ++sorted_it)
+    {
+      auto candidate_it = m_template_candidates.find(sorted_it->id);
+      if (candidate_it == m_template_candidates.end())
+      {
+        MERROR("Transaction " << sorted_it->id << " not found in block template candidates");
+        continue;
+      }
+      template_candidate &candidate = candidate_it->second;
+      if (candidate.blob_size > max_total_size)
+        continue;
+      bool ready = false;
+      try
+      {
+        ready = is_template_candidate_ready(sorted_it->id, candidate, top_block_id, version);
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to check tx " << sorted_it->id << " for block template: " << e.what());
+      }
+      if (!ready)
+        continue;
+      if (have_key_images(k_images, candidate.key_images))
+      {
+        LOG_PRINT_L2("Transaction " << sorted_it->id << " double spends one paying more per byte");
+        if (!sorted_it->meta.kept_by_block)
+          double_spending.push_back(sorted_it->id);
+        continue;
+      }
+      k_images.insert(candidate.key_images.begin(), candidate.key_images.end());
+      eligible.push_back({sorted_it->id, &candidate});
+    }
+
+    // take them in order up to the penalty free size, leaving room for the coinbase
+    const size_t full_reward_size = std::max<size_t>(median_size, get_min_block_size(version));
+    const size_t penalty_free_size = full_reward_size > CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE ? full_reward_size - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE : 0;
+    size_t n_fitting = 0, fitting_size = 0;
+    while (n_fitting < eligible.size() && fitting_size + eligible[n_fitting].second->blob_size <= penalty_free_size)
+      fitting_size += eligible[n_fitting++].second->blob_size;
+
+    // then search the last ones taken and the next ones for the most paying
+    // way to use the room they share
+    const size_t n_fixed = n_fitting - std::min(n_fitting, TEMPLATE_KNAPSACK_TAIL);
+    size_t fixed_size = 0;
+    for (size_t i = 0; i < n_fixed; ++i)
+      fixed_size += eligible[i].second->blob_size;
+    const size_t room = penalty_free_size - fixed_size;
+    std::vector<size_t> window, sizes;
+    std::vector<uint64_t> fees;
+    uint64_t in_order_fee = 0;
+    for (size_t i = n_fixed; i < eligible.size() && window.size() < n_fitting - n_fixed + TEMPLATE_KNAPSACK_NEXT; ++i)
+    {
+      if (eligible[i].second->blob_size > room)
+        continue;
+      if (i < n_fitting)
+        in_order_fee += eligible[i].second->fee;
+      window.push_back(i);
+      sizes.push_back(eligible[i].second->blob_size);
+      fees.push_back(eligible[i].second->fee);
+    }
+
+    std::vector<bool> taken(eligible.size(), false);
+    for (size_t i = 0; i < n_fitting; ++i)
+      taken[i] = true;
+    const std::vector<size_t> selected = select_max_fee_txes(sizes, fees, room);
+    uint64_t selected_fee = 0;
+    for (size_t i: selected)
+      selected_fee += fees[i];
+    // sizes are rounded up in the search, so it may miss the plain order
+    if (selected_fee > in_order_fee)
+    {
+      LOG_PRINT_L2("Search of " << window.size() << " txes for " << room << " bytes raised fees from " << print_money(in_order_fee) << " to " << print_money(selected_fee));
+      for (size_t i = n_fixed; i < n_fitting; ++i)
+        taken[i] = false;
+      for (size_t i: selected)
+        taken[window[i]] = true;
+    }
+
+    total_size = 0;
+    fee = 0;
+    for (size_t i = 0; i < eligible.size(); ++i)
+    {
+      if (!taken[i])
+        continue;
+      tx_hashes.push_back(eligible[i].first);
+      total_size += eligible[i].second->blob_size;
+      fee += eligible[i].second->fee;
+    }
+    uint64_t block_reward;
+    get_block_reward(median_size, total_size, already_generated_coins, block_reward, version);
+    coinbase = block_reward + fee;
+
+    // then go beyond the penalty free size as long as it increases the coinbase
+    for (size_t i = 0; i < eligible.size(); ++i)
+    {
+      if (taken[i])
+        continue;
+      const template_candidate &candidate = *eligible[i].second;
+      if (max_total_size < total_size + candidate.blob_size)
+        continue;
+      if (!get_block_reward(median_size, total_size + candidate.blob_size, already_generated_coins, block_reward, version))
+        continue;
+      if (block_reward + fee + candidate.fee < template_accept_threshold(coinbase))
+        continue;
+      tx_hashes.push_back(eligible[i].first);
+      total_size += candidate.blob_size;
+      fee += candidate.fee;
+      coinbase = block_reward + fee;
+    }
+
+    for (const crypto::hash &txid: double_spending)
+    {
+      if (evict_tx(txid))
+        MINFO("Evicted tx " << txid << " from txpool: double spends a tx paying more per byte");
+    }
+  }
+  //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::fill_block_template(block &bl, size_t median_size, uint64_t already_generated_coins, size_t &total_size, uint64_t &fee, uint64_t &expected_reward, uint8_t version)
   {
-    // Warning: This function takes already_generated_
-    // coins as an argument and appears to do nothing
-    // with it.
-
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
+    const crypto::hash top_block_id = m_blockchain.get_tail_id();
+    if (m_block_template.valid && m_block_template.top_block_id == top_block_id && m_block_template.median_size == median_size
+        && m_block_template.already_generated_coins == already_generated_coins && m_block_template.version == version)
+    {
+      bl.tx_hashes.insert(bl.tx_hashes.end(), m_block_template.tx_hashes.begin(), m_block_template.tx_hashes.end());
+      total_size = m_block_template.total_size;
+      fee = m_block_template.fee;
+      expected_reward = m_block_template.expected_reward;
+      LOG_PRINT_L2("Block template reused with " << m_block_template.tx_hashes.size() << " txes, size " << total_size
+          << ", coinbase " << print_money(expected_reward) << " (including " << print_money(fee) << " in fees)");
+      return true;
+    }
+
     uint64_t best_coinbase = 0, coinbase = 0;
     total_size = 0;
     fee = 0;
@@ -990,108 +1914,122 @@ namespace cryptonote
     size_t max_total_size_v5 = 2 * median_size - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
     size_t max_total_size = version >= 5 ? max_total_size_v5 : max_total_size_pre_v5;
     std::unordered_set<crypto::key_image> k_images;
+    std::vector<crypto::hash> tx_hashes;
 
-    LOG_PRINT_L2("Filling block template, median size " << median_size << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
+    LOG_PRINT_L2("Filling block template, median size " << median_size << ", " << m_txs.size() << " txes in the pool");
 
     LockedTXN lock(m_blockchain);
 
-    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
-    while (sorted_it != m_txs_by_fee_and_receive_time.end())
+    // the fee maximizing filling relies on the penalty free zone, which only exists from v5
+    if (m_maximize_fees && version >= 5)
     {
-      txpool_tx_meta_t meta = m_blockchain.get_txpool_tx_meta(sorted_it->second);
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", size " << meta.blob_size << ", current block size " << total_size << "/" << max_total_size << ", current coinbase " << print_money(best_coinbase));
-
-      // Can not exceed maximum block size
-      if (max_total_size < total_size + meta.blob_size)
-      {
-        LOG_PRINT_L2("  would exceed maximum block size");
-        sorted_it++;
-        continue;
-      }
-
-      // start using the optimal filling algorithm from v5
-      if (version >= 5)
+      fill_block_template_maximizing_fees(top_block_id, median_size, already_generated_coins, max_total_size, version, tx_hashes, total_size, fee, best_coinbase);
+    }
+    else
+    {
+      const auto &txs_by_fee = m_txs.get<pool_tx_by_fee>();
+      auto sorted_it = txs_by_fee.begin();
+      while (sorted_it != txs_by_fee.end())
       {
-        // If we're getting lower coinbase tx,
-        // stop including more tx
-        uint64_t block_reward;
-        if(!get_block_reward(median_size, total_size + meta.blob_size, already_generated_coins, block_reward, version))
+        auto candidate_it = m_template_candidates.find(sorted_it->id);
+        if (candidate_it == m_template_candidates.end())
         {
-          LOG_PRINT_L2("  would exceed maximum block size");
+          MERROR("Transaction " << sorted_it->id << " not found in block template candidates");
           sorted_it++;
           continue;
         }
-        coinbase = block_reward + fee + meta.fee;
-        if (coinbase < template_accept_threshold(best_coinbase))
+        template_candidate &candidate = candidate_it->second;
+        LOG_PRINT_L2("Considering " << sorted_it->id << ", size " << candidate.blob_size << ", current block size " << total_size << "/" << max_total_size << ", current coinbase " << print_money(best_coinbase));
+
+        // Can not exceed maximum block size
+        if (max_total_size < total_size + candidate.blob_size)
         {
-          LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+          LOG_PRINT_L2("  would exceed maximum block size");
           sorted_it++;
           continue;
         }
-      }
-      else
-      {
-        // If we've exceeded the penalty free size,
-        // stop including more tx
-        if (total_size > median_size)
+
+        // start using the optimal filling algorithm from v5
+        if (version >= 5)
         {
-          LOG_PRINT_L2("  would exceed median block size");
-          break;
+          // If we're getting lower coinbase tx,
+          // stop including more tx
+          uint64_t block_reward;
+          if(!get_block_reward(median_size, total_size + candidate.blob_size, already_generated_coins, block_reward, version))
+          {
+            LOG_PRINT_L2("  would exceed maximum block size");
+            sorted_it++;
+            continue;
+          }
+          coinbase = block_reward + fee + candidate.fee;
+          if (coinbase < template_accept_threshold(best_coinbase))
+          {
+            LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+            sorted_it++;
+            continue;
+          }
+        }
+        else
+        {
+          // If we've exceeded the penalty free size,
+          // stop including more tx
+          if (total_size > median_size)
+          {
+            LOG_PRINT_L2("  would exceed median block size");
+            break;
+          }
         }
-      }
-
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
-      cryptonote::transaction tx;
-      if (!parse_and_validate_tx_from_blob(txblob, tx))
-      {
-        MERROR("Failed to parse tx from txpool");
-        sorted_it++;
-        continue;
-      }
 
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = is_transaction_ready_to_go(meta, tx);
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
-      {
+        // Skip transactions that are not ready to be
+        // included into the blockchain or that are
+        // missing key images
+        bool ready = false;
         try
-	{
-	  m_blockchain.update_txpool_tx(sorted_it->second, meta);
-	}
+        {
+          ready = is_template_candidate_ready(sorted_it->id, candidate, top_block_id, version);
+        }
         catch (const std::exception &e)
-	{
-	  MERROR("Failed to update tx meta: " << e.what());
-	  // continue, not fatal
-	}
-      }
-      if (!ready)
-      {
-        LOG_PRINT_L2("  not ready to go");
-        sorted_it++;
-        continue;
-      }
-      if (have_key_images(k_images, tx))
-      {
-        LOG_PRINT_L2("  key images already seen");
+        {
+          MERROR("Failed to check tx " << sorted_it->id << " for block template: " << e.what());
+        }
+        if (!ready)
+        {
+          LOG_PRINT_L2("  not ready to go");
+          sorted_it++;
+          continue;
+        }
+        if (have_key_images(k_images, candidate.key_images))
+        {
+          LOG_PRINT_L2("  key images already seen");
+          sorted_it++;
+          continue;
+        }
+
+        tx_hashes.push_back(sorted_it->id);
+        total_size += candidate.blob_size;
+        fee += candidate.fee;
+        best_coinbase = coinbase;
+        k_images.insert(candidate.key_images.begin(), candidate.key_images.end());
         sorted_it++;
-        continue;
+        LOG_PRINT_L2("  added, new block size " << total_size << "/" << max_total_size << ", coinbase " << print_money(best_coinbase));
       }
-
-      bl.tx_hashes.push_back(sorted_it->second);
-      total_size += meta.blob_size;
-      fee += meta.fee;
-      best_coinbase = coinbase;
-      append_key_images(k_images, tx);
-      sorted_it++;
-      LOG_PRINT_L2("  added, new block size " << total_size << "/" << max_total_size << ", coinbase " << print_money(best_coinbase));
     }
 
     expected_reward = best_coinbase;
-    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, size "
+    LOG_PRINT_L2("Block template filled with " << tx_hashes.size() << " txes, size "
         << total_size << "/" << max_total_size << ", coinbase " << print_money(best_coinbase)
         << " (including " << print_money(fee) << " in fees)");
+
+    bl.tx_hashes.insert(bl.tx_hashes.end(), tx_hashes.begin(), tx_hashes.end());
+    m_block_template.valid = true;
+    m_block_template.top_block_id = top_block_id;
+    m_block_template.median_size = median_size;
+    m_block_template.already_generated_coins = already_generated_coins;
+    m_block_template.version = version;
+    m_block_template.tx_hashes = std::move(tx_hashes);
+    m_block_template.total_size = total_size;
+    m_block_template.fee = fee;
+    m_block_template.expected_reward = expected_reward;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -1100,19 +2038,24 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     size_t tx_size_limit = get_transaction_size_limit(version);
+    const crypto::hash top_block_id = m_blockchain.get_tail_id();
     std::unordered_set<crypto::hash> remove;
 
-    m_blockchain.for_all_txpool_txes([this, &remove, tx_size_limit](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
+    for_all_tx_meta([this, &remove, tx_size_limit, &top_block_id, version](const crypto::hash &txid, const txpool_tx_meta_t &meta) {
+      // eligible on top of the current chain means it's not in it
+      const auto candidate = m_template_candidates.find(txid);
+      const bool ready = candidate != m_template_candidates.end() && candidate->second.ready &&
+          candidate->second.ready_top_block_id == top_block_id && candidate->second.ready_version == version;
       if (meta.blob_size >= tx_size_limit) {
         LOG_PRINT_L1("Transaction " << txid << " is too big (" << meta.blob_size << " bytes), removing it from pool");
         remove.insert(txid);
       }
-      else if (m_blockchain.have_tx(txid)) {
+      else if (!ready && m_blockchain.have_tx(txid)) {
         LOG_PRINT_L1("Transaction " << txid << " is in the blockchain, removing it from pool");
         remove.insert(txid);
       }
       return true;
-    }, false);
+    });
 
     size_t n_removed = 0;
     if (!remove.empty())
@@ -1122,25 +2065,17 @@ namespace cryptonote
       {
         try
         {
-          cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
-          cryptonote::transaction tx;
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
+          const std::shared_ptr<const transaction> tx = get_parsed_tx(txid);
+          if (!tx)
           {
             MERROR("Failed to parse tx from txpool");
             continue;
           }
           // remove tx from db first
           m_blockchain.remove_txpool_tx(txid);
-          remove_transaction_keyimages(tx);
-          auto sorted_it = find_tx_in_sorted_container(txid);
-          if (sorted_it == m_txs_by_fee_and_receive_time.end())
-          {
-            LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
-          }
-          else
-          {
-            m_txs_by_fee_and_receive_time.erase(sorted_it);
-          }
+          remove_transaction_keyimages(*tx);
+          remove_tx_entry(txid);
+          remove_template_candidate(txid);
           ++n_removed;
         }
         catch (const std::exception &e)
@@ -1153,31 +2088,137 @@ namespace cryptonote
     return n_removed;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::init()
+  bool tx_memory_pool::init(size_t max_txpool_size, const std::string &config_folder)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    m_txs_by_fee_and_receive_time.clear();
+    m_config_folder = config_folder;
+    m_txpool_max_size = max_txpool_size ? max_txpool_size : DEFAULT_TXPOOL_MAX_SIZE;
+    m_evicted_txs.clear();
+
+    m_txs.clear();
+    m_short_ids.clear();
+    m_aggregates.clear();
+    m_relayable_aggregates.clear();
     m_spent_key_images.clear();
+    m_template_candidates.clear();
+    m_block_template.valid = false;
+    m_parsed_txs.clear();
+
+    // the saved state is only good for one init, the pool will change from now on
+    std::unordered_map<crypto::hash, template_candidate> saved_candidates;
+    if (!m_config_folder.empty())
+    {
+      const std::string state_file_path = m_config_folder + "/" + CRYPTONOTE_POOLDATA_FILENAME;
+      if (boost::filesystem::exists(state_file_path))
+      {
+        saved_state saved;
+        std::string contents, payload;
+        bool loaded = epee::file_io_utils::load_file_to_string(state_file_path, contents) && read_pool_state_file(contents, payload);
+        if (loaded)
+        {
+          try
+          {
+            std::istringstream iss(payload);
+            boost::archive::portable_binary_iarchive a(iss);
+            a >> saved;
+          }
+          catch (const std::exception &e)
+          {
+            MWARNING("Failed to parse saved pool state: " << e.what());
+            loaded = false;
+          }
+        }
+        if (loaded)
+        {
+          saved_candidates.reserve(saved.template_candidates.size());
+          for (auto &e: saved.template_candidates)
+            saved_candidates.emplace(e.first, std::move(e.second));
+        }
+        else
+        {
+          MWARNING("Failed to load pool state from " << state_file_path << ", rebuilding it");
+        }
+        boost::system::error_code ec;
+        boost::filesystem::remove(state_file_path, ec);
+      }
+    }
+
     std::vector<crypto::hash> remove;
-    bool r = m_blockchain.for_all_txpool_txes([this, &remove](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
-      cryptonote::transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+    const auto add_parsed_tx = [this, &remove](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+      const std::shared_ptr<const transaction> tx = get_parsed_tx(txid, bd);
+      if (!tx)
       {
         MWARNING("Failed to parse tx from txpool, removing");
         remove.push_back(txid);
+        return true;
       }
-      if (!insert_key_images(tx, meta.kept_by_block))
+      if (!insert_key_images(*tx, meta.kept_by_block))
       {
         MFATAL("Failed to insert key images from txpool tx");
         return false;
       }
-      m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.blob_size, meta.receive_time), txid);
+      add_tx_entry(txid, meta);
+      add_template_candidate(txid, *tx, meta, false);
+      return true;
+    };
+
+    // a saved entry is only trusted if its key images are not spent in the
+    // chain, nor by another pool transaction, else the blob is read instead
+    const auto saved_key_images_usable = [this](const txpool_tx_meta_t &meta, const template_candidate &candidate) {
+      if (candidate.key_images.empty())
+        return false;
+      std::unordered_set<crypto::key_image> seen;
+      for (const crypto::key_image &key_image: candidate.key_images)
+      {
+        if (!seen.insert(key_image).second)
+          return false;
+        if (!meta.kept_by_block && m_spent_key_images.contains(key_image))
+          return false;
+        if (m_blockchain.have_tx_keyimg_as_spent(key_image))
+          return false;
+      }
+      return true;
+    };
+
+    // blobs are only read for the transactions the saved state does not cover
+    size_t n_restored = 0;
+    std::vector<std::pair<crypto::hash, txpool_tx_meta_t>> unsaved;
+    bool r = m_blockchain.for_all_txpool_txes([this, &saved_candidates, &n_restored, &unsaved, &add_parsed_tx, &saved_key_images_usable](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+      if (bd)
+        return add_parsed_tx(txid, meta, bd);
+      auto saved = saved_candidates.find(txid);
+      if (saved == saved_candidates.end() || saved->second.blob_size != meta.blob_size || saved->second.fee != meta.fee
+          || !saved_key_images_usable(meta, saved->second))
+      {
+        unsaved.push_back(std::make_pair(txid, meta));
+        return true;
+      }
+      for (const crypto::key_image &key_image: saved->second.key_images)
+      {
+        if (!m_spent_key_images.insert(key_image, txid, meta.kept_by_block))
+        {
+          MFATAL("Failed to insert key images from saved pool state");
+          return false;
+        }
+      }
+      add_tx_entry(txid, meta);
+      template_candidate &candidate = m_template_candidates[txid];
+      candidate = std::move(saved->second);
+      // the fast readiness path assumes the chain only grew since the check,
+      // which does not hold if the saved top block was popped while we were down
+      if (candidate.ready_top_block_id != null_hash && !m_blockchain.get_db().block_exists(candidate.ready_top_block_id))
+        candidate.ready_top_block_id = null_hash;
+      ++n_restored;
       return true;
-    }, true);
+    }, saved_candidates.empty());
+    for (size_t i = 0; r && i < unsaved.size(); ++i)
+      r = add_parsed_tx(unsaved[i].first, unsaved[i].second, NULL);
     if (!r)
       return false;
+    if (!saved_candidates.empty())
+      MINFO("Restored " << n_restored << "/" << m_txs.size() << " pool transactions from saved pool state");
     if (!remove.empty())
     {
       LockedTXN lock(m_blockchain);
@@ -1194,12 +2235,51 @@ namespace cryptonote
         }
       }
     }
+
+    // the limit may have been lowered since the pool was saved
+    prune(m_txpool_max_size);
     return true;
   }
 
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::resync()
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    // the state file is only there between deinit and the next init, so this reads the database only
+    return init(m_txpool_max_size, m_config_folder);
+  }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::deinit()
   {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    if (m_config_folder.empty())
+      return true;
+
+    if (!tools::create_directories_if_necessary(m_config_folder))
+    {
+      MWARNING("Failed to create data directory: " << m_config_folder);
+      return false;
+    }
+
+    saved_state saved;
+    saved.template_candidates.reserve(m_template_candidates.size());
+    for (const auto &e: m_template_candidates)
+      saved.template_candidates.push_back(e);
+    const std::string state_file_path = m_config_folder + "/" + CRYPTONOTE_POOLDATA_FILENAME;
+    try
+    {
+      std::ostringstream oss;
+      {
+        boost::archive::portable_binary_oarchive a(oss);
+        a << saved;
+      }
+      if (!epee::file_io_utils::save_string_to_file(state_file_path, make_pool_state_file(oss.str())))
+        MWARNING("Failed to save pool state to " << state_file_path);
+    }
+    catch (const std::exception &e)
+    {
+      MWARNING("Failed to save pool state to " << state_file_path << ": " << e.what());
+    }
     return true;
   }
 }
@@ -31,16 +31,26 @@
 #pragma once
 #include "include_base_utils.h"
 
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
 #include <boost/serialization/version.hpp>
 #include <boost/utility.hpp>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
 
 #include "string_tools.h"
 #include "syncobj.h"
 #include "math_helper.h"
+#include "common/rolling_median.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
 #include "cryptonote_basic/verification_context.h"
 #include "blockchain_db/blockchain_db.h"
@@ -55,26 +65,364 @@ namespace cryptonote
   /*                                                                      */
   /************************************************************************/
 
-  //! pair of <transaction fee, transaction hash> for organization
-  typedef std::pair<std::pair<double, std::time_t>, crypto::hash> tx_by_fee_and_receive_time_entry;
+  //! a transaction in the pool, with an in memory copy of its db metadata
+  struct pool_tx_entry
+  {
+    crypto::hash id;
+    double fee_per_byte;
+    uint64_t receive_time;
+    txpool_tx_meta_t meta;
+
+    pool_tx_entry(const crypto::hash &id, const txpool_tx_meta_t &meta):
+      id(id), fee_per_byte(meta.fee / (double)meta.blob_size), receive_time(meta.receive_time), meta(meta) {}
+  };
 
-  class txCompare
+  struct pool_tx_by_id {};
+  struct pool_tx_by_fee {};
+  struct pool_tx_by_receive_time {};
+
+  //! container for the pool transactions, indexed by hash, by fee per unit
+  //! size (greatest first, then oldest first), and by receive time
+  typedef boost::multi_index_container<
+    pool_tx_entry,
+    boost::multi_index::indexed_by<
+      boost::multi_index::hashed_unique<boost::multi_index::tag<pool_tx_by_id>,
+        boost::multi_index::member<pool_tx_entry, crypto::hash, &pool_tx_entry::id>>,
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<pool_tx_by_fee>,
+        boost::multi_index::composite_key<pool_tx_entry,
+          boost::multi_index::member<pool_tx_entry, double, &pool_tx_entry::fee_per_byte>,
+          boost::multi_index::member<pool_tx_entry, uint64_t, &pool_tx_entry::receive_time>>,
+        boost::multi_index::composite_key_compare<std::greater<double>, std::less<uint64_t>>>,
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<pool_tx_by_receive_time>,
+        boost::multi_index::member<pool_tx_entry, uint64_t, &pool_tx_entry::receive_time>>
+    >
+  > pool_tx_container;
+
+  /**
+   * @brief key images spent by pool transactions, and the transactions spending them
+   *
+   * The key images are split across shards, each with its own lock, so
+   * looking a key image up does not need the pool lock, and does not wait
+   * on lookups or changes of key images in other shards.  Changes are
+   * still made with the pool lock held, so that checking a transaction's
+   * key images and inserting them is atomic with respect to other pool
+   * changes.
+   */
+  class spent_key_images_index
   {
   public:
-    bool operator()(const tx_by_fee_and_receive_time_entry& a, const tx_by_fee_and_receive_time_entry& b)
+    typedef std::unordered_set<crypto::hash> tx_hashes_container;
+
+    /**
+     * @brief records a key image as spent by a transaction
+     *
+     * @param key_image the key image
+     * @param txid the hash of the transaction spending it
+     * @param kept_by_block whether other transactions may already spend it
+     *
+     * @return false if the key image is already spent and kept_by_block is false, or already recorded for this transaction
+     */
+    bool insert(const crypto::key_image &key_image, const crypto::hash &txid, bool kept_by_block);
+
+    /**
+     * @brief removes a transaction from a key image's spenders
+     *
+     * @param key_image the key image
+     * @param txid the hash of the transaction spending it
+     *
+     * @return false if the transaction was not recorded as spending the key image
+     */
+    bool remove(const crypto::key_image &key_image, const crypto::hash &txid);
+
+    /**
+     * @brief checks whether a key image is spent by any transaction
+     *
+     * @param key_image the key image
+     *
+     * @return true if at least one transaction spends it
+     */
+    bool contains(const crypto::key_image &key_image) const;
+
+    /**
+     * @brief gets the transactions spending a key image
+     *
+     * @param key_image the key image
+     *
+     * @return the hashes of the transactions, empty if none
+     */
+    tx_hashes_container get(const crypto::key_image &key_image) const;
+
+    /**
+     * @brief calls a function for each spent key image
+     *
+     * Each shard is locked in turn while its key images are visited.
+     *
+     * @param f the function to call with each key image and its spenders
+     */
+    void for_each(const std::function<void(const crypto::key_image&, const tx_hashes_container&)> &f) const;
+
+    /**
+     * @brief removes all key images
+     */
+    void clear();
+
+  private:
+    //TODO: confirm the below comments and investigate whether or not this
+    //      is the desired behavior
+    //! map key images to transactions which spent them
+    /*! this seems odd, but it seems that multiple transactions can exist
+     *  in the pool which both have the same spent key.  This would happen
+     *  in the event of a reorg where someone creates a new/different
+     *  transaction on the assumption that the original will not be in a
+     *  block again.
+     */
+    typedef std::unordered_map<crypto::key_image, tx_hashes_container> key_images_container;
+
+    struct shard
     {
-      // sort by greatest first, not least
-      if (a.first.first > b.first.first) return true;
-      else if (a.first.first < b.first.first) return false;
-      else if (a.first.second < b.first.second) return true;
-      else if (a.first.second > b.first.second) return false;
-      else if (a.second != b.second) return true;
-      else return false;
-    }
+      mutable boost::mutex lock;
+      key_images_container key_images;
+    };
+
+    static const size_t SHARD_COUNT = 16;
+
+    shard &get_shard(const crypto::key_image &key_image) { return m_shards[reinterpret_cast<const unsigned char*>(&key_image)[0] % SHARD_COUNT]; }
+    const shard &get_shard(const crypto::key_image &key_image) const { return m_shards[reinterpret_cast<const unsigned char*>(&key_image)[0] % SHARD_COUNT]; }
+
+    shard m_shards[SHARD_COUNT];
+  };
+
+  /**
+   * @brief running totals over a set of pool transactions
+   *
+   * These are updated as transactions are added, removed or change state,
+   * so pool statistics and the fee backlog can be reported without going
+   * through every transaction in the pool.
+   */
+  class txpool_aggregates
+  {
+  public:
+    /**
+     * @brief adds a transaction to the totals
+     *
+     * @param meta the transaction's metadata
+     */
+    void add(const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief removes a transaction from the totals
+     *
+     * @param meta the transaction's metadata, as it was when added
+     */
+    void remove(const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief removes all transactions
+     */
+    void clear();
+
+    /**
+     * @brief gets the number of transactions
+     *
+     * @return the number of transactions
+     */
+    size_t count() const { return m_txs; }
+
+    /**
+     * @brief gets the total size of the transactions
+     *
+     * @return the total size, in bytes
+     */
+    uint64_t bytes() const { return m_bytes; }
+
+    /**
+     * @brief fills in pool statistics
+     *
+     * The age histogram is computed as get_transaction_stats always did,
+     * from per receive time totals rather than from each transaction.
+     *
+     * @param stats return-by-reference the statistics
+     * @param now the current time
+     */
+    void get_stats(txpool_stats &stats, uint64_t now) const;
+
+    /**
+     * @brief gets the backlog, one entry per fee per byte bucket
+     *
+     * Each entry holds the total size and fee of the transactions in the
+     * bucket, and their mean time in the pool, highest fee first.
+     *
+     * @param backlog return-by-reference the backlog entries
+     * @param now the current time
+     */
+    void get_backlog(std::vector<tx_backlog_entry> &backlog, uint64_t now) const;
+
+    /**
+     * @brief gets the fee bucket for a transaction
+     *
+     * Buckets are an eighth of a power of two wide, so transactions in the
+     * same bucket pay within about 9% of each other per byte.
+     *
+     * @param fee the transaction's fee
+     * @param blob_size the transaction's size
+     *
+     * @return the bucket, higher for higher fees per byte
+     */
+    static size_t get_fee_bucket(uint64_t fee, uint64_t blob_size);
+
+  private:
+    struct fee_bucket
+    {
+      uint64_t txs;
+      uint64_t bytes;
+      uint64_t fee;
+      uint64_t receive_time_sum;
+    };
+
+    uint64_t m_txs = 0;
+    uint64_t m_bytes = 0;
+    uint64_t m_fee = 0;
+    uint64_t m_num_failing = 0;
+    uint64_t m_num_not_relayed = 0;
+    uint64_t m_num_double_spends = 0;
+    tools::median_set<uint64_t> m_sizes;
+    std::map<uint64_t, txpool_histo> m_by_receive_time;
+    std::map<size_t, fee_bucket> m_fee_buckets;
+  };
+
+  /**
+   * @brief remembers recently evicted transactions, in constant memory
+   *
+   * A pair of bloom filters: once the newer one has taken a generation's
+   * worth of hashes, the older one is dropped and a new one started, so
+   * the last one to two generations of hashes are remembered.  Lookups may
+   * give false positives, about one in 90000 with full filters, but no
+   * false negatives for remembered hashes.
+   */
+  class evicted_tx_filter
+  {
+  public:
+    /**
+     * @brief constructor
+     *
+     * @param generation_size how many hashes each filter takes before rolling over
+     */
+    explicit evicted_tx_filter(size_t generation_size = TXPOOL_EVICTED_FILTER_GENERATION_SIZE);
+
+    /**
+     * @brief remembers a transaction hash
+     *
+     * @param txid the hash
+     */
+    void insert(const crypto::hash &txid);
+
+    /**
+     * @brief checks whether a transaction hash is (probably) remembered
+     *
+     * @param txid the hash
+     *
+     * @return true if the hash was inserted recently, or on a false positive
+     */
+    bool contains(const crypto::hash &txid) const;
+
+    /**
+     * @brief forgets all hashes
+     */
+    void clear();
+
+  private:
+    static const size_t BITS_PER_TX = 32;
+    static const size_t HASHES = sizeof(crypto::hash) / sizeof(uint32_t);
+
+    size_t get_bit(const crypto::hash &txid, size_t n) const;
+
+    size_t m_generation_size;
+    size_t m_bits;
+    size_t m_count;
+    std::vector<uint64_t> m_current;
+    std::vector<uint64_t> m_previous;
+    uint32_t m_salt[HASHES];
+  };
+
+  /**
+   * @brief least recently used cache of parsed pool transactions
+   *
+   * Transactions are shared, not copied, and come with their hash and size
+   * already set, so neither needs computing again.  The cache is bounded
+   * by the total blob size of the transactions it holds.
+   */
+  class parsed_tx_cache
+  {
+  public:
+    /**
+     * @brief constructor
+     *
+     * @param max_bytes the maximum total blob size of the cached transactions
+     */
+    explicit parsed_tx_cache(size_t max_bytes = TXPOOL_PARSED_TX_CACHE_SIZE): m_max_bytes(max_bytes), m_bytes(0) {}
+
+    /**
+     * @brief gets a cached transaction, marking it as recently used
+     *
+     * @param txid the transaction's hash
+     *
+     * @return the transaction, or an empty pointer if it is not cached
+     */
+    std::shared_ptr<const transaction> get(const crypto::hash &txid);
+
+    /**
+     * @brief caches a transaction, dropping the least recently used ones if needed
+     *
+     * @param txid the transaction's hash
+     * @param tx the transaction
+     * @param blob_size the transaction's blob size
+     */
+    void insert(const crypto::hash &txid, const std::shared_ptr<const transaction> &tx, size_t blob_size);
+
+    /**
+     * @brief drops a transaction from the cache, if there
+     *
+     * @param txid the transaction's hash
+     */
+    void erase(const crypto::hash &txid);
+
+    /**
+     * @brief drops all transactions
+     */
+    void clear();
+
+    size_t size() const { return m_entries.size(); }
+    size_t bytes() const { return m_bytes; }
+
+  private:
+    struct entry
+    {
+      std::shared_ptr<const transaction> tx;
+      size_t blob_size;
+      std::list<crypto::hash>::iterator lru;
+    };
+
+    size_t m_max_bytes;
+    size_t m_bytes;
+    std::unordered_map<crypto::hash, entry> m_entries;
+    std::list<crypto::hash> m_lru;  //!< most recently used first
   };
 
-  //! container for sorting transactions by fee per unit size
-  typedef std::set<tx_by_fee_and_receive_time_entry, txCompare> sorted_tx_container;
+  /**
+   * @brief picks which of a set of transactions to fit in a given size for the largest total fee
+   *
+   * This is a 0/1 knapsack, solved exactly with sizes counted in units of
+   * capacity / max_units bytes, rounded up, so time and memory are bounded
+   * at the cost of up to a unit of room per transaction going unused.
+   *
+   * @param sizes the transactions' sizes
+   * @param fees the transactions' fees
+   * @param capacity the room available, in bytes
+   * @param max_units the number of units to count sizes in
+   *
+   * @return the indices of the chosen transactions, in increasing order
+   */
+  std::vector<size_t> select_max_fee_txes(const std::vector<size_t> &sizes, const std::vector<uint64_t> &fees, size_t capacity, size_t max_units = 4096);
 
   /**
    * @brief Transaction pool, handles transactions which are not part of a block
@@ -100,14 +448,42 @@ namespace cryptonote
      */
     tx_memory_pool(Blockchain& bchs);
 
+    /**
+     * @brief the result of checking a transaction's inputs ahead of adding it
+     */
+    struct checked_inputs
+    {
+      bool valid; //!< whether the inputs passed Blockchain::check_tx_inputs
+      uint64_t max_used_block_height; //!< the height of the newest block the inputs use
+      crypto::hash max_used_block_id; //!< the hash of that block
+      crypto::hash top_block_id; //!< the top block of the chain the inputs were checked on
+      tx_verification_context tvc; //!< the flags the check set
+    };
+
+    /**
+     * @brief checks a transaction's inputs against the chain, without the pool's lock
+     *
+     * The ring signature checks are the bulk of the cost of adding a
+     * transaction, so they can be done before taking the pool's lock and
+     * the result passed to add_tx, which uses it if the chain did not
+     * change in between. Transactions paying too low a fee are left
+     * unchecked, add_tx refuses them before it gets to their inputs.
+     *
+     * @param tx the transaction, its RingCT signatures are expanded in place
+     * @param blob_size the transaction's size
+     * @param kept_by_block has this transaction been in a block?
+     * @param inputs return-by-reference the result of the check
+     */
+    void check_tx_inputs(transaction &tx, size_t blob_size, bool kept_by_block, checked_inputs &inputs) const;
 
     /**
      * @copydoc add_tx(transaction&, tx_verification_context&, bool, bool, uint8_t)
      *
      * @param id the transaction's hash
      * @param blob_size the transaction's size
+     * @param inputs the result of check_tx_inputs for this transaction, or NULL to check them here
      */
-    bool add_tx(transaction &tx, const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version);
+    bool add_tx(transaction &tx, const crypto::hash &id, size_t blob_size, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version, const checked_inputs *inputs = NULL);
 
     /**
      * @brief add a transaction to the transaction pool
@@ -155,7 +531,8 @@ namespace cryptonote
     /**
      * @brief action to take when notified of a block added to the blockchain
      *
-     * Currently does nothing
+     * Invalidates the cached block template, so the next one is built on
+     * the new top block.
      *
      * @param new_block_height the height of the blockchain after the change
      * @param top_block_id the hash of the new top block
@@ -167,7 +544,9 @@ namespace cryptonote
     /**
      * @brief action to take when notified of a block removed from the blockchain
      *
-     * Currently does nothing
+     * Invalidates the cached block template, and makes every template
+     * candidate's eligibility be fully checked again, since outputs it
+     * uses may have been popped along with the block.
      *
      * @param new_block_height the height of the blockchain after the change
      * @param top_block_id the hash of the new top block
@@ -198,15 +577,69 @@ namespace cryptonote
     /**
      * @brief loads pool state (if any) from disk, and initializes pool
      *
-     * @param config_folder folder name where pool state will be
+     * Transactions are read from the database.  If the pool state saved
+     * by deinit() is found in config_folder, the key images and block
+     * template eligibility of the transactions it covers are taken from
+     * it instead of parsing them again, and eligibility is only checked
+     * again once the chain has moved on.  A state file with the wrong
+     * format version or checksum is dropped, and an entry whose key images
+     * are spent in the chain or by another pool transaction is not used.
+     *
+     * @param max_txpool_size the maximum total size of the pool, in bytes, 0 for the default
+     * @param config_folder where the pool state is saved, empty to not save it
      *
      * @return true
      */
-    bool init();
+    bool init(size_t max_txpool_size = 0, const std::string &config_folder = std::string());
+
+    /**
+     * @brief sets the maximum total size of the pool, evicting transactions if needed
+     *
+     * @param bytes the maximum total size, in bytes
+     */
+    void set_txpool_max_size(size_t bytes);
+
+    /**
+     * @brief gets the maximum total size of the pool
+     *
+     * @return the maximum total size, in bytes
+     */
+    size_t get_txpool_max_size() const;
+
+    /**
+     * @brief sets whether the pool tries to maximize the fees of the blocks it fills
+     *
+     * When set, a transaction double spending pool transactions replaces them
+     * if it pays more per byte and in total, rather than being refused, and
+     * block templates are filled up to the penalty free size with the most
+     * paying combination of transactions found, rather than in fee per byte
+     * order only.
+     *
+     * @param maximize_fees whether to maximize fees
+     */
+    void set_maximize_fees(bool maximize_fees);
+
+    /**
+     * @brief gets the salt peers should use for the short ids of the transactions they announce
+     *
+     * @return the salt, never 0
+     */
+    uint64_t get_short_id_salt() const { return m_short_id_salt; }
+
+    /**
+     * @brief gets which of a set of short transaction ids are not in the pool
+     *
+     * @param short_ids the short ids, salted with get_short_id_salt
+     * @param missing return-by-reference the short ids of the transactions not in the pool
+     */
+    void get_missing_short_ids(const std::vector<uint64_t> &short_ids, std::vector<uint64_t> &missing) const;
 
     /**
      * @brief attempts to save the transaction pool state to disk
      *
+     * The transactions themselves are already in the database, so this
+     * only saves what init() would otherwise have to rebuild from them.
+     *
      * Currently fails (returns false) if the data directory from init()
      * does not exist and cannot be created, but returns true even if
      * saving to disk is unsuccessful.
@@ -215,9 +648,24 @@ namespace cryptonote
      */
     bool deinit();
 
+    /**
+     * @brief rebuilds the in memory pool from the database
+     *
+     * For when a write to the database failed, after which the two may
+     * disagree on which transactions are in the pool.
+     *
+     * @return true on success, false otherwise
+     */
+    bool resync();
+
     /**
      * @brief Chooses transactions for a block to include
      *
+     * The pool keeps the last template it built, along with what it knows
+     * of each transaction's eligibility, and updates them as transactions
+     * come and go.  If nothing relevant changed since the last call, the
+     * cached template is returned as is.
+     *
      * @param bl return-by-reference the block to fill in with transactions
      * @param median_size the current median block size
      * @param already_generated_coins the current total number of coins "minted"
@@ -249,14 +697,27 @@ namespace cryptonote
     void get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes = true) const;
 
     /**
-     * @brief get (size, fee, receive time) for all transaction in the pool
+     * @brief get (size, fee, time in pool) for all transactions in the pool
      *
-     * @param txs return-by-reference that data
+     * @param backlog return-by-reference that data
      * @param include_unrelayed_txes include unrelayed txes in the result
      *
      */
     void get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes = true) const;
 
+    /**
+     * @brief get (size, fee, time in pool) for the pool, grouped by fee per byte
+     *
+     * Each entry sums the size and fee of the transactions paying about the
+     * same per byte, with their mean time in the pool, highest fee first.
+     * This is read from running totals, so costs nothing per transaction.
+     *
+     * @param backlog return-by-reference that data
+     * @param include_unrelayed_txes include unrelayed txes in the result
+     *
+     */
+    void get_transaction_backlog_buckets(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes = true) const;
+
     /**
      * @brief get a summary statistics of all transaction hashes in the pool
      *
@@ -472,6 +933,16 @@ namespace cryptonote
      */
     static bool have_key_images(const std::unordered_set<crypto::key_image>& kic, const transaction& tx);
 
+    /**
+     * @brief check if any of the given key images are present in a given set
+     *
+     * @param kic the set of key images to check against
+     * @param key_images the key images to check
+     *
+     * @return true if any key images present in the set, otherwise false
+     */
+    static bool have_key_images(const std::unordered_set<crypto::key_image>& kic, const std::vector<crypto::key_image>& key_images);
+
     /**
      * @brief append the key images from a transaction to the given set
      *
@@ -496,16 +967,161 @@ namespace cryptonote
      */
     void mark_double_spend(const transaction &tx);
 
-    //TODO: confirm the below comments and investigate whether or not this
-    //      is the desired behavior
-    //! map key images to transactions which spent them
-    /*! this seems odd, but it seems that multiple transactions can exist
-     *  in the pool which both have the same spent key.  This would happen
-     *  in the event of a reorg where someone creates a new/different
-     *  transaction on the assumption that the original will not be in a
-     *  block again.
+    /**
+     * @brief gets the pool transactions a transaction double spending them may replace
+     *
+     * A transaction may replace those it double spends if none of them is
+     * kept_by_block, if it pays more per byte than each of them by a margin,
+     * and if it pays more than all of them together.
+     *
+     * @param tx the transaction
+     * @param fee the transaction's fee
+     * @param blob_size the transaction's size
+     * @param replaced return-by-reference the transactions to replace
+     *
+     * @return true if the transaction double spends pool transactions and may replace them, otherwise false
+     */
+    bool get_replaced_txes(const transaction &tx, uint64_t fee, size_t blob_size, std::vector<crypto::hash> &replaced) const;
+
+    /**
+     * @brief removes a transaction from the pool, remembering it as evicted
+     *
+     * The pool and blockchain locks, and a db batch, must be held.
+     *
+     * @param txid the transaction's hash
+     *
+     * @return true if the transaction was removed, otherwise false
      */
-    typedef std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash> > key_images_container;
+    bool evict_tx(const crypto::hash &txid);
+
+    /**
+     * @brief drops the in-memory state of a transaction already removed
+     * from the db, remembering it as evicted
+     *
+     * The pool and blockchain locks must be held.
+     *
+     * @param txid the transaction's hash
+     * @param tx the transaction
+     * @param blob_size the transaction's size
+     */
+    void forget_evicted_tx(const crypto::hash &txid, const transaction &tx, uint64_t blob_size);
+
+    /**
+     * @brief what the pool remembers of a transaction to build block templates
+     */
+    struct template_candidate
+    {
+      std::vector<crypto::key_image> key_images;  //!< the key images spent by the transaction
+      size_t blob_size;  //!< the transaction's size
+      uint64_t fee;  //!< the transaction's fee amount
+      crypto::hash ready_top_block_id;  //!< the top block when eligibility was last checked, null_hash to force a full check
+      uint8_t ready_version;  //!< the hard fork version eligibility was last checked for
+      bool ready;  //!< whether the transaction could go on top of ready_top_block_id
+
+      template<class Archive>
+      void serialize(Archive &a, const unsigned int ver)
+      {
+        a & key_images;
+        a & blob_size;
+        a & fee;
+        a & ready_top_block_id;
+        a & ready_version;
+        a & ready;
+      }
+    };
+
+    /**
+     * @brief the pool state saved by deinit() for the next init()
+     */
+    struct saved_state
+    {
+      std::vector<std::pair<crypto::hash, template_candidate>> template_candidates;  //!< the candidates, by transaction hash
+
+      template<class Archive>
+      void serialize(Archive &a, const unsigned int ver)
+      {
+        a & template_candidates;
+      }
+    };
+
+    /**
+     * @brief the last block template built, and what it was built for
+     */
+    struct block_template
+    {
+      bool valid;  //!< false if the pool changed in a way which might change the template
+      crypto::hash top_block_id;  //!< the block the template builds on
+      size_t median_size;  //!< the median block size used
+      uint64_t already_generated_coins;  //!< the coins generated so far used
+      uint8_t version;  //!< the hard fork version used
+      std::vector<crypto::hash> tx_hashes;  //!< the chosen transactions, in order
+      size_t total_size;  //!< the total size of the chosen transactions
+      uint64_t fee;  //!< the total fee of the chosen transactions
+      uint64_t expected_reward;  //!< the reward for the block, including fees
+    };
+
+    /**
+     * @brief start tracking a transaction as a block template candidate
+     *
+     * @param id the transaction's hash
+     * @param tx the transaction
+     * @param meta the transaction's metadata
+     * @param ready whether the transaction was just found able to go on top of the chain
+     *
+     * @return false if the transaction has inputs other than txin_to_key, otherwise true
+     */
+    bool add_template_candidate(const crypto::hash &id, const transaction &tx, const txpool_tx_meta_t &meta, bool ready);
+
+    /**
+     * @brief stop tracking a transaction as a block template candidate
+     *
+     * The cached template is only invalidated if it contains the transaction,
+     * since the choice of the other transactions does not depend on those
+     * which were left out.
+     *
+     * @param id the transaction's hash
+     */
+    void remove_template_candidate(const crypto::hash &id);
+
+    /**
+     * @brief check if a block template candidate can go on top of the chain
+     *
+     * Transactions which were eligible for the previous top block, under
+     * the same hard fork version, only need their key images checked
+     * against the chain again.  Others are fully checked, and the result
+     * is remembered until the top block changes.
+     *
+     * @param id the transaction's hash
+     * @param candidate the transaction's candidate information
+     * @param top_block_id the current top block
+     * @param version the hard fork version to check for
+     *
+     * @return true if the transaction is eligible, otherwise false
+     */
+    bool is_template_candidate_ready(const crypto::hash &id, template_candidate &candidate, const crypto::hash &top_block_id, uint8_t version);
+
+    /**
+     * @brief chooses the transactions for a block template, maximizing fees
+     *
+     * Eligible transactions are taken in fee per byte order up to the
+     * penalty free size, then the last of them and the next ones are
+     * searched for the combination paying most in what room is left.
+     * Transactions are then added beyond the penalty free size as long as
+     * they increase the coinbase.  Of transactions spending the same key
+     * image, the one paying most per byte wins, and the others are evicted
+     * unless kept_by_block.
+     *
+     * @param top_block_id the current top block
+     * @param median_size the current median block size
+     * @param already_generated_coins the current total number of coins "minted"
+     * @param max_total_size the maximum total size of the transactions
+     * @param version hard fork version to use for consensus rules
+     * @param tx_hashes return-by-reference the chosen transactions
+     * @param total_size return-by-reference the total size of the chosen transactions
+     * @param fee return-by-reference the total fee of the chosen transactions
+     * @param coinbase return-by-reference the reward for the block, including fees
+     */
+    void fill_block_template_maximizing_fees(const crypto::hash &top_block_id, size_t median_size, uint64_t already_generated_coins, size_t max_total_size, uint8_t version, std::vector<crypto::hash> &tx_hashes, size_t &total_size, uint64_t &fee, uint64_t &coinbase);
 
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
 public:
@@ -516,24 +1132,125 @@ private:
 #endif
 
     //! container for spent key images from the transactions in the pool
-    key_images_container m_spent_key_images;  
+    spent_key_images_index m_spent_key_images;
 
     //TODO: this time should be a named constant somewhere, not hard-coded
     //! interval on which to check for stale/"stuck" transactions
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
 
-    //TODO: look into doing this better
-    //!< container for transactions organized by fee per size and receive time
-    sorted_tx_container m_txs_by_fee_and_receive_time;
+    //! the pool transactions and their metadata, the db only being used
+    //! for persistence and for the transaction blobs
+    pool_tx_container m_txs;
+
+    //! running totals over all the pool transactions, and over those which may be relayed
+    txpool_aggregates m_aggregates;
+    txpool_aggregates m_relayable_aggregates;
+
+    //! the maximum total size of the pool transactions, in bytes
+    size_t m_txpool_max_size;
+
+    //! whether to replace transactions by fee and fill templates maximizing fees
+    bool m_maximize_fees;
+
+    //! salt for the short ids of the pool transactions
+    uint64_t m_short_id_salt;
+
+    //! short ids of the pool transactions
+    std::unordered_multiset<uint64_t> m_short_ids;
+
+    //! recently used pool transactions, kept parsed
+    mutable parsed_tx_cache m_parsed_txs;
+
+    //! transactions recently evicted to keep the pool under its maximum size
+    evicted_tx_filter m_evicted_txs;
+
+    uint64_t m_num_evicted;  //!< number of transactions evicted
+    uint64_t m_bytes_evicted;  //!< total size of the transactions evicted
+    uint64_t m_num_evicted_rejected;  //!< number of transactions refused because they were evicted recently or would be
 
     /**
-     * @brief get an iterator to a transaction in the sorted container
+     * @brief gets a pool transaction, parsed
      *
-     * @param id the hash of the transaction to look for
+     * The transaction is taken from the parsed transaction cache if there,
+     * or else parsed and cached.
      *
-     * @return an iterator, possibly to the end of the container if not found
+     * @param id the transaction's hash
+     * @param bd the transaction's blob if already at hand, NULL to get it from the db
+     *
+     * @return the transaction, or an empty pointer if it could not be parsed
      */
-    sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id) const;
+    std::shared_ptr<const transaction> get_parsed_tx(const crypto::hash &id, const cryptonote::blobdata *bd = NULL) const;
+
+    /**
+     * @brief evicts the lowest fee per byte transactions until the pool fits a size
+     *
+     * Transactions kept by block are never evicted, as they are likely to
+     * be in a block we are adding.  Evicted transactions are remembered,
+     * so they are not accepted back right away.
+     *
+     * @param bytes the size to fit in, in bytes
+     */
+    void prune(size_t bytes);
+
+    /**
+     * @brief checks whether a new transaction would be evicted right away
+     *
+     * Replays the order prune evicts in, so a transaction this accepts is
+     * never the one pruned to make room for it.
+     *
+     * @param fee the transaction's fee
+     * @param blob_size the transaction's size
+     * @param replaced the transactions it replaces, whose room it gets
+     *
+     * @return true if the pool is full of transactions paying as much or more per byte
+     */
+    bool would_be_evicted(uint64_t fee, size_t blob_size, const std::vector<crypto::hash> &replaced) const;
+
+    /**
+     * @brief adds a transaction's metadata to the in memory pool
+     *
+     * @param id the transaction's hash
+     * @param meta the transaction's metadata
+     *
+     * @return false if the transaction was already there, true otherwise
+     */
+    bool add_tx_entry(const crypto::hash &id, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief removes a transaction's metadata from the in memory pool
+     *
+     * @param id the transaction's hash
+     */
+    void remove_tx_entry(const crypto::hash &id);
+
+    /**
+     * @brief gets a transaction's metadata
+     *
+     * @param id the transaction's hash
+     *
+     * @return a pointer to the metadata, or NULL if the transaction is not in the pool
+     */
+    const txpool_tx_meta_t *get_tx_meta(const crypto::hash &id) const;
+
+    /**
+     * @brief updates a transaction's metadata, in memory and in the db
+     *
+     * Fee, size and receive time are not expected to change.
+     *
+     * @param id the transaction's hash
+     * @param meta the new metadata
+     */
+    void update_tx_meta(const crypto::hash &id, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief calls a function for each pool transaction's metadata
+     *
+     * @param f the function to call, returning false to stop early
+     * @param include_unrelayed_txes include transactions flagged as do not relay
+     *
+     * @return false if the function returned false, true otherwise
+     */
+    bool for_all_tx_meta(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&)> f, bool include_unrelayed_txes = true) const;
 
     //! transactions which are unlikely to be included in blocks
     /*! These transactions are kept in RAM in case they *are* included
@@ -541,6 +1258,14 @@ private:
      */
     std::unordered_set<crypto::hash> m_timed_out_transactions;
 
+    //! block template information for all the transactions in the pool
+    std::unordered_map<crypto::hash, template_candidate> m_template_candidates;
+
+    std::string m_config_folder;  //!< where the pool state is saved, empty if it is not
+
+    //! the last block template built
+    block_template m_block_template;
+
     Blockchain& m_blockchain;  //!< reference to the Blockchain object
   };
 }
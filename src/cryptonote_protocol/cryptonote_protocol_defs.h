@@ -146,9 +146,11 @@ namespace cryptonote
     struct request
     {
       std::list<blobdata>   txs;
+      bool stem = false; // pass the txes on to a single peer rather than broadcasting them
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(txs)
+        KV_SERIALIZE_OPT(stem, false)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -198,12 +200,14 @@ namespace cryptonote
     uint64_t cumulative_difficulty;
     crypto::hash  top_id;
     uint8_t top_version;
+    uint64_t tx_short_id_salt; // salt peers use for the short tx ids they announce to us, 0 if none
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(current_height)
       KV_SERIALIZE(cumulative_difficulty)
       KV_SERIALIZE_VAL_POD_AS_BLOB(top_id)
       KV_SERIALIZE_OPT(top_version, (uint8_t)0)
+      KV_SERIALIZE_OPT(tx_short_id_salt, (uint64_t)0)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -280,5 +284,39 @@ namespace cryptonote
       END_KV_SERIALIZE_MAP()
     };
   }; 
+
+  /************************************************************************/
+  /* announces new txes by short id, salted with the recipient's salt     */
+  /************************************************************************/
+  struct NOTIFY_NEW_TRANSACTION_IDS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct request
+    {
+      std::vector<uint64_t> short_ids;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(short_ids)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /* asks for announced txes, answered with NOTIFY_NEW_TRANSACTIONS       */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_TRANSACTIONS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request
+    {
+      std::vector<uint64_t> short_ids;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(short_ids)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
     
 }
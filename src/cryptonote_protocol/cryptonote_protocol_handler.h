@@ -35,8 +35,13 @@
 #pragma once
 
 #include <boost/program_options/variables_map.hpp>
+#include <deque>
+#include <map>
 #include <string>
 #include <ctime>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "math_helper.h"
 #include "storages/levin_abstract_invoke2.h"
@@ -93,6 +98,8 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_TRANSACTION_IDS, &cryptonote_protocol_handler::handle_notify_new_transaction_ids)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TRANSACTIONS, &cryptonote_protocol_handler::handle_request_transactions)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -122,10 +129,12 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_transaction_ids(int command, NOTIFY_NEW_TRANSACTION_IDS::request& arg, cryptonote_connection_context& context);
+    int handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
-    virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context);
+    virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const std::vector<crypto::hash> &tx_hashes, cryptonote_connection_context& exclude_context);
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
     bool request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span = false);
@@ -134,6 +143,12 @@ namespace cryptonote
     bool should_download_next_span(cryptonote_connection_context& context) const;
     void drop_connection(cryptonote_connection_context &context, bool add_fail, bool flush_all_spans);
     bool kick_idle_peers();
+    bool forget_requested_tx_short_ids();
+    void expire_requested_tx_short_ids(time_t now, std::map<boost::uuids::uuid, NOTIFY_REQUEST_TRANSACTIONS::request> &requests);
+    void request_announced_txes(std::map<boost::uuids::uuid, NOTIFY_REQUEST_TRANSACTIONS::request> &requests);
+    void forget_requested_tx_short_id(uint64_t short_id);
+    bool flush_tx_relay_queues(bool all);
+    uint64_t get_tx_relay_delay() const;
     int try_add_next_blocks(cryptonote_connection_context &context);
 
     t_core& m_core;
@@ -147,6 +162,41 @@ namespace cryptonote
     block_queue m_block_queue;
     epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
 
+    //! what we know of a peer which takes tx announcements
+    struct tx_announce_peer
+    {
+      uint64_t salt = 0; //!< the salt the peer wants short tx ids made with
+      std::unordered_map<uint64_t, crypto::hash> announced; //!< txes announced to the peer, by short id
+      std::deque<uint64_t> announced_order; //!< short ids in announcement order, oldest first
+    };
+    boost::mutex m_tx_announce_lock;
+    std::map<boost::uuids::uuid, tx_announce_peer> m_tx_announce_peers;
+    //! an announced tx we asked a peer for
+    struct requested_tx
+    {
+      time_t time; //!< when it was asked for
+      boost::uuids::uuid peer; //!< the peer it was asked from
+      std::vector<boost::uuids::uuid> announcers; //!< other peers which announced it, asked in turn if it does not come
+    };
+    std::unordered_map<uint64_t, requested_tx> m_requested_tx_short_ids; //!< announced txes we asked for, by short id
+    std::deque<std::pair<time_t, uint64_t>> m_requested_tx_short_ids_order; //!< when each was asked for, oldest first
+    std::map<boost::uuids::uuid, size_t> m_requested_tx_short_ids_per_peer; //!< how many are still awaited from each peer
+    epee::math_helper::once_a_time_seconds<P2P_TX_ANNOUNCE_REQUEST_TIMEOUT> m_requested_tx_short_ids_cleaner;
+
+    //! txes waiting to be relayed to a peer, sent together in one notification
+    struct tx_relay_queue
+    {
+      std::vector<std::pair<crypto::hash, std::shared_ptr<const cryptonote::blobdata>>> fluff; //!< txes to broadcast
+      std::vector<std::pair<crypto::hash, std::shared_ptr<const cryptonote::blobdata>>> stem; //!< txes to pass on to this peer only
+      std::unordered_set<crypto::hash> queued; //!< hashes of all the queued txes
+      bool announce = false; //!< whether the peer takes tx announcements
+      uint64_t next_flush = 0; //!< tick count to send the queued txes at
+    };
+    boost::mutex m_tx_relay_lock;
+    std::map<boost::uuids::uuid, tx_relay_queue> m_tx_relay_queues;
+    boost::uuids::uuid m_stem_peer; //!< the peer we pass stem txes on to
+    time_t m_stem_peer_chosen = 0; //!< when m_stem_peer was picked
+
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
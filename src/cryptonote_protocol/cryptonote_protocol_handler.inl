@@ -36,7 +36,9 @@
 // developer rfree: this code is caller of our new network code, and is modded; e.g. for rate limiting
 
 #include <boost/interprocess/detail/atomic.hpp>
+#include <cmath>
 #include <list>
+#include <memory>
 #include <unordered_map>
 
 #include "cryptonote_basic/cryptonote_format_utils.h"
@@ -265,6 +267,19 @@ namespace cryptonote
     if(context.m_state == cryptonote_connection_context::state_synchronizing)
       return true;
 
+    if (hshd.tx_short_id_salt)
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_announce_lock);
+      tx_announce_peer &peer = m_tx_announce_peers[context.m_connection_id];
+      if (peer.salt != hshd.tx_short_id_salt)
+      {
+        // ids we announced are meaningless under a new salt
+        peer.salt = hshd.tx_short_id_salt;
+        peer.announced.clear();
+        peer.announced_order.clear();
+      }
+    }
+
     // from v6, if the peer advertises a top block version, reject if it's not what it should be (will only work if no voting)
     const uint8_t version = m_core.get_ideal_hard_fork_version(hshd.current_height - 1);
     if (version >= 6 && version != hshd.top_version)
@@ -322,6 +337,7 @@ namespace cryptonote
     hshd.top_version = m_core.get_ideal_hard_fork_version(hshd.current_height);
     hshd.cumulative_difficulty = m_core.get_block_cumulative_difficulty(hshd.current_height);
     hshd.current_height +=1;
+    hshd.tx_short_id_salt = m_core.get_tx_short_id_salt();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -621,6 +637,20 @@ namespace cryptonote
         b.block = arg.b.block;
         b.txs = have_tx;
 
+        // With fast block relay, a block building on our top block is passed
+        // on as soon as its header and proof of work check out, since we know
+        // all its txes. It is then fully verified as usual.
+        bool relayed_early = false;
+        if (m_core.fast_block_relay_enabled() && m_core.check_block_header_and_pow(new_block))
+        {
+          MDEBUG("Relaying block " << get_block_hash(new_block) << " ahead of full verification");
+          NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
+          reg_arg.current_blockchain_height = arg.current_blockchain_height;
+          reg_arg.b = b;
+          relay_block(reg_arg, context);
+          relayed_early = true;
+        }
+
         std::list<block_complete_entry> blocks;
         blocks.push_back(b);
         m_core.prepare_handle_incoming_blocks(blocks);
@@ -637,11 +667,18 @@ namespace cryptonote
         
         if( bvc.m_verifivation_failed )
         {
+          if (relayed_early)
+          {
+            // we vouched for that block to our peers, so the sender does not
+            // get another chance
+            LOG_PRINT_CCONTEXT_L0("Block relayed before full verification failed verification, blocking peer");
+            m_p2p->block_host(context.m_remote_address);
+          }
           LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
           drop_connection(context, true, false);
           return 1;
         }
-        if( bvc.m_added_to_main_chain )
+        if( bvc.m_added_to_main_chain && !relayed_early )
         {
           //TODO: Add here announce protocol usage
           NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
@@ -769,32 +806,160 @@ namespace cryptonote
       return 1;
     }
 
+    std::vector<crypto::hash> tx_hashes;
+    tx_hashes.reserve(arg.txs.size());
     for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end();)
     {
       cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      m_core.handle_incoming_tx(*tx_blob_it, tvc, false, true, false);
+      crypto::hash tx_hash = crypto::null_hash;
+      m_core.handle_incoming_tx(*tx_blob_it, tvc, false, true, false, &tx_hash);
       if(tvc.m_verifivation_failed)
       {
         LOG_PRINT_CCONTEXT_L1("Tx verification failed, dropping connection");
         drop_connection(context, false, false);
         return 1;
       }
+      if (tx_hash != crypto::null_hash)
+      {
+        // it came, possibly in answer to our request, so the peer's request budget is freed
+        const uint64_t short_id = get_transaction_short_id(tx_hash, m_core.get_tx_short_id_salt());
+        boost::unique_lock<boost::mutex> lock(m_tx_announce_lock);
+        forget_requested_tx_short_id(short_id);
+      }
       if(tvc.m_should_be_relayed)
+      {
+        tx_hashes.push_back(tx_hash);
         ++tx_blob_it;
+      }
       else
         arg.txs.erase(tx_blob_it++);
     }
 
     if(arg.txs.size())
     {
-      //TODO: add announce usage here
-      relay_transactions(arg, context);
+      relay_transactions(arg, tx_hashes, context);
     }
 
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transaction_ids(int command, NOTIFY_NEW_TRANSACTION_IDS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTION_IDS (" << arg.short_ids.size() << " txes)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    // same as for full txes, we don't want them while syncing
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received new tx ids while syncing, ignored");
+      return 1;
+    }
+
+    std::vector<uint64_t> missing;
+    m_core.get_missing_tx_short_ids(arg.short_ids, missing);
+    if (missing.empty())
+      return 1;
+
+    // several peers will usually announce the same tx, only ask the first one
+    // and remember a few others in case it does not send it; what we wait for
+    // is bounded per peer and overall, so announcing lots of made up ids costs
+    // us little, the excess is just not asked for
+    std::map<boost::uuids::uuid, NOTIFY_REQUEST_TRANSACTIONS::request> requests;
+    {
+      const time_t now = time(NULL);
+      boost::unique_lock<boost::mutex> lock(m_tx_announce_lock);
+      expire_requested_tx_short_ids(now, requests);
+      NOTIFY_REQUEST_TRANSACTIONS::request &req = requests[context.m_connection_id];
+      size_t skipped = 0;
+      size_t &peer_requested = m_requested_tx_short_ids_per_peer[context.m_connection_id];
+      for (uint64_t short_id: missing)
+      {
+        auto i = m_requested_tx_short_ids.find(short_id);
+        if (i != m_requested_tx_short_ids.end())
+        {
+          std::vector<boost::uuids::uuid> &announcers = i->second.announcers;
+          if (i->second.peer != context.m_connection_id && announcers.size() < P2P_TX_ANNOUNCE_MAX_ANNOUNCERS
+              && std::find(announcers.begin(), announcers.end(), context.m_connection_id) == announcers.end())
+            announcers.push_back(context.m_connection_id);
+          continue;
+        }
+        // the order queue holds received ones too until they expire, so it bounds both
+        if (peer_requested >= P2P_TX_ANNOUNCE_MAX_REQUESTED_PER_PEER || m_requested_tx_short_ids_order.size() >= P2P_TX_ANNOUNCE_MAX_REQUESTED)
+        {
+          ++skipped;
+          continue;
+        }
+        m_requested_tx_short_ids.insert(std::make_pair(short_id, requested_tx{now, context.m_connection_id, {}}));
+        m_requested_tx_short_ids_order.push_back(std::make_pair(now, short_id));
+        ++peer_requested;
+        req.short_ids.push_back(short_id);
+      }
+      if (skipped)
+        LOG_DEBUG_CC(context, "Too many announced txes awaited, not asking for " << skipped << " more");
+      if (peer_requested == 0)
+        m_requested_tx_short_ids_per_peer.erase(context.m_connection_id);
+      if (req.short_ids.empty())
+        requests.erase(context.m_connection_id);
+    }
+
+    request_announced_txes(requests);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_TRANSACTIONS (" << arg.short_ids.size() << " txes)");
+
+    // we never ask one peer for more than this at once
+    if (arg.short_ids.size() > P2P_TX_ANNOUNCE_MAX_REQUESTED_PER_PEER)
+    {
+      LOG_ERROR_CCONTEXT("Requested " << arg.short_ids.size() << " txes at once, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // only ids we announced to this very peer can be asked for, and each only once,
+    // else a small request could be repeated to get the same txes sent over and over
+    std::vector<crypto::hash> txids;
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_announce_lock);
+      auto peer = m_tx_announce_peers.find(context.m_connection_id);
+      if (peer == m_tx_announce_peers.end())
+      {
+        LOG_DEBUG_CC(context, "Received tx request from a peer we did not announce to, ignored");
+        return 1;
+      }
+      for (uint64_t short_id: arg.short_ids)
+      {
+        auto i = peer->second.announced.find(short_id);
+        if (i != peer->second.announced.end())
+        {
+          txids.push_back(i->second);
+          peer->second.announced.erase(i);
+        }
+      }
+    }
+
+    // txes may have left the pool since we announced them, that's not the peer's fault
+    NOTIFY_NEW_TRANSACTIONS::request rsp;
+    for (const crypto::hash &txid: txids)
+    {
+      cryptonote::blobdata blob;
+      if (m_core.get_pool_transaction(txid, blob))
+        rsp.txs.push_back(std::move(blob));
+    }
+    if (rsp.txs.empty())
+      return 1;
+
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_NEW_TRANSACTIONS: txs.size()=" << rsp.txs.size());
+    post_notify<NOTIFY_NEW_TRANSACTIONS>(rsp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_get_objects(int command, NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_GET_OBJECTS (" << arg.blocks.size() << " blocks, " << arg.txs.size() << " txes)");
@@ -1175,10 +1340,90 @@ skip:
   bool t_cryptonote_protocol_handler<t_core>::on_idle()
   {
     m_idle_peer_kicker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::kick_idle_peers, this));
+    m_requested_tx_short_ids_cleaner.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::forget_requested_tx_short_ids, this));
+    flush_tx_relay_queues(false);
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::forget_requested_tx_short_ids()
+  {
+    std::map<boost::uuids::uuid, NOTIFY_REQUEST_TRANSACTIONS::request> requests;
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_announce_lock);
+      expire_requested_tx_short_ids(time(NULL), requests);
+    }
+    request_announced_txes(requests);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::expire_requested_tx_short_ids(time_t now, std::map<boost::uuids::uuid, NOTIFY_REQUEST_TRANSACTIONS::request> &requests)
+  {
+    // m_tx_announce_lock must be held; txes which other peers announced are
+    // added to requests for the next of them, to be sent once the lock is released
+    while (!m_requested_tx_short_ids_order.empty() && now - m_requested_tx_short_ids_order.front().first >= P2P_TX_ANNOUNCE_REQUEST_TIMEOUT)
+    {
+      const std::pair<time_t, uint64_t> e = m_requested_tx_short_ids_order.front();
+      m_requested_tx_short_ids_order.pop_front();
+      // it may have been received and asked for again since
+      auto i = m_requested_tx_short_ids.find(e.second);
+      if (i == m_requested_tx_short_ids.end() || i->second.time != e.first)
+        continue;
+
+      requested_tx &r = i->second;
+      auto peer = m_requested_tx_short_ids_per_peer.find(r.peer);
+      if (peer != m_requested_tx_short_ids_per_peer.end() && --peer->second == 0)
+        m_requested_tx_short_ids_per_peer.erase(peer);
+      bool asked = false;
+      while (!asked && !r.announcers.empty())
+      {
+        const boost::uuids::uuid next = r.announcers.front();
+        r.announcers.erase(r.announcers.begin());
+        size_t &next_requested = m_requested_tx_short_ids_per_peer[next];
+        if (next_requested < P2P_TX_ANNOUNCE_MAX_REQUESTED_PER_PEER)
+        {
+          ++next_requested;
+          r.peer = next;
+          r.time = now;
+          m_requested_tx_short_ids_order.push_back(std::make_pair(now, e.second));
+          requests[next].short_ids.push_back(e.second);
+          asked = true;
+        }
+      }
+      if (!asked)
+        m_requested_tx_short_ids.erase(i);
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::request_announced_txes(std::map<boost::uuids::uuid, NOTIFY_REQUEST_TRANSACTIONS::request> &requests)
+  {
+    // a peer which is gone is skipped, its txes move on to the next announcer when they expire again
+    for (auto &e: requests)
+    {
+      m_p2p->for_connection(e.first, [this, &e](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags) {
+        LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_TRANSACTIONS: short_ids.size()=" << e.second.short_ids.size());
+        post_notify<NOTIFY_REQUEST_TRANSACTIONS>(e.second, context);
+        return true;
+      });
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::forget_requested_tx_short_id(uint64_t short_id)
+  {
+    // m_tx_announce_lock must be held; the order entry goes when it expires
+    auto i = m_requested_tx_short_ids.find(short_id);
+    if (i == m_requested_tx_short_ids.end())
+      return;
+    auto peer = m_requested_tx_short_ids_per_peer.find(i->second.peer);
+    if (peer != m_requested_tx_short_ids_per_peer.end() && --peer->second == 0)
+      m_requested_tx_short_ids_per_peer.erase(peer);
+    m_requested_tx_short_ids.erase(i);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::kick_idle_peers()
   {
     MTRACE("Checking for idle peers...");
@@ -1661,12 +1906,178 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
-  bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)
+  bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const std::vector<crypto::hash> &tx_hashes, cryptonote_connection_context& exclude_context)
   {
+    CHECK_AND_ASSERT_MES(tx_hashes.size() == arg.txs.size(), false, "Mismatched tx hashes and blobs to relay");
+
     // no check for success, so tell core they're relayed unconditionally
-    for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++tx_blob_it)
-      m_core.on_transaction_relayed(*tx_blob_it);
-    return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+    std::vector<std::pair<crypto::hash, std::shared_ptr<const cryptonote::blobdata>>> txs;
+    txs.reserve(arg.txs.size());
+    size_t n = 0;
+    for (const cryptonote::blobdata &blob: arg.txs)
+    {
+      const crypto::hash &tx_hash = tx_hashes[n++];
+      m_core.on_transaction_relayed(tx_hash, blob);
+      txs.push_back(std::make_pair(tx_hash, std::make_shared<const cryptonote::blobdata>(blob)));
+    }
+    if (txs.empty())
+      return true;
+
+    std::list<std::pair<boost::uuids::uuid, bool>> connections;
+    std::vector<boost::uuids::uuid> outgoing_connections;
+    m_p2p->for_each_connection([&exclude_context, &connections, &outgoing_connections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      if (peer_id && exclude_context.m_connection_id != context.m_connection_id)
+      {
+        connections.push_back(std::make_pair(context.m_connection_id, (support_flags & P2P_SUPPORT_FLAG_TX_ANNOUNCE) != 0));
+        if (!context.m_is_income)
+          outgoing_connections.push_back(context.m_connection_id);
+      }
+      return true;
+    });
+
+    const uint32_t fluff_probability = m_core.get_tx_relay_fluff_probability();
+    bool stem = arg.stem && fluff_probability < 100 && crypto::rand<uint32_t>() % 100 >= fluff_probability;
+    {
+      const uint64_t now = epee::misc_utils::get_tick_count();
+      boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+      const auto enqueue = [this, &txs, now](const boost::uuids::uuid &conn_id, bool announce, bool stem)
+      {
+        tx_relay_queue &queue = m_tx_relay_queues[conn_id];
+        if (queue.queued.empty())
+          queue.next_flush = now + get_tx_relay_delay();
+        // stem txes are always sent in full, so only fluff ones say how the queue's fluff txes go
+        if (!stem)
+          queue.announce = announce;
+        for (const auto &tx: txs)
+          if (queue.queued.insert(tx.first).second)
+            (stem ? queue.stem : queue.fluff).push_back(tx);
+      };
+
+      if (stem)
+      {
+        // keep to one outgoing peer per epoch, picking one per tx would tell more about where txes come from
+        const time_t t = time(NULL);
+        if (m_stem_peer_chosen + P2P_TX_RELAY_STEM_EPOCH < t || std::find(outgoing_connections.begin(), outgoing_connections.end(), m_stem_peer) == outgoing_connections.end())
+        {
+          if (outgoing_connections.empty())
+          {
+            stem = false;
+          }
+          else
+          {
+            m_stem_peer = outgoing_connections[crypto::rand<size_t>() % outgoing_connections.size()];
+            m_stem_peer_chosen = t;
+          }
+        }
+        if (stem)
+          enqueue(m_stem_peer, false, true);
+      }
+      if (!stem)
+      {
+        for (const auto &c: connections)
+          enqueue(c.first, c.second, false);
+      }
+    }
+
+    flush_tx_relay_queues(false);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  uint64_t t_cryptonote_protocol_handler<t_core>::get_tx_relay_delay() const
+  {
+    // exponentially distributed, so flushes to different peers are spread out over time
+    const uint64_t average_delay = m_core.get_tx_relay_average_delay();
+    if (average_delay == 0)
+      return 0;
+    const double u = ((crypto::rand<uint64_t>() >> 11) + 1) * (1.0 / 9007199254740992.0); // (0, 1]
+    return -log(u) * average_delay;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::flush_tx_relay_queues(bool all)
+  {
+    std::list<std::pair<boost::uuids::uuid, tx_relay_queue>> due;
+    {
+      const uint64_t now = epee::misc_utils::get_tick_count();
+      boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+      for (auto i = m_tx_relay_queues.begin(); i != m_tx_relay_queues.end(); )
+      {
+        if (all || i->second.next_flush <= now || i->second.queued.size() >= P2P_TX_RELAY_MAX_QUEUED)
+        {
+          due.push_back(std::make_pair(i->first, std::move(i->second)));
+          i = m_tx_relay_queues.erase(i);
+        }
+        else
+          ++i;
+      }
+    }
+
+    for (const auto &e: due)
+    {
+      const std::list<boost::uuids::uuid> connection(1, e.first);
+      const tx_relay_queue &queue = e.second;
+      std::string blob;
+
+      if (!queue.stem.empty())
+      {
+        NOTIFY_NEW_TRANSACTIONS::request req;
+        req.stem = true;
+        for (const auto &tx: queue.stem)
+          req.txs.push_back(*tx.second);
+        epee::serialization::store_t_to_binary(req, blob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, blob, connection);
+      }
+
+      if (queue.fluff.empty())
+        continue;
+
+      // short ids are salted per peer, so each announcement is built separately
+      bool announced = false;
+      if (queue.announce)
+      {
+        NOTIFY_NEW_TRANSACTION_IDS::request ids;
+        {
+          boost::unique_lock<boost::mutex> lock(m_tx_announce_lock);
+          auto peer = m_tx_announce_peers.find(e.first);
+          if (peer != m_tx_announce_peers.end() && peer->second.salt)
+          {
+            tx_announce_peer &p = peer->second;
+            ids.short_ids.reserve(queue.fluff.size());
+            for (const auto &tx: queue.fluff)
+            {
+              const uint64_t short_id = get_transaction_short_id(tx.first, p.salt);
+              if (p.announced.insert(std::make_pair(short_id, tx.first)).second)
+                p.announced_order.push_back(short_id);
+              ids.short_ids.push_back(short_id);
+            }
+            while (p.announced_order.size() > P2P_TX_ANNOUNCE_MAX_REMEMBERED)
+            {
+              p.announced.erase(p.announced_order.front());
+              p.announced_order.pop_front();
+            }
+            announced = true;
+          }
+        }
+        if (announced)
+        {
+          epee::serialization::store_t_to_binary(ids, blob);
+          m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTION_IDS::ID, blob, connection);
+        }
+      }
+
+      // we don't know its salt yet, or it doesn't take announcements
+      if (!announced)
+      {
+        NOTIFY_NEW_TRANSACTIONS::request req;
+        for (const auto &tx: queue.fluff)
+          req.txs.push_back(*tx.second);
+        epee::serialization::store_t_to_binary(req, blob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, blob, connection);
+      }
+    }
+    return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
@@ -1697,6 +2108,17 @@ skip:
     }
 
     m_block_queue.flush_spans(context.m_connection_id, false);
+
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_announce_lock);
+      m_tx_announce_peers.erase(context.m_connection_id);
+      // what it still owes us expires as usual, but no longer counts against anyone
+      m_requested_tx_short_ids_per_peer.erase(context.m_connection_id);
+    }
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_relay_lock);
+      m_tx_relay_queues.erase(context.m_connection_id);
+    }
   }
 
   //------------------------------------------------------------------------------------------------------------------------
@@ -29,6 +29,7 @@
 // Adapted from Java code by Sarang Noether
 
 #include <stdlib.h>
+#include <memory>
 #include <openssl/ssl.h>
 #include <boost/thread/mutex.hpp>
 #include "misc_log_ex.h"
@@ -38,6 +39,7 @@ extern "C"
 #include "crypto/crypto-ops.h"
 }
 #include "rctOps.h"
+#include "multiexp.h"
 #include "bulletproofs.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -56,7 +58,9 @@ static rct::key inner_product(const rct::keyV &a, const rct::keyV &b);
 
 static constexpr size_t maxN = 64;
 static rct::key Hi[maxN], Gi[maxN];
-static ge_dsmp Gprecomp[64], Hprecomp[64];
+static ge_p3 Hi_p3[maxN], Gi_p3[maxN], G_p3, H_p3;
+// Gi[0], Hi[0], Gi[1], Hi[1]...
+static std::unique_ptr<rct::multiexp_cache> generator_cache;
 static const rct::key TWO = { {0x02, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00 , 0x00, 0x00, 0x00,0x00  } };
 static const rct::keyV oneN = vector_powers(rct::identity(), maxN);
 static const rct::keyV twoN = vector_powers(TWO, maxN);
@@ -77,13 +81,19 @@ static void init_exponents()
   static bool init_done = false;
   if (init_done)
     return;
+  std::vector<ge_p3> points;
   for (size_t i = 0; i < maxN; ++i)
   {
     Hi[i] = get_exponent(rct::H, i * 2);
-    rct::precomp(Hprecomp[i], Hi[i]);
+    CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&Hi_p3[i], Hi[i].bytes) == 0, "ge_frombytes_vartime failed");
     Gi[i] = get_exponent(rct::H, i * 2 + 1);
-    rct::precomp(Gprecomp[i], Gi[i]);
+    CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&Gi_p3[i], Gi[i].bytes) == 0, "ge_frombytes_vartime failed");
+    points.push_back(Gi_p3[i]);
+    points.push_back(Hi_p3[i]);
   }
+  generator_cache.reset(new rct::multiexp_cache(points));
+  ge_scalarmult_base(&G_p3, rct::identity().bytes);
+  CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&H_p3, rct::H.bytes) == 0, "ge_frombytes_vartime failed");
   init_done = true;
 }
 
@@ -92,14 +102,14 @@ static rct::key vector_exponent(const rct::keyV &a, const rct::keyV &b)
 {
   CHECK_AND_ASSERT_THROW_MES(a.size() == b.size(), "Incompatible sizes of a and b");
   CHECK_AND_ASSERT_THROW_MES(a.size() <= maxN, "Incompatible sizes of a and maxN");
-  rct::key res = rct::identity();
+  std::vector<rct::MultiexpData> data;
+  data.reserve(a.size() * 2);
   for (size_t i = 0; i < a.size(); ++i)
   {
-    rct::key term;
-    rct::addKeys3(term, a[i], Gprecomp[i], b[i], Hprecomp[i]);
-    rct::addKeys(res, res, term);
+    data.push_back(rct::MultiexpData(a[i], Gi_p3[i]));
+    data.push_back(rct::MultiexpData(b[i], Hi_p3[i]));
   }
-  return res;
+  return rct::multiexp(data, generator_cache.get());
 }
 
 /* Compute a custom vector-scalar commitment */
@@ -109,39 +119,14 @@ static rct::key vector_exponent_custom(const rct::keyV &A, const rct::keyV &B, c
   CHECK_AND_ASSERT_THROW_MES(a.size() == b.size(), "Incompatible sizes of a and b");
   CHECK_AND_ASSERT_THROW_MES(a.size() == A.size(), "Incompatible sizes of a and A");
   CHECK_AND_ASSERT_THROW_MES(a.size() <= maxN, "Incompatible sizes of a and maxN");
-  rct::key res = rct::identity();
+  std::vector<rct::MultiexpData> data;
+  data.reserve(a.size() * 2);
   for (size_t i = 0; i < a.size(); ++i)
   {
-    rct::key term;
-#if 0
-    // we happen to know where A and B might fall, so don't bother checking the rest
-    ge_dsmp *Acache = NULL, *Bcache = NULL;
-    ge_dsmp Acache_custom[1], Bcache_custom[1];
-    if (Gi[i] == A[i])
-      Acache = Gprecomp + i;
-    else if (i<32 && Gi[i+32] == A[i])
-      Acache = Gprecomp + i + 32;
-    else
-    {
-      rct::precomp(Acache_custom[0], A[i]);
-      Acache = Acache_custom;
-    }
-    if (i == 0 && B[i] == Hi[0])
-      Bcache = Hprecomp;
-    else
-    {
-      rct::precomp(Bcache_custom[0], B[i]);
-      Bcache = Bcache_custom;
-    }
-    rct::addKeys3(term, a[i], *Acache, b[i], *Bcache);
-#else
-    ge_dsmp Acache, Bcache;
-    rct::precomp(Bcache, B[i]);
-    rct::addKeys3(term, a[i], A[i], b[i], Bcache);
-#endif
-    rct::addKeys(res, res, term);
+    data.push_back(rct::MultiexpData(a[i], A[i]));
+    data.push_back(rct::MultiexpData(b[i], B[i]));
   }
-  return res;
+  return rct::multiexp(data);
 }
 
 /* Given a scalar, construct a vector of powers */
@@ -311,7 +296,7 @@ Bulletproof bulletproof_PROVE(const rct::key &sv, const rct::key &gamma)
   rct::keyV aL(N), aR(N);
 
   PERF_TIMER_START_BP(PROVE_v);
-  rct::addKeys2(V, gamma, sv, rct::H);
+  rct::addKeysGH(V, gamma, sv);
   PERF_TIMER_STOP(PROVE_v);
 
   PERF_TIMER_START_BP(PROVE_aLaR);
@@ -423,8 +408,9 @@ Bulletproof bulletproof_PROVE(const rct::key &sv, const rct::key &gamma)
   // PAPER LINES 47-48
   rct::key tau1 = rct::skGen(), tau2 = rct::skGen();
 
-  rct::key T1 = rct::addKeys(rct::scalarmultKey(rct::H, t1), rct::scalarmultBase(tau1));
-  rct::key T2 = rct::addKeys(rct::scalarmultKey(rct::H, t2), rct::scalarmultBase(tau2));
+  rct::key T1, T2;
+  rct::addKeysGH(T1, tau1, t1);
+  rct::addKeysGH(T2, tau2, t2);
 
   // PAPER LINES 49-51
   hashed.clear();
@@ -503,10 +489,10 @@ Bulletproof bulletproof_PROVE(const rct::key &sv, const rct::key &gamma)
     // PAPER LINES 18-19
     L[round] = vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size()));
     sc_mul(tmp.bytes, cL.bytes, x_ip.bytes);
-    rct::addKeys(L[round], L[round], rct::scalarmultKey(rct::H, tmp));
+    rct::addKeys(L[round], L[round], rct::scalarmultH(tmp));
     R[round] = vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
     sc_mul(tmp.bytes, cR.bytes, x_ip.bytes);
-    rct::addKeys(R[round], R[round], rct::scalarmultKey(rct::H, tmp));
+    rct::addKeys(R[round], R[round], rct::scalarmultH(tmp));
 
     // PAPER LINES 21-22
     hashed.clear();
@@ -597,48 +583,43 @@ bool bulletproof_VERIFY(const Bulletproof &proof)
 
   PERF_TIMER_START_BP(VERIFY_line_61);
   // PAPER LINE 61
-  rct::key L61Left = rct::addKeys(rct::scalarmultBase(proof.taux), rct::scalarmultKey(rct::H, proof.t));
-
+  // taux*G + t*H == (z*ip1y + k)*H + zsq*V + x*T1 + xsq*T2
+  // Only the terms on G and H may be moved across: V, T1 and T2 come from the proof and may have a
+  // small order component, for which (l-s)*P is not -(s*P), so each side gets its own multiexp
   rct::key k = rct::zero();
   const auto yN = vector_powers(y, N);
   rct::key ip1y = inner_product(oneN, yN);
   rct::key zsq;
   sc_mul(zsq.bytes, z.bytes, z.bytes);
-  rct::key tmp, tmp2;
+  rct::key tmp;
   sc_mulsub(k.bytes, zsq.bytes, ip1y.bytes, k.bytes);
   rct::key zcu;
   sc_mul(zcu.bytes, zsq.bytes, z.bytes);
   sc_mulsub(k.bytes, zcu.bytes, ip12.bytes, k.bytes);
-  PERF_TIMER_STOP(VERIFY_line_61);
-
-  PERF_TIMER_START_BP(VERIFY_line_61rl);
-  sc_muladd(tmp.bytes, z.bytes, ip1y.bytes, k.bytes);
-  rct::key L61Right = rct::scalarmultKey(rct::H, tmp);
-
-  CHECK_AND_ASSERT_MES(proof.V.size() == 1, false, "proof.V does not have exactly one element");
-  tmp = rct::scalarmultKey(proof.V[0], zsq);
-  rct::addKeys(L61Right, L61Right, tmp);
-
-  tmp = rct::scalarmultKey(proof.T1, x);
-  rct::addKeys(L61Right, L61Right, tmp);
-
   rct::key xsq;
   sc_mul(xsq.bytes, x.bytes, x.bytes);
-  tmp = rct::scalarmultKey(proof.T2, xsq);
-  rct::addKeys(L61Right, L61Right, tmp);
-  PERF_TIMER_STOP(VERIFY_line_61rl);
 
-  if (!(L61Right == L61Left))
+  CHECK_AND_ASSERT_MES(proof.V.size() == 1, false, "proof.V does not have exactly one element");
+  std::vector<rct::MultiexpData> data, proof_data;
+  data.reserve(2);
+  sc_reduce32copy(tmp.bytes, proof.taux.bytes);
+  data.push_back(rct::MultiexpData(tmp, G_p3));
+  sc_muladd(tmp.bytes, z.bytes, ip1y.bytes, k.bytes);
+  sc_sub(tmp.bytes, proof.t.bytes, tmp.bytes);
+  data.push_back(rct::MultiexpData(tmp, H_p3));
+  proof_data.reserve(3);
+  proof_data.push_back(rct::MultiexpData(zsq, proof.V[0]));
+  proof_data.push_back(rct::MultiexpData(x, proof.T1));
+  proof_data.push_back(rct::MultiexpData(xsq, proof.T2));
+  const bool line61 = rct::multiexp(data) == rct::multiexp(proof_data);
+  PERF_TIMER_STOP(VERIFY_line_61);
+
+  if (!line61)
   {
     MERROR("Verification failure at step 1");
     return false;
   }
 
-  PERF_TIMER_START_BP(VERIFY_line_62);
-  // PAPER LINE 62
-  rct::key P = rct::addKeys(proof.A, rct::scalarmultKey(proof.S, x));
-  PERF_TIMER_STOP(VERIFY_line_62);
-
   // Compute the number of rounds for the inner product
   const size_t rounds = proof.L.size();
   CHECK_AND_ASSERT_MES(rounds > 0, false, "Zero rounds");
@@ -661,10 +642,10 @@ bool bulletproof_VERIFY(const Bulletproof &proof)
   }
   PERF_TIMER_STOP(VERIFY_line_21_22);
 
+  // The inner product check, PAPER LINES 24-26 and 62:
+  // sum(g_scalar[i]*Gi[i] + h_scalar[i]*Hi[i]) + a*b*x_ip*H == A + x*S - mu*G + sum(w^2*L + w^-2*R) + t*x_ip*H,
+  // with the generator terms in one multiexp (cached generators first) and the proof's points in another
   PERF_TIMER_START_BP(VERIFY_line_24_25);
-  // Basically PAPER LINES 24-25
-  // Compute the curvepoints from G[i] and H[i]
-  rct::key inner_prod = rct::identity();
   rct::key yinvpow = rct::identity();
   rct::key ypow = rct::identity();
 
@@ -675,6 +656,8 @@ bool bulletproof_VERIFY(const Bulletproof &proof)
     winv[i] = invert(w[i]);
   PERF_TIMER_STOP(VERIFY_line_24_25_invert);
 
+  data.clear();
+  data.reserve(2 * N + 2);
   for (size_t i = 0; i < N; ++i)
   {
     // Convert the index to binary IN REVERSE and construct the scalar exponent
@@ -704,10 +687,8 @@ bool bulletproof_VERIFY(const Bulletproof &proof)
     sc_muladd(tmp.bytes, z.bytes, ypow.bytes, tmp.bytes);
     sc_mulsub(h_scalar.bytes, tmp.bytes, yinvpow.bytes, h_scalar.bytes);
 
-    // Now compute the basepoint's scalar multiplication
-    // Each of these could be written as a multiexp operation instead
-    rct::addKeys3(tmp, g_scalar, Gprecomp[i], h_scalar, Hprecomp[i]);
-    rct::addKeys(inner_prod, inner_prod, tmp);
+    data.push_back(rct::MultiexpData(g_scalar, Gi_p3[i]));
+    data.push_back(rct::MultiexpData(h_scalar, Hi_p3[i]));
 
     if (i != N-1)
     {
@@ -718,37 +699,29 @@ bool bulletproof_VERIFY(const Bulletproof &proof)
   PERF_TIMER_STOP(VERIFY_line_24_25);
 
   PERF_TIMER_START_BP(VERIFY_line_26);
-  // PAPER LINE 26
-  rct::key pprime;
-  sc_sub(tmp.bytes, rct::zero().bytes, proof.mu.bytes);
-  rct::addKeys(pprime, P, rct::scalarmultBase(tmp));
-
+  sc_reduce32copy(tmp.bytes, proof.mu.bytes);
+  data.push_back(rct::MultiexpData(tmp, G_p3));
+  proof_data.clear();
+  proof_data.reserve(2 * rounds + 2);
+  proof_data.push_back(rct::MultiexpData(rct::identity(), proof.A));
+  proof_data.push_back(rct::MultiexpData(x, proof.S));
   for (size_t i = 0; i < rounds; ++i)
   {
     sc_mul(tmp.bytes, w[i].bytes, w[i].bytes);
-    sc_mul(tmp2.bytes, winv[i].bytes, winv[i].bytes);
-#if 1
-    ge_dsmp cacheL, cacheR;
-    rct::precomp(cacheL, proof.L[i]);
-    rct::precomp(cacheR, proof.R[i]);
-    rct::addKeys3(tmp, tmp, cacheL, tmp2, cacheR);
-    rct::addKeys(pprime, pprime, tmp);
-#else
-    rct::addKeys(pprime, pprime, rct::scalarmultKey(proof.L[i], tmp));
-    rct::addKeys(pprime, pprime, rct::scalarmultKey(proof.R[i], tmp2));
-#endif
+    proof_data.push_back(rct::MultiexpData(tmp, proof.L[i]));
+    sc_mul(tmp.bytes, winv[i].bytes, winv[i].bytes);
+    proof_data.push_back(rct::MultiexpData(tmp, proof.R[i]));
   }
-  sc_mul(tmp.bytes, proof.t.bytes, x_ip.bytes);
-  rct::addKeys(pprime, pprime, rct::scalarmultKey(rct::H, tmp));
+  sc_mul(tmp.bytes, proof.a.bytes, proof.b.bytes);
+  sc_sub(tmp.bytes, tmp.bytes, proof.t.bytes);
+  sc_mul(tmp.bytes, tmp.bytes, x_ip.bytes);
+  data.push_back(rct::MultiexpData(tmp, H_p3));
   PERF_TIMER_STOP(VERIFY_line_26);
 
   PERF_TIMER_START_BP(VERIFY_step2_check);
-  sc_mul(tmp.bytes, proof.a.bytes, proof.b.bytes);
-  sc_mul(tmp.bytes, tmp.bytes, x_ip.bytes);
-  tmp = rct::scalarmultKey(rct::H, tmp);
-  rct::addKeys(tmp, tmp, inner_prod);
+  const bool step2 = rct::multiexp(data, generator_cache.get()) == rct::multiexp(proof_data);
   PERF_TIMER_STOP(VERIFY_step2_check);
-  if (!(pprime == tmp))
+  if (!step2)
   {
     MERROR("Verification failure at step 2");
     return false;
@@ -0,0 +1,332 @@
+// Copyright (c) 2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "misc_log_ex.h"
+#include "multiexp.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "multiexp"
+
+// Both algorithms are counted in point additions, a doubling costing about the same
+#define STRAUS_TABLE_ADDS 8
+#define STRAUS_DIGIT_DENSITY 6
+
+namespace rct
+{
+
+static const ge_p3 &get_identity()
+{
+  static const ge_p3 identity = []() {
+    ge_p3 p;
+    CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&p, rct::identity().bytes) == 0, "ge_frombytes_vartime failed");
+    return p;
+  }();
+  return identity;
+}
+
+/* Width 5 signed sliding window recoding, as slide() in crypto-ops.c:
+   digits are odd and in [-15, 15], with at least 4 zeros between two of them */
+static void slide(signed char *r, const unsigned char *a)
+{
+  for (int i = 0; i < 256; ++i)
+    r[i] = 1 & (a[i >> 3] >> (i & 7));
+
+  for (int i = 0; i < 256; ++i)
+  {
+    if (!r[i])
+      continue;
+    for (int b = 1; b <= 6 && i + b < 256; ++b)
+    {
+      if (!r[i + b])
+        continue;
+      if (r[i] + (r[i + b] << b) <= 15)
+      {
+        r[i] += r[i + b] << b;
+        r[i + b] = 0;
+      }
+      else if (r[i] - (r[i + b] << b) >= -15)
+      {
+        r[i] -= r[i + b] << b;
+        for (int k = i + b; k < 256; ++k)
+        {
+          if (!r[k])
+          {
+            r[k] = 1;
+            break;
+          }
+          r[k] = 0;
+        }
+      }
+      else
+        break;
+    }
+  }
+}
+
+/* Bits [start, start + count) of a 256 bit little endian scalar, zero past the end */
+static unsigned int get_bits(const unsigned char *a, size_t start, size_t count)
+{
+  unsigned int v = 0;
+  for (size_t i = 0; i < count && start + i < 256; ++i)
+    v |= ((a[(start + i) >> 3] >> ((start + i) & 7)) & 1) << i;
+  return v;
+}
+
+static void add_cached(ge_p3 &r, const ge_cached &q)
+{
+  ge_p1p1 t;
+  ge_add(&t, &r, &q);
+  ge_p1p1_to_p3(&r, &t);
+}
+
+static void sub_cached(ge_p3 &r, const ge_cached &q)
+{
+  ge_p1p1 t;
+  ge_sub(&t, &r, &q);
+  ge_p1p1_to_p3(&r, &t);
+}
+
+static void add_p3(ge_p3 &r, const ge_p3 &q)
+{
+  ge_cached c;
+  ge_p3_to_cached(&c, &q);
+  add_cached(r, c);
+}
+
+MultiexpData::MultiexpData(const rct::key &s, const rct::key &p): scalar(s)
+{
+  CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&point, p.bytes) == 0, "ge_frombytes_vartime failed");
+}
+
+multiexp_cache::multiexp_cache(const std::vector<ge_p3> &points): tables(points.size())
+{
+  for (size_t i = 0; i < points.size(); ++i)
+    ge_dsm_precomp(tables[i].multiples, &points[i]);
+}
+
+rct::key straus(const std::vector<MultiexpData> &data, const multiexp_cache *cache)
+{
+  const size_t n = data.size();
+  const size_t cached = cache ? std::min(cache->size(), n) : 0;
+
+  std::vector<const ge_cached*> tables(n);
+  std::vector<multiexp_cache::table> local(n - cached);
+  for (size_t i = 0; i < cached; ++i)
+    tables[i] = cache->tables[i].multiples;
+  for (size_t i = cached; i < n; ++i)
+  {
+    ge_dsm_precomp(local[i - cached].multiples, &data[i].point);
+    tables[i] = local[i - cached].multiples;
+  }
+
+  // digits are stored bit major, so each doubling step reads them in order
+  std::vector<signed char> digits(256 * n);
+  signed char buf[256];
+  int top = -1;
+  for (size_t i = 0; i < n; ++i)
+  {
+    slide(buf, data[i].scalar.bytes);
+    for (int k = 0; k < 256; ++k)
+    {
+      digits[k * n + i] = buf[k];
+      if (buf[k] && k > top)
+        top = k;
+    }
+  }
+
+  ge_p2 r;
+  ge_p3_to_p2(&r, &get_identity());
+  ge_p1p1 t;
+  ge_p3 u;
+  for (int k = top; k >= 0; --k)
+  {
+    ge_p2_dbl(&t, &r);
+    const signed char *d = &digits[k * n];
+    for (size_t i = 0; i < n; ++i)
+    {
+      if (d[i] > 0)
+      {
+        ge_p1p1_to_p3(&u, &t);
+        ge_add(&t, &u, &tables[i][d[i] / 2]);
+      }
+      else if (d[i] < 0)
+      {
+        ge_p1p1_to_p3(&u, &t);
+        ge_sub(&t, &u, &tables[i][(-d[i]) / 2]);
+      }
+    }
+    ge_p1p1_to_p2(&r, &t);
+  }
+
+  rct::key res;
+  ge_tobytes(res.bytes, &r);
+  return res;
+}
+
+static size_t get_pippenger_windows(size_t c)
+{
+  // one more than needed to cover 256 bits, for the carry out of the top signed digit
+  return (256 + c - 1) / c + 1;
+}
+
+static size_t get_pippenger_cost(size_t N, size_t c)
+{
+  return get_pippenger_windows(c) * (N + ((size_t)1 << c)) + 256;
+}
+
+size_t get_pippenger_c(size_t N)
+{
+  size_t best_c = 1;
+  for (size_t c = 2; c <= 16; ++c)
+    if (get_pippenger_cost(N, c) < get_pippenger_cost(N, best_c))
+      best_c = c;
+  return best_c;
+}
+
+rct::key pippenger(const std::vector<MultiexpData> &data, const multiexp_cache *cache, size_t c)
+{
+  const size_t n = data.size();
+  const size_t cached = cache ? std::min(cache->size(), n) : 0;
+  if (c == 0)
+    c = get_pippenger_c(n);
+  CHECK_AND_ASSERT_THROW_MES(c >= 1 && c <= 16, "Invalid pippenger window size");
+  const size_t windows = get_pippenger_windows(c);
+  const int half = 1 << (c - 1);
+
+  std::vector<const ge_cached*> points(n);
+  std::vector<ge_cached> local(n - cached);
+  for (size_t i = 0; i < cached; ++i)
+    points[i] = &cache->tables[i].multiples[0];
+  for (size_t i = cached; i < n; ++i)
+  {
+    ge_p3_to_cached(&local[i - cached], &data[i].point);
+    points[i] = &local[i - cached];
+  }
+
+  // signed digits in (-2^(c-1), 2^(c-1)], window major
+  std::vector<int32_t> digits(windows * n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    int carry = 0;
+    for (size_t w = 0; w < windows; ++w)
+    {
+      int v = get_bits(data[i].scalar.bytes, w * c, c) + carry;
+      carry = v > half;
+      digits[w * n + i] = v - (carry << c);
+    }
+  }
+
+  std::vector<ge_p3> buckets(half);
+  std::vector<bool> used(half);
+  ge_p3 r = get_identity();
+  bool r_used = false;
+  for (size_t w = windows; w-- > 0; )
+  {
+    if (r_used)
+    {
+      ge_p2 p2;
+      ge_p1p1 t;
+      ge_p3_to_p2(&p2, &r);
+      for (size_t k = 0; k < c; ++k)
+      {
+        ge_p2_dbl(&t, &p2);
+        if (k + 1 < c)
+          ge_p1p1_to_p2(&p2, &t);
+      }
+      ge_p1p1_to_p3(&r, &t);
+    }
+
+    std::fill(used.begin(), used.end(), false);
+    const int32_t *d = &digits[w * n];
+    for (size_t i = 0; i < n; ++i)
+    {
+      if (d[i] == 0)
+        continue;
+      const size_t b = (d[i] > 0 ? d[i] : -d[i]) - 1;
+      if (!used[b])
+      {
+        buckets[b] = get_identity();
+        used[b] = true;
+      }
+      if (d[i] > 0)
+        add_cached(buckets[b], *points[i]);
+      else
+        sub_cached(buckets[b], *points[i]);
+    }
+
+    // sum of (b + 1) * buckets[b], as a running sum from the top bucket down
+    ge_p3 sum, acc;
+    bool sum_used = false, acc_used = false;
+    for (size_t b = half; b-- > 0; )
+    {
+      if (used[b])
+      {
+        if (sum_used)
+          add_p3(sum, buckets[b]);
+        else
+          sum = buckets[b];
+        sum_used = true;
+      }
+      if (sum_used)
+      {
+        if (acc_used)
+          add_p3(acc, sum);
+        else
+          acc = sum;
+        acc_used = true;
+      }
+    }
+
+    if (acc_used)
+    {
+      if (r_used)
+        add_p3(r, acc);
+      else
+        r = acc;
+      r_used = true;
+    }
+  }
+
+  rct::key res;
+  ge_p3_tobytes(res.bytes, &r);
+  return res;
+}
+
+rct::key multiexp(const std::vector<MultiexpData> &data, const multiexp_cache *cache)
+{
+  const size_t n = data.size();
+  const size_t cached = cache ? std::min(cache->size(), n) : 0;
+  const size_t straus_cost = STRAUS_TABLE_ADDS * (n - cached) + n * 256 / STRAUS_DIGIT_DENSITY + 256;
+  const size_t pippenger_cost = get_pippenger_cost(n, get_pippenger_c(n));
+  if (straus_cost <= pippenger_cost)
+    return straus(data, cache);
+  return pippenger(data, cache);
+}
+
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#ifndef MULTIEXP_H
+#define MULTIEXP_H
+
+#include <vector>
+#include "rctOps.h"
+
+namespace rct
+{
+
+/* One scalar/point pair of a multi scalar multiplication */
+struct MultiexpData {
+  rct::key scalar;
+  ge_p3 point;
+
+  MultiexpData() {}
+  MultiexpData(const rct::key &s, const ge_p3 &p): scalar(s), point(p) {}
+  MultiexpData(const rct::key &s, const rct::key &p);
+};
+
+/* Precomputed tables for points which are used over and over, like the
+   bulletproof generators. A cache of size n stands for the first n entries
+   of any data it is passed along with: their points are taken from the cache
+   and only their scalars are read */
+class multiexp_cache
+{
+public:
+  multiexp_cache(const std::vector<ge_p3> &points);
+  size_t size() const { return tables.size(); }
+
+private:
+  struct table { ge_dsmp multiples; };
+  std::vector<table> tables;
+
+  friend rct::key straus(const std::vector<MultiexpData> &data, const multiexp_cache *cache);
+  friend rct::key pippenger(const std::vector<MultiexpData> &data, const multiexp_cache *cache, size_t c);
+};
+
+/* All functions below return the sum of scalar * point over data, encoded.
+   Scalars must be reduced. Points are not checked to be in the main subgroup */
+
+// interleaved sliding windows, best for up to a couple hundred points
+rct::key straus(const std::vector<MultiexpData> &data, const multiexp_cache *cache = NULL);
+// bucket method with 2^(c-1) buckets per window, best for large sets; c = 0 picks it from the size
+rct::key pippenger(const std::vector<MultiexpData> &data, const multiexp_cache *cache = NULL, size_t c = 0);
+size_t get_pippenger_c(size_t N);
+// picks whichever of the above should be faster for this size
+rct::key multiexp(const std::vector<MultiexpData> &data, const multiexp_cache *cache = NULL);
+
+}
+
+#endif
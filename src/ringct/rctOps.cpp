@@ -106,8 +106,7 @@ namespace rct {
 
     //generates C =aG + bH from b, a is given..
     void genC(key & C, const key & a, xmr_amount amount) {
-        key bH = scalarmultH(d2h(amount));
-        addKeys1(C, a, bH);
+        addKeysGH(C, a, d2h(amount));
     }
 
     //generates a <secret , public> / Pedersen commitment to the amount
@@ -132,19 +131,14 @@ namespace rct {
     }
     
     key zeroCommit(xmr_amount amount) {
-        key mask = identity();
-        mask = scalarmultBase(mask);
-        key am = d2h(amount);
-        key bH = scalarmultH(am);
-        addKeys(mask, mask, bH);
-        return mask;
+        key c;
+        addKeysGH(c, identity(), d2h(amount));
+        return c;
     }
 
     key commit(xmr_amount amount, const key &mask) {
-        key c = scalarmultBase(mask);
-        key am = d2h(amount);
-        key bH = scalarmultH(am);
-        addKeys(c, c, bH);
+        key c;
+        addKeysGH(c, mask, d2h(amount));
         return c;
     }
 
@@ -194,14 +188,30 @@ namespace rct {
     }
 
 
+    //multiples of H laid out like ge_base, for fixed base multiplications by H
+    struct H_table_t {
+        ge_precomp table[32][8];
+    };
+
+    static const H_table_t &get_H_table() {
+        static const H_table_t H_table = []() {
+            H_table_t t;
+            ge_p3 H_p3;
+            CHECK_AND_ASSERT_THROW_MES_L1(ge_frombytes_vartime(&H_p3, H.bytes) == 0, "ge_frombytes_vartime failed at "+boost::lexical_cast<std::string>(__LINE__));
+            ge_precomp_table(t.table, &H_p3);
+            return t;
+        }();
+        return H_table;
+    }
+
     //Computes aH where H= toPoint(cn_fast_hash(G)), G the basepoint
     key scalarmultH(const key & a) {
-        ge_p3 A;
-        ge_p2 R;
-        CHECK_AND_ASSERT_THROW_MES_L1(ge_frombytes_vartime(&A, H.bytes) == 0, "ge_frombytes_vartime failed at "+boost::lexical_cast<std::string>(__LINE__));
-        ge_scalarmult(&R, a.bytes, &A);
+        ge_p3 R;
         key aP;
-        ge_tobytes(aP.bytes, &R);
+        //H is in the prime order subgroup, so reducing a does not change aH
+        sc_reduce32copy(aP.bytes, a.bytes);
+        ge_scalarmult_precomp(&R, aP.bytes, get_H_table().table);
+        ge_p3_tobytes(aP.bytes, &R);
         return aP;
     }
 
@@ -243,6 +253,23 @@ namespace rct {
         ge_tobytes(aGbB.bytes, &rv);
     }
 
+    //addKeysGH
+    //aGbH = aG + bH where a, b are scalars, G is the basepoint and H is the amount basepoint
+    void addKeysGH(key &aGbH, const key &a, const key &b) {
+        ge_p3 aG, bH;
+        ge_cached tmp;
+        ge_p1p1 sum;
+        key s;
+        sc_reduce32copy(s.bytes, a.bytes);
+        ge_scalarmult_base(&aG, s.bytes);
+        sc_reduce32copy(s.bytes, b.bytes);
+        ge_scalarmult_precomp(&bH, s.bytes, get_H_table().table);
+        ge_p3_to_cached(&tmp, &bH);
+        ge_add(&sum, &aG, &tmp);
+        ge_p1p1_to_p3(&aG, &sum);
+        ge_p3_tobytes(aGbH.bytes, &aG);
+    }
+
     //Does some precomputation to make addKeys3 more efficient
     // input B a curve point and output a ge_dsmp which has precomputation applied
     void precomp(ge_dsmp rv, const key & B) {
@@ -419,23 +446,39 @@ namespace rct {
     }
 
     void hashToPoint(key & pointk, const key & hh) {
+        ge_p3 res;
+        hash_to_p3(res, hh);
+        ge_p3_tobytes(pointk.bytes, &res);
+    }    
+
+    void hash_to_p3(ge_p3 &hash8_p3, const key &hh) {
         ge_p2 point;
         ge_p1p1 point2;
-        ge_p3 res;
-        key h = cn_fast_hash(hh); 
+        key h = cn_fast_hash(hh);
         ge_fromfe_frombytes_vartime(&point, h.bytes);
         ge_mul8(&point2, &point);
-        ge_p1p1_to_p3(&res, &point2);        
-        ge_p3_tobytes(pointk.bytes, &res);
-    }    
+        ge_p1p1_to_p3(&hash8_p3, &point2);
+    }
 
     //sums a vector of curve points (for scalars use sc_add)
+    //each point is decompressed once and the sum compressed once, rather than
+    //going through bytes at every addition
     void sumKeys(key & Csum, const keyV &  Cis) {
-        identity(Csum);
-        size_t i = 0;
-        for (i = 0; i < Cis.size(); i++) {
-            addKeys(Csum, Csum, Cis[i]);
+        if (Cis.empty()) {
+            identity(Csum);
+            return;
+        }
+        std::vector<ge_p3> points(Cis.size());
+        CHECK_AND_ASSERT_THROW_MES_L1(ge_frombytes_vartime_batch(points.data(), Cis[0].bytes, Cis.size()) == 0, "ge_frombytes_vartime_batch failed at "+boost::lexical_cast<std::string>(__LINE__));
+        ge_p3 sum = points[0];
+        ge_cached tmp2;
+        ge_p1p1 tmp3;
+        for (size_t i = 1; i < points.size(); i++) {
+            ge_p3_to_cached(&tmp2, &points[i]);
+            ge_add(&tmp3, &sum, &tmp2);
+            ge_p1p1_to_p3(&sum, &tmp3);
         }
+        ge_p3_tobytes(Csum.bytes, &sum);
     }
 
     //Elliptic Curve Diffie Helman: encodes and decodes the amount b and mask a
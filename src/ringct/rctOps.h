@@ -117,6 +117,7 @@ namespace rct {
     void scalarmultKey(key &aP, const key &P, const key &a);
     key scalarmultKey(const key &P, const key &a);
     //Computes aH where H= toPoint(cn_fast_hash(G)), G the basepoint
+    //uses a table of multiples of H built on first use, like G's
     key scalarmultH(const key & a);
 
     //Curve addition / subtractions
@@ -128,6 +129,9 @@ namespace rct {
     void addKeys1(key &aGB, const key &a, const key & B);
     //aGbB = aG + bB where a, b are scalars, G is the basepoint and B is a point
     void addKeys2(key &aGbB, const key &a, const key &b, const key &B);
+    //aGbH = aG + bH where a, b are scalars, G is the basepoint and H is as above
+    //faster than addKeys2 with H, and constant time
+    void addKeysGH(key &aGbH, const key &a, const key &b);
     //Does some precomputation to make addKeys3 more efficient
     // input B a curve point and output a ge_dsmp which has precomputation applied
     void precomp(ge_dsmp rv, const key &B);
@@ -167,9 +171,11 @@ namespace rct {
     key hashToPointSimple(const key &in);
     key hashToPoint(const key &in);
     void hashToPoint(key &out, const key &in);
+    //the same, left decompressed for callers which go on with curve operations
+    void hash_to_p3(ge_p3 &hash8_p3, const key &in);
 
     //sums a vector of curve points (for scalars use sc_add)
-    void sumKeys(key & Csum, const key &Cis);
+    void sumKeys(key & Csum, const keyV &Cis);
 
     //Elliptic Curve Diffie Helman: encodes and decodes the amount b and mask a
     // where C= aG + bH
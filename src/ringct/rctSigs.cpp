@@ -28,10 +28,12 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <boost/thread/tss.hpp>
 #include "misc_log_ex.h"
 #include "common/perf_timer.h"
 #include "common/threadpool.h"
 #include "common/util.h"
+#include "crypto/point_cache.h"
 #include "rctSigs.h"
 #include "bulletproofs.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
@@ -113,6 +115,56 @@ namespace rct {
     }
     
     
+    //the thread's own workspace, for the functions below which take a key matrix
+    static boost::thread_specific_ptr<mlsagWorkspace> mlsag_workspace;
+    static mlsagWorkspace &get_mlsag_workspace() {
+        if (!mlsag_workspace.get())
+            mlsag_workspace.reset(new mlsagWorkspace());
+        return *mlsag_workspace;
+    }
+
+    //sizes the per signature buffers of ws and decompresses its key matrix,
+    //unless the caller already did
+    static bool mlsag_prepare(mlsagWorkspace &ws, size_t dsRows) {
+        ws.toHash.resize(1 + 3 * dsRows + 2 * (ws.rows - dsRows));
+        ws.alpha.resize(ws.rows);
+        ws.Ip.resize(dsRows);
+        ws.LR.resize(dsRows + ws.rows);
+        ws.LRk.resize(dsRows + ws.rows);
+        if (ws.decompressed)
+            return ws.P.size() == ws.pk.size();
+        ws.P.resize(ws.pk.size());
+        return ge_frombytes_vartime_batch(ws.P.data(), ws.pk[0].bytes, ws.pk.size()) == 0;
+    }
+
+    //hashes column i of the matrix in ws, with responses ss and previous challenge c_old,
+    //into the next challenge c. The L and R points of the column are compressed together
+    static void mlsag_column(key &c, mlsagWorkspace &ws, size_t i, const keyV &ss, const key &c_old, size_t dsRows) {
+        const size_t rows = ws.rows;
+        const size_t ndsRows = 3 * dsRows; //non Double Spendable Rows (see identity chains paper)
+        size_t j, ii;
+        ge_p3 Hi;
+        for (j = 0; j < dsRows; j++) {
+            ge_double_scalarmult_base_vartime(&ws.LR[2 * j], c_old.bytes, &ws.P[i * rows + j], ss[j].bytes);
+            hash_to_p3(Hi, ws.at(i, j));
+            ge_double_scalarmult_precomp_vartime(&ws.LR[2 * j + 1], ss[j].bytes, &Hi, c_old.bytes, ws.Ip[j].k);
+        }
+        for (j = dsRows; j < rows; j++) {
+            ge_double_scalarmult_base_vartime(&ws.LR[dsRows + j], c_old.bytes, &ws.P[i * rows + j], ss[j].bytes);
+        }
+        ge_tobytes_batch(ws.LRk[0].bytes, ws.LR.data(), ws.LR.size());
+        for (j = 0; j < dsRows; j++) {
+            ws.toHash[3 * j + 1] = ws.at(i, j);
+            ws.toHash[3 * j + 2] = ws.LRk[2 * j];
+            ws.toHash[3 * j + 3] = ws.LRk[2 * j + 1];
+        }
+        for (j = dsRows, ii = 0; j < rows; j++, ii++) {
+            ws.toHash[ndsRows + 2 * ii + 1] = ws.at(i, j);
+            ws.toHash[ndsRows + 2 * ii + 2] = ws.LRk[dsRows + j];
+        }
+        c = hash_to_scalar(ws.toHash);
+    }
+
     //Multilayered Spontaneous Anonymous Group Signatures (MLSAG signatures)
     //This is a just slghtly more efficient version than the ones described below
     //(will be explained in more detail in Ring Multisig paper
@@ -123,45 +175,62 @@ namespace rct {
     //   the signer knows a secret key for each row in that column
     // Ver verifies that the MG sig was created correctly        
     mgSig MLSAG_Gen(const key &message, const keyM & pk, const keyV & xx, const unsigned int index, size_t dsRows) {
-        mgSig rv;
         size_t cols = pk.size();
         CHECK_AND_ASSERT_THROW_MES(cols >= 2, "Error! What is c if cols = 1!");
-        CHECK_AND_ASSERT_THROW_MES(index < cols, "Index out of range");
         size_t rows = pk[0].size();
         CHECK_AND_ASSERT_THROW_MES(rows >= 1, "Empty pk");
         for (size_t i = 1; i < cols; ++i) {
           CHECK_AND_ASSERT_THROW_MES(pk[i].size() == rows, "pk is not rectangular");
         }
+        mlsagWorkspace &ws = get_mlsag_workspace();
+        ws.reset(cols, rows);
+        for (size_t i = 0; i < cols; ++i)
+          std::copy(pk[i].begin(), pk[i].end(), &ws.at(i, 0));
+        return MLSAG_Gen(message, ws, xx, index, dsRows);
+    }
+
+    //Operations on the signer's secrets (alpha, xx) only use the constant time
+    //scalar multiplications; the variable time ones only see public values
+    mgSig MLSAG_Gen(const key &message, mlsagWorkspace &ws, const keyV & xx, const unsigned int index, size_t dsRows) {
+        mgSig rv;
+        const size_t cols = ws.cols;
+        const size_t rows = ws.rows;
+        CHECK_AND_ASSERT_THROW_MES(cols >= 2, "Error! What is c if cols = 1!");
+        CHECK_AND_ASSERT_THROW_MES(index < cols, "Index out of range");
+        CHECK_AND_ASSERT_THROW_MES(rows >= 1, "Empty pk");
+        CHECK_AND_ASSERT_THROW_MES(ws.pk.size() == cols * rows, "Bad workspace size");
         CHECK_AND_ASSERT_THROW_MES(xx.size() == rows, "Bad xx size");
         CHECK_AND_ASSERT_THROW_MES(dsRows <= rows, "Bad dsRows size");
+        CHECK_AND_ASSERT_THROW_MES(mlsag_prepare(ws, dsRows), "Bad point in pk");
 
         size_t i = 0, j = 0, ii = 0;
-        key c, c_old, L, R, Hi;
-        sc_0(c_old.bytes);
-        vector<geDsmp> Ip(dsRows);
+        key c, c_old;
+        ge_p3 Hi, tmp;
+        ge_p2 tmp2;
         rv.II = keyV(dsRows);
-        keyV alpha(rows);
-        keyV aG(rows);
-        rv.ss = keyM(cols, aG);
-        keyV aHP(dsRows);
-        keyV toHash(1 + 3 * dsRows + 2 * (rows - dsRows));
+        rv.ss = keyM(cols, keyV(rows));
+        keyV &toHash = ws.toHash;
+        keyV &alpha = ws.alpha;
         toHash[0] = message;
         DP("here1");
         for (i = 0; i < dsRows; i++) {
-            skpkGen(alpha[i], aG[i]); //need to save alphas for later..
-            Hi = hashToPoint(pk[index][i]);
-            aHP[i] = scalarmultKey(Hi, alpha[i]);
-            toHash[3 * i + 1] = pk[index][i];
-            toHash[3 * i + 2] = aG[i];
-            toHash[3 * i + 3] = aHP[i];
-            rv.II[i] = scalarmultKey(Hi, xx[i]);
-            precomp(Ip[i].k, rv.II[i]);
+            skGen(alpha[i]); //need to save alphas for later..
+            ge_scalarmult_base(&tmp, alpha[i].bytes);
+            toHash[3 * i + 1] = ws.at(index, i);
+            ge_p3_tobytes(toHash[3 * i + 2].bytes, &tmp);
+            hash_to_p3(Hi, ws.at(index, i));
+            ge_scalarmult(&tmp2, alpha[i].bytes, &Hi);
+            ge_tobytes(toHash[3 * i + 3].bytes, &tmp2);
+            ge_scalarmult(&tmp2, xx[i].bytes, &Hi);
+            ge_tobytes(rv.II[i].bytes, &tmp2);
+            precomp(ws.Ip[i].k, rv.II[i]);
         }
         size_t ndsRows = 3 * dsRows; //non Double Spendable Rows (see identity chains paper)
         for (i = dsRows, ii = 0 ; i < rows ; i++, ii++) {
-            skpkGen(alpha[i], aG[i]); //need to save alphas for later..
-            toHash[ndsRows + 2 * ii + 1] = pk[index][i];
-            toHash[ndsRows + 2 * ii + 2] = aG[i];
+            skGen(alpha[i]); //need to save alphas for later..
+            ge_scalarmult_base(&tmp, alpha[i].bytes);
+            toHash[ndsRows + 2 * ii + 1] = ws.at(index, i);
+            ge_p3_tobytes(toHash[ndsRows + 2 * ii + 2].bytes, &tmp);
         }
 
         c_old = hash_to_scalar(toHash);
@@ -172,23 +241,10 @@ namespace rct {
             copy(rv.cc, c_old);
         }
         while (i != index) {
-
-            rv.ss[i] = skvGen(rows);            
-            sc_0(c.bytes);
-            for (j = 0; j < dsRows; j++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                hashToPoint(Hi, pk[i][j]);
-                addKeys3(R, rv.ss[i][j], Hi, c_old, Ip[j].k);
-                toHash[3 * j + 1] = pk[i][j];
-                toHash[3 * j + 2] = L; 
-                toHash[3 * j + 3] = R;
-            }
-            for (j = dsRows, ii = 0; j < rows; j++, ii++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                toHash[ndsRows + 2 * ii + 1] = pk[i][j];
-                toHash[ndsRows + 2 * ii + 2] = L;
+            for (j = 0; j < rows; j++) {
+                skGen(rv.ss[i][j]);
             }
-            c = hash_to_scalar(toHash);
+            mlsag_column(c, ws, i, rv.ss[i], c_old, dsRows);
             copy(c_old, c);
             i = (i + 1) % cols;
             
@@ -198,7 +254,8 @@ namespace rct {
         }
         for (j = 0; j < rows; j++) {
             sc_mulsub(rv.ss[index][j].bytes, c.bytes, xx[j].bytes, alpha[j].bytes);
-        }        
+        }
+        memset(alpha.data(), 0, alpha.size() * sizeof(key));
         return rv;
     }
     
@@ -220,6 +277,20 @@ namespace rct {
         for (size_t i = 1; i < cols; ++i) {
           CHECK_AND_ASSERT_MES(pk[i].size() == rows, false, "pk is not rectangular");
         }
+        mlsagWorkspace &ws = get_mlsag_workspace();
+        ws.reset(cols, rows);
+        for (size_t i = 0; i < cols; ++i)
+          std::copy(pk[i].begin(), pk[i].end(), &ws.at(i, 0));
+        return MLSAG_Ver(message, ws, rv, dsRows);
+    }
+
+    bool MLSAG_Ver(const key &message, mlsagWorkspace &ws, const mgSig & rv, size_t dsRows) {
+
+        const size_t cols = ws.cols;
+        const size_t rows = ws.rows;
+        CHECK_AND_ASSERT_MES(cols >= 2, false, "Error! What is c if cols = 1!");
+        CHECK_AND_ASSERT_MES(rows >= 1, false, "Empty pk");
+        CHECK_AND_ASSERT_MES(ws.pk.size() == cols * rows, false, "Bad workspace size");
         CHECK_AND_ASSERT_MES(rv.II.size() == dsRows, false, "Bad II size");
         CHECK_AND_ASSERT_MES(rv.ss.size() == cols, false, "Bad rv.ss size");
         for (size_t i = 0; i < cols; ++i) {
@@ -231,36 +302,18 @@ namespace rct {
           for (size_t j = 0; j < rv.ss[i].size(); ++j)
             CHECK_AND_ASSERT_MES(sc_check(rv.ss[i][j].bytes) == 0, false, "Bad ss slot");
         CHECK_AND_ASSERT_MES(sc_check(rv.cc.bytes) == 0, false, "Bad cc");
+        CHECK_AND_ASSERT_MES(mlsag_prepare(ws, dsRows), false, "Bad point in pk");
 
-        size_t i = 0, j = 0, ii = 0;
-        key c,  L, R, Hi;
+        size_t i = 0;
+        key c;
         key c_old = copy(rv.cc);
-        vector<geDsmp> Ip(dsRows);
         for (i = 0 ; i < dsRows ; i++) {
-            precomp(Ip[i].k, rv.II[i]);
+            precomp(ws.Ip[i].k, rv.II[i]);
         }
-        size_t ndsRows = 3 * dsRows; //non Double Spendable Rows (see identity chains paper
-        keyV toHash(1 + 3 * dsRows + 2 * (rows - dsRows));
-        toHash[0] = message;
-        i = 0;
-        while (i < cols) {
-            sc_0(c.bytes);
-            for (j = 0; j < dsRows; j++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                hashToPoint(Hi, pk[i][j]);
-                addKeys3(R, rv.ss[i][j], Hi, c_old, Ip[j].k);
-                toHash[3 * j + 1] = pk[i][j];
-                toHash[3 * j + 2] = L; 
-                toHash[3 * j + 3] = R;
-            }
-            for (j = dsRows, ii = 0 ; j < rows ; j++, ii++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
-                toHash[ndsRows + 2 * ii + 1] = pk[i][j];
-                toHash[ndsRows + 2 * ii + 2] = L;
-            }
-            c = hash_to_scalar(toHash);
+        ws.toHash[0] = message;
+        for (i = 0; i < cols; i++) {
+            mlsag_column(c, ws, i, rv.ss[i], c_old, dsRows);
             copy(c_old, c);
-            i = (i + 1);
         }
         sc_sub(c.bytes, c_old.bytes, rv.cc.bytes);
         return sc_isnonzero(c.bytes) == 0;  
@@ -311,13 +364,37 @@ namespace rct {
       try
       {
         PERF_TIMER(verRange);
+        //H2 never changes, so it is decompressed once for all calls
+        static const std::vector<ge_cached> H2_cached = [](){
+            std::vector<ge_cached> cached(ATOMS);
+            ge_p3 p;
+            for (size_t i = 0; i < ATOMS; i++) {
+                CHECK_AND_ASSERT_THROW_MES(ge_frombytes_vartime(&p, H2[i].bytes) == 0, "ge_frombytes_vartime failed on H2");
+                ge_p3_to_cached(&cached[i], &p);
+            }
+            return cached;
+        }();
+        //work on decompressed points, and compress all the CiH together
+        ge_p3 Ci[ATOMS], CiH_p3[ATOMS];
+        if (ge_frombytes_vartime_batch(Ci, as.Ci[0].bytes, ATOMS) != 0)
+          return false;
         key64 CiH;
         int i = 0;
-        key Ctmp = identity();
-        for (i = 0; i < 64; i++) {
-            subKeys(CiH[i], as.Ci[i], H2[i]);
-            addKeys(Ctmp, Ctmp, as.Ci[i]);
+        ge_p3 sum = Ci[0];
+        ge_cached tmp2;
+        ge_p1p1 tmp3;
+        for (i = 0; i < ATOMS; i++) {
+            ge_sub(&tmp3, &Ci[i], &H2_cached[i]);
+            ge_p1p1_to_p3(&CiH_p3[i], &tmp3);
+            if (i > 0) {
+                ge_p3_to_cached(&tmp2, &Ci[i]);
+                ge_add(&tmp3, &sum, &tmp2);
+                ge_p1p1_to_p3(&sum, &tmp3);
+            }
         }
+        ge_p3_tobytes_batch(CiH[0].bytes, CiH_p3, ATOMS);
+        key Ctmp;
+        ge_p3_tobytes(Ctmp.bytes, &sum);
         if (!equalKeys(C, Ctmp))
           return false;
         if (!verifyBorromean(as.asig, as.Ci, CiH))
@@ -407,19 +484,18 @@ namespace rct {
         CHECK_AND_ASSERT_THROW_MES(outSk.size() == outPk.size(), "Bad outSk/outPk size");
 
         keyV sk(rows + 1);
-        keyV tmp(rows + 1);
         size_t i = 0, j = 0;
         for (i = 0; i < rows + 1; i++) {
             sc_0(sk[i].bytes);
-            identity(tmp[i]);
         }
-        keyM M(cols, tmp);
+        mlsagWorkspace &ws = get_mlsag_workspace();
+        ws.reset(cols, rows + 1);
         //create the matrix to mg sig
         for (i = 0; i < cols; i++) {
-            M[i][rows] = identity();
+            ws.at(i, rows) = identity();
             for (j = 0; j < rows; j++) {
-                M[i][j] = pubs[i][j].dest;
-                addKeys(M[i][rows], M[i][rows], pubs[i][j].mask); //add input commitments in last row
+                ws.at(i, j) = pubs[i][j].dest;
+                addKeys(ws.at(i, rows), ws.at(i, rows), pubs[i][j].mask); //add input commitments in last row
             }
         }
         sc_0(sk[rows].bytes);
@@ -429,15 +505,15 @@ namespace rct {
         }
         for (i = 0; i < cols; i++) {
             for (size_t j = 0; j < outPk.size(); j++) {
-                subKeys(M[i][rows], M[i][rows], outPk[j].mask); //subtract output Ci's in last row
+                subKeys(ws.at(i, rows), ws.at(i, rows), outPk[j].mask); //subtract output Ci's in last row
             }
             //subtract txn fee output in last row
-            subKeys(M[i][rows], M[i][rows], txnFeeKey);
+            subKeys(ws.at(i, rows), ws.at(i, rows), txnFeeKey);
         }
         for (size_t j = 0; j < outPk.size(); j++) {
             sc_sub(sk[rows].bytes, sk[rows].bytes, outSk[j].mask.bytes); //subtract output masks in last row..
         }
-        return MLSAG_Gen(message, M, sk, index, rows);
+        return MLSAG_Gen(message, ws, sk, index, rows);
     }
 
 
@@ -454,17 +530,17 @@ namespace rct {
         size_t rows = 1;
         size_t cols = pubs.size();
         CHECK_AND_ASSERT_THROW_MES(cols >= 1, "Empty pubs");
-        keyV tmp(rows + 1);
         keyV sk(rows + 1);
         size_t i;
-        keyM M(cols, tmp);
+        mlsagWorkspace &ws = get_mlsag_workspace();
+        ws.reset(cols, rows + 1);
         for (i = 0; i < cols; i++) {
-            M[i][0] = pubs[i].dest;
-            subKeys(M[i][1], pubs[i].mask, Cout);
-            sk[0] = copy(inSk.dest);
-            sc_sub(sk[1].bytes, inSk.mask.bytes, a.bytes);  
+            ws.at(i, 0) = pubs[i].dest;
+            subKeys(ws.at(i, 1), pubs[i].mask, Cout);
         }
-        return MLSAG_Gen(message, M, sk, index, rows);
+        sk[0] = copy(inSk.dest);
+        sc_sub(sk[1].bytes, inSk.mask.bytes, a.bytes);
+        return MLSAG_Gen(message, ws, sk, index, rows);
     }
 
 
@@ -487,28 +563,28 @@ namespace rct {
           CHECK_AND_ASSERT_MES(pubs[i].size() == rows, false, "pubs is not rectangular");
         }
 
-        keyV tmp(rows + 1);
         size_t i = 0, j = 0;
-        for (i = 0; i < rows + 1; i++) {
-            identity(tmp[i]);
+        mlsagWorkspace &ws = get_mlsag_workspace();
+        ws.reset(cols, rows + 1);
+        for (i = 0; i < cols; i++) {
+            identity(ws.at(i, rows));
         }
-        keyM M(cols, tmp);
 
         //create the matrix to mg sig
         for (j = 0; j < rows; j++) {
             for (i = 0; i < cols; i++) {
-                M[i][j] = pubs[i][j].dest;
-                addKeys(M[i][rows], M[i][rows], pubs[i][j].mask); //add Ci in last row
+                ws.at(i, j) = pubs[i][j].dest;
+                addKeys(ws.at(i, rows), ws.at(i, rows), pubs[i][j].mask); //add Ci in last row
             }
         }
         for (i = 0; i < cols; i++) {
             for (j = 0; j < outPk.size(); j++) {
-                subKeys(M[i][rows], M[i][rows], outPk[j].mask); //subtract output Ci's in last row
+                subKeys(ws.at(i, rows), ws.at(i, rows), outPk[j].mask); //subtract output Ci's in last row
             }
             //subtract txn fee output in last row
-            subKeys(M[i][rows], M[i][rows], txnFeeKey);
+            subKeys(ws.at(i, rows), ws.at(i, rows), txnFeeKey);
         }
-        return MLSAG_Ver(message, M, mg, rows);
+        return MLSAG_Ver(message, ws, mg, rows);
     }
 
     //Ring-ct Simple MG sigs
@@ -523,16 +599,35 @@ namespace rct {
             size_t rows = 1;
             size_t cols = pubs.size();
             CHECK_AND_ASSERT_MES(cols >= 1, false, "Empty pubs");
-            keyV tmp(rows + 1);
             size_t i;
-            keyM M(cols, tmp);
-            //create the matrix to mg sig
+            mlsagWorkspace &ws = get_mlsag_workspace();
+            ws.reset(cols, rows + 1);
+            ws.P.resize(cols * (rows + 1));
+            ws.LR.resize(cols);
+            ws.LRk.resize(cols);
+            //create the matrix to mg sig, with the ring members decompressed
+            //through the point cache, as popular ones are in many rings
+            crypto::point_cache &cache = crypto::point_cache::instance();
+            ge_p3 Cp3, mask;
+            ge_cached Cc;
+            ge_p1p1 tmp;
+            CHECK_AND_ASSERT_MES(ge_frombytes_vartime(&Cp3, C.bytes) == 0, false, "Bad pseudo output");
+            ge_p3_to_cached(&Cc, &Cp3);
             for (i = 0; i < cols; i++) {
-                    M[i][0] = pubs[i].dest;
-                    subKeys(M[i][1], pubs[i].mask, C);
+                    ws.at(i, 0) = pubs[i].dest;
+                    CHECK_AND_ASSERT_MES(cache.get(ws.P[2 * i], rct2pk(pubs[i].dest)), false, "Bad ring member key");
+                    CHECK_AND_ASSERT_MES(cache.get(mask, rct2pk(pubs[i].mask)), false, "Bad ring member commitment");
+                    ge_sub(&tmp, &mask, &Cc);
+                    ge_p1p1_to_p3(&ws.P[2 * i + 1], &tmp);
+                    ge_p3_to_p2(&ws.LR[i], &ws.P[2 * i + 1]);
             }
+            ge_tobytes_batch(ws.LRk[0].bytes, ws.LR.data(), cols);
+            for (i = 0; i < cols; i++) {
+                    ws.at(i, 1) = ws.LRk[i];
+            }
+            ws.decompressed = true;
             //DP(C);
-            return MLSAG_Ver(message, M, mg, rows);
+            return MLSAG_Ver(message, ws, mg, rows);
         }
         catch (...) { return false; }
     }
@@ -866,10 +961,8 @@ namespace rct {
           key txnFeeKey = scalarmultH(d2h(rv.txnFee));
           addKeys(sumOutpks, txnFeeKey, sumOutpks);
 
-          key sumPseudoOuts = identity();
-          for (size_t i = 0 ; i < rv.pseudoOuts.size() ; i++) {
-              addKeys(sumPseudoOuts, sumPseudoOuts, rv.pseudoOuts[i]);
-          }
+          key sumPseudoOuts;
+          sumKeys(sumPseudoOuts, rv.pseudoOuts);
           DP(sumPseudoOuts);
 
           //check pseudoOuts vs Outs..
@@ -947,7 +1040,7 @@ namespace rct {
         DP("C");
         DP(C);
         key Ctmp;
-        addKeys2(Ctmp, mask, amount, H);
+        addKeysGH(Ctmp, mask, amount);
         DP("Ctmp");
         DP(Ctmp);
         if (equalKeys(C, Ctmp) == false) {
@@ -975,7 +1068,7 @@ namespace rct {
         DP("C");
         DP(C);
         key Ctmp;
-        addKeys2(Ctmp, mask, amount, H);
+        addKeysGH(Ctmp, mask, amount);
         DP("Ctmp");
         DP(Ctmp);
         if (equalKeys(C, Ctmp) == false) {
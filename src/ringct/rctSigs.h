@@ -75,6 +75,30 @@ namespace rct {
     keyV keyImageV(const keyV &xx);
     mgSig MLSAG_Gen(const key &message, const keyM & pk, const keyV & xx, const unsigned int index, size_t dsRows);
     bool MLSAG_Ver(const key &message, const keyM &pk, const mgSig &sig, size_t dsRows);
+
+    //Scratch space for MLSAG_Gen and MLSAG_Ver. The key matrix is kept flat, one
+    //column after the other, and the buffers never shrink, so a workspace reused
+    //for many signatures stops allocating once it has seen the largest ring.
+    //A workspace must not be shared between threads
+    struct mlsagWorkspace {
+        size_t cols, rows;
+        keyV pk;                    //pk[i * rows + j] is row j of column i
+        keyV toHash;
+        keyV alpha;
+        std::vector<ge_p3> P;       //pk, decompressed once per signature
+        bool decompressed;          //set by callers which fill P along with pk
+        std::vector<geDsmp> Ip;     //key images, precomputed once per signature
+        std::vector<ge_p2> LR;      //L and R points of the current column
+        keyV LRk;
+
+        mlsagWorkspace(): cols(0), rows(0), decompressed(false) {}
+        void reset(size_t c, size_t r) { cols = c; rows = r; pk.resize(c * r); decompressed = false; }
+        key &at(size_t i, size_t j) { return pk[i * rows + j]; }
+        const key &at(size_t i, size_t j) const { return pk[i * rows + j]; }
+    };
+    //the same as above, on the matrix set up in ws with reset and at
+    mgSig MLSAG_Gen(const key &message, mlsagWorkspace &ws, const keyV & xx, const unsigned int index, size_t dsRows);
+    bool MLSAG_Ver(const key &message, mlsagWorkspace &ws, const mgSig &sig, size_t dsRows);
     //mgSig MLSAG_Gen_Old(const keyM & pk, const keyV & xx, const int index);
 
     //proveRange and verRange
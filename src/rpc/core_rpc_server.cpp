@@ -664,7 +664,8 @@ namespace cryptonote
 
     cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
     tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-    if(!m_core.handle_incoming_tx(tx_blob, tvc, false, false, req.do_not_relay) || tvc.m_verifivation_failed)
+    crypto::hash tx_hash = crypto::null_hash;
+    if(!m_core.handle_incoming_tx(tx_blob, tvc, false, false, req.do_not_relay, &tx_hash) || tvc.m_verifivation_failed || tvc.m_fee_too_low)
     {
       res.status = "Failed";
       res.reason = "";
@@ -707,7 +708,8 @@ namespace cryptonote
 
     NOTIFY_NEW_TRANSACTIONS::request r;
     r.txs.push_back(tx_blob);
-    m_core.get_protocol()->relay_transactions(r, fake_context);
+    r.stem = true;
+    m_core.get_protocol()->relay_transactions(r, std::vector<crypto::hash>(1, tx_hash), fake_context);
     //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -1731,7 +1733,8 @@ namespace cryptonote
         cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
         NOTIFY_NEW_TRANSACTIONS::request r;
         r.txs.push_back(txblob);
-        m_core.get_protocol()->relay_transactions(r, fake_context);
+        r.stem = true;
+        m_core.get_protocol()->relay_transactions(r, std::vector<crypto::hash>(1, txid), fake_context);
         //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
       }
       else
@@ -1781,7 +1784,7 @@ namespace cryptonote
   {
     PERF_TIMER(on_get_txpool_backlog);
 
-    if (!m_core.get_txpool_backlog(res.backlog))
+    if (!(req.buckets ? m_core.get_txpool_backlog_buckets(res.backlog) : m_core.get_txpool_backlog(res.backlog)))
     {
       error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
       error_resp.message = "Failed to get txpool backlog";
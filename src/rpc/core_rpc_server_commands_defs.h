@@ -49,7 +49,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 1
-#define CORE_RPC_VERSION_MINOR 16
+#define CORE_RPC_VERSION_MINOR 17
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -1463,6 +1463,9 @@ namespace cryptonote
     };
   };
 
+  // one entry per pool transaction, or, if buckets was requested, per group of
+  // pool transactions paying about the same fee per byte, with their total size
+  // and fee, and their mean time in the pool
   struct tx_backlog_entry
   {
     uint64_t blob_size;
@@ -1474,7 +1477,10 @@ namespace cryptonote
   {
     struct request
     {
+      bool buckets;
+
       BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(buckets, false)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1516,6 +1522,9 @@ namespace cryptonote
     uint64_t histo_98pc;
     std::vector<txpool_histo> histo;
     uint32_t num_double_spends;
+    uint64_t num_evicted;
+    uint64_t bytes_evicted;
+    uint64_t num_evicted_rejected;
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(bytes_total)
@@ -1531,6 +1540,9 @@ namespace cryptonote
       KV_SERIALIZE(histo_98pc)
       KV_SERIALIZE_CONTAINER_POD_AS_BLOB(histo)
       KV_SERIALIZE(num_double_spends)
+      KV_SERIALIZE(num_evicted)
+      KV_SERIALIZE(bytes_evicted)
+      KV_SERIALIZE(num_evicted_rejected)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -329,7 +329,8 @@ namespace rpc
     cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
     tx_verification_context tvc = AUTO_VAL_INIT(tvc);
 
-    if(!m_core.handle_incoming_tx(tx_blob, tvc, false, false, !req.relay) || tvc.m_verifivation_failed)
+    crypto::hash tx_hash = crypto::null_hash;
+    if(!m_core.handle_incoming_tx(tx_blob, tvc, false, false, !req.relay, &tx_hash) || tvc.m_verifivation_failed || tvc.m_fee_too_low)
     {
       if (tvc.m_verifivation_failed)
       {
@@ -401,7 +402,8 @@ namespace rpc
 
     NOTIFY_NEW_TRANSACTIONS::request r;
     r.txs.push_back(tx_blob);
-    m_core.get_protocol()->relay_transactions(r, fake_context);
+    r.stem = true;
+    m_core.get_protocol()->relay_transactions(r, std::vector<crypto::hash>(1, tx_hash), fake_context);
 
     //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
     res.status = Message::STATUS_OK;
@@ -6548,7 +6548,7 @@ void wallet2::check_tx_key_helper(const crypto::hash &txid, const crypto::key_de
         rct::ecdhDecode(ecdh_info, rct::sk2rct(scalar1));
         const rct::key C = tx.rct_signatures.outPk[n].mask;
         rct::key Ctmp;
-        rct::addKeys2(Ctmp, ecdh_info.mask, ecdh_info.amount, rct::H);
+        rct::addKeysGH(Ctmp, ecdh_info.mask, ecdh_info.amount);
         if (rct::equalKeys(C, Ctmp))
           amount = rct::h2d(ecdh_info.amount);
         else
@@ -7787,6 +7787,9 @@ std::vector<std::pair<uint64_t, uint64_t>> wallet2::estimate_backlog(uint64_t mi
   req.jsonrpc = "2.0";
   req.id = epee::serialization::storage_entry(0);
   req.method = "get_txpool_backlog";
+  // grouped by fee per byte, so the daemon need not walk the whole pool; a daemon
+  // which does not know about buckets sends one entry per tx, which adds up the same
+  req.params.buckets = true;
   bool r = net_utils::invoke_http_json("/json_rpc", req, res, m_http_client, rpc_timeout);
   m_daemon_rpc_mutex.unlock();
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "Failed to connect to daemon");
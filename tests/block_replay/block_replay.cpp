@@ -0,0 +1,338 @@
+// Copyright (c) 2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <fstream>
+#include <iomanip>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include "misc_log_ex.h"
+#include "profile_tools.h"
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "serialization/binary_utils.h"
+#include "blockchain_utilities/bootstrap_file.h"
+#include "blockchain_utilities/bootstrap_serialization.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "block_replay"
+
+// Replays a segment of a blockchain.raw bootstrap file into a fresh,
+// temporary database through the same prepare/handle/cleanup path the
+// daemon uses when syncing, and reports where the time went.
+
+namespace po = boost::program_options;
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_input_file = {"input-file", "blockchain.raw file to replay", "", true};
+  const command_line::arg_descriptor<uint64_t> arg_block_stop = {"block-stop", "Stop after this block height (0 for the whole file)", 0};
+  const command_line::arg_descriptor<std::string> arg_thread_counts = {"thread-counts", "Comma separated --prep-blocks-threads values to run with", "4"};
+  const command_line::arg_descriptor<std::string> arg_batch_sizes = {"batch-sizes", "Comma separated numbers of blocks handled per prepare/cleanup batch", std::to_string(BLOCKS_SYNCHRONIZING_DEFAULT_COUNT)};
+  const command_line::arg_descriptor<std::string> arg_log_level = {"log-level", "0-4 or categories", ""};
+
+  struct replay_result
+  {
+    bool success;
+    uint64_t blocks;
+    uint64_t txes;
+    uint64_t total_ns;
+    uint64_t tx_pool_ns;
+    cryptonote::Blockchain::block_processing_stats stats;
+  };
+
+  bool parse_list(const std::string &s, std::vector<uint64_t> &values)
+  {
+    std::vector<std::string> fields;
+    boost::split(fields, s, boost::is_any_of(","));
+    for (const std::string &field: fields)
+    {
+      try { values.push_back(std::stoull(boost::algorithm::trim_copy(field))); }
+      catch (const std::exception &) { return false; }
+      if (values.back() == 0)
+        return false;
+    }
+    return !values.empty();
+  }
+
+  template<typename T>
+  void set_arg(po::variables_map &vm, const std::string &name, const T &value)
+  {
+    vm.erase(name);
+    vm.insert(std::make_pair(name, po::variable_value(value, false)));
+  }
+
+  // reads the blocks after genesis, up to block_stop, into memory, so that
+  // file access is not part of the measurements
+  bool load_blocks(const std::string &path, uint64_t block_stop, std::vector<cryptonote::block_complete_entry> &entries)
+  {
+    std::ifstream import_file(path, std::ios_base::binary | std::ifstream::in);
+    if (import_file.fail())
+    {
+      MERROR("Failed to open " << path);
+      return false;
+    }
+    BootstrapFile bootstrap;
+    bootstrap.seek_to_first_chunk(import_file);
+
+    std::vector<char> buffer(BUFFER_SIZE);
+    for (uint64_t height = 0; !block_stop || height <= block_stop; ++height)
+    {
+      char size_buffer[sizeof(uint32_t)];
+      import_file.read(size_buffer, sizeof(size_buffer));
+      if (!import_file)
+        break;
+      uint32_t chunk_size;
+      if (!::serialization::parse_binary(std::string(size_buffer, sizeof(size_buffer)), chunk_size) || chunk_size == 0 || chunk_size > BUFFER_SIZE)
+      {
+        MERROR("Bad chunk size at height " << height);
+        return false;
+      }
+      import_file.read(buffer.data(), chunk_size);
+      if (!import_file)
+      {
+        MERROR("Truncated chunk at height " << height);
+        return false;
+      }
+      // the genesis block is added by the core itself
+      if (height == 0)
+        continue;
+
+      bootstrap::block_package bp;
+      if (!::serialization::parse_binary(std::string(buffer.data(), chunk_size), bp))
+      {
+        MERROR("Failed to deserialize chunk at height " << height);
+        return false;
+      }
+      entries.push_back(cryptonote::block_complete_entry());
+      cryptonote::block_to_blob(bp.block, entries.back().block);
+      for (const auto &tx: bp.txs)
+      {
+        entries.back().txs.push_back(cryptonote::blobdata());
+        cryptonote::tx_to_blob(tx, entries.back().txs.back());
+      }
+    }
+    return true;
+  }
+
+  // the time it takes to parse all blobs, done outside the core so it can
+  // be told apart from validation
+  uint64_t measure_parse(const std::vector<cryptonote::block_complete_entry> &entries)
+  {
+    TIME_MEASURE_NS_START(parse_ns);
+    for (const auto &entry: entries)
+    {
+      cryptonote::block b;
+      if (!cryptonote::parse_and_validate_block_from_blob(entry.block, b))
+        MERROR("Failed to parse block");
+      for (const auto &tx_blob: entry.txs)
+      {
+        cryptonote::transaction tx;
+        if (!cryptonote::parse_and_validate_tx_from_blob(tx_blob, tx))
+          MERROR("Failed to parse tx");
+      }
+    }
+    TIME_MEASURE_NS_FINISH(parse_ns);
+    return parse_ns;
+  }
+
+  bool replay(cryptonote::core &core, const std::vector<cryptonote::block_complete_entry> &entries, uint64_t batch_size, replay_result &result)
+  {
+    core.get_blockchain_storage().reset_block_processing_stats();
+    TIME_MEASURE_NS_START(total_ns);
+    for (size_t start = 0; start < entries.size(); start += batch_size)
+    {
+      const size_t stop = std::min<size_t>(start + batch_size, entries.size());
+      const std::list<cryptonote::block_complete_entry> blocks(entries.begin() + start, entries.begin() + stop);
+      core.prepare_handle_incoming_blocks(blocks);
+      for (const auto &entry: blocks)
+      {
+        for (const auto &tx_blob: entry.txs)
+        {
+          cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+          TIME_MEASURE_NS_START(tx_pool_ns);
+          core.handle_incoming_tx(tx_blob, tvc, true, true, false);
+          TIME_MEASURE_NS_FINISH(tx_pool_ns);
+          result.tx_pool_ns += tx_pool_ns;
+          if (tvc.m_verifivation_failed)
+          {
+            MERROR("Transaction verification failed, tx_id = " << epee::string_tools::pod_to_hex(cryptonote::get_blob_hash(tx_blob)));
+            core.cleanup_handle_incoming_blocks();
+            return false;
+          }
+        }
+        cryptonote::block_verification_context bvc = boost::value_initialized<cryptonote::block_verification_context>();
+        core.handle_incoming_block(entry.block, bvc, false);
+        if (bvc.m_verifivation_failed || bvc.m_marked_as_orphaned)
+        {
+          MERROR("Block verification failed, id = " << epee::string_tools::pod_to_hex(cryptonote::get_blob_hash(entry.block)));
+          core.cleanup_handle_incoming_blocks();
+          return false;
+        }
+        result.txes += entry.txs.size();
+        ++result.blocks;
+      }
+      if (!core.cleanup_handle_incoming_blocks())
+        return false;
+    }
+    TIME_MEASURE_NS_FINISH(total_ns);
+    result.total_ns = total_ns;
+    result.stats = core.get_blockchain_storage().get_block_processing_stats();
+    return true;
+  }
+
+  bool run(po::variables_map vm, const std::vector<cryptonote::block_complete_entry> &entries, uint64_t threads, uint64_t batch_size, replay_result &result)
+  {
+    const boost::filesystem::path data_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("monero-block-replay-%%%%-%%%%-%%%%");
+    const bool testnet = command_line::get_arg(vm, cryptonote::arg_testnet_on);
+    set_arg(vm, testnet ? cryptonote::arg_testnet_data_dir.name : cryptonote::arg_data_dir.name, data_dir.string());
+    set_arg(vm, "prep-blocks-threads", threads);
+
+    result = replay_result();
+    bool r = false;
+    {
+      cryptonote::cryptonote_protocol_stub pr;
+      cryptonote::core core(&pr);
+      core.disable_dns_checkpoints(true);
+      if (core.init(vm, NULL))
+      {
+        r = replay(core, entries, batch_size, result);
+        core.deinit();
+      }
+      else
+      {
+        MERROR("Failed to initialize core");
+      }
+    }
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(data_dir, ec);
+    result.success = r;
+    return r;
+  }
+
+  double ms(uint64_t ns)
+  {
+    return ns / 1e6;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+  tools::on_startup();
+
+  po::options_description desc_options("Command line options");
+  command_line::add_arg(desc_options, arg_input_file);
+  command_line::add_arg(desc_options, arg_block_stop);
+  command_line::add_arg(desc_options, arg_thread_counts);
+  command_line::add_arg(desc_options, arg_batch_sizes);
+  command_line::add_arg(desc_options, arg_log_level);
+  command_line::add_arg(desc_options, command_line::arg_help);
+  cryptonote::core::init_options(desc_options);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc_options << std::endl;
+    return 0;
+  }
+
+  mlog_configure(mlog_get_default_log_path("block_replay.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log("0,block_replay:INFO");
+
+  std::vector<uint64_t> thread_counts, batch_sizes;
+  if (!parse_list(command_line::get_arg(vm, arg_thread_counts), thread_counts))
+  {
+    std::cerr << "Invalid thread counts" << std::endl;
+    return 1;
+  }
+  if (!parse_list(command_line::get_arg(vm, arg_batch_sizes), batch_sizes))
+  {
+    std::cerr << "Invalid batch sizes" << std::endl;
+    return 1;
+  }
+
+  // we want to measure validation, not skip it using the built in hashes
+  if (vm["fast-block-sync"].defaulted())
+    set_arg(vm, "fast-block-sync", (uint64_t)0);
+
+  std::vector<cryptonote::block_complete_entry> entries;
+  if (!load_blocks(command_line::get_arg(vm, arg_input_file), command_line::get_arg(vm, arg_block_stop), entries))
+    return 1;
+  if (entries.empty())
+  {
+    std::cerr << "No blocks to replay" << std::endl;
+    return 1;
+  }
+  MINFO("Loaded " << entries.size() << " blocks");
+  const uint64_t parse_ns = measure_parse(entries);
+
+  std::cout << std::left << std::setw(8) << "threads" << std::setw(8) << "batch" << std::setw(10) << "blocks"
+      << std::setw(12) << "blocks/s" << std::setw(10) << "parse" << std::setw(10) << "txpool" << std::setw(10) << "pow"
+      << std::setw(10) << "rings" << std::setw(10) << "verify" << std::setw(10) << "db" << std::setw(10) << "total"
+      << "(ms)" << std::endl;
+  int ret = 0;
+  for (uint64_t threads: thread_counts)
+  {
+    for (uint64_t batch_size: batch_sizes)
+    {
+      replay_result result;
+      if (!run(vm, entries, threads, batch_size, result))
+      {
+        std::cerr << "Replay failed with " << threads << " threads, batch size " << batch_size
+            << ", after " << result.blocks << " blocks" << std::endl;
+        ret = 1;
+        continue;
+      }
+      std::cout << std::left << std::fixed << std::setprecision(1)
+          << std::setw(8) << threads << std::setw(8) << batch_size << std::setw(10) << result.blocks
+          << std::setw(12) << result.blocks / (result.total_ns / 1e9)
+          << std::setw(10) << ms(parse_ns) << std::setw(10) << ms(result.tx_pool_ns) << std::setw(10) << ms(result.stats.pow_ns)
+          << std::setw(10) << ms(result.stats.ring_fetch_ns) << std::setw(10) << ms(result.stats.tx_check_ns)
+          << std::setw(10) << ms(result.stats.db_write_ns) << std::setw(10) << ms(result.total_ns) << std::endl;
+    }
+  }
+  return ret;
+
+  CATCH_ENTRY_L0("main", 1);
+}
@@ -159,7 +159,9 @@ string tx2str(const cryptonote::transaction& tx, const cryptonote::hash256& tx_h
     return ss.str();
 }*/
 
-bool tests::proxy_core::handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) {
+bool tests::proxy_core::handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay, crypto::hash *ptx_hash) {
+    if (ptx_hash)
+        *ptx_hash = null_hash;
     if (!keeped_by_block)
         return true;
 
@@ -171,6 +173,8 @@ bool tests::proxy_core::handle_incoming_tx(const cryptonote::blobdata& tx_blob,
         cerr << "WRONG TRANSACTION BLOB, Failed to parse, rejected" << endl;
         return false;
     }
+    if (ptx_hash)
+        *ptx_hash = tx_hash;
 
     cout << "TX " << endl << endl;
     cout << tx_hash << endl;
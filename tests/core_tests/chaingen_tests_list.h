@@ -38,6 +38,7 @@
 #include "double_spend.h"
 #include "integer_overflow.h"
 #include "ring_signature_1.h"
+#include "tx_pool.h"
 #include "tx_validation.h"
 #include "v2_tests.h"
 #include "rct.h"
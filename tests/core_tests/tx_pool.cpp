@@ -0,0 +1,202 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#include <algorithm>
+
+#include "chaingen.h"
+#include "tx_pool.h"
+
+using namespace epee;
+using namespace cryptonote;
+
+namespace
+{
+  bool template_has_tx(cryptonote::core& c, const account_public_address& adr, const crypto::hash& txid)
+  {
+    block b;
+    difficulty_type diffic;
+    uint64_t height, expected_reward;
+    if (!c.get_block_template(b, adr, diffic, height, 0, expected_reward, blobdata()))
+      return false;
+    return std::find(b.tx_hashes.begin(), b.tx_hashes.end(), txid) != b.tx_hashes.end();
+  }
+}
+
+gen_txpool_restore_over_reorg::gen_txpool_restore_over_reorg()
+{
+  REGISTER_CALLBACK("check_ready_and_save", gen_txpool_restore_over_reorg::check_ready_and_save);
+  REGISTER_CALLBACK("check_restored", gen_txpool_restore_over_reorg::check_restored);
+}
+
+gen_txpool_restore_over_reorg::~gen_txpool_restore_over_reorg()
+{
+  if (!m_state_dir.empty())
+  {
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(m_state_dir, ec);
+  }
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_txpool_restore_over_reorg::generate(std::vector<test_event_entry>& events) const
+{
+  uint64_t ts_start = 1338224400;
+  /*
+  (0r)-(1 )-(1r)              <- main chain, tx_1 in the pool spends the output tx_0 makes in (1)
+      \-(2 )-...-(2r)         <- alt chain without tx_0, one block longer, switched to while the
+                                 pool state saved on (1r) is on disk
+  */
+
+  GENERATE_ACCOUNT(miner_account);
+
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, ts_start);                                     //  0
+  MAKE_ACCOUNT(events, alice);                                                                    //  1
+  REWIND_BLOCKS(events, blk_0r, blk_0, miner_account);
+  MAKE_TX(events, tx_0, miner_account, alice, MK_COINS(10), blk_0r);
+  MAKE_NEXT_BLOCK_TX1(events, blk_1, blk_0r, miner_account, tx_0);
+  REWIND_BLOCKS_N(events, blk_1r, blk_1, miner_account, CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE);
+  MAKE_TX(events, tx_1, alice, miner_account, MK_COINS(5), blk_1r);
+  DO_CALLBACK(events, "check_ready_and_save");
+  REWIND_BLOCKS_N(events, blk_2r, blk_0r, miner_account, CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE + 2);
+  DO_CALLBACK(events, "check_restored");
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_txpool_restore_over_reorg::check_ready_and_save(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_txpool_restore_over_reorg::check_ready_and_save");
+
+  const account_base& alice = boost::get<account_base>(events[1]);
+  const crypto::hash tx_1_id = get_transaction_hash(boost::get<transaction>(events[ev_index - 1]));
+
+  // the pool saves its state to a folder of our own, so the restore can be driven from here
+  m_state_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  CHECK_TEST_CONDITION(boost::filesystem::create_directory(m_state_dir));
+  CHECK_TEST_CONDITION(c.get_pool().init(0, m_state_dir.string()));
+
+  // marks tx_1 ready on top of blk_1r
+  CHECK_TEST_CONDITION(template_has_tx(c, alice.get_keys().m_account_address, tx_1_id));
+  CHECK_TEST_CONDITION(c.get_pool().deinit());
+  CHECK_TEST_CONDITION(boost::filesystem::exists(m_state_dir / CRYPTONOTE_POOLDATA_FILENAME));
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_txpool_restore_over_reorg::check_restored(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_txpool_restore_over_reorg::check_restored");
+
+  const account_base& alice = boost::get<account_base>(events[1]);
+  const block& blk_2r = boost::get<block>(events[ev_index - 1]);
+  CHECK_TEST_CONDITION(c.get_tail_id() == get_block_hash(blk_2r));
+
+  crypto::hash tx_1_id = crypto::null_hash;
+  for (size_t i = ev_index; i-- > 0 && tx_1_id == crypto::null_hash; )
+    if (events[i].type() == typeid(transaction))
+      tx_1_id = get_transaction_hash(boost::get<transaction>(events[i]));
+
+  // tx_1 was saved as ready on a block that is no longer in the chain, and
+  // the output it spends is gone with it
+  CHECK_TEST_CONDITION(c.get_pool().init(0, m_state_dir.string()));
+  CHECK_TEST_CONDITION(c.get_pool().have_tx(tx_1_id));
+  CHECK_TEST_CONDITION(!template_has_tx(c, alice.get_keys().m_account_address, tx_1_id));
+
+  // stop saving to the folder, it is removed with the test
+  CHECK_TEST_CONDITION(c.get_pool().init(0, std::string()));
+
+  return true;
+}
+
+gen_txpool_full_rejects_low_fee::gen_txpool_full_rejects_low_fee()
+  : m_rejected_tx_count(0)
+{
+  REGISTER_CALLBACK("shrink_pool", gen_txpool_full_rejects_low_fee::shrink_pool);
+  REGISTER_CALLBACK("check_rejected", gen_txpool_full_rejects_low_fee::check_rejected);
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_txpool_full_rejects_low_fee::generate(std::vector<test_event_entry>& events) const
+{
+  uint64_t ts_start = 1338224400;
+
+  GENERATE_ACCOUNT(miner_account);
+
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, ts_start);
+  MAKE_ACCOUNT(events, alice);
+  REWIND_BLOCKS(events, blk_0r, blk_0, miner_account);
+  MAKE_TX(events, tx_0, miner_account, alice, MK_COINS(10), blk_0r);
+  // evicts tx_0, and leaves no room for anything else
+  DO_CALLBACK(events, "shrink_pool");
+  // refused as recently evicted
+  events.push_back(tx_0);
+  // refused as it would be evicted right away
+  MAKE_TX(events, tx_1, miner_account, alice, MK_COINS(20), blk_0r);
+  DO_CALLBACK(events, "check_rejected");
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_txpool_full_rejects_low_fee::check_tx_verification_context(const cryptonote::tx_verification_context& tvc, bool tx_added, size_t /*event_idx*/, const cryptonote::transaction& /*tx*/)
+{
+  if (tvc.m_verifivation_failed)
+    return false;
+  // a refusal must say why, or the RPC would answer OK for a transaction that went nowhere
+  if (tx_added)
+    return tvc.m_added_to_pool && !tvc.m_fee_too_low;
+  ++m_rejected_tx_count;
+  return !tvc.m_added_to_pool && !tvc.m_should_be_relayed && tvc.m_fee_too_low;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_txpool_full_rejects_low_fee::shrink_pool(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_txpool_full_rejects_low_fee::shrink_pool");
+
+  CHECK_EQ(1, c.get_pool_transactions_count());
+  c.get_pool().set_txpool_max_size(1);
+  CHECK_EQ(0, c.get_pool_transactions_count());
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------------------------------
+bool gen_txpool_full_rejects_low_fee::check_rejected(cryptonote::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  DEFINE_TESTS_ERROR_CONTEXT("gen_txpool_full_rejects_low_fee::check_rejected");
+
+  CHECK_EQ(2, m_rejected_tx_count);
+  CHECK_EQ(0, c.get_pool_transactions_count());
+
+  return true;
+}
@@ -29,6 +29,7 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <ios>
@@ -51,6 +52,41 @@ extern "C" {
     }
     tree_hash((const char (*)[32]) data, length >> 5, hash);
   }
+  static void hash_fast_batch(const void *data, size_t length, char *hash) {
+    // enough copies for both the batched and the leftover messages
+    const size_t count = 7;
+    vector<char> copies(count * length + 1);
+    vector<chash> results(count);
+    for (size_t i = 0; i < count; i++) {
+      memcpy(copies.data() + i * length, data, length);
+    }
+    cn_fast_hash_batch(copies.data(), length, count, results.data());
+    for (size_t i = 1; i < count; i++) {
+      if (results[i] != results[0]) {
+        throw ios_base::failure("Inconsistent batch hashes");
+      }
+    }
+    memcpy(hash, &results[0], sizeof(chash));
+  }
+  static void hash_slow_multi(const void *data, size_t length, char *hash) {
+    // every number of ways must give the same hash for every input
+    const void *inputs[CN_SLOW_HASH_MAX_WAYS];
+    size_t lengths[CN_SLOW_HASH_MAX_WAYS];
+    chash results[CN_SLOW_HASH_MAX_WAYS];
+    cn_slow_hash(data, length, hash);
+    for (size_t i = 0; i < CN_SLOW_HASH_MAX_WAYS; i++) {
+      inputs[i] = data;
+      lengths[i] = length;
+    }
+    for (size_t ways = 1; ways <= CN_SLOW_HASH_MAX_WAYS; ways++) {
+      cn_slow_hash_multi(inputs, lengths, ways, results);
+      for (size_t i = 0; i < ways; i++) {
+        if (memcmp(&results[i], hash, sizeof(chash)) != 0) {
+          throw ios_base::failure("Inconsistent multi hashes");
+        }
+      }
+    }
+  }
 }
 POP_WARNINGS
 
@@ -58,7 +94,8 @@ extern "C" typedef void hash_f(const void *, size_t, char *);
 struct hash_func {
   const string name;
   hash_f &f;
-} hashes[] = {{"fast", cn_fast_hash}, {"slow", cn_slow_hash}, {"tree", hash_tree},
+} hashes[] = {{"fast", cn_fast_hash}, {"slow", cn_slow_hash}, {"tree", hash_tree}, {"fast-batch", hash_fast_batch},
+  {"slow-multi", hash_slow_multi},
   {"extra-blake", hash_extra_blake}, {"extra-groestl", hash_extra_groestl},
   {"extra-jh", hash_extra_jh}, {"extra-skein", hash_extra_skein}};
 
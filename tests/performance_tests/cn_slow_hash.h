@@ -65,7 +65,32 @@ public:
     return hash == m_expected_hash;
   }
 
-private:
+protected:
   data_t m_data;
   crypto::hash m_expected_hash;
 };
+
+// computes ways hashes per test, interleaved on one thread
+template<size_t ways>
+class test_cn_slow_hash_multi : public test_cn_slow_hash
+{
+public:
+  static_assert(ways >= 1 && ways <= CN_SLOW_HASH_MAX_WAYS, "Invalid number of ways");
+
+  bool test()
+  {
+    const void *data[ways];
+    size_t length[ways];
+    crypto::hash hashes[ways];
+    for (size_t i = 0; i < ways; ++i)
+    {
+      data[i] = &m_data;
+      length[i] = sizeof(m_data);
+    }
+    crypto::cn_slow_hash_multi(data, length, ways, hashes);
+    for (size_t i = 0; i < ways; ++i)
+      if (hashes[i] != m_expected_hash)
+        return false;
+    return true;
+  }
+};
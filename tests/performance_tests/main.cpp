@@ -28,27 +28,147 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <boost/program_options.hpp>
+
+#include "common/command_line.h"
 #include "common/util.h"
 #include "performance_tests.h"
 #include "performance_utils.h"
 
+extern "C" {
+#include "crypto/crypto-ops.h"
+}
+
 // tests
+#include "bulletproof.h"
 #include "construct_tx.h"
 #include "check_tx_signature.h"
 #include "cn_slow_hash.h"
 #include "derive_public_key.h"
 #include "derive_secret_key.h"
+#include "derive_subaddress_public_key.h"
 #include "ge_frombytes_vartime.h"
 #include "generate_key_derivation.h"
 #include "generate_key_image.h"
 #include "generate_key_image_helper.h"
 #include "generate_keypair.h"
 #include "is_out_to_acc.h"
+#include "mlsag.h"
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
+#include "tree_hash.h"
+#include "tx_pool.h"
+#include "ver_rct_simple.h"
+
+namespace po = boost::program_options;
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_filter = {"filter", "Regular expression the names of the tests to run must contain", ""};
+  const command_line::arg_descriptor<double> arg_loop_multiplier = {"loop-multiplier", "Scale the number of calls of every test by this factor", 1};
+  const command_line::arg_descriptor<double> arg_max_time = {"max-time", "Stop each test after this many seconds, even if short of its calls (0 for no limit)", 0};
+  const command_line::arg_descriptor<std::string> arg_backend = {"backend", "Crypto ops backend to run the tests on, or \"all\" to run them on each available one in turn", ""};
+  const command_line::arg_descriptor<std::string> arg_json = {"json", "Also write the results to this file, as JSON", ""};
+}
+
+static void run_tests(performance_params &params)
+{
+  TEST_PERFORMANCE3(params, test_construct_tx, 1, 1, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 1, 2, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 1, 10, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 1, 100, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 1, 1000, false);
+
+  TEST_PERFORMANCE3(params, test_construct_tx, 2, 1, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 2, 2, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 2, 10, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 2, 100, false);
+
+  TEST_PERFORMANCE3(params, test_construct_tx, 10, 1, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 10, 2, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 10, 10, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 10, 100, false);
+
+  TEST_PERFORMANCE3(params, test_construct_tx, 100, 1, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 100, 2, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 100, 10, false);
+  TEST_PERFORMANCE3(params, test_construct_tx, 100, 100, false);
+
+  TEST_PERFORMANCE3(params, test_construct_tx, 2, 1, true);
+  TEST_PERFORMANCE3(params, test_construct_tx, 2, 2, true);
+  TEST_PERFORMANCE3(params, test_construct_tx, 2, 10, true);
+
+  TEST_PERFORMANCE3(params, test_construct_tx, 10, 1, true);
+  TEST_PERFORMANCE3(params, test_construct_tx, 10, 2, true);
+  TEST_PERFORMANCE3(params, test_construct_tx, 10, 10, true);
+
+  TEST_PERFORMANCE3(params, test_construct_tx, 100, 1, true);
+  TEST_PERFORMANCE3(params, test_construct_tx, 100, 2, true);
+  TEST_PERFORMANCE3(params, test_construct_tx, 100, 10, true);
+
+  TEST_PERFORMANCE2(params, test_check_tx_signature, 1, false);
+  TEST_PERFORMANCE2(params, test_check_tx_signature, 2, false);
+  TEST_PERFORMANCE2(params, test_check_tx_signature, 10, false);
+  TEST_PERFORMANCE2(params, test_check_tx_signature, 100, false);
+
+  TEST_PERFORMANCE2(params, test_check_tx_signature, 2, true);
+  TEST_PERFORMANCE2(params, test_check_tx_signature, 10, true);
+  TEST_PERFORMANCE2(params, test_check_tx_signature, 100, true);
+
+  TEST_PERFORMANCE0(params, test_is_out_to_acc);
+  TEST_PERFORMANCE0(params, test_is_out_to_acc_precomp);
+  TEST_PERFORMANCE0(params, test_generate_key_image_helper);
+  TEST_PERFORMANCE0(params, test_generate_key_derivation);
+  TEST_PERFORMANCE0(params, test_generate_key_image);
+  TEST_PERFORMANCE0(params, test_derive_public_key);
+  TEST_PERFORMANCE0(params, test_derive_secret_key);
+  TEST_PERFORMANCE0(params, test_ge_frombytes_vartime);
+  TEST_PERFORMANCE0(params, test_generate_keypair);
+  TEST_PERFORMANCE0(params, test_sc_reduce32);
+  TEST_PERFORMANCE0(params, test_derive_subaddress_public_key);
+
+  TEST_PERFORMANCE1(params, test_tree_hash, 2);
+  TEST_PERFORMANCE1(params, test_tree_hash, 16);
+  TEST_PERFORMANCE1(params, test_tree_hash, 256);
+  TEST_PERFORMANCE1(params, test_tree_hash, 4096);
+
+  TEST_PERFORMANCE1(params, test_mlsag_ver, 5);
+  TEST_PERFORMANCE1(params, test_mlsag_ver, 11);
+  TEST_PERFORMANCE1(params, test_mlsag_ver, 64);
+
+  TEST_PERFORMANCE4(params, test_ver_rct_simple, 1, 2, 5, false);
+  TEST_PERFORMANCE4(params, test_ver_rct_simple, 2, 2, 5, false);
+  TEST_PERFORMANCE4(params, test_ver_rct_simple, 1, 2, 5, true);
+  TEST_PERFORMANCE4(params, test_ver_rct_simple, 2, 2, 5, true);
+  TEST_PERFORMANCE4(params, test_ver_rct_simple, 2, 2, 11, true);
+
+  TEST_PERFORMANCE1(params, test_bulletproof, false);
+  TEST_PERFORMANCE1(params, test_bulletproof, true);
+
+  TEST_PERFORMANCE0(params, test_cn_slow_hash);
+  TEST_PERFORMANCE1(params, test_cn_slow_hash_multi, 1);
+  TEST_PERFORMANCE1(params, test_cn_slow_hash_multi, 2);
+  TEST_PERFORMANCE1(params, test_cn_slow_hash_multi, 3);
+  TEST_PERFORMANCE1(params, test_cn_slow_hash_multi, 4);
+  TEST_PERFORMANCE1(params, test_cn_fast_hash, 32);
+  TEST_PERFORMANCE1(params, test_cn_fast_hash, 16384);
+
+  // the shared fake chain is built on the first of these, which takes a while
+  TEST_PERFORMANCE1(params, test_tx_pool_handle_incoming_txs, 1000);
+  TEST_PERFORMANCE1(params, test_tx_pool_get_transaction_stats, 1000);
+  TEST_PERFORMANCE1(params, test_tx_pool_fill_block_template, 1000);
+  TEST_PERFORMANCE1(params, test_tx_pool_take_tx, 1000);
+
+  TEST_PERFORMANCE1(params, test_tx_pool_handle_incoming_txs, 10000);
+  TEST_PERFORMANCE1(params, test_tx_pool_get_transaction_stats, 10000);
+  TEST_PERFORMANCE1(params, test_tx_pool_fill_block_template, 10000);
+  TEST_PERFORMANCE1(params, test_tx_pool_take_tx, 10000);
+
+}
 
 int main(int argc, char** argv)
 {
+  TRY_ENTRY();
   tools::on_startup();
   set_process_affinity(1);
   set_thread_high_priority();
@@ -56,67 +176,78 @@ int main(int argc, char** argv)
   mlog_configure(mlog_get_default_log_path("performance_tests.log"), true);
   mlog_set_log_level(0);
 
+  po::options_description desc_options("Allowed options");
+  command_line::add_arg(desc_options, command_line::arg_help);
+  command_line::add_arg(desc_options, arg_filter);
+  command_line::add_arg(desc_options, arg_loop_multiplier);
+  command_line::add_arg(desc_options, arg_max_time);
+  command_line::add_arg(desc_options, arg_backend);
+  command_line::add_arg(desc_options, arg_json);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc_options << std::endl;
+    return 0;
+  }
+
+  performance_params params;
+  params.filter = boost::regex(command_line::get_arg(vm, arg_filter));
+  params.loop_multiplier = command_line::get_arg(vm, arg_loop_multiplier);
+  params.max_time = command_line::get_arg(vm, arg_max_time);
+  if (params.loop_multiplier <= 0 || params.max_time < 0)
+  {
+    std::cout << "loop-multiplier must be positive, and max-time not negative" << std::endl;
+    return 1;
+  }
+
+  std::vector<int> backends;
+  const std::string backend = command_line::get_arg(vm, arg_backend);
+  for (int i = 0; i < CRYPTO_OPS_BACKEND_COUNT; ++i)
+  {
+    if ((backend == "all" && crypto_ops_backend_available(i)) || backend == crypto_ops_backend_name(i))
+      backends.push_back(i);
+  }
+  if (backend.empty())
+    backends.push_back(crypto_ops_get_backend());
+  else if (backends.empty())
+  {
+    std::cout << "Unknown crypto ops backend: " << backend << std::endl;
+    return 1;
+  }
+
   performance_timer timer;
   timer.start();
 
-  TEST_PERFORMANCE3(test_construct_tx, 1, 1, false);
-  TEST_PERFORMANCE3(test_construct_tx, 1, 2, false);
-  TEST_PERFORMANCE3(test_construct_tx, 1, 10, false);
-  TEST_PERFORMANCE3(test_construct_tx, 1, 100, false);
-  TEST_PERFORMANCE3(test_construct_tx, 1, 1000, false);
-
-  TEST_PERFORMANCE3(test_construct_tx, 2, 1, false);
-  TEST_PERFORMANCE3(test_construct_tx, 2, 2, false);
-  TEST_PERFORMANCE3(test_construct_tx, 2, 10, false);
-  TEST_PERFORMANCE3(test_construct_tx, 2, 100, false);
-
-  TEST_PERFORMANCE3(test_construct_tx, 10, 1, false);
-  TEST_PERFORMANCE3(test_construct_tx, 10, 2, false);
-  TEST_PERFORMANCE3(test_construct_tx, 10, 10, false);
-  TEST_PERFORMANCE3(test_construct_tx, 10, 100, false);
-
-  TEST_PERFORMANCE3(test_construct_tx, 100, 1, false);
-  TEST_PERFORMANCE3(test_construct_tx, 100, 2, false);
-  TEST_PERFORMANCE3(test_construct_tx, 100, 10, false);
-  TEST_PERFORMANCE3(test_construct_tx, 100, 100, false);
-
-  TEST_PERFORMANCE3(test_construct_tx, 2, 1, true);
-  TEST_PERFORMANCE3(test_construct_tx, 2, 2, true);
-  TEST_PERFORMANCE3(test_construct_tx, 2, 10, true);
-
-  TEST_PERFORMANCE3(test_construct_tx, 10, 1, true);
-  TEST_PERFORMANCE3(test_construct_tx, 10, 2, true);
-  TEST_PERFORMANCE3(test_construct_tx, 10, 10, true);
-
-  TEST_PERFORMANCE3(test_construct_tx, 100, 1, true);
-  TEST_PERFORMANCE3(test_construct_tx, 100, 2, true);
-  TEST_PERFORMANCE3(test_construct_tx, 100, 10, true);
-
-  TEST_PERFORMANCE2(test_check_tx_signature, 1, false);
-  TEST_PERFORMANCE2(test_check_tx_signature, 2, false);
-  TEST_PERFORMANCE2(test_check_tx_signature, 10, false);
-  TEST_PERFORMANCE2(test_check_tx_signature, 100, false);
-
-  TEST_PERFORMANCE2(test_check_tx_signature, 2, true);
-  TEST_PERFORMANCE2(test_check_tx_signature, 10, true);
-  TEST_PERFORMANCE2(test_check_tx_signature, 100, true);
-
-  TEST_PERFORMANCE0(test_is_out_to_acc);
-  TEST_PERFORMANCE0(test_is_out_to_acc_precomp);
-  TEST_PERFORMANCE0(test_generate_key_image_helper);
-  TEST_PERFORMANCE0(test_generate_key_derivation);
-  TEST_PERFORMANCE0(test_generate_key_image);
-  TEST_PERFORMANCE0(test_derive_public_key);
-  TEST_PERFORMANCE0(test_derive_secret_key);
-  TEST_PERFORMANCE0(test_ge_frombytes_vartime);
-  TEST_PERFORMANCE0(test_generate_keypair);
-  TEST_PERFORMANCE0(test_sc_reduce32);
-
-  TEST_PERFORMANCE0(test_cn_slow_hash);
-  TEST_PERFORMANCE1(test_cn_fast_hash, 32);
-  TEST_PERFORMANCE1(test_cn_fast_hash, 16384);
+  for (int b: backends)
+  {
+    if (!crypto_ops_set_backend(b))
+    {
+      std::cout << "Crypto ops backend " << crypto_ops_backend_name(b) << " is not available on this machine" << std::endl;
+      return 1;
+    }
+    params.backend = crypto_ops_backend_name(b);
+    run_tests(params);
+  }
 
   std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
+  const std::string json = command_line::get_arg(vm, arg_json);
+  if (!json.empty() && !write_json(json, params.results))
+  {
+    std::cout << "Failed to write " << json << std::endl;
+    return 1;
+  }
+
   return 0;
+  CATCH_ENTRY_L0("main", 1);
 }
@@ -0,0 +1,72 @@
+// Copyright (c) 2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include "ringct/rctSigs.h"
+
+// an MLSAG of the shape RCTTypeSimple uses: the output key and the commitment difference
+template<size_t ring_size>
+class test_mlsag_ver
+{
+public:
+  static const size_t loop_count = 1000;
+  static const size_t rows = 2;
+  static const size_t ds_rows = 1;
+
+  bool init()
+  {
+    const unsigned int index = ring_size / 2;
+    m_pk = rct::keyMInit(rows, ring_size);
+    rct::keyV sk(rows);
+    for (size_t i = 0; i < ring_size; ++i)
+    {
+      for (size_t j = 0; j < rows; ++j)
+      {
+        const rct::key x = rct::skGen();
+        m_pk[i][j] = rct::scalarmultBase(x);
+        if (i == index)
+          sk[j] = x;
+      }
+    }
+    m_message = rct::skGen();
+    m_sig = rct::MLSAG_Gen(m_message, m_pk, sk, index, ds_rows);
+    return rct::MLSAG_Ver(m_message, m_pk, m_sig, ds_rows);
+  }
+
+  bool test()
+  {
+    return rct::MLSAG_Ver(m_message, m_pk, m_sig, ds_rows);
+  }
+
+private:
+  rct::key m_message;
+  rct::keyM m_pk;
+  rct::mgSig m_sig;
+};
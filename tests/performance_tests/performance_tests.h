@@ -28,12 +28,22 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
 #include <stdint.h>
 
 #include <boost/chrono.hpp>
+#include <boost/regex.hpp>
 
 class performance_timer
 {
@@ -56,22 +66,68 @@ public:
     return static_cast<int>(boost::chrono::duration_cast<boost::chrono::milliseconds>(elapsed).count());
   }
 
+  uint64_t elapsed_ns()
+  {
+    clock::duration elapsed = clock::now() - m_start;
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(elapsed).count();
+  }
+
 private:
   clock::time_point m_base;
   clock::time_point m_start;
 };
 
+// timings of one test, in nanoseconds per call
+struct test_result
+{
+  std::string name;
+  std::string backend;
+  bool ok;
+  size_t loop_count;
+  double mean;
+  double median;
+  double p95;
+  double stddev;
+  double min;
+};
+
+// what to run and how long for, set from the command line
+struct performance_params
+{
+  boost::regex filter;
+  double loop_multiplier;
+  double max_time;            // seconds per test, 0 for no limit
+  std::string backend;        // crypto ops backend the tests run on
+  std::vector<test_result> results;
+
+  performance_params(): filter(""), loop_multiplier(1), max_time(0) {}
+};
+
+// tests which use up their data as they run, like the pool ones, have a
+// max_calls() member to say how many calls they have data for
+template <typename T>
+auto test_max_calls(const T &test, int) -> decltype(test.max_calls())
+{
+  return test.max_calls();
+}
+
+template <typename T>
+size_t test_max_calls(const T &, long)
+{
+  return std::numeric_limits<size_t>::max();
+}
 
 template <typename T>
 class test_runner
 {
 public:
   test_runner()
-    : m_elapsed(0)
+    : m_loop_count(0)
+    , m_elapsed(0)
   {
   }
 
-  bool run()
+  bool run(const performance_params &params)
   {
     T test;
     if (!test.init())
@@ -82,23 +138,69 @@ public:
     warm_up();
     std::cout << "Warm up: " << timer.elapsed_ms() << " ms" << std::endl;
 
-    timer.start();
-    for (size_t i = 0; i < T::loop_count; ++i)
+    const size_t loop_count = std::min<size_t>(std::max<size_t>(1, T::loop_count * params.loop_multiplier), test_max_calls(test, 0));
+    if (loop_count == 0)
+      return false;
+
+    // calls are timed in batches of at least a microsecond, so that reading
+    // the clock does not weigh on the cheap ones; the first batch, which
+    // measures how long a call takes, counts as a sample like the others
+    const uint64_t max_ns = params.max_time * 1e9;
+    performance_timer total;
+    total.start();
+    m_samples.clear();
+    m_loop_count = 0;
+    m_elapsed = 0;
+    size_t batch = std::min<size_t>(loop_count, 16);
+    while (m_loop_count < loop_count)
     {
-      if (!test.test())
-        return false;
+      const size_t n = std::min(batch, loop_count - m_loop_count);
+      timer.start();
+      for (size_t i = 0; i < n; ++i)
+      {
+        if (!test.test())
+          return false;
+      }
+      const uint64_t ns = timer.elapsed_ns();
+      m_samples.push_back(ns / (double)n);
+      m_elapsed += ns;
+      if (m_loop_count == 0)
+      {
+        const uint64_t call_ns = std::max<uint64_t>(1, ns / n);
+        batch = call_ns >= 1000 ? 1 : (1000 + call_ns - 1) / call_ns;
+      }
+      m_loop_count += n;
+      if (max_ns && total.elapsed_ns() >= max_ns)
+        break;
     }
-    m_elapsed = timer.elapsed_ms();
 
     return true;
   }
 
-  int elapsed_time() const { return m_elapsed; }
+  size_t loop_count() const { return m_loop_count; }
+  uint64_t elapsed_ns() const { return m_elapsed; }
 
-  int time_per_call(int scale = 1) const
+  // each sample is the time per call of one batch
+  test_result get_result() const
   {
-    static_assert(0 < T::loop_count, "T::loop_count must be greater than 0");
-    return m_elapsed * scale / T::loop_count;
+    test_result r;
+    r.ok = true;
+    r.loop_count = m_loop_count;
+    r.mean = m_elapsed / (double)m_loop_count;
+    std::vector<double> sorted = m_samples;
+    std::sort(sorted.begin(), sorted.end());
+    r.min = sorted.front();
+    r.median = sorted[sorted.size() / 2];
+    r.p95 = sorted[std::min(sorted.size() - 1, (size_t)(sorted.size() * 0.95))];
+    double sum = 0;
+    for (double s: sorted)
+      sum += s;
+    const double sample_mean = sum / sorted.size();
+    double variance = 0;
+    for (double s: sorted)
+      variance += (s - sample_mean) * (s - sample_mean);
+    r.stddev = sorted.size() > 1 ? std::sqrt(variance / (sorted.size() - 1)) : 0;
+    return r;
   }
 
 private:
@@ -118,38 +220,97 @@ private:
 
 private:
   volatile uint64_t m_warm_up;  ///<! This field is intended for preclude compiler optimizations
-  int m_elapsed;
+  size_t m_loop_count;
+  uint64_t m_elapsed;
+  std::vector<double> m_samples;
 };
 
+inline std::string format_ns(double ns)
+{
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(ns < 10000 ? 0 : 1);
+  if (ns < 10000)
+    ss << ns << " ns";
+  else if (ns < 10000000)
+#ifdef _WIN32
+    ss << ns / 1000 << " \xb5s";
+#else
+    ss << ns / 1000 << " µs";
+#endif
+  else
+    ss << ns / 1000000 << " ms";
+  return ss.str();
+}
+
 template <typename T>
-void run_test(const char* test_name)
+void run_test(performance_params &params, const char* test_name)
 {
+  if (!boost::regex_search(test_name, params.filter))
+    return;
+
   test_runner<T> runner;
-  if (runner.run())
+  test_result r;
+  if (runner.run(params))
   {
+    r = runner.get_result();
     std::cout << test_name << " - OK:\n";
-    std::cout << "  loop count:    " << T::loop_count << '\n';
-    std::cout << "  elapsed:       " << runner.elapsed_time() << " ms\n";
-    const char *unit = "ms";
-    int time_per_call = runner.time_per_call();
-    if (time_per_call < 30000) {
-     time_per_call = runner.time_per_call(1000);
-#ifdef _WIN32
-     unit = "\xb5s";
-#else
-     unit = "µs";
-#endif
-    }
-    std::cout << "  time per call: " << time_per_call << " " << unit << "/call\n" << std::endl;
+    if (!params.backend.empty())
+      std::cout << "  backend:       " << params.backend << '\n';
+    std::cout << "  loop count:    " << runner.loop_count() << '\n';
+    std::cout << "  elapsed:       " << runner.elapsed_ns() / 1000000 << " ms\n";
+    std::cout << "  time per call: " << format_ns(r.mean) << "/call\n";
+    std::cout << "  median:        " << format_ns(r.median) << '\n';
+    std::cout << "  95th pct:      " << format_ns(r.p95) << '\n';
+    std::cout << "  stddev:        " << format_ns(r.stddev) << '\n' << std::endl;
   }
   else
   {
+    r = test_result();
+    r.ok = false;
     std::cout << test_name << " - FAILED" << std::endl;
   }
+  r.name = test_name;
+  r.backend = params.backend;
+  params.results.push_back(r);
+}
+
+inline std::string json_escape(const std::string &s)
+{
+  std::string out;
+  for (char c: s)
+  {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out;
+}
+
+// one object per test run, timings in nanoseconds per call
+inline bool write_json(const std::string &path, const std::vector<test_result> &results)
+{
+  std::ofstream out(path);
+  if (!out)
+    return false;
+  out << std::fixed << std::setprecision(1);
+  out << "{\n  \"results\": [";
+  for (size_t i = 0; i < results.size(); ++i)
+  {
+    const test_result &r = results[i];
+    out << (i ? ",\n" : "\n") << "    {\"name\": \"" << json_escape(r.name) << "\", \"backend\": \"" << json_escape(r.backend)
+        << "\", \"ok\": " << (r.ok ? "true" : "false");
+    if (r.ok)
+      out << ", \"loop_count\": " << r.loop_count << ", \"mean_ns\": " << r.mean << ", \"median_ns\": " << r.median
+          << ", \"p95_ns\": " << r.p95 << ", \"stddev_ns\": " << r.stddev << ", \"min_ns\": " << r.min;
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+  return out.good();
 }
 
 #define QUOTEME(x) #x
-#define TEST_PERFORMANCE0(test_class)         run_test< test_class >(QUOTEME(test_class))
-#define TEST_PERFORMANCE1(test_class, a0)     run_test< test_class<a0> >(QUOTEME(test_class<a0>))
-#define TEST_PERFORMANCE2(test_class, a0, a1) run_test< test_class<a0, a1> >(QUOTEME(test_class) "<" QUOTEME(a0) ", " QUOTEME(a1) ">")
-#define TEST_PERFORMANCE3(test_class, a0, a1, a2) run_test< test_class<a0, a1, a2> >(QUOTEME(test_class) "<" QUOTEME(a0) ", " QUOTEME(a1) ", " QUOTEME(a2) ">")
+#define TEST_PERFORMANCE0(params, test_class)         run_test< test_class >(params, QUOTEME(test_class))
+#define TEST_PERFORMANCE1(params, test_class, a0)     run_test< test_class<a0> >(params, QUOTEME(test_class<a0>))
+#define TEST_PERFORMANCE2(params, test_class, a0, a1) run_test< test_class<a0, a1> >(params, QUOTEME(test_class) "<" QUOTEME(a0) ", " QUOTEME(a1) ">")
+#define TEST_PERFORMANCE3(params, test_class, a0, a1, a2) run_test< test_class<a0, a1, a2> >(params, QUOTEME(test_class) "<" QUOTEME(a0) ", " QUOTEME(a1) ", " QUOTEME(a2) ">")
+#define TEST_PERFORMANCE4(params, test_class, a0, a1, a2, a3) run_test< test_class<a0, a1, a2, a3> >(params, QUOTEME(test_class) "<" QUOTEME(a0) ", " QUOTEME(a1) ", " QUOTEME(a2) ", " QUOTEME(a3) ">")
@@ -0,0 +1,438 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/difficulty.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "cryptonote_core/tx_pool.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler_common.h"
+#include "ringct/rctSigs.h"
+
+/**
+ * A fake chain with enough spendable RingCT outputs for max_txes pool
+ * transactions, and those transactions, which all pay different fees.
+ * It is built on first use, which takes a while, and shared by all the
+ * pool tests, which move the pool to the size they need.
+ */
+class tx_pool_test_chain
+{
+public:
+  static const size_t max_txes = 10000;
+  static const size_t outs_per_split = 16;
+  static const size_t ring_size = 5;  // the minimum from v6
+
+  static tx_pool_test_chain *get()
+  {
+    static std::unique_ptr<tx_pool_test_chain> chain;
+    if (!chain)
+    {
+      std::unique_ptr<tx_pool_test_chain> new_chain(new tx_pool_test_chain());
+      if (!new_chain->init())
+        return NULL;
+      chain = std::move(new_chain);
+    }
+    return chain.get();
+  }
+
+  ~tx_pool_test_chain()
+  {
+    if (m_core_initialized)
+      m_core.deinit();
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(m_data_dir, ec);
+  }
+
+  cryptonote::core &core() { return m_core; }
+  cryptonote::tx_memory_pool &pool() { return m_core.get_pool(); }
+  const std::vector<cryptonote::blobdata> &tx_blobs() const { return m_tx_blobs; }
+  const std::vector<crypto::hash> &tx_hashes() const { return m_tx_hashes; }
+
+  // makes the pool hold exactly the first n_txes transactions
+  bool fill_pool(size_t n_txes)
+  {
+    std::vector<crypto::hash> pool_hashes;
+    if (!m_core.get_pool_transaction_hashes(pool_hashes))
+      return false;
+    const std::unordered_set<crypto::hash> in_pool(pool_hashes.begin(), pool_hashes.end());
+
+    std::list<crypto::hash> remove;
+    for (size_t i = n_txes; i < m_tx_hashes.size(); ++i)
+      if (in_pool.find(m_tx_hashes[i]) != in_pool.end())
+        remove.push_back(m_tx_hashes[i]);
+    if (!remove.empty() && !m_core.get_blockchain_storage().flush_txes_from_pool(remove))
+      return false;
+
+    std::list<cryptonote::blobdata> add;
+    for (size_t i = 0; i < n_txes && i < m_tx_blobs.size(); ++i)
+      if (in_pool.find(m_tx_hashes[i]) == in_pool.end())
+        add.push_back(m_tx_blobs[i]);
+    return add.empty() || add_txes(add);
+  }
+
+  bool add_txes(const std::list<cryptonote::blobdata> &blobs)
+  {
+    std::vector<cryptonote::tx_verification_context> tvcs;
+    if (!m_core.handle_incoming_txs(blobs, tvcs, false, true, false))
+      return false;
+    for (const cryptonote::tx_verification_context &tvc: tvcs)
+      if (tvc.m_verifivation_failed || !tvc.m_added_to_pool)
+        return false;
+    return true;
+  }
+
+private:
+  struct output
+  {
+    uint64_t global_index;
+    rct::ctkey key;
+    crypto::public_key tx_pub_key;
+    size_t index_in_tx;
+    uint64_t amount;
+    rct::key mask;
+  };
+
+  tx_pool_test_chain(): m_core(&m_protocol), m_core_initialized(false) {}
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    m_data_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("performance_tests_tx_pool_%%%%-%%%%-%%%%");
+    const std::string data_dir = m_data_dir.string();
+    const char *argv[] = {"performance_tests", "--data-dir", data_dir.c_str()};
+    boost::program_options::options_description desc;
+    core::init_options(desc);
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::parse_command_line(3, argv, desc), vm);
+    boost::program_options::notify(vm);
+
+    static const std::pair<uint8_t, uint64_t> hard_forks[] = {std::make_pair(1, 0), std::make_pair(6, 1), std::make_pair(0, 0)};
+    static const test_options options = {hard_forks};
+    if (!m_core.init(vm, &options))
+      return false;
+    m_core_initialized = true;
+    m_core.get_blockchain_storage().get_db().set_batch_transactions(true);
+
+    m_account.generate();
+    m_subaddresses[m_account.get_keys().m_account_address.m_spend_public_key] = {0,0};
+
+    // blocks one target time apart keep the difficulty at 1, and starting
+    // in the past keeps them all from being too far in the future
+    m_timestamp = time(NULL) - 365 * 86400;
+
+    // mine the coinbases to split, and wait for them to unlock
+    const size_t n_splits = (max_txes + outs_per_split - 1) / outs_per_split;
+    static_assert(n_splits >= ring_size, "too few coinbases to make rings");
+    std::vector<output> coinbase_outputs;
+    for (size_t i = 0; i < n_splits + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW; ++i)
+    {
+      block b;
+      if (!mine_block(b))
+        return false;
+      if (i >= n_splits)
+        continue;
+      std::vector<uint64_t> global_indices;
+      if (!m_core.get_tx_outputs_gindexs(get_transaction_hash(b.miner_tx), global_indices) || global_indices.size() != 1)
+        return false;
+      const uint64_t amount = b.miner_tx.vout[0].amount;
+      const crypto::public_key &key = boost::get<txout_to_key>(b.miner_tx.vout[0].target).key;
+      coinbase_outputs.push_back({global_indices[0], {rct::pk2rct(key), rct::zeroCommit(amount)}, get_tx_pub_key_from_extra(b.miner_tx), 0, amount, rct::identity()});
+    }
+
+    // split each coinbase in many outputs, one per pool tx
+    std::vector<std::pair<transaction, crypto::secret_key>> splits;
+    for (size_t i = 0; i < n_splits; ++i)
+    {
+      const uint64_t split_fee = 100000000000;  // 0.1, split txes are large
+      std::vector<tx_destination_entry> destinations(outs_per_split, tx_destination_entry((coinbase_outputs[i].amount - split_fee) / outs_per_split, m_account.get_keys().m_account_address, false));
+      transaction tx;
+      crypto::secret_key tx_key;
+      if (!construct_tx(get_source(coinbase_outputs, i), destinations, tx, tx_key))
+        return false;
+      tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      if (!m_core.handle_incoming_tx(tx_to_blob(tx), tvc, false, true, false) || tvc.m_verifivation_failed)
+        return false;
+      splits.push_back(std::make_pair(tx, tx_key));
+    }
+    while (m_core.get_pool_transactions_count() > 0)
+    {
+      block b;
+      if (!mine_block(b))
+        return false;
+    }
+    for (size_t i = 0; i < CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE; ++i)
+    {
+      block b;
+      if (!mine_block(b))
+        return false;
+    }
+
+    std::vector<output> split_outputs;
+    for (const auto &split: splits)
+    {
+      const transaction &tx = split.first;
+      std::vector<uint64_t> global_indices;
+      if (!m_core.get_tx_outputs_gindexs(get_transaction_hash(tx), global_indices) || global_indices.size() != tx.vout.size())
+        return false;
+      crypto::key_derivation derivation;
+      if (!crypto::generate_key_derivation(m_account.get_keys().m_account_address.m_view_public_key, split.second, derivation))
+        return false;
+      for (size_t o = 0; o < tx.vout.size(); ++o)
+      {
+        crypto::secret_key amount_key;
+        crypto::derivation_to_scalar(derivation, o, amount_key);
+        rct::key mask;
+        const uint64_t amount = tx.rct_signatures.type == rct::RCTTypeSimple || tx.rct_signatures.type == rct::RCTTypeSimpleBulletproof ?
+            rct::decodeRctSimple(tx.rct_signatures, rct::sk2rct(amount_key), o, mask) :
+            rct::decodeRct(tx.rct_signatures, rct::sk2rct(amount_key), o, mask);
+        const crypto::public_key &key = boost::get<txout_to_key>(tx.vout[o].target).key;
+        split_outputs.push_back({global_indices[o], {rct::pk2rct(key), tx.rct_signatures.outPk[o].mask}, get_tx_pub_key_from_extra(tx), o, amount, mask});
+      }
+    }
+
+    // the pool txes, with fees spread over a range so their order matters
+    for (size_t i = 0; i < max_txes; ++i)
+    {
+      const uint64_t fee = 10000000000 + (i % 100) * 100000000;  // 0.01 to 0.0199
+      const uint64_t amount = (split_outputs[i].amount - fee) / 2;
+      std::vector<tx_destination_entry> destinations(2, tx_destination_entry(amount, m_account.get_keys().m_account_address, false));
+      transaction tx;
+      crypto::secret_key tx_key;
+      if (!construct_tx(get_source(split_outputs, i), destinations, tx, tx_key))
+        return false;
+      m_tx_blobs.push_back(tx_to_blob(tx));
+      m_tx_hashes.push_back(get_transaction_hash(tx));
+    }
+
+    return true;
+  }
+
+  bool mine_block(cryptonote::block &b)
+  {
+    cryptonote::difficulty_type diffic;
+    uint64_t height, expected_reward;
+    if (!m_core.get_block_template(b, m_account.get_keys().m_account_address, diffic, height, 0, expected_reward, cryptonote::blobdata()))
+      return false;
+    b.timestamp = m_timestamp;
+    m_timestamp += DIFFICULTY_TARGET_V2;
+    while (!cryptonote::check_hash(cryptonote::get_block_longhash(b, height), diffic))
+      ++b.nonce;
+    return m_core.handle_block_found(b) && m_core.get_current_blockchain_height() == height + 1;
+  }
+
+  // a ring around outputs[real], outputs being sorted by global index
+  static cryptonote::tx_source_entry get_source(const std::vector<output> &outputs, size_t real)
+  {
+    const size_t first = std::min(real >= ring_size / 2 ? real - ring_size / 2 : 0, outputs.size() - ring_size);
+    cryptonote::tx_source_entry source;
+    for (size_t i = first; i < first + ring_size; ++i)
+      source.outputs.push_back(std::make_pair(outputs[i].global_index, outputs[i].key));
+    source.real_output = real - first;
+    source.real_out_tx_key = outputs[real].tx_pub_key;
+    source.real_output_in_tx_index = outputs[real].index_in_tx;
+    source.amount = outputs[real].amount;
+    source.rct = true;
+    source.mask = outputs[real].mask;
+    return source;
+  }
+
+  bool construct_tx(const cryptonote::tx_source_entry &source, const std::vector<cryptonote::tx_destination_entry> &destinations, cryptonote::transaction &tx, crypto::secret_key &tx_key)
+  {
+    std::vector<cryptonote::tx_source_entry> sources(1, source);
+    std::vector<crypto::secret_key> additional_tx_keys;
+    return cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), m_subaddresses, sources, destinations, m_account.get_keys().m_account_address, std::vector<uint8_t>(), tx, 0, tx_key, additional_tx_keys, true);
+  }
+
+  cryptonote::cryptonote_protocol_stub m_protocol;
+  cryptonote::core m_core;
+  bool m_core_initialized;
+  boost::filesystem::path m_data_dir;
+  cryptonote::account_base m_account;
+  std::unordered_map<crypto::public_key, cryptonote::subaddress_index> m_subaddresses;
+  uint64_t m_timestamp;
+  std::vector<cryptonote::blobdata> m_tx_blobs;
+  std::vector<crypto::hash> m_tx_hashes;
+};
+
+template<size_t a_pool_size>
+class test_tx_pool_handle_incoming_txs
+{
+  static_assert(0 < a_pool_size && a_pool_size <= tx_pool_test_chain::max_txes, "pool_size must be between 1 and tx_pool_test_chain::max_txes");
+
+public:
+  static const size_t batch_size = 100;
+  static const size_t loop_count = (a_pool_size + batch_size - 1) / batch_size;
+  static const size_t pool_size = a_pool_size;
+
+  bool init()
+  {
+    m_chain = tx_pool_test_chain::get();
+    if (!m_chain || !m_chain->fill_pool(0))
+      return false;
+
+    const std::vector<cryptonote::blobdata> &blobs = m_chain->tx_blobs();
+    for (size_t i = 0; i < pool_size; i += batch_size)
+      m_batches.push_back(std::list<cryptonote::blobdata>(blobs.begin() + i, blobs.begin() + std::min(i + batch_size, pool_size)));
+    m_next_batch = 0;
+    return true;
+  }
+
+  size_t max_calls() const { return m_batches.size(); }
+
+  bool test()
+  {
+    if (m_next_batch >= m_batches.size())
+      return false;
+    return m_chain->add_txes(m_batches[m_next_batch++]);
+  }
+
+private:
+  tx_pool_test_chain *m_chain;
+  std::vector<std::list<cryptonote::blobdata>> m_batches;
+  size_t m_next_batch;
+};
+
+template<size_t a_pool_size>
+class test_tx_pool_fill_block_template
+{
+  static_assert(0 < a_pool_size && a_pool_size <= tx_pool_test_chain::max_txes, "pool_size must be between 1 and tx_pool_test_chain::max_txes");
+
+public:
+  static const size_t loop_count = 100;
+  static const size_t pool_size = a_pool_size;
+
+  bool init()
+  {
+    m_chain = tx_pool_test_chain::get();
+    if (!m_chain || !m_chain->fill_pool(pool_size))
+      return false;
+
+    // what Blockchain::create_block_template would pass
+    const cryptonote::Blockchain &blockchain = m_chain->core().get_blockchain_storage();
+    m_median_size = blockchain.get_current_cumulative_blocksize_limit() / 2;
+    m_already_generated_coins = blockchain.get_db().get_block_already_generated_coins(blockchain.get_current_blockchain_height() - 1);
+    m_version = blockchain.get_current_hard_fork_version();
+    m_calls = 0;
+    return true;
+  }
+
+  bool test()
+  {
+    // alternate the coins generated so the pool never reuses its cached template
+    cryptonote::block b;
+    size_t total_size;
+    uint64_t fee, expected_reward;
+    return m_chain->pool().fill_block_template(b, m_median_size, m_already_generated_coins + (m_calls++ & 1), total_size, fee, expected_reward, m_version) && !b.tx_hashes.empty();
+  }
+
+private:
+  tx_pool_test_chain *m_chain;
+  size_t m_median_size;
+  uint64_t m_already_generated_coins;
+  uint8_t m_version;
+  size_t m_calls;
+};
+
+template<size_t a_pool_size>
+class test_tx_pool_take_tx
+{
+  static_assert(100 <= a_pool_size && a_pool_size <= tx_pool_test_chain::max_txes, "pool_size must be between 100 and tx_pool_test_chain::max_txes");
+
+public:
+  static const size_t loop_count = 100;
+  static const size_t pool_size = a_pool_size;
+
+  bool init()
+  {
+    m_chain = tx_pool_test_chain::get();
+    if (!m_chain || !m_chain->fill_pool(pool_size))
+      return false;
+    m_next = 0;
+    return true;
+  }
+
+  size_t max_calls() const { return pool_size; }
+
+  bool test()
+  {
+    if (m_next >= pool_size)
+      return false;
+    // as when a block with the transaction arrives
+    cryptonote::transaction tx;
+    size_t blob_size;
+    uint64_t fee;
+    bool relayed, do_not_relay, double_spend_seen;
+    return m_chain->pool().take_tx(m_chain->tx_hashes()[m_next++], tx, blob_size, fee, relayed, do_not_relay, double_spend_seen);
+  }
+
+private:
+  tx_pool_test_chain *m_chain;
+  size_t m_next;
+};
+
+template<size_t a_pool_size>
+class test_tx_pool_get_transaction_stats
+{
+  static_assert(0 < a_pool_size && a_pool_size <= tx_pool_test_chain::max_txes, "pool_size must be between 1 and tx_pool_test_chain::max_txes");
+
+public:
+  static const size_t loop_count = 1000;
+  static const size_t pool_size = a_pool_size;
+
+  bool init()
+  {
+    m_chain = tx_pool_test_chain::get();
+    return m_chain && m_chain->fill_pool(pool_size);
+  }
+
+  bool test()
+  {
+    cryptonote::txpool_stats stats;
+    m_chain->pool().get_transaction_stats(stats);
+    return stats.txs_total == pool_size;
+  }
+
+private:
+  tx_pool_test_chain *m_chain;
+};
@@ -0,0 +1,85 @@
+// Copyright (c) 2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include "ringct/rctSigs.h"
+
+template<size_t a_inputs, size_t a_outputs, size_t ring_size, bool a_bulletproof>
+class test_ver_rct_simple
+{
+public:
+  static const size_t loop_count = a_bulletproof ? 20 : 50;
+
+  bool init()
+  {
+    static const rct::xmr_amount input_amount = 1000000;
+    rct::ctkeyV inSk;
+    rct::ctkeyM mixRing(a_inputs);
+    std::vector<unsigned int> index(a_inputs);
+    std::vector<rct::xmr_amount> inamounts;
+    for (size_t n = 0; n < a_inputs; ++n)
+    {
+      rct::ctkey sk, pk;
+      std::tie(sk, pk) = rct::ctskpkGen(input_amount);
+      inSk.push_back(sk);
+      inamounts.push_back(input_amount);
+      index[n] = n % ring_size;
+      for (size_t i = 0; i < ring_size; ++i)
+      {
+        if (i == index[n])
+          mixRing[n].push_back(pk);
+        else
+          mixRing[n].push_back({rct::pkGen(), rct::pkGen()});
+      }
+    }
+
+    const rct::xmr_amount out_amount = a_inputs * input_amount / a_outputs;
+    const rct::xmr_amount fee = a_inputs * input_amount - a_outputs * out_amount;
+    std::vector<rct::xmr_amount> outamounts(a_outputs, out_amount);
+    rct::keyV destinations, amount_keys;
+    for (size_t n = 0; n < a_outputs; ++n)
+    {
+      destinations.push_back(rct::pkGen());
+      amount_keys.push_back(rct::skGen());
+    }
+
+    rct::ctkeyV outSk;
+    m_sig = rct::genRctSimple(rct::zero(), inSk, destinations, inamounts, outamounts, fee, mixRing, amount_keys, index, outSk, a_bulletproof);
+    return rct::verRctSimple(m_sig);
+  }
+
+  bool test()
+  {
+    return rct::verRctSimple(m_sig);
+  }
+
+private:
+  rct::rctSig m_sig;
+};
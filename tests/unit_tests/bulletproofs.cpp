@@ -69,3 +69,30 @@ TEST(bulletproofs, invalid_31)
   rct::Bulletproof proof = bulletproof_PROVE(invalid_amount, rct::skGen());
   ASSERT_FALSE(rct::bulletproof_VERIFY(proof));
 }
+
+TEST(bulletproofs, torsion_in_V)
+{
+  // V is not hashed into the challenges, so adding a point of order 2 to it keeps every
+  // challenge the same: zsq*(V+T) == zsq*V iff zsq is even, and the verifier must agree
+  static const rct::key order2 = { {0xec, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f} };
+  ASSERT_FALSE(order2 == rct::identity());
+  ASSERT_TRUE(rct::addKeys(order2, order2) == rct::identity());
+  bool seen[2] = {false, false};
+  for (int n = 0; n < 64 && !(seen[0] && seen[1]); ++n)
+  {
+    rct::Bulletproof proof = bulletproof_PROVE(crypto::rand<uint64_t>(), rct::skGen());
+    rct::keyV hashed;
+    hashed.push_back(proof.A);
+    hashed.push_back(proof.S);
+    const rct::key z = rct::hash_to_scalar(rct::hash_to_scalar(hashed));
+    rct::key zsq;
+    sc_mul(zsq.bytes, z.bytes, z.bytes);
+    const bool even = !(zsq.bytes[0] & 1);
+    seen[even] = true;
+
+    proof.V[0] = rct::addKeys(proof.V[0], order2);
+    ASSERT_EQ(rct::bulletproof_VERIFY(proof), even);
+  }
+  ASSERT_TRUE(seen[0] && seen[1]);
+}
@@ -31,8 +31,13 @@
 #include <memory>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "crypto/point_cache.h"
+extern "C" {
+#include "crypto/crypto-ops.h"
+}
 
 namespace
 {
@@ -97,3 +102,96 @@ TEST(Crypto, Ostream)
   EXPECT_TRUE(is_formatted<crypto::key_derivation>());
   EXPECT_TRUE(is_formatted<crypto::key_image>());
 }
+
+TEST(Crypto, batch_encoding)
+{
+  // sizes around the internal chunk size
+  for (size_t n: {0, 1, 2, 63, 64, 65, 200})
+  {
+    std::vector<crypto::public_key> keys(n);
+    std::vector<ge_p3> points(n);
+    std::vector<ge_p2> points_p2(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      crypto::secret_key sec;
+      crypto::generate_keys(keys[i], sec);
+    }
+
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(keys.data());
+    ASSERT_EQ(ge_frombytes_vartime_batch(points.data(), bytes, n), 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+      // a point with Z != 1, so the encoders have something to invert
+      ge_p1p1 p1p1;
+      ge_p3_to_p2(&points_p2[i], &points[i]);
+      ge_p2_dbl(&p1p1, &points_p2[i]);
+      ge_p1p1_to_p3(&points[i], &p1p1);
+      ge_p1p1_to_p2(&points_p2[i], &p1p1);
+    }
+
+    std::vector<unsigned char> batch(32 * n), batch_p2(32 * n);
+    ge_p3_tobytes_batch(batch.data(), points.data(), n);
+    ge_tobytes_batch(batch_p2.data(), points_p2.data(), n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      unsigned char single[32];
+      ge_p3_tobytes(single, &points[i]);
+      ASSERT_EQ(memcmp(single, batch.data() + 32 * i, 32), 0);
+      ASSERT_EQ(memcmp(single, batch_p2.data() + 32 * i, 32), 0);
+    }
+  }
+}
+
+TEST(Crypto, batch_decoding_invalid)
+{
+  std::vector<crypto::public_key> keys(4);
+  for (auto &k: keys)
+  {
+    crypto::secret_key sec;
+    crypto::generate_keys(k, sec);
+  }
+  // y = 2 is not on the curve
+  memset(&keys[2], 0, sizeof(keys[2]));
+  reinterpret_cast<unsigned char*>(&keys[2])[0] = 2;
+
+  std::vector<ge_p3> points(keys.size());
+  ASSERT_EQ(ge_frombytes_vartime_batch(points.data(), reinterpret_cast<const unsigned char*>(keys.data()), keys.size()), -1);
+}
+
+TEST(Crypto, point_cache)
+{
+  crypto::point_cache &cache = crypto::point_cache::instance();
+  cache.set_max_size(64);
+
+  std::vector<crypto::public_key> keys(200);
+  for (auto &k: keys)
+  {
+    crypto::secret_key sec;
+    crypto::generate_keys(k, sec);
+  }
+  memset(&keys[5], 0, sizeof(keys[5]));
+  reinterpret_cast<unsigned char*>(&keys[5])[0] = 2;
+  cache.add(keys.data(), 20);
+
+  // hits, misses and the invalid key all decompress as without the cache, and the size stays bounded
+  for (int pass = 0; pass < 2; ++pass)
+  {
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+      ge_p3 p;
+      const bool valid = cache.get(p, keys[i]);
+      ASSERT_EQ(valid, i != 5);
+      if (!valid)
+        continue;
+      crypto::public_key k;
+      ge_p3_tobytes(reinterpret_cast<unsigned char*>(&k), &p);
+      ASSERT_EQ(k, keys[i]);
+      ASSERT_LE(cache.size(), 64);
+    }
+  }
+
+  cache.set_max_size(0);
+  ASSERT_EQ(cache.size(), 0);
+  cache.add(keys.data(), keys.size());
+  ASSERT_EQ(cache.size(), 0);
+}
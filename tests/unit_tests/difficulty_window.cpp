@@ -0,0 +1,118 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_basic/difficulty.h"
+
+static void push_blocks(cryptonote::difficulty_window &window, uint64_t start, uint64_t stop)
+{
+  for (uint64_t h = start; h < stop; ++h)
+    window.push_back(1000 + h, 10 * h);
+}
+
+TEST(difficulty_window, empty)
+{
+  cryptonote::difficulty_window window(8);
+  ASSERT_TRUE(window.empty());
+  ASSERT_EQ(window.size(), 0);
+  ASSERT_EQ(window.capacity(), 8);
+  ASSERT_EQ(window.start_height(), 0);
+  ASSERT_EQ(window.height(), 0);
+  std::vector<uint64_t> timestamps;
+  ASSERT_TRUE(window.get(0, 0, &timestamps, NULL));
+  ASSERT_FALSE(window.get(0, 1, &timestamps, NULL));
+  ASSERT_TRUE(timestamps.empty());
+}
+
+TEST(difficulty_window, push_back)
+{
+  cryptonote::difficulty_window window(8);
+  push_blocks(window, 0, 5);
+  ASSERT_EQ(window.size(), 5);
+  ASSERT_EQ(window.start_height(), 0);
+  ASSERT_EQ(window.height(), 5);
+  std::vector<uint64_t> timestamps;
+  std::vector<cryptonote::difficulty_type> difficulties;
+  ASSERT_TRUE(window.get(1, 4, &timestamps, &difficulties));
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({1001, 1002, 1003}));
+  ASSERT_EQ(difficulties, std::vector<cryptonote::difficulty_type>({10, 20, 30}));
+}
+
+TEST(difficulty_window, wraps_around)
+{
+  cryptonote::difficulty_window window(8);
+  push_blocks(window, 0, 20);
+  ASSERT_TRUE(window.full());
+  ASSERT_EQ(window.start_height(), 12);
+  ASSERT_EQ(window.height(), 20);
+  ASSERT_FALSE(window.contains(11, 20));
+  std::vector<uint64_t> timestamps;
+  ASSERT_TRUE(window.get(12, 20, &timestamps, NULL));
+  ASSERT_EQ(timestamps.size(), 8);
+  for (size_t i = 0; i < timestamps.size(); ++i)
+    ASSERT_EQ(timestamps[i], 1012 + i);
+}
+
+TEST(difficulty_window, pop_back)
+{
+  cryptonote::difficulty_window window(8);
+  push_blocks(window, 0, 10);
+  window.pop_back();
+  window.pop_back();
+  ASSERT_EQ(window.start_height(), 2);
+  ASSERT_EQ(window.height(), 8);
+  ASSERT_FALSE(window.contains(2, 9));
+  window.push_back(5000, 5000);
+  std::vector<uint64_t> timestamps;
+  ASSERT_TRUE(window.get(7, 9, &timestamps, NULL));
+  ASSERT_EQ(timestamps, std::vector<uint64_t>({1007, 5000}));
+  while (!window.empty())
+    window.pop_back();
+  window.pop_back();
+  ASSERT_EQ(window.height(), 2);
+}
+
+TEST(difficulty_window, push_front)
+{
+  cryptonote::difficulty_window window(4);
+  window.reset(10);
+  push_blocks(window, 10, 12);
+  ASSERT_TRUE(window.push_front(1009, 90));
+  ASSERT_TRUE(window.push_front(1008, 80));
+  ASSERT_FALSE(window.push_front(1007, 70));
+  ASSERT_EQ(window.start_height(), 8);
+  std::vector<cryptonote::difficulty_type> difficulties;
+  ASSERT_TRUE(window.get(8, 12, NULL, &difficulties));
+  ASSERT_EQ(difficulties, std::vector<cryptonote::difficulty_type>({80, 90, 100, 110}));
+
+  window.reset(1);
+  ASSERT_TRUE(window.push_front(1000, 0));
+  ASSERT_FALSE(window.push_front(999, 0));
+  ASSERT_EQ(window.start_height(), 0);
+}
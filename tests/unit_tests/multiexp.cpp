@@ -0,0 +1,144 @@
+// Copyright (c) 2017, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "ringct/rctOps.h"
+#include "ringct/multiexp.h"
+
+static std::vector<rct::MultiexpData> random_data(size_t n)
+{
+  std::vector<rct::MultiexpData> data;
+  for (size_t i = 0; i < n; ++i)
+    data.push_back(rct::MultiexpData(rct::skGen(), rct::pkGen()));
+  return data;
+}
+
+static rct::key naive(const std::vector<rct::MultiexpData> &data)
+{
+  rct::key res = rct::identity();
+  for (const auto &d: data)
+  {
+    rct::key P;
+    ge_p3_tobytes(P.bytes, &d.point);
+    rct::addKeys(res, res, rct::scalarmultKey(P, d.scalar));
+  }
+  return res;
+}
+
+static std::vector<ge_p3> points(const std::vector<rct::MultiexpData> &data)
+{
+  std::vector<ge_p3> res;
+  for (const auto &d: data)
+    res.push_back(d.point);
+  return res;
+}
+
+TEST(multiexp, empty)
+{
+  std::vector<rct::MultiexpData> data;
+  ASSERT_EQ(rct::straus(data), rct::identity());
+  ASSERT_EQ(rct::pippenger(data), rct::identity());
+  ASSERT_EQ(rct::multiexp(data), rct::identity());
+}
+
+TEST(multiexp, zero_and_one)
+{
+  std::vector<rct::MultiexpData> data = random_data(4);
+  data[0].scalar = rct::zero();
+  data[1].scalar = rct::identity();
+  const rct::key expected = naive(data);
+  ASSERT_EQ(rct::straus(data), expected);
+  ASSERT_EQ(rct::pippenger(data), expected);
+
+  for (auto &d: data)
+    d.scalar = rct::zero();
+  ASSERT_EQ(rct::straus(data), rct::identity());
+  ASSERT_EQ(rct::pippenger(data), rct::identity());
+}
+
+TEST(multiexp, largest_scalar)
+{
+  // L - 1 has long runs of ones, which exercise the carries of both recodings
+  rct::key l1;
+  sc_sub(l1.bytes, rct::zero().bytes, rct::identity().bytes);
+  std::vector<rct::MultiexpData> data = random_data(3);
+  for (auto &d: data)
+    d.scalar = l1;
+  const rct::key expected = naive(data);
+  ASSERT_EQ(rct::straus(data), expected);
+  for (size_t c = 1; c <= 9; ++c)
+    ASSERT_EQ(rct::pippenger(data, NULL, c), expected);
+}
+
+TEST(multiexp, largest_digit)
+{
+  // only the top bit of each window set gives pippenger's largest digit,
+  // 2^(c-1), in every window
+  std::vector<rct::MultiexpData> data = random_data(3);
+  for (size_t c = 1; c <= 16; ++c)
+  {
+    rct::key s = rct::zero();
+    for (size_t bit = c - 1; bit < 252; bit += c)
+      s.bytes[bit / 8] |= 1 << (bit % 8);
+    for (auto &d: data)
+      d.scalar = s;
+    ASSERT_EQ(rct::pippenger(data, NULL, c), naive(data));
+  }
+}
+
+TEST(multiexp, random)
+{
+  for (size_t n: {1, 2, 3, 16, 33, 100})
+  {
+    const std::vector<rct::MultiexpData> data = random_data(n);
+    const rct::key expected = naive(data);
+    ASSERT_EQ(rct::straus(data), expected);
+    ASSERT_EQ(rct::pippenger(data), expected);
+    ASSERT_EQ(rct::multiexp(data), expected);
+  }
+}
+
+TEST(multiexp, cached)
+{
+  const std::vector<rct::MultiexpData> data = random_data(24);
+  const rct::key expected = naive(data);
+  // the cache may cover all, some, or more than the data
+  for (size_t cached: {24, 10, 0})
+  {
+    const rct::multiexp_cache cache(points(std::vector<rct::MultiexpData>(data.begin(), data.begin() + cached)));
+    ASSERT_EQ(rct::straus(data, &cache), expected);
+    ASSERT_EQ(rct::pippenger(data, &cache), expected);
+    ASSERT_EQ(rct::multiexp(data, &cache), expected);
+  }
+  std::vector<rct::MultiexpData> longer = data;
+  longer.push_back(rct::MultiexpData(rct::skGen(), rct::pkGen()));
+  const rct::multiexp_cache cache(points(longer));
+  ASSERT_EQ(rct::straus(data, &cache), expected);
+  ASSERT_EQ(rct::pippenger(data, &cache), expected);
+}
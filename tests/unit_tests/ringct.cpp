@@ -37,6 +37,7 @@
 #include "ringct/rctTypes.h"
 #include "ringct/rctSigs.h"
 #include "ringct/rctOps.h"
+#include "crypto/point_cache.h"
 
 using namespace std;
 using namespace crypto;
@@ -1060,3 +1061,73 @@ TEST(ringct, key_ostream)
     out.str()
   );
 }
+
+TEST(ringct, fixed_base_H)
+{
+  // the precomputed table for H must agree with variable base multiplication
+  rct::key l1;
+  sc_sub(l1.bytes, rct::zero().bytes, rct::identity().bytes);
+  std::vector<rct::key> scalars = {rct::zero(), rct::identity(), l1, rct::d2h(1000)};
+  for (int i = 0; i < 16; ++i)
+    scalars.push_back(rct::skGen());
+  for (const rct::key &a: scalars)
+  {
+    ASSERT_EQ(rct::scalarmultH(a), rct::scalarmultKey(rct::H, a));
+    const rct::key b = rct::skGen();
+    rct::key expected, actual;
+    rct::addKeys2(expected, b, a, rct::H);
+    rct::addKeysGH(actual, b, a);
+    ASSERT_EQ(actual, expected);
+  }
+  ASSERT_EQ(rct::zeroCommit(1234), rct::addKeys(rct::scalarmultBase(rct::identity()), rct::scalarmultKey(rct::H, rct::d2h(1234))));
+}
+
+TEST(ringct, MLSAG_workspace)
+{
+  // one workspace reused across ring shapes, checked against the key matrix API
+  rct::mlsagWorkspace ws;
+  const size_t shapes[][3] = {{3, 3, 3}, {11, 2, 1}, {2, 1, 1}, {5, 4, 2}, {11, 2, 1}};
+  for (const auto &shape: shapes)
+  {
+    const size_t cols = shape[0], rows = shape[1], dsRows = shape[2];
+    const unsigned int index = cols / 2;
+    rct::keyM P = rct::keyMInit(rows, cols);
+    rct::keyV sk(rows);
+    ws.reset(cols, rows);
+    for (size_t i = 0; i < cols; ++i)
+    {
+      for (size_t j = 0; j < rows; ++j)
+      {
+        rct::key x = rct::skGen();
+        P[i][j] = rct::scalarmultBase(x);
+        ws.at(i, j) = P[i][j];
+        if (i == index)
+          sk[j] = x;
+      }
+    }
+    const rct::key message = rct::skGen();
+    rct::mgSig sig = rct::MLSAG_Gen(message, ws, sk, index, dsRows);
+    ASSERT_TRUE(rct::MLSAG_Ver(message, ws, sig, dsRows));
+    ASSERT_TRUE(rct::MLSAG_Ver(message, P, sig, dsRows));
+    sig = rct::MLSAG_Gen(message, P, sk, index, dsRows);
+    ASSERT_TRUE(rct::MLSAG_Ver(message, ws, sig, dsRows));
+    ASSERT_FALSE(rct::MLSAG_Ver(rct::skGen(), ws, sig, dsRows));
+    sig.ss[0][0] = rct::skGen();
+    ASSERT_FALSE(rct::MLSAG_Ver(message, ws, sig, dsRows));
+  }
+}
+
+TEST(ringct, simple_point_cache)
+{
+  // verification through the ring member cache, cold then warm, must agree with the uncached one
+  const uint64_t inputs[] = {1000, 3000};
+  const uint64_t outputs[] = {3500};
+  rct::rctSig sig = make_sample_simple_rct_sig(NELTS(inputs), inputs, NELTS(outputs), outputs, 500);
+  crypto::point_cache::instance().set_max_size(1024);
+  ASSERT_TRUE(rct::verRctSimple(sig));
+  ASSERT_TRUE(rct::verRctSimple(sig));
+  ASSERT_NE(crypto::point_cache::instance().size(), 0);
+  sig.pseudoOuts[0] = rct::pkGen();
+  ASSERT_FALSE(rct::verRctSimple(sig));
+  crypto::point_cache::instance().set_max_size(0);
+}
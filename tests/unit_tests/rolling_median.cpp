@@ -0,0 +1,162 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include <random>
+#include <algorithm>
+#include <deque>
+#include "misc_language.h"
+#include "common/rolling_median.h"
+
+TEST(rolling_median, empty)
+{
+  tools::rolling_median<uint64_t> m(10);
+  ASSERT_TRUE(m.empty());
+  ASSERT_EQ(m.median(), 0);
+  ASSERT_THROW(m.pop_back(), std::exception);
+}
+
+TEST(rolling_median, odd_and_even)
+{
+  tools::rolling_median<uint64_t> m(10);
+  m.push_back(5);
+  ASSERT_EQ(m.median(), 5);
+  m.push_back(1);
+  ASSERT_EQ(m.median(), 3);
+  m.push_back(9);
+  ASSERT_EQ(m.median(), 5);
+  m.push_back(2);
+  ASSERT_EQ(m.median(), 3);
+  m.pop_back();
+  ASSERT_EQ(m.median(), 5);
+}
+
+TEST(rolling_median, window_slides)
+{
+  tools::rolling_median<uint64_t> m(3);
+  for (uint64_t v: {10, 20, 30})
+    m.push_back(v);
+  ASSERT_TRUE(m.full());
+  ASSERT_EQ(m.median(), 20);
+  m.push_back(40);
+  ASSERT_EQ(m.size(), 3);
+  ASSERT_EQ(m.median(), 30);
+  ASSERT_FALSE(m.push_front(5));
+  m.pop_back();
+  ASSERT_TRUE(m.push_front(10));
+  ASSERT_EQ(m.median(), 20);
+}
+
+TEST(rolling_median, duplicates)
+{
+  tools::rolling_median<uint64_t> m(4);
+  for (uint64_t v: {7, 7, 7, 7})
+    m.push_back(v);
+  ASSERT_EQ(m.median(), 7);
+  m.push_back(1);
+  m.push_back(1);
+  ASSERT_EQ(m.median(), 4);
+  m.push_back(1);
+  ASSERT_EQ(m.median(), 1);
+}
+
+TEST(rolling_median, matches_full_sort)
+{
+  std::mt19937 rng(0);
+  tools::rolling_median<uint64_t> m(100);
+  std::deque<uint64_t> window;
+  for (int i = 0; i < 2000; ++i)
+  {
+    const uint64_t v = rng() % 1000;
+    if (!window.empty() && rng() % 4 == 0)
+    {
+      m.pop_back();
+      window.pop_back();
+    }
+    else
+    {
+      m.push_back(v);
+      window.push_back(v);
+      if (window.size() > 100)
+        window.pop_front();
+    }
+    std::vector<uint64_t> values(window.begin(), window.end());
+    ASSERT_EQ(m.median(), epee::misc_utils::median(values));
+  }
+}
+
+TEST(median_set, erase_any)
+{
+  tools::median_set<uint64_t> m;
+  ASSERT_TRUE(m.empty());
+  ASSERT_EQ(m.median(), 0);
+  ASSERT_FALSE(m.erase(3));
+  for (uint64_t v: {4, 8, 15, 16, 23, 42})
+    m.insert(v);
+  ASSERT_EQ(m.min(), 4);
+  ASSERT_EQ(m.max(), 42);
+  ASSERT_EQ(m.median(), 15);
+  ASSERT_FALSE(m.erase(5));
+  ASSERT_TRUE(m.erase(4));
+  ASSERT_EQ(m.median(), 16);
+  ASSERT_TRUE(m.erase(42));
+  ASSERT_EQ(m.max(), 23);
+  ASSERT_EQ(m.median(), 15);
+  ASSERT_EQ(m.size(), 4);
+}
+
+TEST(median_set, matches_full_sort)
+{
+  std::mt19937 rng(0);
+  tools::median_set<uint64_t> m;
+  std::vector<uint64_t> values;
+  for (int i = 0; i < 2000; ++i)
+  {
+    if (!values.empty() && rng() % 3 == 0)
+    {
+      const size_t idx = rng() % values.size();
+      ASSERT_TRUE(m.erase(values[idx]));
+      values.erase(values.begin() + idx);
+    }
+    else
+    {
+      const uint64_t v = rng() % 1000;
+      m.insert(v);
+      values.push_back(v);
+    }
+    ASSERT_EQ(m.size(), values.size());
+    if (!values.empty())
+    {
+      ASSERT_EQ(m.min(), *std::min_element(values.begin(), values.end()));
+      ASSERT_EQ(m.max(), *std::max_element(values.begin(), values.end()));
+    }
+    std::vector<uint64_t> sorted = values;
+    ASSERT_EQ(m.median(), epee::misc_utils::median(sorted));
+  }
+}
@@ -53,3 +53,26 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+TEST(protocol_pack, new_transactions_stem_flag)
+{
+  std::string buff;
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request r;
+  r.txs.push_back("tx");
+  ASSERT_FALSE(r.stem);
+
+  r.stem = true;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request r2;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, buff));
+  ASSERT_EQ(1, r2.txs.size());
+  ASSERT_TRUE(r2.stem);
+
+  // peers which don't know about stem txes don't send the flag
+  cryptonote::NOTIFY_REQUEST_TRANSACTIONS::request other;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(other, buff));
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request r3;
+  r3.stem = true;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r3, buff));
+  ASSERT_FALSE(r3.stem);
+}
@@ -203,3 +203,14 @@ TEST(validate_parse_amount_case, validate_parse_amount)
   r = cryptonote::parse_amount(res, "1 00.00 00");
   ASSERT_FALSE(r);
 }
+
+TEST(get_transaction_short_id, depends_on_salt_and_hash)
+{
+  crypto::hash h0 = crypto::null_hash, h1 = crypto::null_hash;
+  h1.data[0] = 1;
+
+  ASSERT_EQ(cryptonote::get_transaction_short_id(h0, 1), cryptonote::get_transaction_short_id(h0, 1));
+  ASSERT_NE(cryptonote::get_transaction_short_id(h0, 1), cryptonote::get_transaction_short_id(h1, 1));
+  ASSERT_NE(cryptonote::get_transaction_short_id(h0, 1), cryptonote::get_transaction_short_id(h0, 2));
+  ASSERT_NE(cryptonote::get_transaction_short_id(h1, 1), cryptonote::get_transaction_short_id(h1, 2));
+}
@@ -0,0 +1,371 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/tx_pool.h"
+
+static crypto::hash make_id(unsigned char n)
+{
+  crypto::hash h = crypto::null_hash;
+  h.data[0] = n;
+  return h;
+}
+
+static cryptonote::txpool_tx_meta_t make_meta(uint64_t fee, uint64_t blob_size, uint64_t receive_time)
+{
+  cryptonote::txpool_tx_meta_t meta;
+  memset(&meta, 0, sizeof(meta));
+  meta.fee = fee;
+  meta.blob_size = blob_size;
+  meta.receive_time = receive_time;
+  return meta;
+}
+
+TEST(tx_pool_container, unique_by_id)
+{
+  cryptonote::pool_tx_container txs;
+  ASSERT_TRUE(txs.emplace(make_id(1), make_meta(100, 10, 5)).second);
+  ASSERT_FALSE(txs.emplace(make_id(1), make_meta(200, 10, 6)).second);
+  ASSERT_EQ(txs.size(), 1);
+  auto &by_id = txs.get<cryptonote::pool_tx_by_id>();
+  ASSERT_TRUE(by_id.find(make_id(1)) != by_id.end());
+  ASSERT_TRUE(by_id.find(make_id(2)) == by_id.end());
+  by_id.erase(make_id(1));
+  ASSERT_TRUE(txs.empty());
+}
+
+TEST(tx_pool_container, fee_order)
+{
+  cryptonote::pool_tx_container txs;
+  txs.emplace(make_id(1), make_meta(100, 10, 5));  // 10/byte
+  txs.emplace(make_id(2), make_meta(300, 10, 9));  // 30/byte
+  txs.emplace(make_id(3), make_meta(200, 20, 3));  // 10/byte, older than 1
+  txs.emplace(make_id(4), make_meta(200, 10, 7));  // 20/byte
+
+  std::vector<crypto::hash> order;
+  for (const auto &e: txs.get<cryptonote::pool_tx_by_fee>())
+    order.push_back(e.id);
+  ASSERT_EQ(order, std::vector<crypto::hash>({make_id(2), make_id(4), make_id(3), make_id(1)}));
+}
+
+TEST(tx_pool_container, receive_time_order)
+{
+  cryptonote::pool_tx_container txs;
+  txs.emplace(make_id(1), make_meta(100, 10, 5));
+  txs.emplace(make_id(2), make_meta(300, 10, 9));
+  txs.emplace(make_id(3), make_meta(200, 20, 3));
+
+  std::vector<crypto::hash> order;
+  for (const auto &e: txs.get<cryptonote::pool_tx_by_receive_time>())
+    order.push_back(e.id);
+  ASSERT_EQ(order, std::vector<crypto::hash>({make_id(3), make_id(1), make_id(2)}));
+}
+
+TEST(tx_pool_container, modify_keeps_order)
+{
+  cryptonote::pool_tx_container txs;
+  txs.emplace(make_id(1), make_meta(100, 10, 5));
+  txs.emplace(make_id(2), make_meta(300, 10, 9));
+  auto &by_id = txs.get<cryptonote::pool_tx_by_id>();
+  by_id.modify(by_id.find(make_id(1)), [](cryptonote::pool_tx_entry &e) { e.meta.relayed = 1; });
+  ASSERT_EQ(by_id.find(make_id(1))->meta.relayed, 1);
+  ASSERT_EQ(txs.get<cryptonote::pool_tx_by_fee>().begin()->id, make_id(2));
+}
+
+static crypto::key_image make_key_image(unsigned char n)
+{
+  crypto::key_image ki;
+  memset(&ki, 0, sizeof(ki));
+  reinterpret_cast<unsigned char*>(&ki)[0] = n;
+  reinterpret_cast<unsigned char*>(&ki)[1] = n;
+  return ki;
+}
+
+TEST(spent_key_images_index, insert_remove)
+{
+  cryptonote::spent_key_images_index index;
+  ASSERT_FALSE(index.contains(make_key_image(1)));
+  ASSERT_TRUE(index.insert(make_key_image(1), make_id(1), false));
+  ASSERT_TRUE(index.contains(make_key_image(1)));
+  ASSERT_FALSE(index.contains(make_key_image(17)));
+  ASSERT_FALSE(index.remove(make_key_image(1), make_id(2)));
+  ASSERT_TRUE(index.remove(make_key_image(1), make_id(1)));
+  ASSERT_FALSE(index.contains(make_key_image(1)));
+  ASSERT_FALSE(index.remove(make_key_image(1), make_id(1)));
+}
+
+TEST(spent_key_images_index, double_spend)
+{
+  cryptonote::spent_key_images_index index;
+  ASSERT_TRUE(index.insert(make_key_image(1), make_id(1), false));
+  ASSERT_FALSE(index.insert(make_key_image(1), make_id(2), false));
+  ASSERT_TRUE(index.insert(make_key_image(1), make_id(3), true));
+  ASSERT_FALSE(index.insert(make_key_image(1), make_id(3), true));
+  const auto spenders = index.get(make_key_image(1));
+  ASSERT_EQ(spenders.size(), 2);
+  ASSERT_EQ(spenders.count(make_id(1)), 1);
+  ASSERT_EQ(spenders.count(make_id(3)), 1);
+  ASSERT_TRUE(index.remove(make_key_image(1), make_id(1)));
+  ASSERT_TRUE(index.contains(make_key_image(1)));
+}
+
+TEST(spent_key_images_index, for_each_and_clear)
+{
+  cryptonote::spent_key_images_index index;
+  for (unsigned char n = 0; n < 40; ++n)
+    ASSERT_TRUE(index.insert(make_key_image(n), make_id(n), false));
+  size_t count = 0;
+  index.for_each([&count](const crypto::key_image &ki, const cryptonote::spent_key_images_index::tx_hashes_container &txids) {
+    ASSERT_EQ(txids.size(), 1);
+    ASSERT_EQ(txids.count(make_id(reinterpret_cast<const unsigned char*>(&ki)[0])), 1);
+    ++count;
+  });
+  ASSERT_EQ(count, 40);
+  index.clear();
+  for (unsigned char n = 0; n < 40; ++n)
+    ASSERT_FALSE(index.contains(make_key_image(n)));
+}
+
+TEST(txpool_aggregates, fee_buckets)
+{
+  ASSERT_EQ(cryptonote::txpool_aggregates::get_fee_bucket(0, 100), 0);
+  ASSERT_EQ(cryptonote::txpool_aggregates::get_fee_bucket(100, 0), cryptonote::txpool_aggregates::get_fee_bucket(100, 1));
+  size_t last = 0;
+  for (uint64_t fee_per_byte = 1; fee_per_byte < 100000; fee_per_byte = fee_per_byte * 9 / 8 + 1)
+  {
+    const size_t bucket = cryptonote::txpool_aggregates::get_fee_bucket(fee_per_byte * 1000, 1000);
+    ASSERT_GT(bucket, last);
+    last = bucket;
+  }
+  ASSERT_EQ(cryptonote::txpool_aggregates::get_fee_bucket(1024, 1), cryptonote::txpool_aggregates::get_fee_bucket(1100, 1));
+  ASSERT_LT(cryptonote::txpool_aggregates::get_fee_bucket(1024, 1), cryptonote::txpool_aggregates::get_fee_bucket(1200, 1));
+  ASSERT_GT(cryptonote::txpool_aggregates::get_fee_bucket(~(uint64_t)0, 1), last);
+}
+
+TEST(txpool_aggregates, stats)
+{
+  cryptonote::txpool_aggregates aggregates;
+  cryptonote::txpool_stats stats = AUTO_VAL_INIT(stats);
+  aggregates.get_stats(stats, 10000);
+  ASSERT_EQ(stats.txs_total, 0);
+  ASSERT_EQ(stats.bytes_min, 0);
+  ASSERT_TRUE(stats.histo.empty());
+
+  cryptonote::txpool_tx_meta_t failing = make_meta(400, 40, 9000);
+  failing.last_failed_height = 5;
+  failing.relayed = 1;
+  aggregates.add(make_meta(100, 10, 9900));
+  aggregates.add(make_meta(200, 20, 9950));
+  aggregates.add(make_meta(300, 30, 9000));
+  aggregates.add(failing);
+  aggregates.get_stats(stats, 10000);
+  ASSERT_EQ(stats.txs_total, 4);
+  ASSERT_EQ(stats.bytes_total, 100);
+  ASSERT_EQ(stats.bytes_min, 10);
+  ASSERT_EQ(stats.bytes_max, 40);
+  ASSERT_EQ(stats.bytes_med, 25);
+  ASSERT_EQ(stats.fee_total, 1000);
+  ASSERT_EQ(stats.oldest, 9000);
+  ASSERT_EQ(stats.num_10m, 2);
+  ASSERT_EQ(stats.num_failing, 1);
+  ASSERT_EQ(stats.num_not_relayed, 3);
+  ASSERT_EQ(stats.histo.size(), 4);
+  uint64_t histo_txs = 0, histo_bytes = 0;
+  for (const auto &h: stats.histo)
+  {
+    histo_txs += h.txs;
+    histo_bytes += h.bytes;
+  }
+  ASSERT_EQ(histo_txs, 4);
+  ASSERT_EQ(histo_bytes, 100);
+
+  aggregates.remove(failing);
+  aggregates.get_stats(stats, 10000);
+  ASSERT_EQ(stats.txs_total, 3);
+  ASSERT_EQ(stats.bytes_max, 30);
+  ASSERT_EQ(stats.bytes_med, 20);
+  ASSERT_EQ(stats.num_failing, 0);
+  ASSERT_EQ(stats.num_10m, 1);
+  ASSERT_THROW(aggregates.remove(failing), std::exception);
+}
+
+TEST(txpool_aggregates, backlog)
+{
+  cryptonote::txpool_aggregates aggregates;
+  aggregates.add(make_meta(1000, 100, 100));  // 10/byte
+  aggregates.add(make_meta(2000, 200, 200));  // 10/byte
+  aggregates.add(make_meta(5000, 100, 300));  // 50/byte
+  std::vector<cryptonote::tx_backlog_entry> backlog;
+  aggregates.get_backlog(backlog, 1000);
+  ASSERT_EQ(backlog.size(), 2);
+  ASSERT_EQ(backlog[0].blob_size, 100);
+  ASSERT_EQ(backlog[0].fee, 5000);
+  ASSERT_EQ(backlog[0].time_in_pool, 700);
+  ASSERT_EQ(backlog[1].blob_size, 300);
+  ASSERT_EQ(backlog[1].fee, 3000);
+  ASSERT_EQ(backlog[1].time_in_pool, 850);
+
+  aggregates.remove(make_meta(5000, 100, 300));
+  backlog.clear();
+  aggregates.get_backlog(backlog, 1000);
+  ASSERT_EQ(backlog.size(), 1);
+  ASSERT_EQ(aggregates.count(), 2);
+  aggregates.clear();
+  backlog.clear();
+  aggregates.get_backlog(backlog, 1000);
+  ASSERT_TRUE(backlog.empty());
+  ASSERT_EQ(aggregates.count(), 0);
+}
+
+static crypto::hash make_random_id()
+{
+  crypto::hash h;
+  crypto::generate_random_bytes_not_thread_safe(sizeof(h), &h);
+  return h;
+}
+
+TEST(evicted_tx_filter, remembers)
+{
+  cryptonote::evicted_tx_filter filter(100);
+  std::vector<crypto::hash> ids;
+  for (int i = 0; i < 100; ++i)
+  {
+    ids.push_back(make_random_id());
+    ASSERT_FALSE(filter.contains(ids.back()));
+    filter.insert(ids.back());
+  }
+  for (const auto &id: ids)
+    ASSERT_TRUE(filter.contains(id));
+  filter.clear();
+  for (const auto &id: ids)
+    ASSERT_FALSE(filter.contains(id));
+}
+
+TEST(evicted_tx_filter, rolls_over)
+{
+  cryptonote::evicted_tx_filter filter(100);
+  std::vector<crypto::hash> ids;
+  for (int i = 0; i < 300; ++i)
+  {
+    ids.push_back(make_random_id());
+    filter.insert(ids.back());
+  }
+  // the first generation was dropped, the last two are kept
+  size_t first_generation = 0;
+  for (size_t i = 0; i < 100; ++i)
+    first_generation += filter.contains(ids[i]);
+  ASSERT_LT(first_generation, 3);
+  for (size_t i = 100; i < 300; ++i)
+    ASSERT_TRUE(filter.contains(ids[i]));
+}
+
+TEST(evicted_tx_filter, false_positives)
+{
+  cryptonote::evicted_tx_filter filter(1000);
+  for (int i = 0; i < 2000; ++i)
+    filter.insert(make_random_id());
+  size_t false_positives = 0;
+  for (int i = 0; i < 100000; ++i)
+    false_positives += filter.contains(make_random_id());
+  ASSERT_LT(false_positives, 10);
+}
+
+TEST(parsed_tx_cache, get_insert_erase)
+{
+  cryptonote::parsed_tx_cache cache(1000);
+  ASSERT_FALSE(cache.get(make_id(1)));
+  const auto tx = std::make_shared<const cryptonote::transaction>();
+  cache.insert(make_id(1), tx, 100);
+  ASSERT_EQ(cache.get(make_id(1)), tx);
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(cache.bytes(), 100);
+  cache.insert(make_id(1), tx, 200);
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(cache.bytes(), 200);
+  cache.erase(make_id(1));
+  ASSERT_FALSE(cache.get(make_id(1)));
+  ASSERT_EQ(cache.bytes(), 0);
+  cache.erase(make_id(1));
+}
+
+TEST(parsed_tx_cache, bounded_lru)
+{
+  cryptonote::parsed_tx_cache cache(300);
+  for (unsigned char n = 1; n <= 3; ++n)
+    cache.insert(make_id(n), std::make_shared<const cryptonote::transaction>(), 100);
+  // 1 becomes the most recently used, so 2 goes first
+  ASSERT_TRUE(cache.get(make_id(1)));
+  cache.insert(make_id(4), std::make_shared<const cryptonote::transaction>(), 100);
+  ASSERT_TRUE(cache.get(make_id(1)));
+  ASSERT_FALSE(cache.get(make_id(2)));
+  ASSERT_TRUE(cache.get(make_id(3)));
+  ASSERT_TRUE(cache.get(make_id(4)));
+  cache.insert(make_id(5), std::make_shared<const cryptonote::transaction>(), 250);
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_TRUE(cache.get(make_id(5)));
+  // too big to cache at all
+  cache.insert(make_id(6), std::make_shared<const cryptonote::transaction>(), 301);
+  ASSERT_FALSE(cache.get(make_id(6)));
+  ASSERT_TRUE(cache.get(make_id(5)));
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.bytes(), 0);
+}
+
+TEST(select_max_fee_txes, empty)
+{
+  ASSERT_TRUE(cryptonote::select_max_fee_txes({}, {}, 1000).empty());
+  ASSERT_TRUE(cryptonote::select_max_fee_txes({10}, {100}, 0).empty());
+  ASSERT_TRUE(cryptonote::select_max_fee_txes({10}, {100}, 9).empty());
+}
+
+TEST(select_max_fee_txes, beats_fee_per_byte_order)
+{
+  // in fee per byte order, the first one would leave no room for the others
+  const std::vector<size_t> sizes = {60, 50, 50};
+  const std::vector<uint64_t> fees = {660, 500, 500};
+  ASSERT_EQ(cryptonote::select_max_fee_txes(sizes, fees, 100), std::vector<size_t>({1, 2}));
+  ASSERT_EQ(cryptonote::select_max_fee_txes(sizes, fees, 110), std::vector<size_t>({0, 1}));
+}
+
+TEST(select_max_fee_txes, fits_rounded_sizes)
+{
+  // with 4 units of 25 bytes, 26 bytes take 2 units, so only three such fit
+  const std::vector<size_t> sizes = {26, 26, 26, 26};
+  const std::vector<uint64_t> fees = {10, 40, 30, 20};
+  ASSERT_EQ(cryptonote::select_max_fee_txes(sizes, fees, 104), std::vector<size_t>({0, 1, 2, 3}));
+  ASSERT_EQ(cryptonote::select_max_fee_txes(sizes, fees, 100, 4), std::vector<size_t>({1, 2}));
+
+  size_t total = 0;
+  const std::vector<size_t> selected = cryptonote::select_max_fee_txes(sizes, fees, 100);
+  for (size_t i: selected)
+    total += sizes[i];
+  ASSERT_LE(total, 100);
+  ASSERT_EQ(selected, std::vector<size_t>({1, 2, 3}));
+}
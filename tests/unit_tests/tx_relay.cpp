@@ -0,0 +1,172 @@
+// Copyright (c) 2014-2017, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include "gtest/gtest.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "p2p/net_node_common.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace cryptonote {
+  class blockchain_storage;
+}
+
+namespace
+{
+  class test_core
+  {
+  public:
+    void on_synchronized(){}
+    void safesyncmode(const bool){}
+    uint64_t get_current_blockchain_height() const {return 1;}
+    void set_target_blockchain_height(uint64_t) {}
+    bool init(const boost::program_options::variables_map& vm) {return true ;}
+    bool deinit(){return true;}
+    bool get_short_chain_history(std::list<crypto::hash>& ids) const { return true; }
+    bool get_stat_info(cryptonote::core_stat_info& st_inf) const {return true;}
+    bool have_block(const crypto::hash& id) const {return true;}
+    void get_blockchain_top(uint64_t& height, crypto::hash& top_id)const{height=0;top_id=crypto::null_hash;}
+    bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay, crypto::hash *tx_hash = NULL) { return true; }
+    bool handle_incoming_txs(const std::list<cryptonote::blobdata>& tx_blob, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true) { return true; }
+    void pause_mine(){}
+    void resume_mine(){}
+    bool on_idle(){return true;}
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
+    bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    cryptonote::blockchain_storage &get_blockchain_storage() { throw std::runtime_error("Called invalid member function: please never call get_blockchain_storage on the TESTING class test_core."); }
+    bool get_test_drop_download() const {return true;}
+    bool get_test_drop_download_height() const {return true;}
+    bool prepare_handle_incoming_blocks(const std::list<cryptonote::block_complete_entry>  &blocks) { return true; }
+    bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+    uint64_t get_target_blockchain_height() const { return 1; }
+    size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+    virtual void on_transaction_relayed(const crypto::hash &tx_hash, const cryptonote::blobdata& tx) {}
+    bool get_testnet() const { return false; }
+    bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const { return false; }
+    uint64_t get_tx_short_id_salt() const { return 0; }
+    void get_missing_tx_short_ids(const std::vector<uint64_t> &short_ids, std::vector<uint64_t> &missing) const {}
+    bool pool_has_tx(const crypto::hash &txid) const { return false; }
+    bool get_blocks(uint64_t start_offset, size_t count, std::list<std::pair<cryptonote::blobdata, cryptonote::block>>& blocks, std::list<cryptonote::blobdata>& txs) const { return false; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::list<cryptonote::transaction>& txs, std::list<crypto::hash>& missed_txs) const { return false; }
+    bool get_block_by_hash(const crypto::hash &h, cryptonote::block &blk, bool *orphan = NULL) const { return false; }
+    uint8_t get_ideal_hard_fork_version(uint64_t height) const { return 0; }
+    uint8_t get_hard_fork_version(uint64_t height) const { return 0; }
+    cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
+    bool fluffy_blocks_enabled() const { return false; }
+    bool fast_block_relay_enabled() const { return false; }
+    // queued txes are only sent when a queue fills up, and stem txes are always stemmed
+    uint64_t get_tx_relay_average_delay() const { return 1000000000; }
+    uint32_t get_tx_relay_fluff_probability() const { return 0; }
+    bool check_block_header_and_pow(const cryptonote::block& b) { return false; }
+    uint64_t prevalidate_block_hashes(uint64_t height, const std::list<crypto::hash> &hashes) { return 0; }
+  };
+
+  // outgoing peers supporting tx announcements, recording what is sent to them
+  class test_p2p: public nodetool::p2p_endpoint_stub<cryptonote::cryptonote_connection_context>
+  {
+  public:
+    std::vector<cryptonote::cryptonote_connection_context> connections;
+    std::vector<std::pair<int, std::string>> sent;
+
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid>& conns)
+    {
+      sent.push_back(std::make_pair(command, data_buff));
+      return true;
+    }
+    virtual void for_each_connection(std::function<bool(cryptonote::cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f)
+    {
+      for (cryptonote::cryptonote_connection_context &context: connections)
+        if (!f(context, 1, P2P_SUPPORT_FLAGS))
+          break;
+    }
+    virtual bool for_connection(const boost::uuids::uuid &id, std::function<bool(cryptonote::cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f)
+    {
+      for (cryptonote::cryptonote_connection_context &context: connections)
+        if (context.m_connection_id == id)
+          return f(context, 1, P2P_SUPPORT_FLAGS);
+      return false;
+    }
+  };
+
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request make_txes(const std::string &prefix, size_t n, std::vector<crypto::hash> &hashes)
+  {
+    cryptonote::NOTIFY_NEW_TRANSACTIONS::request req;
+    for (size_t i = 0; i < n; ++i)
+    {
+      req.txs.push_back(prefix + std::to_string(i));
+      hashes.push_back(crypto::cn_fast_hash(req.txs.back().data(), req.txs.back().size()));
+    }
+    return req;
+  }
+}
+
+TEST(tx_relay, stem_does_not_unannounce_fluff)
+{
+  test_core core;
+  cryptonote::t_cryptonote_protocol_handler<test_core> protocol(core, NULL);
+  test_p2p p2p;
+  protocol.set_p2p_endpoint(&p2p);
+
+  cryptonote::cryptonote_connection_context peer;
+  static_cast<epee::net_utils::connection_context_base&>(peer) =
+      epee::net_utils::connection_context_base(boost::uuids::random_generator()(), epee::net_utils::ipv4_network_address{MAKE_IP(1,2,3,4),0}, false);
+  p2p.connections.push_back(peer);
+  cryptonote::CORE_SYNC_DATA sync_data = AUTO_VAL_INIT(sync_data);
+  sync_data.tx_short_id_salt = 1;
+  ASSERT_TRUE(protocol.process_payload_sync_data(sync_data, p2p.connections[0], true));
+
+  // the peer's queue is one tx short of being sent after this
+  cryptonote::i_cryptonote_protocol &relay = protocol;
+  cryptonote::cryptonote_connection_context exclude;
+  std::vector<crypto::hash> fluff_hashes;
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request fluff = make_txes("fluff ", P2P_TX_RELAY_MAX_QUEUED - 1, fluff_hashes);
+  ASSERT_TRUE(relay.relay_transactions(fluff, fluff_hashes, exclude));
+  ASSERT_TRUE(p2p.sent.empty());
+
+  // the only outgoing peer is the stem peer, so this fills the same queue
+  std::vector<crypto::hash> stem_hashes;
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request stem = make_txes("stem ", 1, stem_hashes);
+  stem.stem = true;
+  ASSERT_TRUE(relay.relay_transactions(stem, stem_hashes, exclude));
+
+  // the stem tx goes in full, the fluff ones are still only announced
+  ASSERT_EQ(2, p2p.sent.size());
+  ASSERT_EQ(static_cast<int>(cryptonote::NOTIFY_NEW_TRANSACTIONS::ID), p2p.sent[0].first);
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request stemmed;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(stemmed, p2p.sent[0].second));
+  ASSERT_TRUE(stemmed.stem);
+  ASSERT_EQ(stem.txs, stemmed.txs);
+  ASSERT_EQ(static_cast<int>(cryptonote::NOTIFY_NEW_TRANSACTION_IDS::ID), p2p.sent[1].first);
+  cryptonote::NOTIFY_NEW_TRANSACTION_IDS::request announced;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(announced, p2p.sent[1].second));
+  ASSERT_EQ(fluff.txs.size(), announced.short_ids.size());
+  for (size_t i = 0; i < fluff_hashes.size(); ++i)
+    ASSERT_EQ(cryptonote::get_transaction_short_id(fluff_hashes[i], 1), announced.short_ids[i]);
+}